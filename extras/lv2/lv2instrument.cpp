@@ -0,0 +1,163 @@
+#include <cmath>
+#include <cstring>
+
+#include <lv2/lv2plug.in/ns/ext/atom/atom.h>
+#include <lv2/lv2plug.in/ns/ext/midi/midi.h>
+#include <lv2/lv2plug.in/ns/lv2core/lv2.h>
+
+#include <instrumentbuffer.hpp>
+
+#include "lv2instrument.hpp"
+
+
+using namespace std;
+
+
+LV2URIDMap::LV2URIDMap() {
+  pthread_mutex_init(&m_mutex, 0);
+  m_feature_data.handle = this;
+  m_feature_data.map = &LV2URIDMap::map_callback;
+}
+
+
+LV2URIDMap::~LV2URIDMap() {
+  pthread_mutex_destroy(&m_mutex);
+}
+
+
+LV2_URID LV2URIDMap::map(const string& uri) {
+  pthread_mutex_lock(&m_mutex);
+  std::map<string, LV2_URID>::iterator iter = m_ids.find(uri);
+  LV2_URID id;
+  if (iter == m_ids.end()) {
+    id = m_ids.size() + 1;
+    m_ids[uri] = id;
+  }
+  else
+    id = iter->second;
+  pthread_mutex_unlock(&m_mutex);
+  return id;
+}
+
+
+LV2_URID_Map* LV2URIDMap::get_feature_data() {
+  return &m_feature_data;
+}
+
+
+LV2_URID LV2URIDMap::map_callback(LV2_URID_Map_Handle handle, 
+                                  const char* uri) {
+  return static_cast<LV2URIDMap*>(handle)->map(uri);
+}
+
+
+LV2Instrument::LV2Instrument(const LilvWorld* world, const LilvPlugin* plugin,
+                             double frame_rate, uint32_t max_frames, 
+                             LV2URIDMap& urids) throw(runtime_error)
+  : m_instance(0),
+    m_max_frames(max_frames),
+    m_event_port(-1),
+    m_sequence_type(urids.map(LV2_ATOM__Sequence)),
+    m_midi_type(urids.map(LV2_MIDI__MidiEvent)),
+    m_silence(max_frames, 0.0f),
+    m_null_atoms(2, 0) {
+  
+  LV2_Feature urid_feature = { LV2_URID__map, urids.get_feature_data() };
+  const LV2_Feature* features[] = { &urid_feature, 0 };
+  m_instance = lilv_plugin_instantiate(plugin, frame_rate, features);
+  if (!m_instance)
+    throw runtime_error("Could not instantiate the LV2 plugin");
+  
+  LilvNode* audio = lilv_new_uri(world, LV2_CORE__AudioPort);
+  LilvNode* control = lilv_new_uri(world, LV2_CORE__ControlPort);
+  LilvNode* input = lilv_new_uri(world, LV2_CORE__InputPort);
+  LilvNode* atom = lilv_new_uri(world, LV2_ATOM__AtomPort);
+  LilvNode* midi = lilv_new_uri(world, LV2_MIDI__MidiEvent);
+  
+  uint32_t nports = lilv_plugin_get_num_ports(plugin);
+  m_controls.resize(nports, 0.0f);
+  vector<float> defaults(nports, 0.0f);
+  lilv_plugin_get_port_ranges_float(plugin, 0, 0, &defaults[0]);
+  
+  // all buffers are allocated here, so the vectors must not grow after 
+  // this point or the connected pointers would be invalidated
+  uint32_t noutputs = 0;
+  for (uint32_t i = 0; i < nports; ++i) {
+    const LilvPort* port = lilv_plugin_get_port_by_index(plugin, i);
+    if (lilv_port_is_a(plugin, port, audio) && 
+        !lilv_port_is_a(plugin, port, input))
+      ++noutputs;
+  }
+  m_audio_outputs.resize(noutputs, vector<float>(max_frames, 0.0f));
+  
+  // the atom sequence header is { size, type, unit, pad }
+  uint32_t* null_seq = reinterpret_cast<uint32_t*>(&m_null_atoms[0]);
+  null_seq[0] = 2 * sizeof(uint32_t);
+  null_seq[1] = m_sequence_type;
+  
+  noutputs = 0;
+  for (uint32_t i = 0; i < nports; ++i) {
+    const LilvPort* port = lilv_plugin_get_port_by_index(plugin, i);
+    bool is_input = lilv_port_is_a(plugin, port, input);
+    if (lilv_port_is_a(plugin, port, audio)) {
+      if (is_input)
+        lilv_instance_connect_port(m_instance, i, &m_silence[0]);
+      else
+        lilv_instance_connect_port(m_instance, i, 
+                                   &m_audio_outputs[noutputs++][0]);
+    }
+    else if (lilv_port_is_a(plugin, port, control)) {
+      m_controls[i] = is_input && !std::isnan(defaults[i]) ? defaults[i] : 0.0f;
+      lilv_instance_connect_port(m_instance, i, &m_controls[i]);
+    }
+    else if (lilv_port_is_a(plugin, port, atom)) {
+      if (is_input && m_event_port == -1 && 
+          lilv_port_supports_event(plugin, port, midi))
+        m_event_port = i;
+      else
+        lilv_instance_connect_port(m_instance, i, &m_null_atoms[0]);
+    }
+    else
+      lilv_instance_connect_port(m_instance, i, 0);
+  }
+  
+  lilv_node_free(midi);
+  lilv_node_free(atom);
+  lilv_node_free(input);
+  lilv_node_free(control);
+  lilv_node_free(audio);
+  
+  lilv_instance_activate(m_instance);
+}
+
+
+LV2Instrument::~LV2Instrument() {
+  if (m_instance) {
+    lilv_instance_deactivate(m_instance);
+    lilv_instance_free(m_instance);
+  }
+}
+
+
+void LV2Instrument::run(Dino::InstrumentBuffer& events, uint32_t nframes) {
+  if (nframes > m_max_frames)
+    nframes = m_max_frames;
+  
+  // this only rewrites the type IDs the first time the buffer is used
+  if (events.get_data()->type != m_sequence_type)
+    events.set_type_ids(m_sequence_type, m_midi_type);
+  
+  if (m_event_port != -1)
+    lilv_instance_connect_port(m_instance, m_event_port, events.get_data());
+  lilv_instance_run(m_instance, nframes);
+}
+
+
+size_t LV2Instrument::get_audio_output_count() const {
+  return m_audio_outputs.size();
+}
+
+
+const float* LV2Instrument::get_audio_output(size_t index) const {
+  return &m_audio_outputs[index][0];
+}
@@ -0,0 +1,78 @@
+#ifndef LV2INSTRUMENT_HPP
+#define LV2INSTRUMENT_HPP
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+#include <lilv/lilv.h>
+#include <lv2/lv2plug.in/ns/ext/urid/urid.h>
+
+#include <instrument.hpp>
+
+
+/** A thread safe URI to URID map that can be shared by any number of
+    plugin instances. */
+class LV2URIDMap {
+public:
+  LV2URIDMap();
+  ~LV2URIDMap();
+  
+  LV2_URID map(const std::string& uri);
+  LV2_URID_Map* get_feature_data();
+  
+protected:
+  
+  static LV2_URID map_callback(LV2_URID_Map_Handle handle, const char* uri);
+  
+  std::map<std::string, LV2_URID> m_ids;
+  pthread_mutex_t m_mutex;
+  LV2_URID_Map m_feature_data;
+};
+
+
+/** An LV2 plugin instance that can be added to a Dino::InstrumentGraph.
+    The event input port is connected directly to the InstrumentBuffer,
+    which already has the layout of an atom sequence, so no events are
+    copied or converted. Audio outputs go to buffers owned by this object,
+    audio inputs are connected to silence and control inputs get their
+    default values. */
+class LV2Instrument : public Dino::Instrument {
+public:
+  
+  /** Instantiate @c plugin. @c max_frames is the largest period size that
+      run() will be called with. */
+  LV2Instrument(const LilvWorld* world, const LilvPlugin* plugin, 
+                double frame_rate, uint32_t max_frames, LV2URIDMap& urids)
+    throw(std::runtime_error);
+  ~LV2Instrument();
+  
+  void run(Dino::InstrumentBuffer& events, uint32_t nframes);
+  
+  size_t get_audio_output_count() const;
+  const float* get_audio_output(size_t index) const;
+  
+protected:
+  
+  LilvInstance* m_instance;
+  uint32_t m_max_frames;
+  
+  /** The index of the event input port, or -1 if there is none. */
+  long m_event_port;
+  
+  LV2_URID m_sequence_type;
+  LV2_URID m_midi_type;
+  
+  std::vector<float> m_controls;
+  std::vector<float> m_silence;
+  std::vector<std::vector<float> > m_audio_outputs;
+  
+  /** A sequence header for unused atom ports. */
+  std::vector<uint64_t> m_null_atoms;
+};
+
+
+#endif
@@ -0,0 +1,181 @@
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <getopt.h>
+
+#include <instrumentbuffer.hpp>
+#include <instrumentgraph.hpp>
+#include <sequencable.hpp>
+#include <sequencer.hpp>
+#include <songtime.hpp>
+
+#include "lv2instrument.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+/** Plays an eighth note every beat, starting at a given key. */
+class Arpeggio : public Sequencable {
+public:
+  
+  Arpeggio(unsigned char key) : Sequencable("Arpeggio"), m_key(key) { }
+  
+  bool sequence(Position& pos, SongTime const& to, EventBuffer& buf) const {
+    int64_t beat = SongTime(1, 0).to_ticks();
+    int64_t t = (pos.get_time().to_ticks() + beat / 2 - 1) / (beat / 2);
+    for ( ; t * (beat / 2) < to.to_ticks(); ++t) {
+      unsigned char key = m_key + (t / 2) % 4 * 4;
+      unsigned char status = t % 2 ? 0x80 : 0x90;
+      unsigned char data[] = { status, key, 100 };
+      buf.write_event(SongTime::from_ticks(t * (beat / 2)), 3, data);
+    }
+    update_position(pos, to);
+    return true;
+  }
+  
+protected:
+  
+  unsigned char m_key;
+};
+
+
+void print_usage(const char* argv0) {
+  cerr<<"usage: "<<argv0<<" [OPTIONS] PLUGIN_URI"<<endl
+      <<"Render a number of instances of an LV2 instrument offline and "
+      <<"write the mix"<<endl
+      <<"as raw interleaved stereo 32 bit floats."<<endl<<endl
+      <<"  -n, --instances=N     the number of instances (default 64)"<<endl
+      <<"  -s, --seconds=S       the length to render (default 60)"<<endl
+      <<"  -t, --threads=N       the number of worker threads (default one "
+      <<"less than"<<endl
+      <<"                        the number of CPUs)"<<endl
+      <<"  -o, --output=FILE     the output file (default no output)"<<endl
+      <<"  -h, --help            show this message"<<endl;
+}
+
+
+int main(int argc, char** argv) {
+  
+  unsigned instances = 64;
+  double seconds = 60;
+  unsigned threads = InstrumentGraph::default_threads();
+  string output;
+  uint32_t rate = 48000;
+  uint32_t period = 512;
+  double bpm = 120;
+  
+  option long_options[] = {
+    { "instances", required_argument, 0, 'n' },
+    { "seconds", required_argument, 0, 's' },
+    { "threads", required_argument, 0, 't' },
+    { "output", required_argument, 0, 'o' },
+    { "help", no_argument, 0, 'h' },
+    { 0, 0, 0, 0 }
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "n:s:t:o:h", long_options, 0)) != -1) {
+    switch (c) {
+    case 'n': instances = atoi(optarg); break;
+    case 's': seconds = atof(optarg); break;
+    case 't': threads = atoi(optarg); break;
+    case 'o': output = optarg; break;
+    case 'h': print_usage(argv[0]); return 0;
+    default: print_usage(argv[0]); return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  
+  // find the plugin
+  LilvWorld* world = lilv_world_new();
+  lilv_world_load_all(world);
+  LilvNode* uri = lilv_new_uri(world, argv[optind]);
+  const LilvPlugin* plugin = 
+    lilv_plugins_get_by_uri(lilv_world_get_all_plugins(world), uri);
+  lilv_node_free(uri);
+  if (!plugin) {
+    cerr<<"Could not find the plugin with URI <"<<argv[optind]<<">"<<endl;
+    lilv_world_free(world);
+    return 1;
+  }
+  
+  // build the sequencer and the instrument graph
+  LV2URIDMap urids;
+  Sequencer seq;
+  InstrumentGraph graph(threads);
+  vector<shared_ptr<LV2Instrument> > instruments;
+  try {
+    Sequencer::Transaction t = seq.begin_transaction();
+    for (unsigned i = 0; i < instances; ++i) {
+      instruments.push_back(make_shared<LV2Instrument>(world, plugin, rate, 
+                                                       period, urids));
+      InstrumentGraph::NodeID id = graph.add_instrument(instruments.back());
+      t.add_sequencable(make_shared<Arpeggio>(36 + i % 48), 
+                        graph.get_event_buffer(id));
+    }
+    seq.commit(t);
+  }
+  catch (exception& e) {
+    cerr<<e.what()<<endl;
+    return 1;
+  }
+  
+  ofstream out;
+  if (!output.empty()) {
+    out.open(output.c_str(), ios::binary);
+    if (!out) {
+      cerr<<"Could not open "<<output<<endl;
+      return 1;
+    }
+  }
+  
+  // render
+  int64_t tempo_num = int64_t(bpm * 1000 + 0.5);
+  int64_t tempo_den = int64_t(60000) * rate;
+  uint64_t total = uint64_t(seconds * rate);
+  vector<float> mix(2 * period);
+  timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint64_t frame = 0; frame < total; frame += period) {
+    SongTime from = SongTime::from_ticks(int64_t(frame) << 24).
+      scale(tempo_num, tempo_den);
+    SongTime to = SongTime::from_ticks(int64_t(frame + period) << 24).
+      scale(tempo_num, tempo_den);
+    graph.process(seq, from, to, period);
+    
+    if (out) {
+      fill(mix.begin(), mix.end(), 0.0f);
+      for (size_t i = 0; i < instruments.size(); ++i) {
+        size_t n = instruments[i]->get_audio_output_count();
+        for (size_t ch = 0; ch < 2 && n > 0; ++ch) {
+          const float* buf = 
+            instruments[i]->get_audio_output(ch < n ? ch : n - 1);
+          for (uint32_t j = 0; j < period; ++j)
+            mix[2 * j + ch] += buf[j] / instances;
+        }
+      }
+      out.write(reinterpret_cast<const char*>(&mix[0]), 
+                mix.size() * sizeof(float));
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  
+  double elapsed = (end.tv_sec - start.tv_sec) + 
+    (end.tv_nsec - start.tv_nsec) / 1e9;
+  cerr<<"Rendered "<<seconds<<" s with "<<instances<<" instances and "
+      <<graph.get_threads()<<" worker threads in "<<elapsed<<" s ("
+      <<seconds / elapsed<<"x realtime)"<<endl;
+  
+  instruments.clear();
+  lilv_world_free(world);
+  
+  return 0;
+}
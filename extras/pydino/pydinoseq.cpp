@@ -0,0 +1,317 @@
+#include <cstring>
+#include <vector>
+
+#include <boost/python.hpp>
+#include <curve.hpp>
+#include <eventbuffer.hpp>
+#include <songtime.hpp>
+
+
+using namespace boost::python;
+using namespace Dino;
+
+
+/* Bindings for the current libdinoseq API. Unlike the ones in pydino.cpp
+   these are meant for scripts that move a lot of data, so points and events
+   go in and out as contiguous arrays that support the buffer protocol.
+   numpy.frombuffer() or memoryview() can use the arrays returned from here
+   without copying them, and anything that exports a C-contiguous buffer of
+   the right integer type (numpy arrays, array.array, bytearray etc) can be
+   passed to the bulk insert functions. All times are in ticks, see
+   ticks_per_beat(). */
+namespace {
+
+
+  /** Releases the GIL for as long as it exists. Nothing in the scope may
+      touch Python objects, or modify a Curve - the GIL is what keeps 
+      Python threads from editing the same Curve at the same time, and
+      only one thread at a time may do that. */
+  class ReleaseGIL {
+  public:
+    ReleaseGIL() : m_state(PyEval_SaveThread()) { }
+    ~ReleaseGIL() { PyEval_RestoreThread(m_state); }
+  private:
+    PyThreadState* m_state;
+  };
+
+
+  /** A Python object that owns a one-dimensional block of memory and
+      exports it through the buffer protocol. */
+  struct Array {
+    PyObject_HEAD
+    char* data;
+    Py_ssize_t size;
+    Py_ssize_t itemsize;
+    const char* format;
+  };
+
+
+  void Array_dealloc(PyObject* self) {
+    PyMem_Free(reinterpret_cast<Array*>(self)->data);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free(self);
+    Py_DECREF(type);
+  }
+
+
+  int Array_getbuffer(PyObject* self, Py_buffer* view, int flags) {
+    Array* a = reinterpret_cast<Array*>(self);
+    view->obj = self;
+    Py_INCREF(self);
+    view->buf = a->data;
+    view->len = a->size * a->itemsize;
+    view->readonly = 0;
+    view->itemsize = a->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(a->format) : 0;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &a->size : 0;
+    view->strides = (flags & PyBUF_STRIDES) ? &a->itemsize : 0;
+    view->suboffsets = 0;
+    view->internal = 0;
+    return 0;
+  }
+
+
+  Py_ssize_t Array_length(PyObject* self) {
+    return reinterpret_cast<Array*>(self)->size;
+  }
+
+
+  PyType_Slot Array_slots[] = {
+    { Py_tp_dealloc, reinterpret_cast<void*>(&Array_dealloc) },
+    { Py_bf_getbuffer, reinterpret_cast<void*>(&Array_getbuffer) },
+    { Py_sq_length, reinterpret_cast<void*>(&Array_length) },
+    { Py_tp_doc, const_cast<char*>("A block of memory that supports the "
+				   "buffer protocol.") },
+    { 0, 0 }
+  };
+
+
+  PyType_Spec Array_spec = {
+    "dinoseq.Array", sizeof(Array), 0, Py_TPFLAGS_DEFAULT, Array_slots
+  };
+
+
+  PyTypeObject* Array_type = 0;
+
+
+  /** Create a new Array with room for @c n items and return it together
+      with a pointer to its memory. */
+  object new_array(Py_ssize_t n, Py_ssize_t itemsize, const char* format,
+		   char*& data) {
+    Array* a = PyObject_New(Array, Array_type);
+    if (!a)
+      throw_error_already_set();
+    a->data = static_cast<char*>(PyMem_Malloc(n > 0 ? n * itemsize : 1));
+    a->size = n;
+    a->itemsize = itemsize;
+    a->format = format;
+    object result = object(handle<>(reinterpret_cast<PyObject*>(a)));
+    if (!a->data) {
+      PyErr_NoMemory();
+      throw_error_already_set();
+    }
+    data = a->data;
+    return result;
+  }
+
+
+  /** Holds a C-contiguous buffer of signed integers from any object that
+      exports one, and releases it when it goes out of scope. */
+  class IntBuffer {
+  public:
+
+    IntBuffer(object const& obj, Py_ssize_t itemsize, const char* what) {
+      if (PyObject_GetBuffer(obj.ptr(), &m_view,
+			     PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+	throw_error_already_set();
+      const char* f = m_view.format ? m_view.format : "B";
+      if (*f == '@' || *f == '=' || *f == '<')
+	++f;
+      if (m_view.itemsize != itemsize ||
+	  std::strlen(f) != 1 || !std::strchr("bhilqn", *f)) {
+	PyBuffer_Release(&m_view);
+	PyErr_Format(PyExc_TypeError, "%s must be a buffer of %d byte signed "
+		     "integers", what, int(itemsize));
+	throw_error_already_set();
+      }
+    }
+
+    ~IntBuffer() {
+      PyBuffer_Release(&m_view);
+    }
+
+    template <typename T> T const* get() const {
+      return static_cast<T const*>(m_view.buf);
+    }
+
+    Py_ssize_t size() const {
+      return m_view.len / m_view.itemsize;
+    }
+
+  private:
+
+    Py_buffer m_view;
+
+  };
+
+
+  /** An EventBuffer that collects everything in memory, used for offline
+      rendering. */
+  class VectorBuffer : public EventBuffer {
+  public:
+
+    bool write_event(SongTime const& st, size_t bytes,
+		     unsigned char const* data) {
+      // only the fixed size messages fit in the rendered array
+      if (bytes > 3)
+	return true;
+      Event e;
+      e.time = st;
+      std::memset(e.data, 0, 3);
+      std::memcpy(e.data, data, bytes);
+      events.push_back(e);
+      return true;
+    }
+
+    size_t write_events(Event const* e, size_t n) {
+      events.insert(events.end(), e, e + n);
+      return n;
+    }
+
+    std::vector<Event> events;
+
+  };
+
+
+  /** The layout of the items in the array returned by Curve.render(). */
+  struct RenderedEvent {
+    int64_t time;
+    unsigned char data[3];
+    unsigned char padding[5];
+  };
+
+
+  SongTime ticks(long long t) {
+    return SongTime::from_ticks(t);
+  }
+
+
+  Curve* Curve_init(std::string const& label, long long length,
+		    Curve::ControllerID cid) {
+    return new Curve(label, ticks(length), cid);
+  }
+
+  void Curve_add_point(Curve& c, long long time, AtomicInt::Type value) {
+    c.add_point(ticks(time), value);
+  }
+
+  void Curve_add_points(Curve& c, object times, object values) {
+    IntBuffer t(times, sizeof(int64_t), "times");
+    IntBuffer v(values, sizeof(AtomicInt::Type), "values");
+    if (t.size() != v.size()) {
+      PyErr_SetString(PyExc_ValueError,
+		      "times and values must have the same length");
+      throw_error_already_set();
+    }
+    std::vector<SongTime> st(t.size());
+    {
+      ReleaseGIL nogil;
+      int64_t const* tp = t.get<int64_t>();
+      for (size_t i = 0; i < st.size(); ++i)
+	st[i] = SongTime::from_ticks(tp[i]);
+    }
+    c.add_points(st.data(), v.get<AtomicInt::Type>(), st.size());
+  }
+
+  tuple Curve_points(Curve& c) {
+    size_t n = c.count_points();
+    char* tdata;
+    char* vdata;
+    object times = new_array(n, sizeof(int64_t), "q", tdata);
+    object values = new_array(n, sizeof(AtomicInt::Type), "i", vdata);
+    {
+      ReleaseGIL nogil;
+      std::vector<SongTime> st(n);
+      c.copy_points(c.begin(), st.data(),
+		    reinterpret_cast<AtomicInt::Type*>(vdata), n);
+      int64_t* tp = reinterpret_cast<int64_t*>(tdata);
+      for (size_t i = 0; i < n; ++i)
+	tp[i] = st[i].to_ticks();
+    }
+    return make_tuple(times, values);
+  }
+
+  size_t Curve_len(Curve& c) {
+    return c.count_points();
+  }
+
+  AtomicInt::Type Curve_get_value(Curve& c, long long time) {
+    if (c.begin() == c.end()) {
+      PyErr_SetString(PyExc_ValueError, "The curve has no points");
+      throw_error_already_set();
+    }
+    return c.get_value(ticks(time));
+  }
+
+  object Curve_get_range(Curve& c, long long from, long long to) {
+    AtomicInt::Type min, max;
+    if (!c.get_range(ticks(from), ticks(to), min, max))
+      return object();
+    return make_tuple(min, max);
+  }
+
+  object Curve_render(Curve& c, long long from, long long to) {
+    // creating and destroying the position changes the curve's set of
+    // positions, so only the sequencing can be done without the GIL
+    VectorBuffer buf;
+    std::unique_ptr<Sequencable::Position> pos = 
+      c.create_position(ticks(from));
+    {
+      ReleaseGIL nogil;
+      while (!c.sequence(*pos, ticks(to), buf));
+    }
+    pos.reset();
+    char* data;
+    object result = new_array(buf.events.size(), sizeof(RenderedEvent),
+			      "q3B5x", data);
+    RenderedEvent* re = reinterpret_cast<RenderedEvent*>(data);
+    for (size_t i = 0; i < buf.events.size(); ++i) {
+      re[i].time = buf.events[i].time.to_ticks();
+      std::memcpy(re[i].data, buf.events[i].data, 3);
+      std::memset(re[i].padding, 0, 5);
+    }
+    return result;
+  }
+
+  long long ticks_per_beat() {
+    return SongTime::ticks_per_beat();
+  }
+
+}
+
+
+BOOST_PYTHON_MODULE(dinoseq) {
+
+  Array_type = reinterpret_cast<PyTypeObject*>(PyType_FromSpec(&Array_spec));
+  if (!Array_type)
+    throw_error_already_set();
+  scope().attr("Array") = object(handle<>(borrowed(Array_type)));
+
+  def("ticks_per_beat", &ticks_per_beat);
+
+  // Dino::Curve
+  class_<Curve, boost::noncopyable> _Curve("Curve", no_init);
+  _Curve.def("__init__", make_constructor(&Curve_init, default_call_policies(),
+					  (arg("label"), arg("length"),
+					   arg("cid") = 0)));
+  _Curve.add_property("controller_id", &Curve::get_controller_id,
+		      &Curve::set_controller_id);
+  _Curve.def("__len__", &Curve_len);
+  _Curve.def("add_point", &Curve_add_point);
+  _Curve.def("add_points", &Curve_add_points);
+  _Curve.def("points", &Curve_points);
+  _Curve.def("get_value", &Curve_get_value);
+  _Curve.def("get_range", &Curve_get_range);
+  _Curve.def("render", &Curve_render);
+}
@@ -143,6 +143,31 @@ class SongInterface(dbus.Interface):
     def removeCurvePoint(self, track, pattern, number, step):
         self.RemoveCurvePoint(track, pattern, number, step)
     
+    # The batched methods take lists of tuples and send them in a single 
+    # message without waiting for a reply.
+    
+    def addNotes(self, track, pattern, notes):
+        self.AddNotes(track, pattern, 
+                      dbus.Array([int(x) for n in notes for x in n], 'i'),
+                      ignore_reply=True)
+    
+    def setNoteVelocities(self, track, pattern, notes):
+        self.SetNoteVelocities(track, pattern, 
+                               dbus.Array([int(x) for n in notes for x in n],
+                                          'i'),
+                               ignore_reply=True)
+    
+    def deleteNotes(self, track, pattern, notes):
+        self.DeleteNotes(track, pattern, 
+                         dbus.Array([int(x) for n in notes for x in n], 'i'),
+                         ignore_reply=True)
+    
+    def addCurvePoints(self, track, pattern, number, points):
+        self.AddCurvePoints(track, pattern, number,
+                            dbus.Array([int(x) for p in points for x in p], 
+                                       'i'),
+                            ignore_reply=True)
+    
 
 
 
@@ -75,8 +75,8 @@ ArrangementEditor::ArrangementEditor(PluginInterface& plif)
     m_seq(plif.get_sequencer()),
     m_proxy(plif.get_command_proxy()),
     m_song(m_proxy.get_song()),
-    m_sequence_ruler(m_song.get_length(), 1, 4, 
-		     SongTime::ticks_per_beat() / 16, 20),
+    m_timeline(SongTime::ticks_per_beat() / 16, m_song.get_length()),
+    m_sequence_ruler(m_timeline, 1, 4, 20),
     m_vbx_track_editor(false, 0),
     m_vbx_track_labels(false, 0),
     m_active_track(-1) {
@@ -152,7 +152,7 @@ ArrangementEditor::ArrangementEditor(PluginInterface& plif)
   pack_start(*v);
   
   // add a new tempo widget and a tempo label
-  TempoWidget* tmpw = manage(new TempoWidget(m_proxy, &m_song));
+  TempoWidget* tmpw = manage(new TempoWidget(m_proxy, m_timeline, &m_song));
   m_vbx_track_editor.pack_start(*tmpw, PACK_SHRINK);
   slot<void> update_menu = bind(mem_fun(*tmpw, &TempoWidget::update_menu), 
                                 ref(m_plif));
@@ -28,6 +28,7 @@
 #include "plugininterface.hpp"
 #include "debug.hpp"
 #include "ruler.hpp"
+#include "timelinecache.hpp"
 #include "song.hpp"
 #include "trackdialog.hpp"
 
@@ -84,6 +85,8 @@ protected:
   const Dino::Song& m_song;
   
   // GUI components
+  /** Shared by the ruler and the tempo widget. */
+  TimelineCache m_timeline;
   Ruler m_sequence_ruler;
   Gtk::VBox m_vbx_track_editor;
   Gtk::VBox m_vbx_track_labels;
@@ -49,7 +49,8 @@ SequenceWidget::SequenceWidget(CommandProxy& proxy)
     //m_drag_beat(-1), 
     //m_drag_pattern(-1),
     m_drag_seqid(-1),
-    m_current_beat(0) {
+    m_current_beat(0),
+    m_redraw(*this) {
   
   m_colormap = Colormap::get_system();
   m_bg_color.set_rgb(65535, 65535, 65535);
@@ -77,7 +78,7 @@ void SequenceWidget::set_track(const Track* track) {
   // XXX Need to disconnect the old track here
   m_track->signal_length_changed().
     connect(mem_fun(*this, &SequenceWidget::slot_length_changed));
-  slot<void> draw = mem_fun(*this, &SequenceWidget::queue_draw);
+  slot<void> draw = mem_fun(m_redraw, &RedrawScheduler::queue_all);
   m_track->signal_sequence_entry_added().
     connect(sigc::hide(sigc::hide(sigc::hide(draw))));
   m_track->signal_sequence_entry_changed().
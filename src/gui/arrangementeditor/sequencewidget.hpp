@@ -23,6 +23,7 @@
 
 #include <gtkmm.h>
 
+#include "redrawscheduler.hpp"
 #include "songtime.hpp"
 
 
@@ -80,6 +81,8 @@ private:
   
   Gtk::Menu m_pattern_menu;
   Gtk::Menu m_action_menu;
+  
+  RedrawScheduler m_redraw;
 };
 
 
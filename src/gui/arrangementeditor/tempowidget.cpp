@@ -37,13 +37,15 @@ using namespace sigc;
 using namespace std;
 
 
-TempoWidget::TempoWidget(CommandProxy& proxy, const Song* song) 
+TempoWidget::TempoWidget(CommandProxy& proxy, TimelineCache& timeline,
+			 const Song* song) 
   : m_proxy(proxy),
+    m_timeline(timeline),
     m_song(song), 
-    m_col_width(16),
     m_height(20),
     m_drag_beat(-1), 
-    m_active_tempo(0) {
+    m_active_tempo(0),
+    m_redraw(*this) {
 
   assert(song);
   
@@ -64,12 +66,14 @@ TempoWidget::TempoWidget(CommandProxy& proxy, const Song* song)
   
   // connect signals
   song->signal_tempo_changed().
-    connect(mem_fun(*this, &TempoWidget::queue_draw));
-  song->signal_length_changed().
-    connect(mem_fun(*this, &TempoWidget::length_changed));
+    connect(mem_fun(*this, &TempoWidget::tempo_changed));
+  m_timeline.signal_changed.
+    connect(mem_fun(*this, &TempoWidget::timeline_changed));
+  tempo_changed();
   
   add_events(BUTTON_PRESS_MASK | BUTTON_RELEASE_MASK | BUTTON_MOTION_MASK);
-  set_size_request(m_col_width * m_song->get_length().get_beat(), m_height);
+  set_size_request(m_timeline.beat2pixel(m_song->get_length().get_beat()), 
+		   m_height);
 }
   
 
@@ -88,96 +92,93 @@ bool TempoWidget::on_expose_event(GdkEventExpose* event) {
   RefPtr<Gdk::Window> win = get_window();
   win->clear();
   
-  int width = m_col_width * m_song->get_length().get_beat();
+  int length = m_song->get_length().get_beat();
+  int width = m_timeline.beat2pixel(length);
   int height = m_height;
   Rectangle bounds(0, 0, width + 1, height);
   m_gc->set_clip_rectangle(bounds);
   
+  // only draw the beats that intersect the exposed area
+  int first, last;
+  if (!m_timeline.get_visible_beats(event->area.x, event->area.width,
+				    first, last))
+    return true;
+  last = last < length ? last : length - 1;
+  
   // draw background
-  int bpb = 4;
-  for (int b = 0; b < m_song->get_length().get_beat(); ++b) {
+  int bpb = m_timeline.get_beats_per_bar();
+  for (int b = first; b <= last; ++b) {
     if (b % (2*bpb) < bpb)
       m_gc->set_foreground(m_bg_color);
     else
       m_gc->set_foreground(m_bg_color2);
-    win->draw_rectangle(m_gc, true, b * m_col_width, 0, m_col_width, height);
+    int x = m_timeline.beat2pixel(b);
+    win->draw_rectangle(m_gc, true, x, 0, m_timeline.beat2pixel(b + 1) - x,
+			height);
   }
   m_gc->set_foreground(m_grid_color);
-  win->draw_line(m_gc, 0, 0, width, 0);
-  win->draw_line(m_gc, 0, height-1, width, height-1);
-  for (int c = 0; c < m_song->get_length().get_beat() + 1; ++c) {
-    win->draw_line(m_gc, c * m_col_width, 0, c * m_col_width, height);
+  int x0 = m_timeline.beat2pixel(first);
+  int x1 = m_timeline.beat2pixel(last + 1);
+  win->draw_line(m_gc, x0, 0, x1, 0);
+  win->draw_line(m_gc, x0, height-1, x1, height-1);
+  for (int c = first; c <= last + 1; ++c) {
+    int x = m_timeline.beat2pixel(c);
+    win->draw_line(m_gc, x, 0, x, height);
   }
   
-  // draw tempo changes
-  Pango::FontDescription fd("helvetica bold 9");
-  get_pango_context()->set_font_description(fd);
-  char tmp[10];
-  Song::TempoIterator iter;
-  //const TempoMap::TempoChange* tempo = m_song->get_tempo_changes();
-  //for ( ; tempo; tempo = tempo->next) {
-  for (iter = m_song->tempo_begin(); iter != m_song->tempo_end(); ++iter) {
-    if (&(*iter) == m_active_tempo)
+  // draw tempo changes, starting with the one that is active a marker 
+  // width before the exposed area since markers stick out to the right
+  int marker_width = int(height * 1.5);
+  int from = m_timeline.pixel2beat(x0 - marker_width);
+  TimelineCache::TempoIterator iter;
+  for (iter = m_timeline.tempo_find(from); 
+       iter != m_timeline.tempo_end() && iter->beat <= last; ++iter) {
+    if (m_active_tempo && int(m_active_tempo->get_beat()) == iter->beat)
       continue;
-    Rectangle bounds(int(iter->get_beat() * m_col_width), 0, 
-		     int(m_height * 1.5) + 1, height);
-    m_gc->set_clip_rectangle(bounds);
-    vector<Point> points;
-    int x = int(iter->get_beat() * m_col_width);
-    points.push_back(Point(x, 0));
-    points.push_back(Point(x + height, 0));
-    points.push_back(Point(x + 1.5 * height, height / 2));
-    points.push_back(Point(x + 1.5 * height, height-1));
-    points.push_back(Point(x, height-1));
-    m_gc->set_foreground(m_fg_color);
-    win->draw_polygon(m_gc, true, points);
-    m_gc->set_foreground(m_edge_color);
-    win->draw_polygon(m_gc, false, points); 
-    RefPtr<Pango::Layout> l = Pango::Layout::create(get_pango_context());
-    sprintf(tmp, "%d", iter->get_bpm());
-    l->set_text(tmp);
-    int lHeight = l->get_pixel_logical_extents().get_height();
-    win->draw_layout(m_gc, int(iter->get_beat() * m_col_width + 2), 
-		     (height - lHeight) / 2, l);
+    draw_marker(win, iter->beat, iter->bpm, marker_width, m_fg_color);
   }
   
   if (m_active_tempo) {
-    const TempoMap::TempoChange* tempo = m_active_tempo;
-    Rectangle bounds(int(tempo->get_beat() * m_col_width), 0, 
-		     int(m_col_width * 1.5) + 1, height);
-    m_gc->set_clip_rectangle(bounds);
-    vector<Point> points;
-    points.push_back(Point(int(tempo->get_beat() * m_col_width), 0));
-    points.push_back(Point(int((tempo->get_beat() + 1) * m_col_width), 0));
-    points.push_back(Point(int((tempo->get_beat() + 1.5) * m_col_width), 
-			   height / 2));
-    points.push_back(Point(int((tempo->get_beat() + 1.5) * m_col_width), 
-			   height-1));
-    points.push_back(Point(int(tempo->get_beat() * m_col_width), height-1));
-    m_gc->set_foreground(m_hl_color);
-    win->draw_polygon(m_gc, true, points);
-    m_gc->set_foreground(m_edge_color);
-    win->draw_polygon(m_gc, false, points); 
-    RefPtr<Pango::Layout> l = Pango::Layout::create(get_pango_context());
-    sprintf(tmp, "%.0f", float(m_editing_bpm));
-    l->set_text(tmp);
-    int lHeight = l->get_pixel_logical_extents().get_height();
-    win->draw_layout(m_gc, int(tempo->get_beat() * m_col_width + 2), 
-		     (height - lHeight) / 2, l);
+    int beat = m_active_tempo->get_beat();
+    int w = int(1.5 * (m_timeline.beat2pixel(beat + 1) - 
+		       m_timeline.beat2pixel(beat)));
+    draw_marker(win, beat, m_editing_bpm, w, m_hl_color);
   }
   
   return true;
 }
 
 
+void TempoWidget::draw_marker(RefPtr<Gdk::Window> win, int beat, int bpm,
+			      int width, const Color& color) {
+  int height = m_height;
+  int x = m_timeline.beat2pixel(beat);
+  Rectangle bounds(x, 0, width + 1, height);
+  m_gc->set_clip_rectangle(bounds);
+  vector<Point> points;
+  points.push_back(Point(x, 0));
+  points.push_back(Point(x + width * 2 / 3, 0));
+  points.push_back(Point(x + width, height / 2));
+  points.push_back(Point(x + width, height-1));
+  points.push_back(Point(x, height-1));
+  m_gc->set_foreground(color);
+  win->draw_polygon(m_gc, true, points);
+  m_gc->set_foreground(m_edge_color);
+  win->draw_polygon(m_gc, false, points); 
+  RefPtr<Pango::Layout> l = m_timeline.get_label(get_pango_context(), bpm);
+  int lHeight = l->get_pixel_logical_extents().get_height();
+  win->draw_layout(m_gc, x + 2, (height - lHeight) / 2, l);
+}
+
+
 bool TempoWidget::on_button_press_event(GdkEventButton* event) {
-  unsigned int beat = (unsigned int)(event->x) / m_col_width;
+  unsigned int beat = m_timeline.pixel2beat(int(event->x));
   
   switch (event->button) {
   case 1: {
     if (event->state & GDK_CONTROL_MASK) {
       if (beat >= 0 && beat < unsigned(m_song->get_length().get_beat())) {
-        double bpm = m_song->get_current_tempo(beat);
+        double bpm = m_timeline.get_tempo(beat);
         Song::TempoIterator iter;
 	m_proxy.add_tempo_change(beat, bpm, &iter);
         if (iter != m_song->tempo_end()) {
@@ -253,8 +254,15 @@ void TempoWidget::update() {
 }
 
 
-void TempoWidget::length_changed(const SongTime& length) {
-  set_size_request(m_col_width * length.get_beat(), m_height);
+void TempoWidget::tempo_changed() {
+  m_timeline.set_tempo_changes(m_song->tempo_begin(), m_song->tempo_end());
+}
+
+
+void TempoWidget::timeline_changed() {
+  set_size_request(m_timeline.beat2pixel(m_song->get_length().get_beat()), 
+		   m_height);
+  m_redraw.queue_all();
 }
 
 
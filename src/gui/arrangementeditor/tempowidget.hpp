@@ -23,6 +23,9 @@
 
 #include <gtkmm.h>
 
+#include "redrawscheduler.hpp"
+#include "timelinecache.hpp"
+
 
 namespace Dino {
   class CommandProxy;
@@ -37,7 +40,8 @@ class TempoWidget : public Gtk::DrawingArea {
 public:
   
   // XXX what was the purpose of allowing songless tempo widgets again?
-  TempoWidget(Dino::CommandProxy& proxy, const Dino::Song* song = 0);
+  TempoWidget(Dino::CommandProxy& proxy, TimelineCache& timeline,
+	      const Dino::Song* song = 0);
   
   virtual void on_realize();
   virtual bool on_expose_event(GdkEventExpose* event);
@@ -50,11 +54,16 @@ public:
   
 private:
   
-  void length_changed(const Dino::SongTime& length);
+  void tempo_changed();
+  void timeline_changed();
+  
+  /** Draw the marker for a tempo change at @c beat. */
+  void draw_marker(Glib::RefPtr<Gdk::Window> win, int beat, int bpm, 
+		   int width, const Gdk::Color& color);
   
   Dino::CommandProxy& m_proxy;
+  TimelineCache& m_timeline;
   const Dino::Song* m_song;
-  int m_col_width;
   int m_height;
 
   Glib::RefPtr<Gdk::GC> m_gc;
@@ -68,6 +77,8 @@ private:
   const Dino::TempoMap::TempoChange* m_active_tempo;
   
   Gtk::Menu m_menu;
+  
+  RedrawScheduler m_redraw;
 };
 
 
@@ -49,6 +49,13 @@ namespace DBus {
       s(value) {
 
   }
+  
+  
+  Argument::Argument(const int* values, int size)
+    : type(INT_ARRAY) {
+    a.v = values;
+    a.n = size;
+  }
 
 
 }
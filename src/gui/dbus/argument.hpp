@@ -41,12 +41,16 @@ namespace DBus {
     Argument(double value);
     /** Creates a string argument. */
     Argument(const char* value);
+    /** Creates an integer array argument. The array is not copied, it 
+	must stay valid as long as this object is used. */
+    Argument(const int* values, int size);
     
     /** The different types that an argument can have. */
     enum Type {
       INT,
       DOUBLE,
       STRING,
+      INT_ARRAY,
       INVALID
     } type;
     
@@ -55,6 +59,10 @@ namespace DBus {
       int i;
       double d;
       const char* s;
+      struct {
+	const int* v;
+	int n;
+      } a;
     };
     
   };
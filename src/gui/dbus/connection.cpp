@@ -21,6 +21,9 @@
 #include <cstring>
 #include <iostream>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "connection.hpp"
 #include "object.hpp"
 
@@ -33,7 +36,17 @@ namespace DBus {
   
   Connection::Connection(const std::string& name)
     : m_conn(0),
-      m_error(0) {
+      m_error(0),
+      m_reader_running(false),
+      m_pending(false),
+      m_stop(false) {
+    m_wakeup[0] = m_wakeup[1] = -1;
+    pthread_mutex_init(&m_mutex, 0);
+    pthread_cond_init(&m_cond, 0);
+    
+    // the reader thread and the main loop share the connection
+    dbus_threads_init_default();
+    
     if (!(m_conn = dbus_bus_get_private(DBUS_BUS_SESSION, m_error)))
       return;
     dbus_bus_request_name(m_conn, name.c_str(), 0, m_error);
@@ -45,6 +58,9 @@ namespace DBus {
   
   Connection::~Connection() {
     // XXX delete objects and treenodes here
+    stop_reader();
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
     if (m_conn) {
       dbus_connection_close(m_conn);
       dbus_connection_unref(m_conn);
@@ -95,7 +111,107 @@ namespace DBus {
 
 
   bool Connection::run(int msec) {
-    return (dbus_connection_read_write_dispatch(m_conn, msec) == TRUE);
+    if (dbus_connection_read_write_dispatch(m_conn, msec) != TRUE)
+      return false;
+    // dbus_connection_read_write_dispatch() only dispatches a single 
+    // message, don't leave the rest waiting for the next call
+    while (dbus_connection_dispatch(m_conn) == DBUS_DISPATCH_DATA_REMAINS);
+    return true;
+  }
+  
+  
+  bool Connection::start_reader() {
+    if (!m_conn)
+      return false;
+    if (m_reader_running)
+      return true;
+    if (pipe(m_wakeup) != 0) {
+      m_wakeup[0] = m_wakeup[1] = -1;
+      return false;
+    }
+    fcntl(m_wakeup[0], F_SETFL, fcntl(m_wakeup[0], F_GETFL) | O_NONBLOCK);
+    m_stop = false;
+    m_pending = false;
+    if (pthread_create(&m_reader, 0, &Connection::reader_main, this) != 0) {
+      close(m_wakeup[0]);
+      close(m_wakeup[1]);
+      m_wakeup[0] = m_wakeup[1] = -1;
+      return false;
+    }
+    m_reader_running = true;
+    return true;
+  }
+  
+  
+  int Connection::get_wakeup_fd() const {
+    return m_wakeup[0];
+  }
+  
+  
+  bool Connection::dispatch() {
+    
+    // empty the wakeup pipe, one call handles everything that is queued
+    if (m_wakeup[0] != -1) {
+      char buf[64];
+      while (read(m_wakeup[0], buf, sizeof(buf)) > 0);
+    }
+    
+    while (dbus_connection_dispatch(m_conn) == DBUS_DISPATCH_DATA_REMAINS);
+    
+    // the reader is parked while m_pending is set, so the replies can be 
+    // written without waiting for it to release the connection
+    dbus_connection_flush(m_conn);
+    
+    pthread_mutex_lock(&m_mutex);
+    m_pending = false;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+    
+    return true;
+  }
+  
+  
+  void* Connection::reader_main(void* arg) {
+    Connection* me = static_cast<Connection*>(arg);
+    while (true) {
+      pthread_mutex_lock(&me->m_mutex);
+      while (me->m_pending && !me->m_stop)
+	pthread_cond_wait(&me->m_cond, &me->m_mutex);
+      bool stop = me->m_stop;
+      pthread_mutex_unlock(&me->m_mutex);
+      if (stop)
+	break;
+      
+      // the timeout only bounds how long it takes to notice m_stop
+      if (dbus_connection_read_write(me->m_conn, 100) != TRUE)
+	break;
+      
+      if (dbus_connection_get_dispatch_status(me->m_conn) == 
+	  DBUS_DISPATCH_DATA_REMAINS) {
+	pthread_mutex_lock(&me->m_mutex);
+	me->m_pending = true;
+	pthread_mutex_unlock(&me->m_mutex);
+	char c = 0;
+	if (write(me->m_wakeup[1], &c, 1) != 1)
+	  cerr<<"Could not wake up the D-Bus dispatcher"<<endl;
+      }
+    }
+    return 0;
+  }
+  
+  
+  void Connection::stop_reader() {
+    if (!m_reader_running)
+      return;
+    pthread_mutex_lock(&m_mutex);
+    m_stop = true;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+    pthread_join(m_reader, 0);
+    m_reader_running = false;
+    close(m_wakeup[0]);
+    close(m_wakeup[1]);
+    m_wakeup[0] = m_wakeup[1] = -1;
   }
   
 
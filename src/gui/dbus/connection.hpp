@@ -24,6 +24,7 @@
 #include <map>
 
 #include <dbus/dbus.h>
+#include <pthread.h>
 
 
 /** C++ wrapper for the low-level D-Bus API. */
@@ -63,6 +64,22 @@ namespace DBus {
 	send signals and replies. */
     bool run(int msec);
     
+    /** Start a thread that reads and decodes messages from the bus, so the
+	owner's main loop only has to dispatch the ones that are already 
+	queued. Whenever there are messages to dispatch a byte is written to
+	the file descriptor returned by get_wakeup_fd(), and the owner should
+	call dispatch() when it becomes readable. Returns @c false if the
+	thread could not be started, in which case run() still works. */
+    bool start_reader();
+    
+    /** Return the file descriptor that becomes readable when the reader 
+	thread has queued messages, or -1 if it isn't running. */
+    int get_wakeup_fd() const;
+    
+    /** Dispatch all queued method calls and send the replies. This must be
+	called from the thread that owns the registered objects. */
+    bool dispatch();
+    
     /** Return the D-Bus name for this connection. May not be the same as
 	the one requested in the constructor (if it was already in use). */
     const std::string& get_name() const;
@@ -90,6 +107,12 @@ namespace DBus {
     /** Called when an object is unregistered. */
     static void op_unregister_function(DBusConnection* conn, void* user_data);
     
+    /** The main function for the reader thread. */
+    static void* reader_main(void* arg);
+    
+    /** Stop and join the reader thread, if it is running. */
+    void stop_reader();
+    
     /** Called when a message is received for an object. */
     static DBusHandlerResult op_message_function(DBusConnection* conn, 
 						 DBusMessage* msg,
@@ -103,6 +126,21 @@ namespace DBus {
     TreeNode m_root;
     /** Our connection name. */
     std::string m_name;
+    
+    /** The reader thread and the pipe it uses to wake up the owner. */
+    pthread_t m_reader;
+    bool m_reader_running;
+    int m_wakeup[2];
+    
+    /** Protects the two flags below. */
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+    /** Set by the reader when it has queued messages, cleared by 
+	dispatch(). The reader waits while it is set so it doesn't spin on
+	messages that are already queued. */
+    bool m_pending;
+    /** Tells the reader to quit. */
+    bool m_stop;
 
   };
 
@@ -20,6 +20,7 @@
 
 #include <cstring>
 #include <iostream>
+#include <vector>
 
 #include "argument.hpp"
 #include "object.hpp"
@@ -119,34 +120,53 @@ namespace DBus {
       return DBUS_HANDLER_RESULT_HANDLED;
     }
     
-    // through all the checks - get the arguments
-    int argc = strlen(typesig);
-    Argument* argv = new Argument[argc];
+    // through all the checks - get the arguments. Integer arrays are not
+    // copied, they point into the message which outlives the handler call.
+    // The type signature has already been matched, so anything else than
+    // the handled types can't show up here.
+    vector<Argument> args;
     DBusMessageIter aiter;
     dbus_message_iter_init(msg, &aiter);
-    for (int i = 0; i < argc; ++i, dbus_message_iter_next(&aiter)) {
-      dbus_uint64_t value;
-      dbus_message_iter_get_basic(&aiter, &value);
-      int type = dbus_message_iter_get_arg_type(&aiter);
-      if (type == DBUS_TYPE_INT32)
-	argv[i] = Argument(*reinterpret_cast<int*>(&value));
-      else if (type == DBUS_TYPE_DOUBLE)
-	argv[i] = Argument(*reinterpret_cast<double*>(&value));
-      else if (type == DBUS_TYPE_STRING)
-	argv[i] = Argument(*reinterpret_cast<const char**>(&value));
+    int type;
+    while ((type = dbus_message_iter_get_arg_type(&aiter)) != 
+	   DBUS_TYPE_INVALID) {
+      if (type == DBUS_TYPE_ARRAY) {
+	DBusMessageIter eiter;
+	const int* values = 0;
+	int n = 0;
+	dbus_message_iter_recurse(&aiter, &eiter);
+	if (dbus_message_iter_get_arg_type(&eiter) == DBUS_TYPE_INT32)
+	  dbus_message_iter_get_fixed_array(&eiter, &values, &n);
+	args.push_back(Argument(values, n));
+      }
+      else {
+	dbus_uint64_t value;
+	dbus_message_iter_get_basic(&aiter, &value);
+	if (type == DBUS_TYPE_INT32)
+	  args.push_back(Argument(*reinterpret_cast<int*>(&value)));
+	else if (type == DBUS_TYPE_DOUBLE)
+	  args.push_back(Argument(*reinterpret_cast<double*>(&value)));
+	else if (type == DBUS_TYPE_STRING)
+	  args.push_back(Argument(*reinterpret_cast<const char**>(&value)));
+	else
+	  args.push_back(Argument());
+      }
+      dbus_message_iter_next(&aiter);
     }
     
-    // call the method!
-    if (tsiter->second(argc, argv)) {
-      DBusMessage* reply = dbus_message_new_method_return(msg);
-      dbus_connection_send(conn, reply, 0);
-    }
-    else {
-      DBusMessage* reply = dbus_message_new_error(msg, DBUS_ERROR_FAILED,
-						  "Method handler failed");
+    // call the method! callers that don't want a reply can pipeline their
+    // calls without waiting for a round trip each
+    bool success = tsiter->second(args.size(), args.empty() ? 0 : &args[0]);
+    if (!dbus_message_get_no_reply(msg)) {
+      DBusMessage* reply;
+      if (success)
+	reply = dbus_message_new_method_return(msg);
+      else
+	reply = dbus_message_new_error(msg, DBUS_ERROR_FAILED,
+				       "Method handler failed");
       dbus_connection_send(conn, reply, 0);
+      dbus_message_unref(reply);
     }
-    delete [] argv;
     
     return DBUS_HANDLER_RESULT_HANDLED;
   }
@@ -118,8 +118,17 @@ DinoDBusObject::DinoDBusObject(Dino::CommandProxy& proxy,
 	     sigc::mem_fun(*this, &DinoDBusObject::add_curve_point));
   add_method("org.nongnu.dino.Song", "RemoveCurvePoint", "iiii",
 	     sigc::mem_fun(*this, &DinoDBusObject::remove_curve_point));
-
-
+  
+  // batched versions of the most common edits, one message and one undo 
+  // step for any number of notes or points
+  add_method("org.nongnu.dino.Song", "AddNotes", "iiai",
+	     sigc::mem_fun(*this, &DinoDBusObject::add_notes));
+  add_method("org.nongnu.dino.Song", "SetNoteVelocities", "iiai",
+	     sigc::mem_fun(*this, &DinoDBusObject::set_note_velocities));
+  add_method("org.nongnu.dino.Song", "DeleteNotes", "iiai",
+	     sigc::mem_fun(*this, &DinoDBusObject::delete_notes));
+  add_method("org.nongnu.dino.Song", "AddCurvePoints", "iiiai",
+	     sigc::mem_fun(*this, &DinoDBusObject::add_curve_points));
 }
 
 
@@ -352,4 +361,62 @@ bool DinoDBusObject::remove_curve_point(int argc, DBus::Argument* argv){
 }
 
 
-
+bool DinoDBusObject::add_notes(int argc, DBus::Argument* argv) {
+  const int* v = argv[2].a.v;
+  int n = argv[2].a.n;
+  if (n % 4 != 0)
+    return false;
+  bool success = true;
+  m_proxy.start_atomic("Add notes");
+  for (int i = 0; i < n; i += 4)
+    success &= m_proxy.add_note(argv[0].i, argv[1].i, 
+				Dino::SongTime(v[i], 0), v[i + 1], v[i + 2],
+				Dino::SongTime(v[i + 3], 0));
+  m_proxy.end_atomic();
+  return success;
+}
+
+
+bool DinoDBusObject::set_note_velocities(int argc, DBus::Argument* argv) {
+  const int* v = argv[2].a.v;
+  int n = argv[2].a.n;
+  if (n % 3 != 0)
+    return false;
+  bool success = true;
+  m_proxy.start_atomic("Set note velocities");
+  for (int i = 0; i < n; i += 3)
+    success &= m_proxy.set_note_velocity(argv[0].i, argv[1].i, 
+					 v[i], v[i + 1], v[i + 2]);
+  m_proxy.end_atomic();
+  return success;
+}
+
+
+bool DinoDBusObject::delete_notes(int argc, DBus::Argument* argv) {
+  const int* v = argv[2].a.v;
+  int n = argv[2].a.n;
+  if (n % 2 != 0)
+    return false;
+  bool success = true;
+  m_proxy.start_atomic("Delete notes");
+  for (int i = 0; i < n; i += 2)
+    success &= m_proxy.delete_note(argv[0].i, argv[1].i, 
+				   Dino::SongTime(v[i], 0), v[i + 1]);
+  m_proxy.end_atomic();
+  return success;
+}
+
+
+bool DinoDBusObject::add_curve_points(int argc, DBus::Argument* argv) {
+  const int* v = argv[3].a.v;
+  int n = argv[3].a.n;
+  if (n % 2 != 0)
+    return false;
+  bool success = true;
+  m_proxy.start_atomic("Add curve points");
+  for (int i = 0; i < n; i += 2)
+    success &= m_proxy.add_curve_point(argv[0].i, argv[1].i, argv[2].i,
+				       Dino::SongTime(v[i], 0), v[i + 1]);
+  m_proxy.end_atomic();
+  return success;
+}
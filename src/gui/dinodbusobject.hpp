@@ -178,6 +178,23 @@ protected:
   
   /** Remove a curve points. */
   bool remove_curve_point(int argc, DBus::Argument* argv);
+  
+  
+  /** Add many notes to a pattern in a single undoable step. The third 
+      argument is an array of (step, key, velocity, length) quadruples. */
+  bool add_notes(int argc, DBus::Argument* argv);
+  
+  /** Set the velocities of many notes. The third argument is an array of
+      (step, key, velocity) triples. */
+  bool set_note_velocities(int argc, DBus::Argument* argv);
+  
+  /** Delete many notes from a pattern. The third argument is an array of
+      (step, key) pairs. */
+  bool delete_notes(int argc, DBus::Argument* argv);
+  
+  /** Add many curve points. The fourth argument is an array of 
+      (step, value) pairs. */
+  bool add_curve_points(int argc, DBus::Argument* argv);
 
   
   /** The global command proxy object. */
@@ -414,8 +414,18 @@ DinoGUI::DinoGUI(int argc, char** argv)
   
   m_dbus_obj = new DinoDBusObject(m_proxy, m_seq);
   m_dbus.register_object("/", m_dbus_obj);
-  signal_timeout().
-    connect(bind(mem_fun(m_dbus, &DBus::Connection::run), 0), 50);
+  
+  // let a separate thread read from the bus and only dispatch the decoded
+  // calls here, fall back to polling if the thread can't be started
+  if (m_dbus.start_reader()) {
+    signal_io().
+      connect(hide(mem_fun(m_dbus, &DBus::Connection::dispatch)),
+	      m_dbus.get_wakeup_fd(), IO_IN);
+  }
+  else {
+    signal_timeout().
+      connect(bind(mem_fun(m_dbus, &DBus::Connection::run), 0), 50);
+  }
   
   // initialise the main window
   m_window.set_title("Dino");
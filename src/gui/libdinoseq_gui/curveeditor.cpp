@@ -18,8 +18,10 @@
    Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 ****************************************************************************/
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <limits>
 #include <sstream>
 
 #include "commandproxy.hpp"
@@ -27,7 +29,6 @@
 #include "curve.hpp"
 #include "curveeditor.hpp"
 #include "controller_numbers.hpp"
-#include "interpolatedevent.hpp"
 
 
 using namespace Glib;
@@ -48,7 +49,8 @@ CurveEditor::CurveEditor(Dino::CommandProxy& proxy)
     m_alternation(4),
     m_curve(0),
     m_proxy(proxy),
-    m_drag_step(-1) {
+    m_drag_step(-1),
+    m_redraw(*this) {
 
   RefPtr<Colormap> cmap = Colormap::get_system();
   cmap->alloc_color(m_bg_colour1);
@@ -68,7 +70,7 @@ void CurveEditor::set_curve(int track, int pattern, const Dino::Curve* curve) {
   m_curve = curve;
   if (m_curve) {
     set_size_request(m_curve->get_size() * m_step_width, 68);
-    slot<void> draw = mem_fun(*this, &CurveEditor::queue_draw);
+    slot<void> draw = mem_fun(m_redraw, &RedrawScheduler::queue_all);
     m_curve->signal_point_added().
       connect(sigc::hide(sigc::hide(draw)));
     m_curve->signal_point_changed().
@@ -199,11 +201,17 @@ bool CurveEditor::on_expose_event(GdkEventExpose* event) {
     return true;
   
   RefPtr<Gdk::Window> win = get_window();
+  Gdk::Rectangle area(&event->area);
   
   unsigned steps = m_curve->get_size();
   unsigned spb = m_alternation;
   
-  for (unsigned i = 0; i < steps; i += spb) {
+  // only draw the steps in the exposed area
+  unsigned first = xpix2step(area.get_x());
+  unsigned last = std::min(unsigned(xpix2step(area.get_x() + 
+					      area.get_width())) + 1, steps);
+  
+  for (unsigned i = first - first % spb; i < last; i += spb) {
     if ((i / spb) % 2 == 0)
       m_gc->set_foreground(m_bg_colour1);
     else
@@ -213,35 +221,37 @@ bool CurveEditor::on_expose_event(GdkEventExpose* event) {
   }
   
   m_gc->set_foreground(m_grid_colour);
-  for (unsigned i = 0; i < steps; ++i) {
+  for (unsigned i = first; i < last; ++i) {
     win->draw_line(m_gc, (i + 1) * m_step_width, 0, 
 		   (i + 1) * m_step_width, get_height());
   }
   
-  for (unsigned i = 0; i < steps; ++i) {
-    const InterpolatedEvent* event = 
-      m_curve->get_event(i);
-    if (event && event->get_step() == i) {
-      m_gc->set_foreground(m_edge_colour);
-      win->draw_line(m_gc, m_step_width * i, value2ypix(event->get_start()),
-		     m_step_width * (i + event->get_length()),
-		     value2ypix(event->get_end()));
-      m_gc->set_foreground(m_fg_colour);
-      win->draw_rectangle(m_gc, true, m_step_width * i - 2, 
-			  value2ypix(event->get_start()) - 2, 5, 5);
-      m_gc->set_foreground(m_edge_colour);
-      win->draw_rectangle(m_gc, false, m_step_width * i - 2, 
-			  value2ypix(event->get_start()) - 2, 5, 5);
+  // draw one vertical span per pixel column, using the value summary in the
+  // curve so the time doesn't depend on the number of points
+  int x0 = std::max(area.get_x(), 0);
+  int x1 = std::min(area.get_x() + area.get_width(), step2xpix(steps) + 1);
+  m_gc->set_foreground(m_edge_colour);
+  for (int x = x0; x < x1; ++x) {
+    AtomicInt::Type min, max;
+    if (m_curve->get_range(xpix2time(x), xpix2time(x + 1), min, max)) {
+      win->draw_line(m_gc, x, curvevalue2ypix(max), 
+		     x, curvevalue2ypix(min));
     }
-    if (event && i == steps - 1) {
+  }
+  
+  // draw the handles for the points only when we are zoomed in far enough
+  // to tell them apart
+  if (m_step_width >= 16) {
+    SongTime end = xpix2time(x1 + 2);
+    Curve::ConstIterator iter = m_curve->lower_bound(xpix2time(x0 - 2));
+    for ( ; iter != m_curve->end() && iter->m_time <= end; ++iter) {
+      int x = iter->m_time.scale(m_step_width, 1).get_beat();
+      int y = curvevalue2ypix(iter->m_value.get());
       m_gc->set_foreground(m_fg_colour);
-      win->draw_rectangle(m_gc, true, m_step_width * steps - 2, 
-			  value2ypix(event->get_end()) - 2, 5, 5);
+      win->draw_rectangle(m_gc, true, x - 2, y - 2, 5, 5);
       m_gc->set_foreground(m_edge_colour);
-      win->draw_rectangle(m_gc, false, m_step_width * steps - 2, 
-			  value2ypix(event->get_end()) - 2, 5, 5);
+      win->draw_rectangle(m_gc, false, x - 2, y - 2, 5, 5);
     }
-      
   }
   
   return true;
@@ -278,6 +288,18 @@ int CurveEditor::xpix2step(int value) {
 }
 
 
+SongTime CurveEditor::xpix2time(int x) {
+  return SongTime::from_ticks(int64_t(std::max(x, 0)) << 24).
+    scale(1, m_step_width);
+}
+
+
+int CurveEditor::curvevalue2ypix(AtomicInt::Type value) {
+  double max = numeric_limits<AtomicInt::Type>::max();
+  return get_height() - int(get_height() * (value / max));
+}
+
+
 sigc::signal<void, const std::string&>& CurveEditor::signal_status() {
   return m_signal_status;
 }
@@ -25,6 +25,10 @@
 
 #include <gtkmm.h>
 
+#include "atomicint.hpp"
+#include "redrawscheduler.hpp"
+#include "songtime.hpp"
+
 
 namespace Dino {
   class CommandProxy;
@@ -55,6 +59,8 @@ protected:
   int ypix2value(int value);
   int step2xpix(int value);
   int xpix2step(int value);
+  Dino::SongTime xpix2time(int x);
+  int curvevalue2ypix(Dino::AtomicInt::Type value);
   
   Glib::RefPtr<Gdk::GC> m_gc;
   Gdk::Color m_bg_colour1, m_bg_colour2, m_grid_colour, 
@@ -70,6 +76,8 @@ protected:
   
   int m_drag_step;
   
+  RedrawScheduler m_redraw;
+  
   sigc::signal<void, const std::string&> m_signal_status;
 };
 
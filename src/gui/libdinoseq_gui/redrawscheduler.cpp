@@ -0,0 +1,127 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#include <algorithm>
+
+#include "redrawscheduler.hpp"
+
+
+using namespace Dino;
+using namespace Glib;
+
+
+RedrawScheduler::RedrawScheduler(Gtk::Widget& widget, const MapSlot& map,
+				 unsigned interval)
+  : m_widget(widget),
+    m_map(map),
+    m_interval(interval),
+    m_all(false),
+    m_have_range(false),
+    m_min_key(0),
+    m_max_key(0),
+    m_have_rect(false) {
+
+}
+
+
+RedrawScheduler::~RedrawScheduler() {
+  m_timer.disconnect();
+}
+
+
+void RedrawScheduler::queue(const SongTime& from, const SongTime& to,
+			    int min_key, int max_key) {
+  if (m_map.empty()) {
+    queue_all();
+    return;
+  }
+  if (!m_have_range) {
+    m_from = from;
+    m_to = to;
+    m_min_key = min_key;
+    m_max_key = max_key;
+    m_have_range = true;
+  }
+  else {
+    m_from = std::min(m_from, from);
+    m_to = std::max(m_to, to);
+    m_min_key = std::min(m_min_key, min_key);
+    m_max_key = std::max(m_max_key, max_key);
+  }
+  schedule();
+}
+
+
+void RedrawScheduler::queue_rect(const Gdk::Rectangle& rect) {
+  if (!m_have_rect) {
+    m_rect = rect;
+    m_have_rect = true;
+  }
+  else
+    m_rect.join(rect);
+  schedule();
+}
+
+
+void RedrawScheduler::queue_all() {
+  m_all = true;
+  schedule();
+}
+
+
+void RedrawScheduler::flush() {
+  m_timer.disconnect();
+  
+  RefPtr<Gdk::Window> win = m_widget.get_window();
+  if (win) {
+    if (m_all)
+      win->invalidate(false);
+    else {
+      if (m_have_range) {
+	Gdk::Rectangle r = m_map(m_from, m_to, m_min_key, m_max_key);
+	if (m_have_rect)
+	  m_rect.join(r);
+	else
+	  m_rect = r;
+	m_have_rect = true;
+      }
+      if (m_have_rect)
+	win->invalidate_rect(m_rect, false);
+    }
+  }
+  
+  m_all = false;
+  m_have_range = false;
+  m_have_rect = false;
+}
+
+
+void RedrawScheduler::schedule() {
+  if (!m_timer.connected()) {
+    m_timer = signal_timeout().
+      connect(sigc::mem_fun(*this, &RedrawScheduler::on_timeout), m_interval);
+  }
+}
+
+
+bool RedrawScheduler::on_timeout() {
+  flush();
+  return false;
+}
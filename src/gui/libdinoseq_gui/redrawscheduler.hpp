@@ -0,0 +1,103 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#ifndef REDRAWSCHEDULER_HPP
+#define REDRAWSCHEDULER_HPP
+
+#include <gtkmm.h>
+
+#include "songtime.hpp"
+
+
+/** This class sits between the signals from the song model and a widget
+    that displays it. Instead of invalidating the widget every time a note,
+    point or sequence entry changes, the changes are accumulated into one
+    dirty region that is invalidated at most once per frame. This keeps bulk
+    edits like pastes or scripts that add thousands of notes from triggering
+    thousands of expose events.
+    
+    Changes can be given as ranges of time and keys, which are mapped to 
+    widget coordinates when the region is flushed, or directly as widget
+    rectangles. */
+class RedrawScheduler {
+public:
+  
+  /** The slot type used to map a time range [from, to] and a key range 
+      [min_key, max_key] to a rectangle in the widget. */
+  typedef sigc::slot<Gdk::Rectangle, const Dino::SongTime&, 
+		     const Dino::SongTime&, int, int> MapSlot;
+  
+  /** Create a new scheduler for @c widget. @c map is used to convert 
+      ranges passed to queue() into rectangles, if it is empty queue() will
+      invalidate the whole widget. @c interval is the minimum time between
+      two flushes in milliseconds. */
+  RedrawScheduler(Gtk::Widget& widget, const MapSlot& map = MapSlot(), 
+		  unsigned interval = 16);
+  
+  ~RedrawScheduler();
+  
+  /** Queue a redraw of the given time and key range. */
+  void queue(const Dino::SongTime& from, const Dino::SongTime& to,
+	     int min_key = 0, int max_key = 127);
+  
+  /** Queue a redraw of a rectangle in widget coordinates. */
+  void queue_rect(const Gdk::Rectangle& rect);
+  
+  /** Queue a redraw of the whole widget. This has the same signature as
+      Gtk::Widget::queue_draw() so it can be connected to the same 
+      signals. */
+  void queue_all();
+  
+  /** Invalidate the accumulated region right away instead of waiting
+      for the timer. */
+  void flush();
+  
+private:
+  
+  /** Start the flush timer if it isn't running already. */
+  void schedule();
+  
+  /** Called by the timer. */
+  bool on_timeout();
+  
+  
+  Gtk::Widget& m_widget;
+  MapSlot m_map;
+  unsigned m_interval;
+  sigc::connection m_timer;
+  
+  /** Set if the whole widget should be redrawn. */
+  bool m_all;
+  
+  /** The accumulated time and key range, valid if @c m_have_range is set. */
+  bool m_have_range;
+  Dino::SongTime m_from;
+  Dino::SongTime m_to;
+  int m_min_key;
+  int m_max_key;
+  
+  /** The accumulated widget rectangle, valid if @c m_have_rect is set. */
+  bool m_have_rect;
+  Gdk::Rectangle m_rect;
+  
+};
+
+
+#endif
@@ -33,14 +33,30 @@ using namespace Dino;
 
 Ruler::Ruler(const SongTime& length, int subs, int interval, 
 	     SongTime::Tick ticks_per_pixel, int height)
-  : m_length(length), 
+  : m_own_timeline(ticks_per_pixel, length),
+    m_timeline(&m_own_timeline),
     m_subs(subs), 
     m_interval(interval), 
-    m_ticks_per_pixel(ticks_per_pixel), 
     m_height(height),
     m_loop_start(-1, 0),
     m_loop_end(-1, 0) {
-  
+  init();
+}
+
+
+Ruler::Ruler(TimelineCache& timeline, int subs, int interval, int height)
+  : m_own_timeline(timeline.get_ticks_per_pixel()),
+    m_timeline(&timeline),
+    m_subs(subs), 
+    m_interval(interval), 
+    m_height(height),
+    m_loop_start(-1, 0),
+    m_loop_end(-1, 0) {
+  init();
+}
+
+
+void Ruler::init() {
   m_fg.set_rgb(0, 0, 0);
   m_loop_bg.set_rgb(65000, 65000, 40000);
   m_loop_marker.set_rgb(60000, 40000, 0);
@@ -49,14 +65,15 @@ Ruler::Ruler(const SongTime& length, int subs, int interval,
   m_colormap->alloc_color(m_loop_bg);
   m_colormap->alloc_color(m_loop_marker);
   
-  set_size_request(time2pixel(m_length) + 1, m_height);
+  m_timeline->signal_changed.
+    connect(sigc::mem_fun(*this, &Ruler::timeline_changed));
+  set_size_request(m_timeline->get_width() + 1, m_height);
   add_events(BUTTON_PRESS_MASK | BUTTON_RELEASE_MASK | BUTTON_MOTION_MASK);
 }
 
   
 void Ruler::set_length(const SongTime& length) {
-  m_length = length;
-  set_size_request(time2pixel(m_length) + 1, m_height);
+  m_timeline->set_length(length);
 }
 
 
@@ -71,8 +88,13 @@ void Ruler::set_interval(int interval) {
 
 
 void Ruler::set_ticks_per_pixel(SongTime::Tick ticks_per_pixel) {
-  m_ticks_per_pixel = ticks_per_pixel;
-  set_size_request(time2pixel(m_length) + 1, m_height);
+  m_timeline->set_ticks_per_pixel(ticks_per_pixel);
+}
+
+
+void Ruler::timeline_changed() {
+  set_size_request(m_timeline->get_width() + 1, m_height);
+  queue_draw();
 }
 
 
@@ -88,13 +110,9 @@ bool Ruler::on_expose_event(GdkEventExpose* event) {
 
   Glib::RefPtr<Gdk::Window> win = get_window();
   win->clear();
-  if (m_length <= SongTime(0, 0))
+  if (m_timeline->get_length() <= SongTime(0, 0))
     return true;
   
-  Pango::FontDescription fd("helvetica bold 9");
-  get_pango_context()->set_font_description(fd);
-  char tmp[10];
-  
   int start = time2pixel(m_loop_start);
   int end = time2pixel(m_loop_end);
   
@@ -119,22 +137,29 @@ bool Ruler::on_expose_event(GdkEventExpose* event) {
     win->draw_rectangle(m_gc, true, end - 6, 2 * m_height / 3 - 1, 3, 3);
   }
   
-  // draw the ticks and numbers
+  // draw the ticks and numbers for the exposed beats only, extended a bit
+  // so labels that are centered on a beat outside the area aren't cut off
+  int first, last;
+  int margin = 32;
+  if (!m_timeline->get_visible_beats(event->area.x - margin, 
+				     event->area.width + 2 * margin,
+				     first, last))
+    return true;
+  if (last == m_timeline->get_length().get_beat() - 1)
+    ++last;
   m_gc->set_foreground(m_fg);
-  for (int i = 0; i <= m_length.get_beat(); ++i) {
-    int x = time2pixel(SongTime(i, 0));
+  for (int i = first; i <= last; ++i) {
+    int x = m_timeline->beat2pixel(i);
     win->draw_line(m_gc, x, m_height - 4, x, m_height);
     if (i % m_interval == 0 && i != 0) {
       Glib::RefPtr<Pango::Layout> l = 
-	Pango::Layout::create(get_pango_context());
-      sprintf(tmp, "%d", i);
-      l->set_text(tmp);
+	m_timeline->get_label(get_pango_context(), i);
       Pango::Rectangle rect = l->get_pixel_logical_extents();
       win->draw_layout(m_gc, x - rect.get_width() / 2, 
 		       (m_height - 4 - rect.get_height()) / 2, l);
     }
+    int b = m_timeline->beat2pixel(i + 1) - x;
     for (int j = 1; j < m_subs; ++j) {
-      int b = time2pixel(SongTime(1, 0));
       win->draw_line(m_gc, x + j * b / m_subs, 
 		     m_height- 2, x + j * b / m_subs, m_height);
     }
@@ -163,16 +188,12 @@ void Ruler::set_loop_end(const SongTime& end) {
 
 
 SongTime Ruler::pixel2time(int x) {
-  int64_t t = int64_t(x) * m_ticks_per_pixel;
-  SongTime::Beat b = t >> (sizeof(SongTime::Tick) * 8);
-  return SongTime(b, t - (int64_t(b) << (sizeof(SongTime::Tick) * 8)));
+  return m_timeline->pixel2time(x);
 }
 
 
 int Ruler::time2pixel(const SongTime& time) {
-  int64_t value = int64_t(time.get_beat()) * SongTime::ticks_per_beat() + 
-    time.get_tick();
-  return int(value / m_ticks_per_pixel);
+  return m_timeline->time2pixel(time);
 }
 
 
@@ -24,6 +24,7 @@
 #include <gtkmm.h>
 
 #include "songtime.hpp"
+#include "timelinecache.hpp"
 
 
 namespace Dino {
@@ -36,6 +37,11 @@ public:
   Ruler(const Dino::SongTime& length, int subs, int interval, 
 	Dino::SongTime::Tick ticks_per_pixel, int height);
   
+  /** Create a ruler that uses a timeline cache shared with other 
+      widgets. set_length() and set_ticks_per_pixel() will change the
+      shared cache. */
+  Ruler(TimelineCache& timeline, int subs, int interval, int height);
+  
   void set_length(const Dino::SongTime& length);
   void set_subdivisions(int subdivisions);
   void set_interval(int interval);
@@ -53,14 +59,15 @@ public:
   
 private:
   
-  Dino::SongTime pixel2time(int x);
-  int time2pixel(const Dino::SongTime& time);
-
+  void init();
+  void timeline_changed();
+  
   
-  Dino::SongTime m_length;
+  /** Used if no shared timeline cache is given. */
+  TimelineCache m_own_timeline;
+  TimelineCache* m_timeline;
   int m_subs;
   int m_interval;
-  Dino::SongTime::Tick m_ticks_per_pixel;
   int m_height;
   Dino::SongTime m_loop_start;
   Dino::SongTime m_loop_end;
@@ -0,0 +1,81 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#include <algorithm>
+
+#include "tilecache.hpp"
+
+
+using namespace Gdk;
+using namespace Glib;
+
+
+TileCache::TileCache(const RenderSlot& render, int tile_size, 
+		     unsigned max_tiles)
+  : m_render(render),
+    m_tile_size(tile_size),
+    m_max_tiles(max_tiles) {
+
+}
+
+
+void TileCache::invalidate() {
+  m_tiles.clear();
+}
+
+
+void TileCache::draw(RefPtr<Gdk::Window> win, RefPtr<GC> gc,
+		     const Rectangle& area) {
+  if (area.get_width() <= 0 || area.get_height() <= 0)
+    return;
+  
+  int tx0 = area.get_x() / m_tile_size;
+  int ty0 = area.get_y() / m_tile_size;
+  int tx1 = (area.get_x() + area.get_width() - 1) / m_tile_size;
+  int ty1 = (area.get_y() + area.get_height() - 1) / m_tile_size;
+  
+  for (int ty = ty0; ty <= ty1; ++ty) {
+    for (int tx = tx0; tx <= tx1; ++tx) {
+      
+      int x = tx * m_tile_size;
+      int y = ty * m_tile_size;
+      
+      // render the tile if we don't have it already, dropping the whole 
+      // cache if it's full - the tiles we need will be rendered again anyway
+      TileMap::iterator iter = m_tiles.find(std::make_pair(tx, ty));
+      if (iter == m_tiles.end()) {
+	if (m_tiles.size() >= m_max_tiles)
+	  m_tiles.clear();
+	RefPtr<Pixmap> pixmap = Pixmap::create(win, m_tile_size, m_tile_size);
+	m_render(pixmap, x, y, m_tile_size, m_tile_size);
+	iter = m_tiles.insert(std::make_pair(std::make_pair(tx, ty), 
+					     pixmap)).first;
+      }
+      
+      // copy the part of the tile that intersects the area
+      int x0 = std::max(x, area.get_x());
+      int y0 = std::max(y, area.get_y());
+      int x1 = std::min(x + m_tile_size, area.get_x() + area.get_width());
+      int y1 = std::min(y + m_tile_size, area.get_y() + area.get_height());
+      win->draw_drawable(gc, iter->second, x0 - x, y0 - y, 
+			 x0, y0, x1 - x0, y1 - y0);
+    }
+  }
+}
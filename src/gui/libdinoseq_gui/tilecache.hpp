@@ -0,0 +1,70 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#ifndef TILECACHE_HPP
+#define TILECACHE_HPP
+
+#include <map>
+#include <utility>
+
+#include <gtkmm.h>
+
+
+/** A cache of offscreen pixmaps for the parts of a widget that rarely
+    change, like the background and grid of an editor. The widget area is 
+    split into square tiles that are rendered on demand and then copied to
+    the window, so scrolling and expose events don't have to redraw 
+    anything that hasn't changed. */
+class TileCache {
+public:
+  
+  /** The slot type that renders a tile. It should draw the rectangle of the
+      widget that starts at (x, y) with the given width and height into the
+      drawable, with (x, y) mapped to (0, 0). */
+  typedef sigc::slot<void, Glib::RefPtr<Gdk::Drawable>, 
+		     int, int, int, int> RenderSlot;
+  
+  /** Create a new cache that renders tiles using @c render. No more than
+      @c max_tiles tiles will be kept in memory at once. */
+  TileCache(const RenderSlot& render, int tile_size = 256, 
+	    unsigned max_tiles = 64);
+  
+  /** Throw away all cached tiles. This should be called whenever the 
+      rendered contents change. */
+  void invalidate();
+  
+  /** Copy the part of the cached image that intersects @c area to 
+      @c win, rendering any tiles that are missing. */
+  void draw(Glib::RefPtr<Gdk::Window> win, Glib::RefPtr<Gdk::GC> gc,
+	    const Gdk::Rectangle& area);
+  
+private:
+  
+  typedef std::map<std::pair<int, int>, Glib::RefPtr<Gdk::Pixmap> > TileMap;
+  
+  RenderSlot m_render;
+  int m_tile_size;
+  unsigned m_max_tiles;
+  TileMap m_tiles;
+  
+};
+
+
+#endif
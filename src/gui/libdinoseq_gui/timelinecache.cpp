@@ -0,0 +1,197 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+
+#include "timelinecache.hpp"
+
+
+using namespace Dino;
+using namespace Glib;
+using namespace std;
+
+
+namespace {
+  
+  /** The maximum number of cached labels. Only the visible ones are used
+      for each expose so this is plenty, if it fills up it is just 
+      cleared. */
+  const size_t max_labels = 4096;
+  
+  bool starts_before(const TimelineCache::TempoSegment& a,
+		     const TimelineCache::TempoSegment& b) {
+    return a.beat < b.beat;
+  }
+  
+}
+
+
+TimelineCache::TimelineCache(SongTime::Tick ticks_per_pixel, 
+			     const SongTime& length, int beats_per_bar)
+  : m_length(length),
+    m_ticks_per_pixel(ticks_per_pixel),
+    m_beats_per_bar(beats_per_bar),
+    m_tempo(1, TempoSegment()),
+    m_font("helvetica bold 9") {
+  update_beats();
+}
+
+
+void TimelineCache::set_length(const SongTime& length) {
+  if (length == m_length)
+    return;
+  m_length = length;
+  update_beats();
+  signal_changed();
+}
+
+
+const SongTime& TimelineCache::get_length() const {
+  return m_length;
+}
+
+
+void TimelineCache::set_ticks_per_pixel(SongTime::Tick ticks_per_pixel) {
+  if (ticks_per_pixel == m_ticks_per_pixel)
+    return;
+  m_ticks_per_pixel = ticks_per_pixel;
+  update_beats();
+  signal_changed();
+}
+
+
+SongTime::Tick TimelineCache::get_ticks_per_pixel() const {
+  return m_ticks_per_pixel;
+}
+
+
+void TimelineCache::set_beats_per_bar(int beats_per_bar) {
+  if (beats_per_bar == m_beats_per_bar)
+    return;
+  m_beats_per_bar = beats_per_bar;
+  signal_changed();
+}
+
+
+int TimelineCache::get_beats_per_bar() const {
+  return m_beats_per_bar;
+}
+
+
+int TimelineCache::get_width() const {
+  return time2pixel(m_length);
+}
+
+
+int TimelineCache::time2pixel(const SongTime& time) const {
+  int64_t value = int64_t(time.get_beat()) * SongTime::ticks_per_beat() + 
+    time.get_tick();
+  return int(value / m_ticks_per_pixel);
+}
+
+
+SongTime TimelineCache::pixel2time(int x) const {
+  return SongTime::from_ticks(int64_t(x) * m_ticks_per_pixel);
+}
+
+
+int TimelineCache::beat2pixel(int beat) const {
+  if (beat >= 0 && size_t(beat) < m_beat_x.size())
+    return m_beat_x[beat];
+  return time2pixel(SongTime(beat, 0));
+}
+
+
+int TimelineCache::pixel2beat(int x) const {
+  if (m_beat_x.size() < 2)
+    return 0;
+  vector<int>::const_iterator iter = 
+    upper_bound(m_beat_x.begin(), m_beat_x.end() - 1, x);
+  return iter == m_beat_x.begin() ? 0 : (iter - m_beat_x.begin()) - 1;
+}
+
+
+bool TimelineCache::get_visible_beats(int x, int width, 
+				      int& first, int& last) const {
+  if (width <= 0 || m_beat_x.size() < 2 || x >= m_beat_x.back() || 
+      x + width <= 0)
+    return false;
+  first = pixel2beat(x);
+  last = pixel2beat(x + width - 1);
+  return true;
+}
+
+
+int TimelineCache::get_tempo(int beat) const {
+  return tempo_find(beat)->bpm;
+}
+
+
+TimelineCache::TempoIterator TimelineCache::tempo_find(int beat) const {
+  // the last segment that starts at or before beat
+  TempoIterator iter = upper_bound(m_tempo.begin(), m_tempo.end(), 
+				   TempoSegment(beat), &starts_before);
+  return iter == m_tempo.begin() ? iter : iter - 1;
+}
+
+
+TimelineCache::TempoIterator TimelineCache::tempo_begin() const {
+  return m_tempo.begin();
+}
+
+
+TimelineCache::TempoIterator TimelineCache::tempo_end() const {
+  return m_tempo.end();
+}
+
+
+RefPtr<Pango::Layout> 
+TimelineCache::get_label(const RefPtr<Pango::Context>& context, int number) {
+  map<int, RefPtr<Pango::Layout> >::iterator iter = m_labels.find(number);
+  if (iter != m_labels.end())
+    return iter->second;
+  if (m_labels.size() >= max_labels)
+    m_labels.clear();
+  RefPtr<Pango::Layout> l = Pango::Layout::create(context);
+  l->set_font_description(m_font);
+  char tmp[16];
+  sprintf(tmp, "%d", number);
+  l->set_text(tmp);
+  m_labels[number] = l;
+  return l;
+}
+
+
+void TimelineCache::set_font(const Pango::FontDescription& font) {
+  m_font = font;
+  m_labels.clear();
+  signal_changed();
+}
+
+
+void TimelineCache::update_beats() {
+  m_beat_x.clear();
+  if (m_ticks_per_pixel <= 0)
+    m_ticks_per_pixel = 1;
+  for (int b = 0; b <= m_length.get_beat() + (m_length.get_tick() ? 1 : 0); 
+       ++b)
+    m_beat_x.push_back(time2pixel(SongTime(b, 0)));
+}
@@ -0,0 +1,146 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#ifndef TIMELINECACHE_HPP
+#define TIMELINECACHE_HPP
+
+#include <map>
+#include <vector>
+
+#include <gtkmm.h>
+
+#include "songtime.hpp"
+
+
+/** Everything the timeline widgets (rulers, the tempo widget and so on) 
+    need to draw a range of the song without walking the whole song: the
+    pixel position of every beat, the tempo map as a sorted list of 
+    segments, and Pango layouts for the numbers that are drawn. The pixel
+    map is recomputed only when the scale or the length changes and the
+    tempo segments only when the tempo map changes, so expose and mouse
+    handlers just do lookups for the part of the timeline that is visible.
+    
+    One cache can be shared by all widgets that show the same timeline at
+    the same scale. They should redraw themselves when signal_changed is
+    emitted. */
+class TimelineCache {
+public:
+  
+  /** A range of beats with a constant tempo, starting at @c beat and 
+      ending where the next segment starts. */
+  struct TempoSegment {
+    TempoSegment(int _beat = 0, int _bpm = 120) : beat(_beat), bpm(_bpm) { }
+    int beat;
+    int bpm;
+  };
+  
+  typedef std::vector<TempoSegment>::const_iterator TempoIterator;
+  
+  TimelineCache(Dino::SongTime::Tick ticks_per_pixel, 
+		const Dino::SongTime& length = Dino::SongTime(0, 0),
+		int beats_per_bar = 4);
+  
+  void set_length(const Dino::SongTime& length);
+  const Dino::SongTime& get_length() const;
+  void set_ticks_per_pixel(Dino::SongTime::Tick ticks_per_pixel);
+  Dino::SongTime::Tick get_ticks_per_pixel() const;
+  void set_beats_per_bar(int beats_per_bar);
+  int get_beats_per_bar() const;
+  
+  /** The width of the whole timeline in pixels. */
+  int get_width() const;
+  
+  int time2pixel(const Dino::SongTime& time) const;
+  Dino::SongTime pixel2time(int x) const;
+  
+  /** The x coordinate where @c beat starts. @c beat can be anything from
+      0 to the last beat of the song + 1. */
+  int beat2pixel(int beat) const;
+  
+  /** The beat that pixel column @c x is in, clamped to the song. */
+  int pixel2beat(int x) const;
+  
+  /** Find the beats that intersect the pixel range [x, x + width), so 
+      expose handlers can draw just those. Returns false if there are 
+      none. */
+  bool get_visible_beats(int x, int width, int& first, int& last) const;
+  
+  /** Replace the tempo map. @c begin and @c end can be any iterators over
+      objects with get_beat() and get_bpm() functions, such as 
+      Song::TempoIterator. */
+  template <class Iterator> void set_tempo_changes(Iterator begin, 
+						   Iterator end);
+  
+  /** The tempo at @c beat. */
+  int get_tempo(int beat) const;
+  
+  /** The tempo segment that contains @c beat, or the first one if 
+      @c beat is before that. Iterate from here to tempo_end() and stop at
+      the first segment after the visible range. */
+  TempoIterator tempo_find(int beat) const;
+  TempoIterator tempo_begin() const;
+  TempoIterator tempo_end() const;
+  
+  /** Return a layout with the text for @c number in the timeline font. 
+      The layouts are created from @c context the first time they are 
+      needed and then reused, as long as the font doesn't change. */
+  Glib::RefPtr<Pango::Layout> 
+  get_label(const Glib::RefPtr<Pango::Context>& context, int number);
+  
+  /** Change the font for the labels. */
+  void set_font(const Pango::FontDescription& font);
+  
+  /** Emitted when the scale, the length or the tempo map changes. */
+  sigc::signal<void> signal_changed;
+  
+private:
+  
+  /** Recompute the pixel positions for all beats. */
+  void update_beats();
+  
+  
+  Dino::SongTime m_length;
+  Dino::SongTime::Tick m_ticks_per_pixel;
+  int m_beats_per_bar;
+  
+  /** The x coordinate of every beat from 0 to the end of the song. */
+  std::vector<int> m_beat_x;
+  
+  std::vector<TempoSegment> m_tempo;
+  
+  Pango::FontDescription m_font;
+  std::map<int, Glib::RefPtr<Pango::Layout> > m_labels;
+  
+};
+
+
+template <class Iterator> 
+void TimelineCache::set_tempo_changes(Iterator begin, Iterator end) {
+  m_tempo.clear();
+  for ( ; begin != end; ++begin)
+    m_tempo.push_back(TempoSegment(int(begin->get_beat()), 
+				   int(begin->get_bpm())));
+  if (m_tempo.empty())
+    m_tempo.push_back(TempoSegment());
+  signal_changed();
+}
+
+
+#endif
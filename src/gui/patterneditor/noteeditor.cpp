@@ -18,6 +18,7 @@
    Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 ****************************************************************************/
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
@@ -53,7 +54,11 @@ NoteEditor::NoteEditor(Dino::CommandProxy& proxy)
     m_pat(0),
     m_trk(0),
     m_vadj(0),
-    m_proxy(proxy) {
+    m_proxy(proxy),
+    m_background(mem_fun(*this, &NoteEditor::render_background)),
+    m_note_index_dirty(true),
+    m_selection_index_dirty(true),
+    m_redraw(*this, mem_fun(*this, &NoteEditor::dirty_rect)) {
   
   // initialise colours
   m_colormap = Colormap::get_system();
@@ -143,22 +148,28 @@ void NoteEditor::set_pattern(const Track* track, const Pattern* pattern) {
       m_last_note_length = m_pat->get_steps();
       
       m_selection = NoteSelection(m_pat);
+      selection_changed();
       
       namespace s = sigc;
-      sigc::slot<void> draw = mem_fun(*this, &NoteEditor::queue_draw);
-      m_note_added_conn = m_pat->signal_note_added().connect(s::hide(draw));
-      m_note_removed_conn = m_pat->signal_note_removed().connect(s::hide(draw));
-      m_note_changed_conn = m_pat->signal_note_changed().connect(s::hide(draw));
+      sigc::slot<void> notes = mem_fun(*this, &NoteEditor::notes_changed);
+      sigc::slot<void> layout = mem_fun(*this, &NoteEditor::layout_changed);
+      m_note_added_conn = m_pat->signal_note_added().connect(s::hide(notes));
+      m_note_removed_conn = m_pat->signal_note_removed().
+	connect(s::hide(notes));
+      m_note_changed_conn = m_pat->signal_note_changed().
+	connect(s::hide(notes));
       m_length_changed_conn = m_pat->signal_length_changed().
-	connect(s::hide(draw));
+	connect(s::hide(layout));
       m_steps_changed_conn = m_pat->signal_steps_changed().
-	connect(s::hide(draw));
+	connect(s::hide(layout));
       
       mode_changed(m_trk->get_mode());
     }
     else
       set_size_request();
     
+    m_note_index_dirty = true;
+    m_background.invalidate();
     queue_draw();
   }
 }
@@ -261,10 +272,10 @@ void NoteEditor::delete_selection() {
 
 void NoteEditor::select_all() {
   if (m_pat) {
-    m_selection.clear();
+    clear_selection();
     Pattern::NoteIterator iter;
     for (iter = m_pat->notes_begin(); iter != m_pat->notes_end(); ++iter)
-      m_selection.add_note(iter);
+      select_note(iter);
     queue_draw();
   }
 }
@@ -330,8 +341,8 @@ bool NoteEditor::on_button_press_event(GdkEventButton* event) {
 			       SongTime(m_last_note_length, 0))) {
 	    Pattern::NoteIterator iter = m_pat->find_note(SongTime(step, 0),
 							  row2key(row));
-	    m_selection.clear();
-	    m_selection.add_note(iter);
+	    clear_selection();
+	    select_note(iter);
 	    m_added_note = make_pair(step, row2key(row));
 	    m_drag_operation = DragChangingNoteLength;
 	  }
@@ -346,17 +357,17 @@ bool NoteEditor::on_button_press_event(GdkEventButton* event) {
 	  
 	  // Shift adds or removes from selection
 	  if (event->state & GDK_SHIFT_MASK) {
-	    if (m_selection.find(iterator) == m_selection.end())
-	      m_selection.add_note(iterator);
+	    if (!is_selected(iterator))
+	      select_note(iterator);
 	    else
-	      m_selection.remove_note(iterator);
+	      deselect_note(iterator);
 	  }
 	  
 	  // No shift, drag the selection
 	  else {
-	    if (m_selection.find(iterator) == m_selection.end()) {
-	      m_selection.clear();
-	      m_selection.add_note(iterator);
+	    if (!is_selected(iterator)) {
+	      clear_selection();
+	      select_note(iterator);
 	    }
 	    m_moved_notes.clear();
 	    m_drag_step_min = 0;
@@ -399,7 +410,7 @@ bool NoteEditor::on_button_press_event(GdkEventButton* event) {
 	// outside a note, select a box
 	else {
 	  if (!(event->state & GDK_SHIFT_MASK))
-	    m_selection.clear();
+	    clear_selection();
 	  m_drag_operation = DragSelectBox;
 	  m_sb_row = row;
 	  m_sb_step = step;
@@ -417,9 +428,9 @@ bool NoteEditor::on_button_press_event(GdkEventButton* event) {
       if (iterator != m_pat->notes_end()) {
 	
 	// if the click is outside the selection, clear the selection first
-	if (m_selection.find(iterator) == m_selection.end()) {
-	  m_selection.clear();
-	  m_selection.add_note(iterator);
+	if (!is_selected(iterator)) {
+	  clear_selection();
+	  select_note(iterator);
 	}
 	
 	if (event->state & GDK_CONTROL_MASK) {
@@ -472,9 +483,9 @@ bool NoteEditor::on_button_press_event(GdkEventButton* event) {
 							row2key(row));
       if (iterator != m_pat->notes_end()) {
 	// if shift isn't pressed the selection is set to this single note
-	if (m_selection.find(iterator) == m_selection.end()) {
-	  m_selection.clear();
-	  m_selection.add_note(iterator);
+	if (!is_selected(iterator)) {
+	  clear_selection();
+	  select_note(iterator);
 	}
 	if (event->state & GDK_CONTROL_MASK) {
 	  m_proxy.start_atomic("Delete notes");
@@ -538,6 +549,7 @@ bool NoteEditor::on_button_release_event(GdkEventButton* event) {
     m_proxy.add_notes(m_trk->get_id(), m_pat->get_id(), m_moved_notes, 
 		      SongTime(0, 0), 0, &m_selection);
     m_proxy.end_atomic();
+    selection_changed();
   }
   
   // select
@@ -555,7 +567,7 @@ bool NoteEditor::on_button_release_event(GdkEventButton* event) {
 	  key2row(iter->get_key()) < 128 &&
 	  key2row(iter->get_key()) >= minrow && 
 	  key2row(iter->get_key()) <= maxrow) {
-	m_selection.add_note(iter);
+	select_note(iter);
       }
     }
     queue_draw();
@@ -721,26 +733,46 @@ bool NoteEditor::on_expose_event(GdkEventExpose* event) {
   //  return true;
   
   RefPtr<Gdk::Window> win = get_window();
-  win->clear();
-  if (!m_pat)
+  Gdk::Rectangle area(&event->area);
+  if (!m_pat) {
+    win->clear_area(area.get_x(), area.get_y(), 
+		    area.get_width(), area.get_height());
     return true;
+  }
   
   int width = m_pat->get_length().get_beat() * m_pat->get_steps() * m_col_width;
-  int height = (m_trk->get_mode() == Track::NormalMode ? 
-		m_rows * m_row_height : 
-		m_trk->get_keys().size() * m_row_height);
-		
-		
+  int height = m_rows * m_row_height;
+  
+  // the background and grid are copied from the cached tiles, everything 
+  // else is drawn on top of them and clipped to the exposed area
+  m_background.draw(win, m_gc, area);
+  m_gc->set_clip_rectangle(area);
+  
   Pattern::NoteIterator iter;
-
-  draw_background(win, width, height);
-  draw_grid(win, width, height);
+  
   draw_selection_box(win, width, height);
-  for (iter = m_pat->notes_begin(); iter != m_pat->notes_end(); ++iter)
-    draw_note(iter, m_selection.find(iter) != m_selection.end());
+  
+  // only look at the notes in the exposed columns and rows
+  if (m_note_index_dirty) {
+    m_note_index.rebuild(*m_pat);
+    m_note_index_dirty = false;
+  }
+  int min_row = pixel2row(area.get_y() + area.get_height() - 1);
+  int max_row = pixel2row(area.get_y());
+  m_note_index.find(pixel2step(area.get_x()), 
+		    pixel2step(area.get_x() + area.get_width() - 1),
+		    m_visible_notes);
+  for (unsigned i = 0; i < m_visible_notes.size(); ++i) {
+    iter = m_visible_notes[i];
+    int row = key2row(iter->get_key());
+    if (row < min_row || row > max_row)
+      continue;
+    draw_note(iter, is_selected(iter));
+  }
+  
   if (m_drag_operation == DragChangingNoteVelocity) {
     iter = m_pat->find_note(SongTime(m_drag_step, 0), row2key(m_drag_row));
-    draw_velocity_box(iter, m_selection.find(iter) != m_selection.end());
+    draw_velocity_box(iter, is_selected(iter));
   }
   if (m_motion_operation == MotionPaste)
     draw_paste_outline(win, width, height);
@@ -755,6 +787,9 @@ bool NoteEditor::on_expose_event(GdkEventExpose* event) {
     event->area.width - 1, event->area.height - 1);
   */
   
+  // the tiles are rendered with the same GC, so don't leave it clipped
+  gdk_gc_set_clip_mask(m_gc->gobj(), 0);
+  
   return true;
 }
 
@@ -903,38 +938,136 @@ void NoteEditor::mode_changed(Track::Mode mode) {
 	m_keymap[i] = 255;
     }
   }
+  m_background.invalidate();
   queue_draw();
 }
 
 
-void NoteEditor::draw_background(RefPtr<Gdk::Window> win, 
-				 int width, int height) {
-  for (int b = 0; b < m_pat->get_length().get_beat(); ++b) {
+void NoteEditor::notes_changed() {
+  m_note_index_dirty = true;
+  m_selection_index_dirty = true;
+  
+  // the pattern keeps track of the area that changed, hand it over to the
+  // redraw scheduler so a bulk edit only causes one invalidation
+  int min_step, min_note, max_step, max_note;
+  m_pat->get_dirty_rect(&min_step, &min_note, &max_step, &max_note);
+  m_pat->reset_dirty_rect();
+  if (min_step <= max_step && min_note <= max_note)
+    m_redraw.queue(SongTime(min_step, 0), SongTime(max_step, 0), 
+		   min_note, max_note);
+  else
+    m_redraw.queue_all();
+}
+
+
+void NoteEditor::select_note(const Pattern::NoteIterator& iter) {
+  m_selection.add_note(iter);
+  selection_changed();
+}
+
+
+void NoteEditor::deselect_note(const Pattern::NoteIterator& iter) {
+  m_selection.remove_note(iter);
+  selection_changed();
+}
+
+
+void NoteEditor::clear_selection() {
+  m_selection.clear();
+  selection_changed();
+}
+
+
+void NoteEditor::selection_changed() {
+  m_selection_index_dirty = true;
+}
+
+
+void NoteEditor::update_selection_index() {
+  if (m_selection_index_dirty) {
+    m_selection_index.rebuild(m_selection);
+    m_selection_index_dirty = false;
+  }
+}
+
+
+bool NoteEditor::is_selected(const Pattern::NoteIterator& iter) {
+  if (iter == m_pat->notes_end())
+    return false;
+  update_selection_index();
+  return m_selection_index.contains(iter);
+}
+
+
+void NoteEditor::layout_changed() {
+  m_note_index_dirty = true;
+  m_background.invalidate();
+  m_redraw.queue_all();
+}
+
+
+Gdk::Rectangle NoteEditor::dirty_rect(const SongTime& from, 
+				      const SongTime& to,
+				      int min_key, int max_key) {
+  int x = step2pixel(from.get_beat());
+  int w = step2pixel(to.get_beat() + 1) - x + 1;
+  if (m_trk->get_mode() == Track::DrumMode)
+    return Gdk::Rectangle(x, 0, w, m_rows * m_row_height + 1);
+  int y = row2pixel(max_key);
+  return Gdk::Rectangle(x, y, w, row2pixel(min_key) + m_row_height - y + 1);
+}
+
+
+void NoteEditor::render_background(RefPtr<Drawable> dst, 
+				   int x, int y, int width, int height) {
+  dst->draw_rectangle(get_style()->get_bg_gc(STATE_NORMAL), true, 
+		      0, 0, width, height);
+  if (m_pat) {
+    draw_background(dst, x, y, width, height);
+    draw_grid(dst, x, y, width, height);
+  }
+}
+
+
+void NoteEditor::draw_background(RefPtr<Drawable> dst, 
+				 int x, int y, int width, int height) {
+  int beat_width = m_pat->get_steps() * m_col_width;
+  int rows_height = m_rows * m_row_height;
+  int b = x / beat_width;
+  for ( ; b < m_pat->get_length().get_beat() && 
+	  b * beat_width < x + width; ++b) {
     if (b % 2 == 0)
       m_gc->set_foreground(m_bg_color);
     else
       m_gc->set_foreground(m_bg_color2);
-    win->draw_rectangle(m_gc, true, b * m_pat->get_steps() * m_col_width, 0, 
-			m_pat->get_steps() * m_col_width, height);
+    dst->draw_rectangle(m_gc, true, b * beat_width - x, -y, 
+			beat_width, rows_height);
   }
 }
 
 
-void NoteEditor::draw_grid(Glib::RefPtr<Gdk::Window> win, 
-			   int width, int height) {
+void NoteEditor::draw_grid(RefPtr<Drawable> dst, 
+			   int x, int y, int width, int height) {
+  int steps = m_pat->get_steps() * m_pat->get_length().get_beat();
+  int rows_width = steps * m_col_width;
+  int rows_height = m_rows * m_row_height;
+  int line_end = std::min(rows_width - x, width);
   m_gc->set_foreground(m_grid_color);
-  for (int r = -1; r < m_rows; ++r) {
-    win->draw_line(m_gc, 0, (m_rows - r - 1) * m_row_height, 
-		   width, (m_rows - r - 1) * m_row_height);
+  for (int r = -1; line_end >= 0 && r < m_rows; ++r) {
+    int ry = (m_rows - r - 1) * m_row_height - y;
+    if (ry < -m_row_height || ry > height)
+      continue;
+    dst->draw_line(m_gc, 0, ry, line_end, ry);
     if (m_trk->get_mode() == Track::NormalMode &&
 	(r % 12 == 1 || r % 12 == 3 || r % 12 == 6 || 
 	 r % 12 == 8 || r % 12 == 10)) {
-      win->draw_rectangle(m_gc, true, 0, (m_rows - r - 1) * m_row_height,
-			  width, m_row_height);
+      dst->draw_rectangle(m_gc, true, 0, ry, line_end, m_row_height);
     }
   }
-  for (unsigned c = 0; c < m_pat->get_steps() * m_pat->get_length().get_beat() + 1; ++c)
-    win->draw_line(m_gc, c * m_col_width, 0, c * m_col_width, height);
+  int c = x / m_col_width;
+  for ( ; c < steps + 1 && c * m_col_width <= x + width; ++c)
+    dst->draw_line(m_gc, c * m_col_width - x, -y, 
+		   c * m_col_width - x, rows_height - y);
 }
 
 
@@ -22,12 +22,17 @@
 #define NOTEEDITOR_HPP
 
 #include <utility>
+#include <vector>
 
 #include <gtkmm.h>
 
 #include "notecollection.hpp"
+#include "noteindex.hpp"
 #include "noteselection.hpp"
 #include "pattern.hpp"
+#include "redrawscheduler.hpp"
+#include "selectionindex.hpp"
+#include "tilecache.hpp"
 #include "track.hpp"
 
 
@@ -72,8 +77,24 @@ protected:
 		    int row, bool good);
   void update();
   void mode_changed(Dino::Track::Mode mode);
-  void draw_background(Glib::RefPtr<Gdk::Window> win, int width, int height);
-  void draw_grid(Glib::RefPtr<Gdk::Window> win, int width, int height);
+  void notes_changed();
+  
+  void select_note(const Dino::Pattern::NoteIterator& iter);
+  void deselect_note(const Dino::Pattern::NoteIterator& iter);
+  void clear_selection();
+  void selection_changed();
+  void update_selection_index();
+  bool is_selected(const Dino::Pattern::NoteIterator& iter);
+  void layout_changed();
+  Gdk::Rectangle dirty_rect(const Dino::SongTime& from, 
+			    const Dino::SongTime& to, 
+			    int min_key, int max_key);
+  void render_background(Glib::RefPtr<Gdk::Drawable> dst, 
+			 int x, int y, int width, int height);
+  void draw_background(Glib::RefPtr<Gdk::Drawable> dst, 
+		       int x, int y, int width, int height);
+  void draw_grid(Glib::RefPtr<Gdk::Drawable> dst, 
+		 int x, int y, int width, int height);
   void draw_selection_box(Glib::RefPtr<Gdk::Window> win, int width, int height);
   void draw_paste_outline(Glib::RefPtr<Gdk::Window> win, int width, int height);
   void draw_move_outline(Glib::RefPtr<Gdk::Window> win, int width, int height);
@@ -162,6 +183,22 @@ private:
   sigc::connection m_key_changed_conn;
   sigc::connection m_key_moved_conn;
   
+  /** Cached tiles of the background and the grid. */
+  TileCache m_background;
+  
+  /** The notes bucketed by start step, rebuilt lazily when they change. */
+  NoteIndex m_note_index;
+  bool m_note_index_dirty;
+  std::vector<Dino::Pattern::NoteIterator> m_visible_notes;
+  
+  /** The selected notes sorted for fast lookups, rebuilt lazily when the 
+      selection or the notes change. */
+  SelectionIndex m_selection_index;
+  bool m_selection_index_dirty;
+  
+  /** Collects note changes and invalidates them once per frame. */
+  RedrawScheduler m_redraw;
+  
 };
 
 
@@ -18,9 +18,11 @@
    Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 ****************************************************************************/
 
+#include <algorithm>
 #include <iostream>
 
 #include "commandproxy.hpp"
+#include "note.hpp"
 #include "noteeditor2.hpp"
 
 
@@ -42,7 +44,11 @@ NoteEditor2::NoteEditor2(CommandProxy& proxy)
     m_note_length(1, 0),
     m_track(0),
     m_pattern(0),
-    m_proxy(proxy) {
+    m_proxy(proxy),
+    m_background(mem_fun(*this, &NoteEditor2::draw_background)),
+    m_note_index_dirty(true),
+    m_selection_index_dirty(true),
+    m_redraw(*this) {
 
   // initialise colours
   m_colormap = Colormap::get_system();
@@ -98,18 +104,21 @@ void NoteEditor2::set_pattern(const Track& track, const Pattern& pattern) {
   m_rows = (m_track->get_mode() == Track::DrumMode ? 
 	    m_track->get_keys().size() : 128);
   m_selection = NoteSelection(&pattern);
+  selection_changed();
   
   // reset connections
   m_note_added_conn.disconnect();
   m_note_removed_conn.disconnect();
   m_note_changed_conn.disconnect();
-  slot<void> draw = mem_fun(*this, &NoteEditor2::queue_draw);
+  slot<void> notes = mem_fun(*this, &NoteEditor2::notes_changed);
   m_note_added_conn = m_pattern->signal_note_added().
-    connect(sigc::hide(draw));
+    connect(sigc::hide(notes));
   m_note_removed_conn = m_pattern->signal_note_removed().
-    connect(sigc::hide(draw));
+    connect(sigc::hide(notes));
   m_note_changed_conn = m_pattern->signal_note_changed().
-    connect(sigc::hide(draw));
+    connect(sigc::hide(notes));
+  m_note_index_dirty = true;
+  m_background.invalidate();
   
   set_size_request(time2pixel(m_pattern->get_length()) + 1, 
 		   m_rows * m_row_height + 1);
@@ -121,10 +130,13 @@ void NoteEditor2::unset_pattern() {
   m_track = 0;
   m_pattern = 0;
   m_selection = NoteSelection();
+  selection_changed();
 
   m_note_added_conn.disconnect();
   m_note_removed_conn.disconnect();
   m_note_changed_conn.disconnect();
+  m_note_index.clear();
+  m_background.invalidate();
 
   set_size_request(0, 0);
   queue_draw();
@@ -240,7 +252,7 @@ void NoteEditor2::select_all() {
   
   Pattern::NoteIterator iter;
   for (iter = m_pattern->notes_begin(); iter != m_pattern->notes_end(); ++iter)
-    m_selection.add_note(iter);
+    select_note(iter);
   
   queue_draw();
 }
@@ -344,32 +356,49 @@ bool NoteEditor2::on_motion_notify_event(GdkEventMotion* event) {
 bool NoteEditor2::on_expose_event(GdkEventExpose* event) {
   
   RefPtr<Gdk::Window> win = get_window();
-  win->clear();
-  if (!m_pattern)
+  Gdk::Rectangle area(&event->area);
+  if (!m_pattern) {
+    win->clear_area(area.get_x(), area.get_y(), 
+		    area.get_width(), area.get_height());
     return true;
+  }
   
-  draw_background(win);
+  // the background is copied from the cached tiles, everything else is 
+  // drawn on top of it and clipped to the exposed area
+  m_background.draw(win, m_gc, area);
+  m_gc->set_clip_rectangle(area);
   
-  // draw notes
-  Pattern::NoteIterator iter;
-  NoteSelection::Iterator s_iter = m_selection.begin();
-  for (iter = m_pattern->notes_begin(); 
-       iter != m_pattern->notes_end(); ++iter) {
-    bool selected = false;
-    if (&*iter == &*s_iter) {
-      selected = true;
-      ++s_iter;
-    }
-    draw_note(win, iter, selected);
+  // draw the notes in the exposed beats and keys
+  if (m_note_index_dirty) {
+    m_note_index.rebuild(*m_pattern);
+    m_note_index_dirty = false;
+  }
+  int min_key = pixel2key(area.get_y() + area.get_height() - 1);
+  int max_key = pixel2key(area.get_y());
+  m_note_index.find(pixel2time(area.get_x()).get_beat(),
+		    pixel2time(area.get_x() + area.get_width()).get_beat(),
+		    m_visible_notes);
+  for (unsigned i = 0; i < m_visible_notes.size(); ++i) {
+    const Pattern::NoteIterator& iter = m_visible_notes[i];
+    if (iter->get_key() < min_key || iter->get_key() > max_key)
+      continue;
+    draw_note(win, iter, is_selected(iter));
   }
   
   // draw resizing outlines
   if (m_drag_operation == DragResizeNotes) {
     if (m_drag_time > m_drag_start_time) {
       SongTime length = m_drag_time - m_drag_start_time;
-      NoteSelection::Iterator iter;
-      for (iter = m_selection.begin(); iter != m_selection.end(); ++iter)
-	draw_outline(win, iter->get_time(), iter->get_key(), length, true);
+      update_selection_index();
+      m_selection_index.find(pixel2time(area.get_x()).get_beat() - 
+			     length.get_beat() - 1,
+			     pixel2time(area.get_x() + 
+					area.get_width()).get_beat(),
+			     m_visible_selection);
+      for (unsigned i = 0; i < m_visible_selection.size(); ++i) {
+	const Note* note = m_visible_selection[i];
+	draw_outline(win, note->get_time(), note->get_key(), length, true);
+      }
     }
   }
   
@@ -401,6 +430,9 @@ bool NoteEditor2::on_expose_event(GdkEventExpose* event) {
     }
   }
   
+  // the tiles are rendered with the same GC, so don't leave it clipped
+  gdk_gc_set_clip_mask(m_gc->gobj(), 0);
+  
   return true;
 }
 
@@ -437,38 +469,94 @@ void NoteEditor2::check_paste(const SongTime& time, unsigned char key) {
 }
 
 
-void NoteEditor2::draw_background(Glib::RefPtr<Gdk::Window>& win) {
-
-  // draw the background and the vertical grid
-  bool bg = true;
+void NoteEditor2::draw_background(RefPtr<Drawable> dst, 
+				  int x, int y, int width, int height) {
+  
+  dst->draw_rectangle(get_style()->get_bg_gc(STATE_NORMAL), true, 
+		      0, 0, width, height);
+  if (!m_pattern)
+    return;
+  
+  // draw the background and the vertical grid for the beats in this tile
   int beat_width = time2pixel(SongTime(1, 0));
+  int rows_height = m_rows * m_row_height;
   SongTime::Beat b;
-  for (b = 0; b < m_pattern->get_length().get_beat(); ++b) {
-    int x = time2pixel(SongTime(b, 0));
-    m_gc->set_foreground( bg ? m_bg_color : m_bg_color2);
-    bg = !bg;
-    win->draw_rectangle(m_gc, true, x, 0, beat_width, m_rows * m_row_height);
+  for (b = pixel2time(x).get_beat(); 
+       b < m_pattern->get_length().get_beat(); ++b) {
+    int bx = time2pixel(SongTime(b, 0)) - x;
+    if (bx > width)
+      break;
+    m_gc->set_foreground(b % 2 == 0 ? m_bg_color : m_bg_color2);
+    dst->draw_rectangle(m_gc, true, bx, -y, beat_width, rows_height);
     m_gc->set_foreground(m_grid_color);
-    win->draw_line(m_gc, x, 0, x, m_rows * m_row_height);
+    dst->draw_line(m_gc, bx, -y, bx, rows_height - y);
   }
   SongTime::Tick t = m_pattern->get_length().get_tick();
-  if (t > 0) {
-    m_gc->set_foreground( bg ? m_bg_color : m_bg_color2);
-    win->draw_rectangle(m_gc, true, time2pixel(SongTime(b, 0)),
-			0, time2pixel(SongTime(0, t)), m_rows * m_row_height);
+  if (t > 0 && b == m_pattern->get_length().get_beat()) {
+    m_gc->set_foreground(b % 2 == 0 ? m_bg_color : m_bg_color2);
+    dst->draw_rectangle(m_gc, true, time2pixel(SongTime(b, 0)) - x,
+			-y, time2pixel(SongTime(0, t)), rows_height);
   }
-  int x = time2pixel(m_pattern->get_length());
+  int end = time2pixel(m_pattern->get_length()) - x;
   m_gc->set_foreground(m_grid_color);
-  win->draw_line(m_gc, x, 0, x, m_rows * m_row_height);
+  dst->draw_line(m_gc, end, -y, end, rows_height - y);
   
   // draw the horizontal grid
-  for (int i = 0; i < m_rows + 1; ++i) {
-    int y = i * m_row_height;
-    win->draw_line(m_gc, 0, y, x, y);
+  int line_end = std::min(end, width);
+  for (int i = 0; line_end >= 0 && i < m_rows + 1; ++i) {
+    int ry = i * m_row_height - y;
+    if (ry >= 0 && ry <= height)
+      dst->draw_line(m_gc, 0, ry, line_end, ry);
   }
 }
 
 
+void NoteEditor2::notes_changed() {
+  m_note_index_dirty = true;
+  m_selection_index_dirty = true;
+  m_redraw.queue_all();
+}
+
+
+void NoteEditor2::select_note(const Pattern::NoteIterator& iter) {
+  m_selection.add_note(iter);
+  selection_changed();
+}
+
+
+void NoteEditor2::deselect_note(const Pattern::NoteIterator& iter) {
+  m_selection.remove_note(iter);
+  selection_changed();
+}
+
+
+void NoteEditor2::clear_selection() {
+  m_selection.clear();
+  selection_changed();
+}
+
+
+void NoteEditor2::selection_changed() {
+  m_selection_index_dirty = true;
+}
+
+
+void NoteEditor2::update_selection_index() {
+  if (m_selection_index_dirty) {
+    m_selection_index.rebuild(m_selection);
+    m_selection_index_dirty = false;
+  }
+}
+
+
+bool NoteEditor2::is_selected(const Pattern::NoteIterator& iter) {
+  if (iter == m_pattern->notes_end())
+    return false;
+  update_selection_index();
+  return m_selection_index.contains(iter);
+}
+
+
 void NoteEditor2::draw_note(Glib::RefPtr<Gdk::Window>& win, 
 			    const Pattern::NoteIterator& iter, bool selected) {
 
@@ -531,7 +619,7 @@ void NoteEditor2::end_drag(const SongTime& time, unsigned char key) {
       const SongTime& t = iter->get_time();
       const SongTime& l = iter->get_length();
       if (k >= key_a && k <= key_b && t < time_b && t + l > time_a)
-	m_selection.add_note(iter);
+	select_note(iter);
     }
   }
   
@@ -550,6 +638,7 @@ void NoteEditor2::finish_paste(const SongTime& time, unsigned char key) {
     m_proxy.add_notes(m_track->get_id(), m_pattern->get_id(),
 		      m_clipboard, t + m_paste_offset_time, 
 		      int(key) - m_paste_offset_key, &m_selection);
+    selection_changed();
     m_motion_operation = MotionNoOperation;
     queue_draw();
   }
@@ -584,7 +673,7 @@ SongTime NoteEditor2::snap(const SongTime& time) {
 
 
 void NoteEditor2::start_adding_note(const SongTime& time, unsigned char key) {
-  m_selection.clear();
+  clear_selection();
   
   SongTime t = snap(time);
   
@@ -616,7 +705,7 @@ void NoteEditor2::start_adding_note(const SongTime& time, unsigned char key) {
 		       t, key, 64, length)) {
     m_note_length = length;
     Pattern::NoteIterator iter = m_pattern->find_note(t, key);
-    m_selection.add_note(iter);
+    select_note(iter);
     m_drag_operation = DragResizeNotes;
     m_drag_start_time = t;
     m_drag_start_key = key;
@@ -636,7 +725,7 @@ void NoteEditor2::start_removing_notes(const Dino::SongTime& time,
     return;
   
   // if the note is selected, remove the entire selection
-  if (m_selection.find(iter) != m_selection.end()) {
+  if (is_selected(iter)) {
     NoteSelection::Iterator s_iter;
     m_proxy.start_atomic("Remove notes");
     for (s_iter = m_selection.begin(); s_iter != m_selection.end(); ++s_iter) {
@@ -657,15 +746,15 @@ void NoteEditor2::start_removing_notes(const Dino::SongTime& time,
 void NoteEditor2::start_selecting(const SongTime& time, unsigned char key,
 				  bool clear) {
   if (clear)
-    m_selection.clear();
+    clear_selection();
   
   // if the click is inside a note, just add or remove that note
   Pattern::NoteIterator iter = m_pattern->find_note(time, key);
   if (iter != m_pattern->notes_end()) {
-    if (m_selection.find(iter) != m_selection.end())
-      m_selection.remove_note(iter);
+    if (is_selected(iter))
+      deselect_note(iter);
     else
-      m_selection.add_note(iter);
+      select_note(iter);
     queue_draw();
     return;
   }
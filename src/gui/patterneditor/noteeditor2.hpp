@@ -22,12 +22,17 @@
 #define NOTEEDITOR2_HPP
 
 #include <utility>
+#include <vector>
 
 #include <gtkmm.h>
 
 #include "notecollection.hpp"
+#include "noteindex.hpp"
 #include "noteselection.hpp"
 #include "pattern.hpp"
+#include "redrawscheduler.hpp"
+#include "selectionindex.hpp"
+#include "tilecache.hpp"
 #include "track.hpp"
 
 
@@ -85,7 +90,8 @@ private:
   
   
   void check_paste(const Dino::SongTime& time, unsigned char key);
-  void draw_background(Glib::RefPtr<Gdk::Window>& win);
+  void draw_background(Glib::RefPtr<Gdk::Drawable> dst, 
+		       int x, int y, int width, int height);
   void draw_note(Glib::RefPtr<Gdk::Window>& win, 
 		 const Dino::Pattern::NoteIterator& iter, bool selected);
   void draw_outline(Glib::RefPtr<Gdk::Window>& win,
@@ -102,6 +108,14 @@ private:
   void start_selecting(const Dino::SongTime& time, unsigned char key, 
 		       bool clear);
   int time2pixel(const Dino::SongTime& time);
+  void notes_changed();
+  
+  void select_note(const Dino::Pattern::NoteIterator& iter);
+  void deselect_note(const Dino::Pattern::NoteIterator& iter);
+  void clear_selection();
+  void selection_changed();
+  void update_selection_index();
+  bool is_selected(const Dino::Pattern::NoteIterator& iter);
   
   Dino::NoteSelection& get_selection() {
     return m_selection;
@@ -157,6 +171,22 @@ private:
   sigc::connection m_key_changed_conn;
   sigc::connection m_key_moved_conn;
   
+  /** Cached tiles of the background and the grid. */
+  TileCache m_background;
+  
+  /** The notes bucketed by start beat, rebuilt lazily when they change. */
+  NoteIndex m_note_index;
+  bool m_note_index_dirty;
+  std::vector<Dino::Pattern::NoteIterator> m_visible_notes;
+  
+  /** The selected notes sorted for fast lookups, rebuilt lazily when the 
+      selection or the notes change. */
+  SelectionIndex m_selection_index;
+  bool m_selection_index_dirty;
+  std::vector<const Dino::Note*> m_visible_selection;
+  
+  RedrawScheduler m_redraw;
+  
 };
 
 
@@ -0,0 +1,73 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#include "note.hpp"
+#include "noteindex.hpp"
+#include "notespan.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+NoteIndex::NoteIndex()
+  : m_max_span(1) {
+
+}
+
+
+void NoteIndex::rebuild(const Pattern& pattern) {
+  clear();
+  m_buckets.resize(pattern.get_length().get_beat() + 1);
+  Pattern::NoteIterator iter;
+  for (iter = pattern.notes_begin(); iter != pattern.notes_end(); ++iter) {
+    SongTime::Beat b = iter->get_time().get_beat();
+    if (b < 0)
+      b = 0;
+    if (b >= SongTime::Beat(m_buckets.size()))
+      b = m_buckets.size() - 1;
+    m_buckets[b].push_back(iter);
+    SongTime::Beat span = note_span(*iter, b);
+    if (span > m_max_span)
+      m_max_span = span;
+  }
+}
+
+
+void NoteIndex::clear() {
+  m_buckets.clear();
+  m_max_span = 1;
+}
+
+
+void NoteIndex::find(SongTime::Beat first, SongTime::Beat last,
+		     vector<Pattern::NoteIterator>& result) const {
+  result.clear();
+  SongTime::Beat b = first_overlapping_beat(first, m_max_span);
+  if (last >= SongTime::Beat(m_buckets.size()))
+    last = m_buckets.size() - 1;
+  for ( ; b <= last; ++b) {
+    vector<Pattern::NoteIterator>::const_iterator iter;
+    for (iter = m_buckets[b].begin(); iter != m_buckets[b].end(); ++iter) {
+      if (note_reaches(**iter, first))
+	result.push_back(*iter);
+    }
+  }
+}
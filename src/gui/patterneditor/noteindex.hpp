@@ -0,0 +1,61 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#ifndef NOTEINDEX_HPP
+#define NOTEINDEX_HPP
+
+#include <vector>
+
+#include "pattern.hpp"
+#include "songtime.hpp"
+
+
+/** An index of the notes in a Pattern, bucketed by the beat they start on.
+    The note editors use it to find the notes inside an exposed rectangle
+    without looping over the whole pattern. It has to be rebuilt when the
+    notes change, which is much less often than they are drawn. */
+class NoteIndex {
+public:
+  
+  NoteIndex();
+  
+  /** Index all the notes in @c pattern. */
+  void rebuild(const Dino::Pattern& pattern);
+  
+  /** Remove all notes from the index. */
+  void clear();
+  
+  /** Replace the contents of @c result with all notes that overlap the 
+      beats from @c first to @c last, inclusive. The notes are in the same
+      order as in the pattern. */
+  void find(Dino::SongTime::Beat first, Dino::SongTime::Beat last,
+	    std::vector<Dino::Pattern::NoteIterator>& result) const;
+  
+private:
+  
+  std::vector<std::vector<Dino::Pattern::NoteIterator> > m_buckets;
+  
+  /** The largest number of buckets a single note spans. */
+  Dino::SongTime::Beat m_max_span;
+  
+};
+
+
+#endif
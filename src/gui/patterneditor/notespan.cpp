@@ -0,0 +1,45 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#include "note.hpp"
+#include "notespan.hpp"
+
+
+using namespace Dino;
+
+
+SongTime::Beat note_span(const Note& note, SongTime::Beat start) {
+  SongTime end = note.get_time() + note.get_length();
+  return end.get_beat() - start + (end.get_tick() > 0 ? 1 : 0);
+}
+
+
+SongTime::Beat first_overlapping_beat(SongTime::Beat first, 
+				      SongTime::Beat max_span) {
+  // a note that starts up to max_span - 1 beats before the range may 
+  // still reach into it
+  SongTime::Beat b = first - max_span + 1;
+  return b < 0 ? 0 : b;
+}
+
+
+bool note_reaches(const Note& note, SongTime::Beat first) {
+  return (note.get_time() + note.get_length()).get_beat() >= first;
+}
@@ -0,0 +1,47 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#ifndef NOTESPAN_HPP
+#define NOTESPAN_HPP
+
+#include "songtime.hpp"
+
+
+namespace Dino {
+  class Note;
+}
+
+
+/** Return the number of beats that @c note reaches into, counting from the
+    beat @c start. */
+Dino::SongTime::Beat note_span(const Dino::Note& note, 
+			       Dino::SongTime::Beat start);
+
+/** Return the first beat that can hold the start of a note overlapping the
+    beat @c first, if no note spans more than @c max_span beats. Never 
+    returns anything less than 0. */
+Dino::SongTime::Beat first_overlapping_beat(Dino::SongTime::Beat first,
+					    Dino::SongTime::Beat max_span);
+
+/** Return @c true if @c note ends in or after the beat @c first. */
+bool note_reaches(const Dino::Note& note, Dino::SongTime::Beat first);
+
+
+#endif
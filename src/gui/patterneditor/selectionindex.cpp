@@ -0,0 +1,96 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#include <algorithm>
+
+#include "note.hpp"
+#include "notespan.hpp"
+#include "selectionindex.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+namespace {
+  
+  bool earlier(const Note* a, const Note* b) {
+    return a->get_time() < b->get_time();
+  }
+  
+  bool starts_before(const Note* note, SongTime::Beat beat) {
+    return note->get_time().get_beat() < beat;
+  }
+  
+}
+
+
+SelectionIndex::SelectionIndex()
+  : m_max_span(1) {
+
+}
+
+
+void SelectionIndex::rebuild(const NoteSelection& selection) {
+  clear();
+  NoteSelection::Iterator iter;
+  for (iter = selection.begin(); iter != selection.end(); ++iter) {
+    const Note* note = &*iter;
+    m_by_address.push_back(note);
+    SongTime::Beat span = note_span(*note, note->get_time().get_beat());
+    if (span > m_max_span)
+      m_max_span = span;
+  }
+  m_by_time = m_by_address;
+  sort(m_by_address.begin(), m_by_address.end());
+  stable_sort(m_by_time.begin(), m_by_time.end(), earlier);
+}
+
+
+void SelectionIndex::clear() {
+  m_by_address.clear();
+  m_by_time.clear();
+  m_max_span = 1;
+}
+
+
+bool SelectionIndex::contains(const Pattern::NoteIterator& iter) const {
+  return binary_search(m_by_address.begin(), m_by_address.end(), &*iter);
+}
+
+
+void SelectionIndex::find(SongTime::Beat first, SongTime::Beat last,
+			  vector<const Note*>& result) const {
+  result.clear();
+  SongTime::Beat b = first_overlapping_beat(first, m_max_span);
+  vector<const Note*>::const_iterator iter = 
+    lower_bound(m_by_time.begin(), m_by_time.end(), b, starts_before);
+  for ( ; iter != m_by_time.end(); ++iter) {
+    if ((*iter)->get_time().get_beat() > last)
+      break;
+    if (note_reaches(**iter, first))
+      result.push_back(*iter);
+  }
+}
+
+
+size_t SelectionIndex::size() const {
+  return m_by_address.size();
+}
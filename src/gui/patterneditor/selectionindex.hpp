@@ -0,0 +1,77 @@
+/****************************************************************************
+   Dino - A simple pattern based MIDI sequencer
+   
+   Copyright (C) 2006  Lars Luthman <lars.luthman@gmail.com>
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software Foundation, 
+   Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+****************************************************************************/
+
+#ifndef SELECTIONINDEX_HPP
+#define SELECTIONINDEX_HPP
+
+#include <vector>
+
+#include "noteselection.hpp"
+#include "pattern.hpp"
+#include "songtime.hpp"
+
+
+namespace Dino {
+  class Note;
+}
+
+
+/** A sorted snapshot of a NoteSelection. The note editors ask whether a 
+    note is selected once for every note they draw, and walking the 
+    selection for every one of them gets slow when thousands of notes are 
+    selected. This keeps the selected notes in two flat sorted vectors, one 
+    by address for membership tests and one by start time for finding the 
+    selected notes in a range of beats. It has to be rebuilt when the 
+    selection changes. */
+class SelectionIndex {
+public:
+  
+  SelectionIndex();
+  
+  /** Index all the notes in @c selection. */
+  void rebuild(const Dino::NoteSelection& selection);
+  
+  /** Remove all notes from the index. */
+  void clear();
+  
+  /** Return @c true if the note that @c iter points to is in the index. */
+  bool contains(const Dino::Pattern::NoteIterator& iter) const;
+  
+  /** Replace the contents of @c result with all indexed notes that overlap 
+      the beats from @c first to @c last, inclusive, sorted by start 
+      time. */
+  void find(Dino::SongTime::Beat first, Dino::SongTime::Beat last,
+	    std::vector<const Dino::Note*>& result) const;
+  
+  /** Return the number of indexed notes. */
+  size_t size() const;
+  
+private:
+  
+  std::vector<const Dino::Note*> m_by_address;
+  std::vector<const Dino::Note*> m_by_time;
+  
+  /** The largest number of beats a single selected note spans. */
+  Dino::SongTime::Beat m_max_span;
+  
+};
+
+
+#endif
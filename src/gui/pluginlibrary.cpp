@@ -18,7 +18,17 @@
    Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 ****************************************************************************/
 
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+
 #include <dlfcn.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+#include <glibmm.h>
 
 #include "debug.hpp"
 #include "plugininterface.hpp"
@@ -30,10 +40,21 @@ using namespace std;
 using namespace Dino;
 
 
+namespace {
+  
+  /** The first line of the manifest cache. Change the version number if
+      the format changes. */
+  const string cache_magic = "dino-plugin-cache 2";
+  
+}
+
+
 PluginLibrary::PluginInfo::PluginInfo(const std::string& _name, 
-                                      const std::string& _filename)
+                                      const std::string& _filename,
+				      bool _unloadable)
   : name(_name),
     filename(_filename),
+    unloadable(_unloadable),
     module(0),
     loaded(false) {
   
@@ -42,45 +63,179 @@ PluginLibrary::PluginInfo::PluginInfo(const std::string& _name,
 
 PluginLibrary::PluginLibrary(PluginInterface& plif) 
   : m_plif(plif) {
+  refresh_list();
+}
+
+
+PluginLibrary::~PluginLibrary() {
+  for (iterator iter = begin(); iter != end(); ++iter)
+    unload_plugin(iter);
+}
+
+
+void PluginLibrary::refresh_list() {
+  
+  Cache old_cache;
+  read_cache(old_cache);
+  Cache new_cache;
+  std::set<string> seen;
+  unsigned probed = 0;
   
   try {
     Dir plugin_dir(PLUGIN_DIR);
     Dir::const_iterator iter;
     for (iter = plugin_dir.begin(); iter != plugin_dir.end(); ++iter) {
       string filename = string(PLUGIN_DIR) + "/" + *iter;
-      void* mod = dlopen(filename.c_str(), RTLD_LAZY | RTLD_GLOBAL);
-      if (mod) {
-        void* plug;
-        if ((plug = dlsym(mod, "dino_get_name"))) {
-          string name = (*illegal_cast<PluginNameFunc>(plug))();
-          m_plugins[name] = PluginInfo(name, *iter);
-        }
-        else {
-          dbg(0, cc+ "Shared module \"" + (*iter) + 
-              "\" has no dino_plugin() callback");
-        }
-        dlclose(mod);
+      struct stat st;
+      if (stat(filename.c_str(), &st) || !S_ISREG(st.st_mode))
+	continue;
+      
+      CacheEntry entry;
+      Cache::const_iterator citer = old_cache.find(*iter);
+      if (citer != old_cache.end() && citer->second.inode == st.st_ino &&
+	  citer->second.mtime == st.st_mtim.tv_sec &&
+	  citer->second.mtime_nsec == st.st_mtim.tv_nsec &&
+	  citer->second.size == st.st_size)
+	entry = citer->second;
+      else {
+	entry.inode = st.st_ino;
+	entry.mtime = st.st_mtim.tv_sec;
+	entry.mtime_nsec = st.st_mtim.tv_nsec;
+	entry.size = st.st_size;
+	entry.unloadable = false;
+	++probed;
+	if (!probe_plugin(filename, entry))
+	  continue;
+      }
+      new_cache[*iter] = entry;
+      
+      if (entry.name.empty())
+	continue;
+      seen.insert(entry.name);
+      iterator piter = m_plugins.find(entry.name);
+      if (piter == m_plugins.end())
+	m_plugins[entry.name] = PluginInfo(entry.name, *iter, entry.unloadable);
+      else if (!piter->second.loaded) {
+	piter->second.filename = *iter;
+	piter->second.unloadable = entry.unloadable;
       }
-      else
-        dbg(0, cc+ "Could not load module \"" + (*iter) + 
-	    "\": " + dlerror());
     }
   }
   catch (...) {
     dbg(0, "Could not open plugin directory");
-    m_plugins.clear();
   }
+  
+  // forget plugins that have disappeared, unless they are in use
+  for (iterator iter = m_plugins.begin(); iter != m_plugins.end(); ) {
+    if (!iter->second.loaded && seen.find(iter->first) == seen.end())
+      m_plugins.erase(iter++);
+    else
+      ++iter;
+  }
+  
+  if (probed > 0 || new_cache.size() != old_cache.size())
+    write_cache(new_cache);
+  dbg(1, cc+ "Found " + m_plugins.size() + " plugins, opened " + probed +
+      " files to read their names");
 }
 
 
-PluginLibrary::~PluginLibrary() {
-  for (iterator iter = begin(); iter != end(); ++iter)
-    unload_plugin(iter);
+bool PluginLibrary::probe_plugin(const std::string& filename, 
+				 CacheEntry& entry) {
+  // RTLD_LOCAL so that nothing in the probed module can affect symbol
+  // lookups for modules that are actually loaded later
+  void* mod = dlopen(filename.c_str(), RTLD_LAZY | RTLD_LOCAL);
+  if (!mod) {
+    // this may be a missing library that gets installed later, so don't
+    // remember it
+    dbg(0, cc+ "Could not load module \"" + filename + "\": " + dlerror());
+    return false;
+  }
+  void* plug;
+  if ((plug = dlsym(mod, "dino_get_name"))) {
+    entry.name = (*illegal_cast<PluginNameFunc>(plug))();
+    entry.unloadable = dlsym(mod, "dino_unload_plugin") != 0;
+  }
+  else {
+    dbg(0, cc+ "Shared module \"" + filename + 
+	"\" has no dino_get_name() callback");
+  }
+  dlclose(mod);
+  return true;
 }
 
 
-void PluginLibrary::refresh_list() {
+std::string PluginLibrary::cache_file() const {
+  return build_filename(get_user_cache_dir(), "dino", "plugins.cache");
+}
+
+
+void PluginLibrary::read_cache(Cache& cache) const {
+  ifstream ifs(cache_file().c_str());
+  string line;
+  
+  // the cache is only valid for the plugin directory it was written for
+  if (!getline(ifs, line) || line != cache_magic ||
+      !getline(ifs, line) || line != PLUGIN_DIR)
+    return;
+  
+  // inode, mtime, mtime nanoseconds, size and unloadable, then filename 
+  // and name separated by tabs
+  while (getline(ifs, line)) {
+    istringstream iss(line);
+    CacheEntry entry;
+    string filename;
+    unsigned long long inode;
+    long long mtime, size;
+    long mtime_nsec;
+    if (!(iss >> inode >> mtime >> mtime_nsec >> size >> entry.unloadable) ||
+	iss.get() != '\t' || !getline(iss, filename, '\t') || filename.empty())
+      continue;
+    getline(iss, entry.name);
+    entry.inode = inode;
+    entry.mtime = mtime;
+    entry.mtime_nsec = mtime_nsec;
+    entry.size = size;
+    cache[filename] = entry;
+  }
+}
+
 
+void PluginLibrary::write_cache(const Cache& cache) const {
+  string filename = cache_file();
+  string dir = path_get_dirname(filename);
+  if (g_mkdir_with_parents(dir.c_str(), 0755)) {
+    dbg(0, cc+ "Could not create the directory " + dir);
+    return;
+  }
+  
+  // write to a temporary file and rename it so a crash or a second Dino
+  // instance never leaves a half-written cache behind
+  string tmp = filename + ".tmp";
+  {
+    ofstream ofs(tmp.c_str());
+    ofs<<cache_magic<<'\n'<<PLUGIN_DIR<<'\n';
+    Cache::const_iterator iter;
+    for (iter = cache.begin(); iter != cache.end(); ++iter) {
+      if (iter->first.find_first_of("\t\n") != string::npos ||
+	  iter->second.name.find('\n') != string::npos)
+	continue;
+      ofs<<(unsigned long long)iter->second.inode<<' '
+	 <<(long long)iter->second.mtime<<' '<<iter->second.mtime_nsec<<' '
+	 <<(long long)iter->second.size<<' '<<iter->second.unloadable<<'\t'
+	 <<iter->first<<'\t'<<iter->second.name<<'\n';
+    }
+    if (!ofs) {
+      dbg(0, cc+ "Could not write the plugin cache " + tmp);
+      ofs.close();
+      g_unlink(tmp.c_str());
+      return;
+    }
+  }
+  if (g_rename(tmp.c_str(), filename.c_str())) {
+    dbg(0, cc+ "Could not write the plugin cache " + filename);
+    g_unlink(tmp.c_str());
+  }
 }
 
   
@@ -120,8 +275,11 @@ void PluginLibrary::load_plugin(iterator& iter) {
 void PluginLibrary::unload_plugin(iterator& iter) {
   if (iter->second.loaded) {
     dbg(1, cc+ "Unloading plugin \"" + iter->second.name + "\"");
-    void* plug;
-    if (!(plug = dlsym(iter->second.module, "dino_unload_plugin"))) {
+    // the probe already knows if there is an unload function
+    void* plug = 0;
+    if (iter->second.unloadable)
+      plug = dlsym(iter->second.module, "dino_unload_plugin");
+    if (!plug) {
       dbg(0, cc+ "Could not unload plugin \"" + iter->second.name +
           "\" - it has no unload function!");
       m_plif.set_status(string("Could not unload ") + iter->second.name + "!");
@@ -25,6 +25,8 @@
 #include <map>
 #include <string>
 
+#include <sys/types.h>
+
 
 class PluginInterface;
 class Plugin;
@@ -36,9 +38,12 @@ public:
   class PluginInfo {
   public:
     PluginInfo(const std::string& _name = "", 
-	       const std::string& _filename = "");
+	       const std::string& _filename = "",
+	       bool _unloadable = true);
     std::string name;
     std::string filename;
+    /** False if the plugin has no dino_unload_plugin() function. */
+    bool unloadable;
   private:
     friend class PluginLibrary;
     void* module;
@@ -51,6 +56,10 @@ public:
   PluginLibrary(PluginInterface& plif);
   ~PluginLibrary();
 
+  /** Rescan the plugin directory. Files that are unchanged since the last
+      scan (same inode, mtime in nanoseconds and size) are looked up in the
+      manifest cache, only new or modified files are opened to read their
+      names. Loaded plugins are always kept in the list. */
   void refresh_list();
   
   bool is_loaded(const_iterator& iter) const;
@@ -72,6 +81,29 @@ public:
   
 protected:
   
+  /** What the manifest cache knows about a file in the plugin directory.
+      Files that aren't Dino plugins are cached with an empty name so they
+      aren't opened again either. */
+  struct CacheEntry {
+    ino_t inode;
+    time_t mtime;
+    long mtime_nsec;
+    off_t size;
+    std::string name;
+    bool unloadable;
+  };
+  
+  typedef std::map<std::string, CacheEntry> Cache;
+  
+  /** Open a plugin file and read its name and capabilities. */
+  bool probe_plugin(const std::string& filename, CacheEntry& entry);
+  
+  /** The name of the manifest cache file. */
+  std::string cache_file() const;
+  
+  void read_cache(Cache& cache) const;
+  void write_cache(const Cache& cache) const;
+  
   /** Never use this unless you really know what you are doing! */
   template <class T, class S> T illegal_cast(S arg) {
     union {
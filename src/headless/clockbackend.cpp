@@ -0,0 +1,31 @@
+/*****************************************************************************
+    dino-headless - a JACK-free driver for the libdinoseq sequencer
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "clockbackend.hpp"
+
+
+namespace Dino {
+  
+  
+  ClockBackend::~ClockBackend() {}
+  
+  
+  void ClockBackend::print_statistics(std::ostream&) const {}
+  
+  
+}
@@ -0,0 +1,72 @@
+/*****************************************************************************
+    dino-headless - a JACK-free driver for the libdinoseq sequencer
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef CLOCKBACKEND_HPP
+#define CLOCKBACKEND_HPP
+
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+#include <stdint.h>
+
+
+namespace Dino {
+  
+  
+  /** An abstract base class for the clock sources that drive the sequencer
+      in dino-headless. A clock backend owns a thread (a realtime thread if
+      possible) and calls a callback once per period with the number of
+      frames in that period. */
+  class ClockBackend {
+  public:
+    
+    /** The type of the period callback. It is called in the clock thread
+	and must be realtime safe. */
+    typedef std::function<void(uint32_t)> Callback;
+    
+    /** A virtual destructor is needed to delete safely. */
+    virtual ~ClockBackend();
+    
+    /** Start calling @c callback once per period. 
+	@throw std::runtime_error if the clock thread can't be started */
+    virtual void start(Callback const& callback) 
+      throw(std::runtime_error) = 0;
+    
+    /** Stop the clock thread and wait for it to finish. After this returns
+	the callback will not be called again. */
+    virtual void stop() throw() = 0;
+    
+    /** Return the sample rate in frames per second. */
+    virtual uint32_t get_sample_rate() const throw() = 0;
+    
+    /** Return the nominal number of frames per period. */
+    virtual uint32_t get_period_size() const throw() = 0;
+    
+    /** Print backend specific statistics, for example wakeup jitter. This
+	may only be called when the clock is stopped. The default 
+	implementation prints nothing. */
+    virtual void print_statistics(std::ostream& os) const;
+    
+  };
+  
+  
+}
+
+
+#endif
@@ -0,0 +1,178 @@
+/*****************************************************************************
+    dino-headless - a JACK-free driver for the libdinoseq sequencer
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <limits>
+
+#include "dummyclock.hpp"
+
+
+namespace Dino {
+  
+  
+  using std::endl;
+  using std::invalid_argument;
+  using std::numeric_limits;
+  using std::ostream;
+  using std::runtime_error;
+  
+  
+  namespace {
+    
+    int64_t const nsec_per_sec = 1000000000;
+    
+    int64_t to_ns(timespec const& ts) {
+      return int64_t(ts.tv_sec) * nsec_per_sec + ts.tv_nsec;
+    }
+    
+    timespec from_ns(int64_t ns) {
+      timespec ts;
+      ts.tv_sec = ns / nsec_per_sec;
+      ts.tv_nsec = ns % nsec_per_sec;
+      return ts;
+    }
+    
+  }
+  
+  
+  DummyClock::DummyClock(uint32_t sample_rate, uint32_t period_size,
+			 int priority) throw(invalid_argument)
+    : m_sample_rate(sample_rate),
+      m_period_size(period_size),
+      m_priority(priority),
+      m_running(false),
+      m_realtime(false),
+      m_quit(0),
+      m_periods(0),
+      m_min_latency(0),
+      m_max_latency(0),
+      m_total_latency(0) {
+    if (sample_rate == 0 || period_size == 0)
+      throw invalid_argument("Invalid sample rate or period size");
+  }
+  
+  
+  DummyClock::~DummyClock() throw() {
+    stop();
+  }
+  
+  
+  void DummyClock::start(Callback const& callback) throw(runtime_error) {
+    if (m_running)
+      throw runtime_error("The clock is already running");
+    m_callback = callback;
+    m_quit.set(0);
+    m_periods = 0;
+    m_min_latency = numeric_limits<int64_t>::max();
+    m_max_latency = 0;
+    m_total_latency = 0;
+    
+    // try to get a SCHED_FIFO thread first, then fall back to a normal one
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = m_priority;
+    pthread_attr_setschedparam(&attr, &param);
+    m_realtime = true;
+    int err = pthread_create(&m_thread, &attr, &DummyClock::thread_main, this);
+    pthread_attr_destroy(&attr);
+    if (err == EPERM || err == EINVAL) {
+      m_realtime = false;
+      err = pthread_create(&m_thread, 0, &DummyClock::thread_main, this);
+    }
+    if (err != 0)
+      throw runtime_error("Could not start the clock thread");
+    m_running = true;
+  }
+  
+  
+  void DummyClock::stop() throw() {
+    if (!m_running)
+      return;
+    m_quit.set(1);
+    pthread_join(m_thread, 0);
+    m_running = false;
+  }
+  
+  
+  uint32_t DummyClock::get_sample_rate() const throw() {
+    return m_sample_rate;
+  }
+  
+  
+  uint32_t DummyClock::get_period_size() const throw() {
+    return m_period_size;
+  }
+  
+  
+  void DummyClock::print_statistics(ostream& os) const {
+    os<<"Clock:            dummy, "<<(m_realtime ? "SCHED_FIFO" : "SCHED_OTHER")
+      <<endl
+      <<"Periods:          "<<m_periods<<endl;
+    if (m_periods > 0) {
+      os<<"Wakeup latency:   min "<<m_min_latency / 1000.0<<" us, mean "
+	<<m_total_latency / 1000.0 / m_periods<<" us, max "
+	<<m_max_latency / 1000.0<<" us"<<endl;
+    }
+  }
+  
+  
+  void* DummyClock::thread_main(void* arg) {
+    static_cast<DummyClock*>(arg)->run();
+    return 0;
+  }
+  
+  
+  void DummyClock::run() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t start = to_ns(now);
+    uint64_t frames = 0;
+    
+    while (!m_quit.get()) {
+      
+      // sleep until the absolute deadline for the end of this period, 
+      // computed from the total frame count so rounding errors don't 
+      // accumulate
+      frames += m_period_size;
+      int64_t deadline = start + 
+	frames / m_sample_rate * nsec_per_sec +
+	frames % m_sample_rate * nsec_per_sec / m_sample_rate;
+      timespec ts = from_ns(deadline);
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      int64_t latency = to_ns(now) - deadline;
+      
+      ++m_periods;
+      m_total_latency += latency;
+      if (latency < m_min_latency)
+	m_min_latency = latency;
+      if (latency > m_max_latency)
+	m_max_latency = latency;
+      
+      m_callback(m_period_size);
+    }
+  }
+  
+  
+}
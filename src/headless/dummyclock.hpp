@@ -0,0 +1,93 @@
+/*****************************************************************************
+    dino-headless - a JACK-free driver for the libdinoseq sequencer
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef DUMMYCLOCK_HPP
+#define DUMMYCLOCK_HPP
+
+#include <pthread.h>
+
+#include "atomicint.hpp"
+#include "clockbackend.hpp"
+
+
+namespace Dino {
+  
+  
+  /** A clock backend that needs no audio hardware. It runs a thread that
+      sleeps until the start of each period using @c clock_nanosleep() with
+      absolute deadlines on @c CLOCK_MONOTONIC, so the periods don't drift,
+      and records how late each wakeup was. The thread is started with
+      @c SCHED_FIFO if the process is allowed to do that, and falls back
+      to the normal scheduler otherwise. */
+  class DummyClock : public ClockBackend {
+  public:
+    
+    /** Create a new clock with the given sample rate, period size and
+	@c SCHED_FIFO priority. */
+    DummyClock(uint32_t sample_rate, uint32_t period_size, 
+	       int priority = 70) throw(std::invalid_argument);
+    
+    /** Stops the clock thread if it is running. */
+    ~DummyClock() throw();
+    
+    void start(Callback const& callback) throw(std::runtime_error);
+    
+    void stop() throw();
+    
+    uint32_t get_sample_rate() const throw();
+    
+    uint32_t get_period_size() const throw();
+    
+    /** Print the number of periods, whether the thread was realtime, and
+	the minimum, mean and maximum wakeup latency. */
+    void print_statistics(std::ostream& os) const;
+    
+  private:
+    
+    /** The thread entry point, it just calls run(). */
+    static void* thread_main(void* arg);
+    
+    /** The period loop. */
+    void run();
+    
+    uint32_t m_sample_rate;
+    uint32_t m_period_size;
+    int m_priority;
+    
+    Callback m_callback;
+    pthread_t m_thread;
+    bool m_running;
+    bool m_realtime;
+    
+    /** Set to 1 by stop() to make the thread exit. */
+    AtomicInt m_quit;
+    
+    /** Wakeup statistics. They are only written by the clock thread and
+	only read after it has been joined. */
+    uint64_t m_periods;
+    int64_t m_min_latency;
+    int64_t m_max_latency;
+    int64_t m_total_latency;
+    
+  };
+  
+  
+}
+
+
+#endif
@@ -0,0 +1,101 @@
+/*****************************************************************************
+    dino-headless - a JACK-free driver for the libdinoseq sequencer
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "jackclock.hpp"
+
+
+namespace Dino {
+  
+  
+  using std::endl;
+  using std::ostream;
+  using std::runtime_error;
+  using std::string;
+  
+  
+  JackClock::JackClock(string const& client_name) throw(runtime_error)
+    : m_client(0),
+      m_running(false),
+      m_periods(0),
+      m_xruns(0) {
+    m_client = jack_client_open(client_name.c_str(), JackNoStartServer, 0);
+    if (!m_client)
+      throw runtime_error("Could not connect to the JACK server");
+    jack_set_process_callback(m_client, &JackClock::process, this);
+    jack_set_xrun_callback(m_client, &JackClock::xrun, this);
+  }
+  
+  
+  JackClock::~JackClock() throw() {
+    stop();
+    jack_client_close(m_client);
+  }
+  
+  
+  void JackClock::start(Callback const& callback) throw(runtime_error) {
+    if (m_running)
+      throw runtime_error("The clock is already running");
+    m_callback = callback;
+    m_periods = 0;
+    m_xruns = 0;
+    if (jack_activate(m_client))
+      throw runtime_error("Could not activate the JACK client");
+    m_running = true;
+  }
+  
+  
+  void JackClock::stop() throw() {
+    if (!m_running)
+      return;
+    jack_deactivate(m_client);
+    m_running = false;
+  }
+  
+  
+  uint32_t JackClock::get_sample_rate() const throw() {
+    return jack_get_sample_rate(m_client);
+  }
+  
+  
+  uint32_t JackClock::get_period_size() const throw() {
+    return jack_get_buffer_size(m_client);
+  }
+  
+  
+  void JackClock::print_statistics(ostream& os) const {
+    os<<"Clock:            JACK"<<endl
+      <<"Periods:          "<<m_periods<<endl
+      <<"Xruns:            "<<m_xruns<<endl;
+  }
+  
+  
+  int JackClock::process(jack_nframes_t nframes, void* arg) {
+    JackClock* me = static_cast<JackClock*>(arg);
+    ++me->m_periods;
+    me->m_callback(nframes);
+    return 0;
+  }
+  
+  
+  int JackClock::xrun(void* arg) {
+    ++static_cast<JackClock*>(arg)->m_xruns;
+    return 0;
+  }
+  
+  
+}
@@ -0,0 +1,76 @@
+/*****************************************************************************
+    dino-headless - a JACK-free driver for the libdinoseq sequencer
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef JACKCLOCK_HPP
+#define JACKCLOCK_HPP
+
+#include <string>
+
+#include <jack/jack.h>
+
+#include "clockbackend.hpp"
+
+
+namespace Dino {
+  
+  
+  /** A clock backend that is driven by the process callback of a JACK 
+      client. The sample rate and period size are whatever the JACK server
+      uses. */
+  class JackClock : public ClockBackend {
+  public:
+    
+    /** Open a JACK client with the given name.
+	@throw std::runtime_error if the JACK server isn't running */
+    JackClock(std::string const& client_name) throw(std::runtime_error);
+    
+    /** Stops the clock and closes the JACK client. */
+    ~JackClock() throw();
+    
+    void start(Callback const& callback) throw(std::runtime_error);
+    
+    void stop() throw();
+    
+    uint32_t get_sample_rate() const throw();
+    
+    uint32_t get_period_size() const throw();
+    
+    /** Print the number of periods and xruns. */
+    void print_statistics(std::ostream& os) const;
+    
+  private:
+    
+    /** The JACK process callback. */
+    static int process(jack_nframes_t nframes, void* arg);
+    
+    /** The JACK xrun callback. */
+    static int xrun(void* arg);
+    
+    jack_client_t* m_client;
+    Callback m_callback;
+    bool m_running;
+    uint64_t m_periods;
+    uint64_t m_xruns;
+    
+  };
+  
+  
+}
+
+
+#endif
@@ -0,0 +1,375 @@
+/*****************************************************************************
+    dino-headless - a JACK-free driver for the libdinoseq sequencer
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "clockbackend.hpp"
+#include "curve.hpp"
+#include "dummyclock.hpp"
+#include "eventbuffer.hpp"
+#include "ostreambuffer.hpp"
+#include "outputfilter.hpp"
+#include "sequencer.hpp"
+#include "songtime.hpp"
+#include "transport.hpp"
+
+#ifdef WITH_JACK
+#include "jackclock.hpp"
+#endif
+
+#ifdef WITH_LIBLO
+#include "oscserver.hpp"
+#endif
+
+
+using namespace std;
+using namespace Dino;
+
+
+namespace {
+  
+  
+  /** An EventBuffer that only counts the events. It's realtime safe, 
+      unlike OStreamBuffer. */
+  class CountingBuffer : public EventBuffer {
+  public:
+    CountingBuffer() : events(0) {}
+    bool write_event(SongTime const&, size_t, unsigned char const*) {
+      ++events;
+      return true;
+    }
+    size_t write_events(Event const*, size_t n) {
+      events += n;
+      return n;
+    }
+    uint64_t events;
+  };
+  
+  
+  /** The state that is shared between the period callback and main(). 
+      The statistics are only written in the clock thread and only read 
+      after the clock has been stopped. */
+  struct Engine {
+    Engine(uint32_t rate, double bpm) : transport(rate, bpm) {}
+    Sequencer seq;
+    Transport transport;
+    uint64_t frame;
+    uint64_t periods;
+    uint64_t overruns;
+    int64_t period_ns;
+    int64_t min_run_ns;
+    int64_t max_run_ns;
+    int64_t total_run_ns;
+    
+    /** The period callback. */
+    void process(uint32_t nframes) {
+      timespec before, after;
+      clock_gettime(CLOCK_MONOTONIC, &before);
+      transport.process(seq, frame, nframes);
+      clock_gettime(CLOCK_MONOTONIC, &after);
+      frame += nframes;
+      int64_t ns = (int64_t(after.tv_sec) - before.tv_sec) * 1000000000 +
+	after.tv_nsec - before.tv_nsec;
+      ++periods;
+      total_run_ns += ns;
+      if (ns < min_run_ns)
+	min_run_ns = ns;
+      if (ns > max_run_ns)
+	max_run_ns = ns;
+      if (ns > period_ns)
+	++overruns;
+    }
+  };
+  
+  
+  volatile sig_atomic_t do_quit = 0;
+  
+  
+  void signal_handler(int) {
+    do_quit = 1;
+  }
+  
+  
+  void print_version() {
+    cout<<"dino-headless "<<VERSION<<endl
+	<<"Copyright (C) "<<CR_YEAR<<" Lars Luthman <mail@larsluthman.net>"
+	<<endl
+	<<"This program comes with ABSOLUTELY NO WARRANTY."<<endl
+	<<"This is free software, and you are welcome to redistribute it"<<endl
+	<<"under certain conditions; see the file COPYING for details."<<endl;
+  }
+  
+  
+  void print_usage(char const* argv0) {
+    cout<<"Usage: "<<argv0<<" [OPTIONS]"<<endl
+	<<"Run the libdinoseq sequencer without a GUI and report timing "
+	<<"statistics."<<endl<<endl
+	<<"  -b, --backend=NAME    the clock backend, 'dummy' (default)"
+#ifdef WITH_JACK
+	<<" or 'jack'"
+#endif
+	<<endl
+	<<"  -r, --rate=FRAMES     the sample rate for the dummy clock "
+	<<"(48000)"<<endl
+	<<"  -p, --period=FRAMES   the period size for the dummy clock (256)"
+	<<endl
+	<<"  -P, --priority=N      the SCHED_FIFO priority for the dummy clock "
+	<<"(70)"<<endl
+	<<"  -t, --tempo=BPM       the tempo (120)"<<endl
+	<<"  -d, --duration=SECS   how long to run, 0 means until interrupted "
+	<<"(10)"<<endl
+	<<"  -c, --curves=N        the number of generated test curves (16)"
+	<<endl
+	<<"  -e, --print-events    print all events to stdout (not realtime "
+	<<"safe)"<<endl
+	<<"  -s, --status          show the song position and event count "
+	<<"while running"<<endl
+	<<"  -f, --filter          drop redundant controller messages before "
+	<<"the output"<<endl
+#ifdef WITH_LIBLO
+	<<"  -o, --osc-port=PORT   accept /dino/play, /dino/stop, "
+	<<"/dino/relocate and"<<endl
+	<<"                        /dino/status on this UDP port"<<endl
+#endif
+	<<"  -h, --help            print this message"<<endl
+	<<"      --version         print the version"<<endl;
+  }
+  
+  
+  /** Create a curve with a point every quarter beat, alternating between
+      the minimum and maximum values, so every period has some interpolated
+      events to write. */
+  shared_ptr<Curve> make_test_curve(int n, SongTime::Beat beats) {
+    auto c = make_shared<Curve>("Curve " + to_string(n), SongTime(beats, 0), 
+				n % 128);
+    AtomicInt::Type max = numeric_limits<AtomicInt::Type>::max();
+    for (SongTime::Beat b = 0; b < beats; ++b) {
+      for (int q = 0; q < 4; ++q) {
+	c->add_point(SongTime(b, q * (SongTime::ticks_per_beat() / 4)), 
+		     q % 2 ? max : 0);
+      }
+    }
+    return c;
+  }
+  
+  
+}
+
+
+int main(int argc, char** argv) {
+  
+  string backend = "dummy";
+  uint32_t rate = 48000;
+  uint32_t period = 256;
+  int priority = 70;
+  double tempo = 120;
+  double duration = 10;
+  int curves = 16;
+  bool print_events = false;
+  bool show_status = false;
+  bool filter = false;
+  string osc_port;
+  
+  static option long_options[] = {
+    { "backend", required_argument, 0, 'b' },
+    { "rate", required_argument, 0, 'r' },
+    { "period", required_argument, 0, 'p' },
+    { "priority", required_argument, 0, 'P' },
+    { "tempo", required_argument, 0, 't' },
+    { "duration", required_argument, 0, 'd' },
+    { "curves", required_argument, 0, 'c' },
+    { "print-events", no_argument, 0, 'e' },
+    { "status", no_argument, 0, 's' },
+    { "filter", no_argument, 0, 'f' },
+    { "osc-port", required_argument, 0, 'o' },
+    { "help", no_argument, 0, 'h' },
+    { "version", no_argument, 0, 'V' },
+    { 0, 0, 0, 0 }
+  };
+  
+  int c;
+  while ((c = getopt_long(argc, argv, "b:r:p:P:t:d:c:esfo:h", 
+			  long_options, 0)) != -1) {
+    switch (c) {
+    case 'b': backend = optarg; break;
+    case 'r': rate = std::atoi(optarg); break;
+    case 'p': period = std::atoi(optarg); break;
+    case 'P': priority = std::atoi(optarg); break;
+    case 't': tempo = std::atof(optarg); break;
+    case 'd': duration = std::atof(optarg); break;
+    case 'c': curves = std::atoi(optarg); break;
+    case 'e': print_events = true; break;
+    case 's': show_status = true; break;
+    case 'f': filter = true; break;
+    case 'o': osc_port = optarg; break;
+    case 'h': print_usage(argv[0]); return 0;
+    case 'V': print_version(); return 0;
+    default: print_usage(argv[0]); return 1;
+    }
+  }
+  if (tempo <= 0 || curves < 0) {
+    cerr<<"Invalid tempo or number of curves"<<endl;
+    return 1;
+  }
+  
+  // create the clock
+  unique_ptr<ClockBackend> clock;
+  try {
+    if (backend == "dummy")
+      clock.reset(new DummyClock(rate, period, priority));
+#ifdef WITH_JACK
+    else if (backend == "jack")
+      clock.reset(new JackClock("dino-headless"));
+#endif
+    else {
+      cerr<<"Unknown clock backend '"<<backend<<"'"<<endl;
+      return 1;
+    }
+  }
+  catch (std::exception& e) {
+    cerr<<e.what()<<endl;
+    return 1;
+  }
+  rate = clock->get_sample_rate();
+  period = clock->get_period_size();
+  
+  // set up the sequencer with the test curves
+  Engine engine(rate, tempo);
+  engine.frame = 0;
+  engine.periods = 0;
+  engine.overruns = 0;
+  engine.period_ns = int64_t(period) * 1000000000 / rate;
+  engine.min_run_ns = numeric_limits<int64_t>::max();
+  engine.max_run_ns = 0;
+  engine.total_run_ns = 0;
+  SongTime::Beat beats = 
+    SongTime::Beat((duration > 0 ? duration : 3600) * tempo / 60) + 1;
+  auto counter = make_shared<CountingBuffer>();
+  shared_ptr<EventBuffer> buf = counter;
+  if (print_events)
+    buf = make_shared<OStreamBuffer>(cout);
+  shared_ptr<OutputFilter> output_filter;
+  if (filter)
+    buf = output_filter = make_shared<OutputFilter>(buf);
+  for (int i = 0; i < curves; ++i) {
+    engine.seq.set_event_buffer(engine.seq.add_sequencable(
+				  make_test_curve(i, beats)), buf);
+  }
+  
+  // lock all memory so the clock thread doesn't page fault
+  if (mlockall(MCL_CURRENT | MCL_FUTURE))
+    cerr<<"Could not lock memory, there may be page faults"<<endl;
+  
+  std::signal(SIGINT, &signal_handler);
+  std::signal(SIGTERM, &signal_handler);
+  
+  // start playing at the first period. After this only the OSC server
+  // posts transport commands.
+  engine.transport.post_play();
+#ifdef WITH_LIBLO
+  unique_ptr<OscServer> osc;
+  if (!osc_port.empty()) {
+    try {
+      osc.reset(new OscServer(osc_port, engine.transport, engine.seq));
+      cerr<<"OSC server listening on port "<<osc->get_port()<<endl;
+    }
+    catch (std::exception& e) {
+      cerr<<e.what()<<endl;
+      return 1;
+    }
+  }
+#else
+  if (!osc_port.empty())
+    cerr<<"dino-headless was built without OSC support"<<endl;
+#endif
+  
+  // run until the time is up or we are interrupted
+  try {
+    clock->start([&engine](uint32_t nframes) { engine.process(nframes); });
+  }
+  catch (std::exception& e) {
+    cerr<<e.what()<<endl;
+    return 1;
+  }
+  timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  AtomicInt::Type status_count = engine.seq.get_status_count();
+  while (!do_quit) {
+    usleep(100000);
+    
+    // poll the status that the clock thread publishes after every period
+    Sequencer::Status status;
+    if (show_status && engine.seq.get_status_count() != status_count &&
+	engine.seq.get_status(status)) {
+      status_count = engine.seq.get_status_count();
+      unsigned events = 0;
+      for (size_t i = 0; i < Sequencer::max_status_entries; ++i)
+	events += status.events[i];
+      ostringstream line;
+      line<<"\rBeat "<<fixed<<setprecision(2)
+	  <<status.position.to_ticks() / double(SongTime(1, 0).to_ticks())
+	  <<", period "<<status.periods<<", events "<<events % 65536<<"    ";
+      cerr<<line.str()<<flush;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (duration > 0 && 
+	(now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9 >= 
+	duration)
+      break;
+  }
+  clock->stop();
+  if (show_status)
+    cerr<<endl;
+  
+  // print the report
+  cerr<<"Sample rate:      "<<rate<<endl
+      <<"Period size:      "<<period<<" ("<<engine.period_ns / 1000.0
+      <<" us)"<<endl;
+  clock->print_statistics(cerr);
+  if (engine.periods > 0) {
+    cerr<<"Sequencer::run(): min "<<engine.min_run_ns / 1000.0<<" us, mean "
+	<<engine.total_run_ns / 1000.0 / engine.periods<<" us, max "
+	<<engine.max_run_ns / 1000.0<<" us"<<endl
+	<<"Overruns:         "<<engine.overruns<<endl;
+  }
+  if (!print_events)
+    cerr<<"Events:           "<<counter->events<<endl;
+  if (output_filter)
+    cerr<<"Filtered events:  "<<output_filter->get_dropped()<<endl;
+#ifdef WITH_LIBLO
+  if (osc && osc->get_dropped() > 0)
+    cerr<<"Dropped commands: "<<osc->get_dropped()<<endl;
+#endif
+  
+  return 0;
+}
@@ -0,0 +1,132 @@
+/*****************************************************************************
+    dino-headless - a JACK-free driver for the libdinoseq sequencer
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+
+#include "oscserver.hpp"
+#include "sequencer.hpp"
+#include "songtime.hpp"
+#include "transport.hpp"
+
+
+namespace Dino {
+  
+  
+  using std::runtime_error;
+  using std::string;
+  
+  
+  OscServer::OscServer(string const& port, Transport& transport,
+		       Sequencer const& seq) throw(runtime_error)
+    : m_thread(lo_server_thread_new(port.empty() ? 0 : port.c_str(), 0)),
+      m_transport(transport),
+      m_seq(seq),
+      m_dropped(0) {
+    if (!m_thread)
+      throw runtime_error("Could not start the OSC server");
+    lo_server_thread_add_method(m_thread, "/dino/play", "", 
+				&OscServer::play_handler, this);
+    lo_server_thread_add_method(m_thread, "/dino/play", "h", 
+				&OscServer::play_handler, this);
+    lo_server_thread_add_method(m_thread, "/dino/stop", "", 
+				&OscServer::stop_handler, this);
+    lo_server_thread_add_method(m_thread, "/dino/stop", "h", 
+				&OscServer::stop_handler, this);
+    lo_server_thread_add_method(m_thread, "/dino/relocate", "f", 
+				&OscServer::relocate_handler, this);
+    lo_server_thread_add_method(m_thread, "/dino/relocate", "fh", 
+				&OscServer::relocate_handler, this);
+    lo_server_thread_add_method(m_thread, "/dino/status", "", 
+				&OscServer::status_handler, this);
+    if (lo_server_thread_start(m_thread) != 0) {
+      lo_server_thread_free(m_thread);
+      throw runtime_error("Could not start the OSC server thread");
+    }
+  }
+  
+  
+  OscServer::~OscServer() throw() {
+    lo_server_thread_stop(m_thread);
+    lo_server_thread_free(m_thread);
+  }
+  
+  
+  int OscServer::get_port() const throw() {
+    return lo_server_thread_get_port(m_thread);
+  }
+  
+  
+  unsigned long OscServer::get_dropped() const throw() {
+    return m_dropped.get();
+  }
+  
+  
+  int OscServer::play_handler(char const*, char const*, lo_arg** argv, 
+			      int argc, lo_message, void* user_data) {
+    OscServer* me = static_cast<OscServer*>(user_data);
+    if (!me->m_transport.post_play(argc > 0 ? argv[0]->h : 0))
+      me->m_dropped.add(1);
+    return 0;
+  }
+  
+  
+  int OscServer::stop_handler(char const*, char const*, lo_arg** argv, 
+			      int argc, lo_message, void* user_data) {
+    OscServer* me = static_cast<OscServer*>(user_data);
+    if (!me->m_transport.post_stop(argc > 0 ? argv[0]->h : 0))
+      me->m_dropped.add(1);
+    return 0;
+  }
+  
+  
+  int OscServer::relocate_handler(char const*, char const*, lo_arg** argv, 
+				  int argc, lo_message, void* user_data) {
+    OscServer* me = static_cast<OscServer*>(user_data);
+    double beat = argv[0]->f;
+    if (!std::isfinite(beat))
+      return 0;
+    
+    // clamp before converting, a float can be far too large for int64_t
+    double ticks = std::max(beat, 0.0) * SongTime(1, 0).to_ticks();
+    SongTime time = SongTime::max_valid();
+    if (ticks < time.to_ticks())
+      time = SongTime::from_ticks(int64_t(ticks));
+    if (!me->m_transport.post_locate(time, argc > 1 ? argv[1]->h : 0))
+      me->m_dropped.add(1);
+    return 0;
+  }
+  
+  
+  int OscServer::status_handler(char const*, char const*, lo_arg**, int, 
+				lo_message msg, void* user_data) {
+    OscServer* me = static_cast<OscServer*>(user_data);
+    Sequencer::Status status;
+    if (!me->m_seq.get_status(status))
+      return 0;
+    float beat = status.position.to_ticks() / 
+      float(SongTime(1, 0).to_ticks());
+    lo_address source = lo_message_get_source(msg);
+    lo_send_from(source, lo_server_thread_get_server(me->m_thread), 
+		 LO_TT_IMMEDIATE, "/dino/status", "fi", beat, 
+		 me->m_transport.is_playing() ? 1 : 0);
+    return 0;
+  }
+  
+  
+}
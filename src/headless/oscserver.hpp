@@ -0,0 +1,105 @@
+/*****************************************************************************
+    dino-headless - a JACK-free driver for the libdinoseq sequencer
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef OSCSERVER_HPP
+#define OSCSERVER_HPP
+
+#include <stdexcept>
+#include <string>
+
+#include <lo/lo.h>
+
+#include "atomicint.hpp"
+
+
+namespace Dino {
+  
+  
+  class Sequencer;
+  class Transport;
+  
+  
+  /** An OSC server that controls a Transport. It runs in its own thread 
+      (the one liblo creates) and posts the commands straight to the 
+      transport, so they take effect at the next period boundary, or at the
+      frame given in the message. These messages are handled:
+      
+      - @c /dino/play and @c /dino/play @c h - start playing, now or at the
+        given frame
+      - @c /dino/stop and @c /dino/stop @c h - stop playing, now or at the
+        given frame
+      - @c /dino/relocate @c f and @c /dino/relocate @c fh - move to the 
+        given beat, now or at the given frame
+      - @c /dino/status - reply to the sender with @c /dino/status @c fi, 
+        the song position in beats and 1 if the transport is playing or 0 
+        if it isn't. The position is read from the sequencer's status 
+        channel, so polling it doesn't disturb the clock thread.
+      
+      The server must be the only thread that posts commands to the 
+      transport while it is running. */
+  class OscServer {
+  public:
+    
+    /** Start a server on the UDP port @c port, or any free port if it is
+	empty. 
+	@throw std::runtime_error if the server can't be started */
+    OscServer(std::string const& port, Transport& transport,
+	      Sequencer const& seq) throw(std::runtime_error);
+    
+    /** Stop the server thread. */
+    ~OscServer() throw();
+    
+    /** Return the port that the server is listening on. */
+    int get_port() const throw();
+    
+    /** Return the number of commands that were dropped because the 
+	transport's command ring was full. */
+    unsigned long get_dropped() const throw();
+    
+  private:
+    
+    OscServer(OscServer const&) = delete;
+    OscServer& operator=(OscServer const&) = delete;
+    
+    static int play_handler(char const* path, char const* types, 
+			    lo_arg** argv, int argc, lo_message msg, 
+			    void* user_data);
+    static int stop_handler(char const* path, char const* types, 
+			    lo_arg** argv, int argc, lo_message msg, 
+			    void* user_data);
+    static int relocate_handler(char const* path, char const* types, 
+				lo_arg** argv, int argc, lo_message msg, 
+				void* user_data);
+    static int status_handler(char const* path, char const* types, 
+			      lo_arg** argv, int argc, lo_message msg, 
+			      void* user_data);
+    
+    lo_server_thread m_thread;
+    Transport& m_transport;
+    Sequencer const& m_seq;
+    
+    /** Incremented in the server thread and read in the main thread. */
+    AtomicInt m_dropped;
+    
+  };
+  
+  
+}
+
+
+#endif
@@ -41,6 +41,22 @@ namespace Dino {
   void AtomicInt::increase() {
     g_atomic_int_inc(&m_data);
   }
+  
+  
+  AtomicInt::Type AtomicInt::add(Type delta) {
+    // g_atomic_int_add() only returns the old value since glib 2.30, and
+    // the function that always did is deprecated from that version on
+#if GLIB_CHECK_VERSION(2, 30, 0)
+    return g_atomic_int_add(&m_data, delta);
+#else
+    return g_atomic_int_exchange_and_add(&m_data, delta);
+#endif
+  }
+  
+  
+  bool AtomicInt::decrease_and_test() {
+    return g_atomic_int_dec_and_test(&m_data);
+  }
 
 
 }
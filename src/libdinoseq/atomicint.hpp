@@ -54,6 +54,16 @@ namespace Dino {
 	operation and also a memory barrier. */
     void increase();
     
+    /** Add @c delta to the atomic integer and return the value it had 
+	before. This is an atomic and lock-free operation and also a memory 
+	barrier. */
+    Type add(Type delta);
+    
+    /** Decrease the atomic integer by 1 and return @c true if it became 0.
+	This is an atomic and lock-free operation and also a memory 
+	barrier. */
+    bool decrease_and_test();
+    
   private:
     
     /** The actual underlying integral variable. */
@@ -35,6 +35,10 @@ namespace Dino {
   class AtomicPtr {
   public:
     
+    /** Initialise the atomic pointer to 0. This operation is @b not 
+	atomic. */
+    AtomicPtr() : m_pointer(0) { }
+    
     /** Initialise the atomic pointer to the value of @c t. This operation is
 	@b not atomic. */
     AtomicPtr(T* t) : m_pointer(t) { }
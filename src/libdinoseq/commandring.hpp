@@ -0,0 +1,138 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef COMMANDRING_HPP
+#define COMMANDRING_HPP
+
+#include <cstddef>
+#include <new>
+
+#include "atomicint.hpp"
+
+
+namespace Dino {
+
+  
+  /** A fixed size lock-free ring buffer for one writer and one reader. 
+      Unlike NodeQueue it allocates all its slots when it is created, so 
+      both ends are realtime safe and a non-realtime thread can post small
+      commands to a realtime thread without allocating anything. If the
+      ring is full push() fails instead of blocking.
+      
+      @c T must have a copy assignment operator that doesn't throw, and 
+      should be cheap to copy.
+  */
+  template <typename T>
+  class CommandRing {
+  public:
+    
+    /** Create a new ring with room for at least @c capacity elements. The
+	capacity is rounded up to a power of two. */
+    explicit CommandRing(size_t capacity) throw(std::bad_alloc)
+      : m_mask(round_up(capacity) - 1),
+	m_data(new T[m_mask + 1]),
+	m_write(0),
+	m_read(0) {
+    
+    }
+    
+    /** Destroy the ring. No other thread may use it while this is 
+	running. */
+    ~CommandRing() throw() {
+      delete [] m_data;
+    }
+    
+    /** Return the number of elements that fit in the ring. */
+    size_t get_capacity() const throw() {
+      return m_mask + 1;
+    }
+    
+    /** Add a copy of @c t at the end of the ring. Returns @c false if the
+	ring is full. This may only be called by the writer. */
+    bool push(T const& t) throw() {
+      unsigned w = m_write.get();
+      if (w - unsigned(m_read.get()) > m_mask)
+	return false;
+      m_data[w & m_mask] = t;
+      // the element has to be in place before the reader can see it
+      m_write.set(w + 1);
+      return true;
+    }
+    
+    /** Return a pointer to the oldest element in the ring, or 0 if it is
+	empty. The element stays in the ring until drop() is called. This 
+	may only be called by the reader. */
+    T const* peek() const throw() {
+      unsigned r = m_read.get();
+      if (r == unsigned(m_write.get()))
+	return 0;
+      return &m_data[r & m_mask];
+    }
+    
+    /** Remove the oldest element from the ring. It must not be empty.
+	This may only be called by the reader. */
+    void drop() throw() {
+      m_read.set(unsigned(m_read.get()) + 1);
+    }
+    
+    /** Copy the oldest element to @c t and remove it from the ring. Returns
+	@c false if the ring was empty. This may only be called by the 
+	reader. */
+    bool pop(T& t) throw() {
+      T const* p = peek();
+      if (!p)
+	return false;
+      t = *p;
+      drop();
+      return true;
+    }
+    
+  private:
+    
+    CommandRing(CommandRing const&) = delete;
+    CommandRing& operator=(CommandRing const&) = delete;
+    
+    /** Return the smallest power of two that is at least @c n. */
+    static size_t round_up(size_t n) throw() {
+      size_t p = 1;
+      while (p < n)
+	p <<= 1;
+      return p;
+    }
+    
+    /** The capacity minus one, used to wrap the counters. */
+    size_t m_mask;
+    
+    /** The slots. */
+    T* m_data;
+    
+    /** The number of elements that have been pushed, modulo 2^32. Only 
+	written by the writer. */
+    AtomicInt m_write;
+    
+    /** The number of elements that have been dropped, modulo 2^32. Only
+	written by the reader. */
+    AtomicInt m_read;
+    
+  };
+  
+  
+}
+
+
+#endif
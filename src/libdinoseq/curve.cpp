@@ -16,18 +16,277 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>.
 *****************************************************************************/
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 #include "curve.hpp"
+#include "eventbuffer.hpp"
 
 
 namespace Dino {
   
   
+  namespace {
+    
+    
+    /** Return log2 of the number of ticks per summary bucket for a curve
+	with the given length. Buckets are 1/16 beat long unless that would 
+	make more than 65536 of them. */
+    int summary_shift(SongTime const& length) throw() {
+      int64_t ticks = std::max(length.to_ticks(), int64_t(0));
+      int shift = 20;
+      while ((ticks >> shift) >= 65536)
+	++shift;
+      return shift;
+    }
+    
+    
+    /** Scale a curve value in the range [0, M] to the range 
+	[0, @c steps - 1]. 32 bit values repeat the top bit at the bottom
+	so that M maps to the largest 32 bit value. */
+    int64_t scale_value(AtomicInt::Type v, int64_t steps) throw() {
+      if (v < 0)
+	return 0;
+      if (steps == int64_t(1) << 32)
+	return (int64_t(v) << 1) | (v >> 30);
+      int64_t max = std::numeric_limits<AtomicInt::Type>::max();
+      int64_t c = int64_t(v) * steps / (max + 1);
+      return c < 0 ? 0 : (c >= steps ? steps - 1 : c);
+    }
+    
+    
+    /** Collects controller events on the stack and writes them to an
+	EventBuffer in batches using EventBuffer::write_events(). */
+    class EventBatch {
+    public:
+      
+      EventBatch(EventBuffer& buf) throw()
+	: m_buf(buf), m_n(0), m_failed_at(0) {}
+      
+      /** Queue a controller event with a 7 bit value. Returns @c false if
+	  the batch had to be flushed and the buffer was full. */
+      bool add_controller(int64_t t, unsigned char number, int c) throw() {
+	if (m_n == capacity && !flush())
+	  return false;
+	EventBuffer::Event& e = m_events[m_n++];
+	e.time = SongTime::from_ticks(t);
+	e.data[0] = 0xB0;
+	e.data[1] = number;
+	e.data[2] = c;
+	return true;
+      }
+      
+      /** Write all queued events to the buffer. Returns @c false if the
+	  buffer could not take all of them. */
+      bool flush() throw() {
+	size_t written = m_buf.write_events(m_events, m_n);
+	if (written < m_n) {
+	  m_failed_at = m_events[written].time.to_ticks();
+	  m_n = 0;
+	  return false;
+	}
+	m_n = 0;
+	return true;
+      }
+      
+      /** The time of the first event that could not be written. */
+      int64_t failed_at() const throw() {
+	return m_failed_at;
+      }
+      
+    private:
+      
+      static size_t const capacity = 32;
+      
+      EventBuffer& m_buf;
+      EventBuffer::Event m_events[capacity];
+      size_t m_n;
+      int64_t m_failed_at;
+      
+    };
+    
+    
+    /** Turns controller values into the MIDI messages for a curve's 
+	output mode. Multi-message parameters only send the parts that have
+	changed since the last value: the MSB of a 14 bit controller or of 
+	the data entry controller is only sent when it changes, and the 
+	(N)RPN parameter number is only selected once after a relocation.
+	The state for this is kept in the position, in @c last_mode and
+	@c last_msb, and is reset by Curve::update_position(). */
+    class ControllerOutput {
+    public:
+      
+      ControllerOutput(EventBuffer& buf, Curve::ControllerID cid,
+		       Curve::OutputMode mode, int& last_mode, int& last_msb)
+	throw()
+	: m_buf(buf),
+	  m_batch(buf),
+	  m_cid(cid),
+	  m_mode(mode),
+	  m_last_msb(last_msb),
+	  m_failed_at(-1) {
+	if (last_mode != mode) {
+	  last_mode = mode;
+	  last_msb = -1;
+	}
+      }
+      
+      /** The number of distinct values in this mode. */
+      int64_t get_steps() const throw() {
+	switch (m_mode) {
+	case Curve::Controller7: 
+	  return 128;
+	case Curve::Controller14: 
+	case Curve::NRPN: 
+	case Curve::RPN: 
+	  return 16384;
+	default: 
+	  return int64_t(1) << 32;
+	}
+      }
+      
+      /** The shortest time between two interpolated values. 7 bit 
+	  controllers send every step, the high resolution modes would 
+	  flood the output if they did that. */
+      int64_t get_min_gap() const throw() {
+	if (m_mode == Curve::Controller7)
+	  return 0;
+	return SongTime::ticks_per_beat() / 128;
+      }
+      
+      /** Write the messages for a curve value. */
+      bool add(int64_t t, AtomicInt::Type v) throw() {
+	return add_scaled(t, scale_value(v, get_steps()));
+      }
+      
+      /** Write the messages for a value that has already been scaled to
+	  the range [0, get_steps() - 1]. */
+      bool add_scaled(int64_t t, int64_t c) throw() {
+	switch (m_mode) {
+	  
+	case Curve::Controller7:
+	  return m_batch.add_controller(t, m_cid & 0x7F, c);
+	  
+	case Curve::Controller14:
+	  return add_14bit(t, m_cid & 0x1F, (m_cid & 0x1F) + 32, c, false);
+	  
+	case Curve::NRPN:
+	case Curve::RPN:
+	  return add_14bit(t, 6, 38, c, true);
+	  
+	default: {
+	  // MIDI 2.0 channel voice message, control change (0xB), 
+	  // registered controller (0x2) or assignable controller (0x3)
+	  uint32_t words[2];
+	  if (m_mode == Curve::UMPController)
+	    words[0] = 0x40B00000 | ((m_cid & 0x7F) << 8);
+	  else {
+	    words[0] = (m_mode == Curve::UMPRegistered ? 0x40200000 : 
+			0x40300000) | (((m_cid >> 7) & 0x7F) << 8) | 
+	      (m_cid & 0x7F);
+	  }
+	  words[1] = uint32_t(c);
+	  if (!m_buf.write_packet(SongTime::from_ticks(t), 2, words)) {
+	    m_failed_at = t;
+	    return false;
+	  }
+	  return true;
+	}
+	  
+	}
+      }
+      
+      /** Write all queued events. */
+      bool flush() throw() {
+	return m_batch.flush();
+      }
+      
+      /** The time of the first event that could not be written. */
+      int64_t failed_at() const throw() {
+	return m_failed_at >= 0 ? m_failed_at : m_batch.failed_at();
+      }
+      
+    private:
+      
+      /** Write a 14 bit value as an MSB and an LSB controller, with the
+	  parameter number first if @c param is set. */
+      bool add_14bit(int64_t t, unsigned char msb_cc, unsigned char lsb_cc,
+		     int64_t c, bool param) throw() {
+	int msb = int(c >> 7);
+	if (param && m_last_msb < 0) {
+	  bool rpn = m_mode == Curve::RPN;
+	  if (!m_batch.add_controller(t, rpn ? 101 : 99, (m_cid >> 7) & 0x7F) ||
+	      !m_batch.add_controller(t, rpn ? 100 : 98, m_cid & 0x7F))
+	    return false;
+	}
+	if (msb != m_last_msb) {
+	  if (!m_batch.add_controller(t, msb_cc, msb))
+	    return false;
+	  m_last_msb = msb;
+	}
+	return m_batch.add_controller(t, lsb_cc, int(c & 0x7F));
+      }
+      
+      EventBuffer& m_buf;
+      EventBatch m_batch;
+      Curve::ControllerID m_cid;
+      Curve::OutputMode m_mode;
+      int& m_last_msb;
+      int64_t m_failed_at;
+      
+    };
+    
+    
+    /** Queue the interpolated controller values between the points @c p0 
+	and @c p1 that fall in the range [@c from, @c to). The points 
+	themselves are not included. An event is only generated when the 
+	value in the output resolution actually changes, and no more often
+	than the output's minimum gap. */
+    bool interpolate(ControllerOutput& out, Curve::Point const& p0, 
+		     Curve::Point const& p1, int64_t from, int64_t to) throw() {
+      int64_t t0 = p0.m_time.to_ticks();
+      int64_t d = p1.m_time.to_ticks() - t0;
+      int64_t c0 = scale_value(p0.m_value.get(), out.get_steps());
+      int64_t c1 = scale_value(p1.m_value.get(), out.get_steps());
+      int64_t diff = c1 - c0;
+      int64_t steps = diff > 0 ? diff : -diff;
+      int64_t gap = out.get_min_gap();
+      if (gap > 0 && steps > d / gap)
+	steps = d / gap;
+      if (d <= 0 || steps < 2)
+	return true;
+      
+      // step k is reached at t0 + ceil(k * d / steps), start at the first
+      // k that is not earlier than from
+      int64_t k = 1;
+      if (from - t0 > 1)
+	k = (from - t0 - 1) * steps / d + 1;
+      for ( ; k < steps; ++k) {
+	int64_t t = t0 + (k * d + steps - 1) / steps;
+	if (t >= to)
+	  break;
+	// if several steps fall on the same tick, only send the last one
+	if (k + 1 < steps && t0 + ((k + 1) * d + steps - 1) / steps == t)
+	  continue;
+	if (!out.add_scaled(t, c0 + diff * k / steps))
+	  return false;
+      }
+      
+      return true;
+    }
+    
+    
+  }
+  
+  
   using std::bad_alloc;
   using std::invalid_argument;
   using std::out_of_range;
   using std::shared_ptr;
   using std::string;
   using std::unique_ptr;
+  using std::vector;
   
 
   Curve::Point::Point(SongTime const& st, AtomicInt::Type v) throw()
@@ -36,11 +295,12 @@ namespace Dino {
   }
 
 
-  bool Curve::Point::operator<(Point const& p) const throw() {
-    return m_time < p.m_time;
+  Curve::CurvePosition::~CurvePosition() {
+    if (curve)
+      curve->remove_curve_position(this);
   }
-  
-  
+
+
   Curve::ConstIterator::ConstIterator() throw() 
     : IteratorT<ConstIterator, ConstIterator, Node const>(0) {
   }
@@ -65,9 +325,13 @@ namespace Dino {
     
     
   Curve::Curve(string const& label, 
-	       SongTime const& length, ControllerID cid) throw() 
+	       SongTime const& length, ControllerID cid) throw(bad_alloc)
     : Sequencable(label, length),
-      m_cid(cid) {
+      m_cid(cid),
+      m_mode(Controller7),
+      m_summary_shift(summary_shift(length)),
+      m_summary((std::max(length.to_ticks(), int64_t(0)) >> 
+		 m_summary_shift) + 1) {
   }
   
   
@@ -85,6 +349,16 @@ namespace Dino {
   void Curve::set_controller_id(ControllerID cid) throw() {
     m_cid = cid;
   }
+  
+  
+  Curve::OutputMode Curve::get_output_mode() const throw() {
+    return m_mode;
+  }
+  
+  
+  void Curve::set_output_mode(OutputMode mode) throw() {
+    m_mode = mode;
+  }
     
   
   Curve::Iterator Curve::add_point(SongTime const& time, AtomicInt::Type value)
@@ -94,9 +368,10 @@ namespace Dino {
     if (time > get_length() || time < SongTime(0, 0))
       throw out_of_range("Time for curve point is out of range");
     
-    Node* n = new Node(Point(time, value));
+    Node* n = Node::create(Point(time, value));
     Iterator i = upper_bound(time);
     m_data.insert(i.m_node, n);
+    m_summary.add(get_bucket(time), value);
     return Iterator(n);
   }
   
@@ -119,12 +394,49 @@ namespace Dino {
       throw invalid_argument("Inserting the point at the given position would "
 			     "break the order");
     
-    Node* n = new Node(Point(time, value));
+    Node* n = Node::create(Point(time, value));
     m_data.insert(before.m_node, n);
+    m_summary.add(get_bucket(time), value);
     return Iterator(n);
   }
   
   
+  void Curve::add_points(SongTime const* times, 
+			 AtomicInt::Type const* values, size_t n)
+    throw(bad_alloc, out_of_range, invalid_argument) {
+    
+    // First, delete any old nodes that should be deleted.
+    delete_queued_nodes();
+    
+    // check everything before touching the curve
+    for (size_t i = 0; i < n; ++i) {
+      if (times[i] > get_length() || times[i] < SongTime(0, 0))
+	throw out_of_range("Time for curve point is out of range");
+      if (i > 0 && times[i] < times[i - 1])
+	throw invalid_argument("The times of the new points are not sorted");
+    }
+    
+    // allocate all nodes up front so running out of memory leaves the 
+    // curve as it was
+    typedef unique_ptr<Node, Node::Deleter> NodePtr;
+    vector<NodePtr> nodes;
+    nodes.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+      nodes.push_back(NodePtr(Node::create(Point(times[i], values[i]))));
+    
+    // merge the sorted points into the list, the insertion point only ever
+    // moves forward. New points go after old ones with the same time, like
+    // in add_point().
+    Iterator before = n > 0 ? upper_bound(times[0]) : end();
+    for (size_t i = 0; i < n; ++i) {
+      while (before != end() && !(times[i] < before->m_time))
+	++before;
+      m_data.insert(before.m_node, nodes[i].release());
+      m_summary.add(get_bucket(times[i]), values[i]);
+    }
+  }
+  
+  
   Curve::Iterator Curve::move_point(Iterator iter, SongTime const& time, 
 				    AtomicInt::Type value)
     throw(bad_alloc, out_of_range) {
@@ -157,12 +469,19 @@ namespace Dino {
     
     // If the time has changed we need to remove the node and add a new one.
     if (time != iter->m_time) {
-      Node* n = new Node(Point(time, value));
+      Node* n = Node::create(Point(time, value));
+      // insert the new node on the side of the old one that it's moving 
+      // towards, otherwise the order check in insert() fails and the point
+      // is lost
       Iterator before = iter;
-      m_data.insert((++before).m_node, n);
+      if (iter->m_time < time)
+	++before;
+      m_data.insert(before.m_node, n);
       Node* old = static_cast<Node*>(iter.m_node);
       m_data.remove(old);
-      shared_ptr<Node> sp = shared_ptr<Node>(old);
+      update_bucket(get_bucket(old->data.m_time));
+      update_bucket(get_bucket(time));
+      shared_ptr<Node> sp(old, Node::Deleter());
       for (auto i = m_positions.begin(); i != m_positions.end(); ++i) {
 	(*i)->to_be_confirmed.
 	  push_node(new NodeQueue<shared_ptr<Node>>::Node(sp));
@@ -172,6 +491,7 @@ namespace Dino {
     
     // If not we can just tweak the value.
     static_cast<Node*>(iter.m_node)->data.m_value.set(value);
+    update_bucket(get_bucket(time));
     return iter;
   }
   
@@ -185,7 +505,8 @@ namespace Dino {
     ++next;
     Node* node = static_cast<Node*>(iter.m_node);
     m_data.remove(node);
-    shared_ptr<Node> sp = shared_ptr<Node>(node);
+    update_bucket(get_bucket(node->data.m_time));
+    shared_ptr<Node> sp(node, Node::Deleter());
     for (auto i = m_positions.begin(); i != m_positions.end(); ++i) {
       (*i)->to_be_confirmed.
 	push_node(new NodeQueue<shared_ptr<Node>>::Node(sp));
@@ -234,10 +555,95 @@ namespace Dino {
   }
   
   
+  AtomicInt::Type Curve::get_value(SongTime const& time) const throw() {
+    ConstIterator next = upper_bound(time);
+    if (next == begin())
+      return next->m_value.get();
+    ConstIterator prev = next;
+    --prev;
+    if (next == end())
+      return prev->m_value.get();
+    double v0 = prev->m_value.get();
+    double v1 = next->m_value.get();
+    double f = double((time - prev->m_time).to_ticks()) / 
+      (next->m_time - prev->m_time).to_ticks();
+    return AtomicInt::Type(v0 + f * (v1 - v0) + 0.5);
+  }
+  
+  
+  bool Curve::get_range(SongTime const& from, SongTime const& to,
+			AtomicInt::Type& min, AtomicInt::Type& max) const 
+    throw() {
+    if (begin() == end())
+      return false;
+    
+    min = max = get_value(from);
+    AtomicInt::Type v = get_value(to);
+    min = std::min(min, v);
+    max = std::max(max, v);
+    
+    // the points in the whole buckets between the first and the last one
+    // are in the summary, the rest have to be visited
+    ConstIterator iter = lower_bound(from);
+    ConstIterator stop = upper_bound(to);
+    size_t b0 = get_bucket(from);
+    size_t b1 = get_bucket(to);
+    if (b1 > b0 + 1) {
+      ConstIterator mid = lower_bound(get_bucket_start(b0 + 1));
+      for ( ; iter != mid; ++iter) {
+	min = std::min(min, iter->m_value.get());
+	max = std::max(max, iter->m_value.get());
+      }
+      m_summary.get(b0 + 1, b1, min, max);
+      iter = lower_bound(get_bucket_start(b1));
+    }
+    for ( ; iter != stop; ++iter) {
+      min = std::min(min, iter->m_value.get());
+      max = std::max(max, iter->m_value.get());
+    }
+    
+    return true;
+  }
+  
+  
+  size_t Curve::count_points() const throw() {
+    size_t n = 0;
+    for (ConstIterator iter = begin(); iter != end(); ++iter)
+      ++n;
+    return n;
+  }
+  
+  
+  Curve::MemoryUsage Curve::get_memory_usage() const throw() {
+    NodeSkipList<Point>::MemoryUsage nmu = m_data.get_memory_usage();
+    MemoryUsage mu;
+    mu.points = nmu.nodes;
+    mu.links = nmu.links;
+    mu.point_bytes = nmu.bytes;
+    mu.summary_bytes = m_summary.get_memory_usage();
+    return mu;
+  }
+  
+  
+  size_t Curve::copy_points(ConstIterator from, SongTime* times,
+			    AtomicInt::Type* values, size_t n) const throw() {
+    size_t i;
+    for (i = 0; i < n && from != end(); ++i, ++from) {
+      times[i] = from->m_time;
+      values[i] = from->m_value.get();
+    }
+    return i;
+  }
+  
+  
   unique_ptr<Sequencable::Position> 
   Curve::create_position(SongTime const& st) const {
     auto pos = unique_ptr<CurvePosition>(new CurvePosition());
     update_position(*pos, st);
+    // the position has to know about removed nodes so it can tell us when
+    // the sequencing thread is done with them
+    pos->curve = const_cast<Curve*>(this);
+    pos->curve->m_positions.insert(pos.get());
     return move(pos);
   }
     
@@ -245,12 +651,16 @@ namespace Dino {
   void Curve::update_position(Sequencable::Position& pos, 
 			      SongTime const& st) const {
     Sequencable::update_position(pos, st);
-    static_cast<CurvePosition&>(pos).node = m_data.find_less(Point(st));
+    CurvePosition& cp = static_cast<CurvePosition&>(pos);
+    cp.node = m_data.find_less(Point(st));
+    // the receiver may have lost track after a jump, so send every part 
+    // of the next value
+    cp.last_mode = -1;
   }
   
   
   bool Curve::sequence(Sequencable::Position& pos, SongTime const& to, 
-		       EventBuffer& /*buf*/) const {
+		       EventBuffer& buf) const {
     // check if the position needs to be updated
     CurvePosition& cp = static_cast<CurvePosition&>(pos);
     NodeQueue<shared_ptr<Node>>::Node* n;
@@ -263,28 +673,74 @@ namespace Dino {
     if (needs_update)
       update_position(pos, pos.get_time());
     
-    // for each curve point with time < to:
-    NodeBase* nb = cp.node->links[0].next.get();
-    NodeBase* last_sequenced = nb;
-    while (nb != m_data.end_marker()) {
-      Node* node = static_cast<Node*>(node);
-      if (node->data.m_time >= to)
-	break;
-      last_sequenced = node;
-      if (node->data.m_time >= cp.get_time()) {
-	//   interpolate events until to and write to buf
+    // write the events for each segment that overlaps [pos, to), including
+    // the points themselves
+    ControllerOutput out(buf, m_cid, m_mode, cp.last_mode, cp.last_msb);
+    int64_t from = pos.get_time().to_ticks();
+    int64_t end = to.to_ticks();
+    NodeBase const* prev = cp.node;
+    NodeBase const* next = prev->next(0).get();
+    bool ok = true;
+    while (ok && next != m_data.end_marker()) {
+      Point const& p1 = static_cast<Node const*>(next)->data;
+      int64_t t1 = p1.m_time.to_ticks();
+      if (prev != m_data.head_marker()) {
+	ok = interpolate(out, static_cast<Node const*>(prev)->data, p1,
+			 from, std::min(end, t1));
       }
-      nb = node->links[0].next.get();
+      if (!ok || t1 >= end)
+	break;
+      // a point that was added behind the position while we were at it
+      // has already been passed, don't write it with a time in the past
+      if (t1 >= from)
+	ok = out.add(t1, p1.m_value.get());
+      prev = next;
+      next = next->next(0).get();
+    }
+    if (ok)
+      ok = out.flush();
+    
+    // if the buffer was full, continue from the first event that wasn't 
+    // written next time
+    if (!ok) {
+      update_position(pos, SongTime::from_ticks(out.failed_at()));
+      return false;
     }
     
     // update pos with time to and the last node before it
     Sequencable::update_position(pos, to);
-    cp.node = last_sequenced;
+    cp.node = prev;
     
     return true;
   }
 
 
+  bool Curve::chase(Sequencable::Position& pos, EventBuffer& buf) const {
+    if (begin() == end())
+      return true;
+    CurvePosition& cp = static_cast<CurvePosition&>(pos);
+    cp.last_mode = -1;
+    ControllerOutput out(buf, m_cid, m_mode, cp.last_mode, cp.last_msb);
+    if (!out.add(pos.get_time().to_ticks(), get_value(pos.get_time())) || 
+	!out.flush()) {
+      cp.last_mode = -1;
+      return false;
+    }
+    return true;
+  }
+  
+  
+  void Curve::set_length(SongTime const& st) {
+    MinMaxPyramid summary((std::max(st.to_ticks(), int64_t(0)) >> 
+			   summary_shift(st)) + 1);
+    Sequencable::set_length(st);
+    m_summary_shift = summary_shift(st);
+    std::swap(m_summary, summary);
+    for (ConstIterator iter = begin(); iter != end(); ++iter)
+      m_summary.add(get_bucket(iter->m_time), iter->m_value.get());
+  }
+  
+  
   void Curve::remove_curve_position(CurvePosition* c) {
     auto iter = m_positions.find(c);
     if (iter != m_positions.end())
@@ -300,5 +756,37 @@ namespace Dino {
     }
   }
 
+  
+  size_t Curve::get_bucket(SongTime const& time) const throw() {
+    int64_t b = time.to_ticks() >> m_summary_shift;
+    if (b < 0)
+      return 0;
+    if (b >= int64_t(m_summary.get_size()))
+      return m_summary.get_size() - 1;
+    return b;
+  }
+  
+  
+  SongTime Curve::get_bucket_start(size_t bucket) const throw() {
+    return SongTime::from_ticks(int64_t(bucket) << m_summary_shift);
+  }
+  
+  
+  void Curve::update_bucket(size_t bucket) throw() {
+    AtomicInt::Type min = std::numeric_limits<AtomicInt::Type>::max();
+    AtomicInt::Type max = std::numeric_limits<AtomicInt::Type>::min();
+    bool empty = true;
+    for (Iterator i = lower_bound(get_bucket_start(bucket)); 
+	 i != end() && get_bucket(i->m_time) == bucket; ++i) {
+      min = std::min(min, i->m_value.get());
+      max = std::max(max, i->m_value.get());
+      empty = false;
+    }
+    if (empty)
+      m_summary.clear(bucket);
+    else
+      m_summary.set(bucket, min, max);
+  }
+
 
 }
@@ -26,6 +26,7 @@
 
 #include "atomicint.hpp"
 #include "meta.hpp"
+#include "minmaxpyramid.hpp"
 #include "nodequeue.hpp"
 #include "nodeskiplist.hpp"
 #include "sequencable.hpp"
@@ -42,6 +43,11 @@ namespace Dino {
       smooth. There are functions for adding and removing points,
       as well as moving them around and iterating over them.
       
+      The curve also keeps a MinMaxPyramid of the point values that is
+      updated when points are added, moved or removed, so get_range() can 
+      find the value range of any time interval without visiting every 
+      point in it. Editors use this to draw the curve at any zoom level.
+      
       @ingroup mididata
   */
   class Curve : public Sequencable {
@@ -55,8 +61,11 @@ namespace Dino {
 		     AtomicInt::Type v = AtomicInt::Type()) throw();
       
       /** A comparison operator so we can use this as the payload type
-	  in a NodeSkipList. */
-      bool operator<(Point const& p) const throw();
+	  in a NodeSkipList. It is inline since it is called in the inner
+	  loop of every skip list search. */
+      bool operator<(Point const& p) const throw() {
+	return m_time < p.m_time;
+      }
       
       /** The time of this point, from the start of the curve. */
       SongTime m_time;
@@ -80,7 +89,12 @@ namespace Dino {
 	to the last sequenced node (or the skiplist head, if no node in the
 	list has been played yet). */
     struct CurvePosition : Position {
-      CurvePosition() throw() : Position(SongTime(0, 0)), node(0) {}
+      CurvePosition() throw() 
+	: Position(SongTime(0, 0)), node(0), curve(0), last_mode(-1),
+	  last_msb(-1) {}
+      
+      /** Unregister the position from the curve, if it still exists. */
+      ~CurvePosition();
       
       /** The last sequenced node, or the head of the curve if no node in
 	  it has been sequenced yet. */
@@ -96,6 +110,13 @@ namespace Dino {
       
       /** The Curve that this position is used with. */
       Curve* curve;
+      
+      /** The output mode that the last event was sent with, or -1 if the
+	  next value must be sent in full. */
+      int last_mode;
+      
+      /** The last MSB that was sent in the 14 bit modes, or -1. */
+      int last_msb;
     };
     
 
@@ -138,7 +159,7 @@ namespace Dino {
       
       /** Make the iterator point to the next curve point. */
       Derived& operator++() throw() {
-	m_node = static_cast<N*>(m_node)->links[0].next.get();
+	m_node = static_cast<N*>(m_node)->next(0).get();
 	return static_cast<Derived&>(*this);
       }
       
@@ -152,7 +173,7 @@ namespace Dino {
       
       /** Make the iterator point to the previous curve point. */
       Derived& operator--() throw() {
-	m_node = m_node->links[0].prev;
+	m_node = m_node->prev;
 	return static_cast<Derived&>(*this);
       }
       
@@ -224,10 +245,38 @@ namespace Dino {
     /** XXX This should be moved somewhere else! */
     typedef unsigned ControllerID;
     
+    /** The MIDI messages that a curve is sequenced as. All of them are 
+	sent on channel 1 (or group 1, channel 1 for UMP). */
+    enum OutputMode {
+      /** 7 bit control change on controller number ID. This is the 
+	  default. */
+      Controller7,
+      /** 14 bit control change with the MSB on controller ID (0-31) and 
+	  the LSB on controller ID + 32. The MSB is only sent when it 
+	  changes. */
+      Controller14,
+      /** 14 bit NRPN with ID as the parameter number. The parameter is 
+	  selected at the start and after relocations, after that only the
+	  data entry LSB and, when it changes, MSB are sent. */
+      NRPN,
+      /** 14 bit RPN with ID as the parameter number, sent like NRPN. */
+      RPN,
+      /** MIDI 2.0 control change with a 32 bit value on controller ID, 
+	  written with EventBuffer::write_packet(). */
+      UMPController,
+      /** MIDI 2.0 registered controller with a 32 bit value, ID is the
+	  bank times 128 plus the index. */
+      UMPRegistered,
+      /** MIDI 2.0 assignable controller with a 32 bit value, ID is the
+	  bank times 128 plus the index. */
+      UMPAssignable
+    };
+    
     
     /** Create a new Curve with the given label, length and controller ID. */
     Curve(std::string const& label, 
-	  SongTime const& length, ControllerID cid = 0) throw();
+	  SongTime const& length, ControllerID cid = 0) 
+      throw(std::bad_alloc);
     
     /** Destroy the curve. */
     ~Curve() throw();
@@ -238,6 +287,14 @@ namespace Dino {
     /** Set the controller ID. */
     void set_controller_id(ControllerID cid) throw();
     
+    /** Return the output mode. */
+    OutputMode get_output_mode() const throw();
+    
+    /** Set the output mode. The interpolated values are sent with the
+	resolution of the mode, but the high resolution modes send at most
+	128 interpolated values per beat. */
+    void set_output_mode(OutputMode mode) throw();
+    
     /** Add a curve point at the last position that keeps the order
 	of points consistent. Return an iterator for the new point. 
     
@@ -262,6 +319,22 @@ namespace Dino {
 		       Iterator before) 
       throw(std::bad_alloc, std::out_of_range, std::invalid_argument);
     
+    /** Add @c n points with the times in @c times and the values in 
+	@c values. The times must be sorted. The result is the same as 
+	calling add_point() for every point, but the points are merged into
+	the curve in a single pass instead of searching for the position of
+	each one, which makes a big difference when adding many points at 
+	once. Either all points are added or none of them.
+	
+	@throw std::bad_alloc if there isn't enough memory to add the points
+	@throw std::out_of_range if any of the times is smaller than 
+	                         @c SongTime(0,0) or larger than get_length()
+	@throw std::invalid_argument if the times are not sorted
+    */
+    void add_points(SongTime const* times, AtomicInt::Type const* values,
+		    size_t n)
+      throw(std::bad_alloc, std::out_of_range, std::invalid_argument);
+    
     /** Move the point referred to by @c iter to the given time and value.
 	Return a new iterator to the point (the old one will be invalidated)
 	or end() if moving the point to the given time would make the points
@@ -311,6 +384,51 @@ namespace Dino {
 	@c time. */
     ConstIterator upper_bound(SongTime const& time) const throw();
 
+    /** Return the value of the curve at @c time, interpolated linearly
+	between the surrounding points. Before the first point and after the
+	last the value of that point is used. The curve must not be empty. */
+    AtomicInt::Type get_value(SongTime const& time) const throw();
+    
+    /** Find the smallest and largest values of the curve in the interval
+	[@c from, @c to], including the interpolated values at the ends. 
+	Returns false if the curve has no points. This should only be called
+	in the same thread as the functions that modify the curve. */
+    bool get_range(SongTime const& from, SongTime const& to,
+		   AtomicInt::Type& min, AtomicInt::Type& max) const throw();
+    
+    /** Return the number of points in the curve. This has to walk the
+	whole curve. */
+    size_t count_points() const throw();
+    
+    /** The memory used by a curve, see get_memory_usage(). */
+    struct MemoryUsage {
+      
+      /** The number of points in the curve. */
+      size_t points;
+      
+      /** The total number of skip list links in the points. */
+      size_t links;
+      
+      /** The number of bytes used by the points and their links. */
+      size_t point_bytes;
+      
+      /** The number of bytes used by the summary of the point values. */
+      size_t summary_bytes;
+    };
+    
+    /** Return the number of points in the curve and the memory they and
+	the value summary use, not counting the overhead of the memory
+	allocator. This should only be called in the same thread as the
+	functions that modify the curve. */
+    MemoryUsage get_memory_usage() const throw();
+    
+    /** Copy the times and values of at most @c n points, starting at 
+	@c from, into the arrays @c times and @c values. Returns the number
+	of points that were copied. This is the fast way to get the points
+	into contiguous memory for bulk processing. */
+    size_t copy_points(ConstIterator from, SongTime* times, 
+		       AtomicInt::Type* values, size_t n) const throw();
+
     /** Create a new Position object for this sequencable.
 	The Position will start at the offset given by @c st. This function
 	is @b not realtime safe. */
@@ -330,6 +448,17 @@ namespace Dino {
     virtual bool sequence(Position& pos, SongTime const& to, 
 			  EventBuffer& buf) const;
     
+    /** Write the value that the curve has at @c pos in full, including 
+	the parameter selection in the (N)RPN modes. The value is looked up
+	in the skip list, so this takes logarithmic time. Nothing is written
+	if the curve has no points. This function is realtime safe. */
+    virtual bool chase(Position& pos, EventBuffer& buf) const;
+    
+    /** Set the length of the curve. The summary of the point values is
+	rebuilt with buckets that fit the new length, which has to visit 
+	every point. Points after the new end are not removed. */
+    virtual void set_length(SongTime const& st);
+    
   private:
     
     /** Called by the CurvePosition destructor to remove itself. */
@@ -339,6 +468,16 @@ namespace Dino {
 	CurvePositions have confirmed the deletions. */
     void delete_queued_nodes() throw();
     
+    /** Return the summary bucket that @c time falls in. Times after the 
+	end of the curve go in the last bucket. */
+    size_t get_bucket(SongTime const& time) const throw();
+    
+    /** Return the start time of the summary bucket @c bucket. */
+    SongTime get_bucket_start(size_t bucket) const throw();
+    
+    /** Recompute the summary range for @c bucket from the points in it. */
+    void update_bucket(size_t bucket) throw();
+    
     
     /** The list of curve points. */
     NodeSkipList<Point> m_data;
@@ -346,9 +485,18 @@ namespace Dino {
     /** The ID of the controller this curve is for. */
     ControllerID m_cid;
     
+    /** The kind of MIDI messages the curve is sequenced as. */
+    OutputMode m_mode;
+    
     /** The active CurvePositions. */
     std::set<CurvePosition*> m_positions;
     
+    /** log2 of the number of ticks in a summary bucket. */
+    int m_summary_shift;
+    
+    /** The value ranges of all summary buckets. */
+    MinMaxPyramid m_summary;
+    
   };
   
 
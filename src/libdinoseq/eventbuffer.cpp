@@ -0,0 +1,90 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "eventbuffer.hpp"
+
+
+namespace Dino {
+  
+  
+  EventBuffer::~EventBuffer() {}
+  
+  
+  size_t EventBuffer::write_events(Event const* events, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      if (!write_event(events[i].time, 3, events[i].data))
+	return i;
+    }
+    return n;
+  }
+  
+  
+  bool EventBuffer::write_packet(SongTime const& st, size_t n, 
+				 uint32_t const* words) {
+    if (n < 1)
+      return true;
+    uint32_t w = words[0];
+    unsigned char data[3];
+    
+    // MIDI 1.0 channel voice messages, just unwrap them
+    if ((w >> 28) == 0x2) {
+      data[0] = (w >> 16) & 0xFF;
+      data[1] = (w >> 8) & 0x7F;
+      data[2] = w & 0x7F;
+      bool two_bytes = (data[0] & 0xE0) == 0xC0;
+      return write_event(st, two_bytes ? 2 : 3, data);
+    }
+    
+    // MIDI 2.0 channel voice messages
+    if ((w >> 28) != 0x4 || n < 2)
+      return true;
+    unsigned char channel = (w >> 16) & 0x0F;
+    switch ((w >> 20) & 0x0F) {
+      
+    case 0xB: // control change, keep the top 7 bits
+      data[0] = 0xB0 | channel;
+      data[1] = (w >> 8) & 0x7F;
+      data[2] = words[1] >> 25;
+      return write_event(st, 3, data);
+      
+    case 0x2:   // registered controller, send an RPN with the top 14 bits
+    case 0x3: { // assignable controller, send an NRPN
+      bool rpn = ((w >> 20) & 0x0F) == 0x2;
+      unsigned char const params[] = { 
+	(unsigned char)(rpn ? 101 : 99), (unsigned char)((w >> 8) & 0x7F),
+	(unsigned char)(rpn ? 100 : 98), (unsigned char)(w & 0x7F),
+	6, (unsigned char)(words[1] >> 25),
+	38, (unsigned char)((words[1] >> 18) & 0x7F)
+      };
+      data[0] = 0xB0 | channel;
+      for (int i = 0; i < 4; ++i) {
+	data[1] = params[2 * i];
+	data[2] = params[2 * i + 1];
+	if (!write_event(st, 3, data))
+	  return false;
+      }
+      return true;
+    }
+      
+    }
+    
+    return true;
+  }
+  
+  
+}
@@ -19,13 +19,16 @@
 #ifndef EVENTBUFFER_HPP
 #define EVENTBUFFER_HPP
 
+#include <cstddef>
+
+#include <stdint.h>
+
+#include "songtime.hpp"
+
 
 namespace Dino {
 
   
-  class SongTime;
-  
-  
   /** An abstract base class for MIDI event buffers.
       All non-abstract derived classes must implement write_event().
       
@@ -33,11 +36,49 @@ namespace Dino {
   class EventBuffer {
   public:
     
+    /** A fixed size event that can be passed to write_events(). It holds
+	a three byte MIDI message, which covers all the channel messages
+	that the Sequencables generate in bulk (note on and off, controllers,
+	pitchbend). Shorter or longer messages should be written using
+	write_event(). */
+    struct Event {
+      
+      /** The time of the event. */
+      SongTime time;
+      
+      /** The MIDI message. */
+      unsigned char data[3];
+    };
+    
+    /** A virtual destructor is needed to delete safely. */
+    virtual ~EventBuffer();
+    
     /** This function is called by Sequencable::sequence() to write events
 	to the buffer. */
     virtual bool write_event(SongTime const& st, 
 			     size_t bytes, unsigned char const* data) = 0;
     
+    /** This function is called by Sequencable::sequence() to write a 
+	batch of @c n events, sorted by time, to the buffer. It returns the 
+	number of events that were written, which will be less than @c n if
+	the buffer ran out of space. The default implementation calls
+	write_event() once for every event, subclasses that store events in
+	memory should override it to check the available space once and copy
+	the whole batch. */
+    virtual size_t write_events(Event const* events, size_t n);
+    
+    /** This function is called by Sequencable::sequence() to write a MIDI
+	2.0 Universal MIDI Packet of @c n 32 bit words (1, 2, 3 or 4 
+	depending on the message type) to the buffer. Buffers that can pass
+	UMP on to their destination should override it. The default 
+	implementation translates the MIDI 1.0 and MIDI 2.0 channel voice
+	controller messages (control change, registered and assignable
+	controllers) to MIDI 1.0 byte messages, reducing the resolution to
+	7 or 14 bits, and writes them using write_event(). Other packets are
+	ignored. */
+    virtual bool write_packet(SongTime const& st, size_t n, 
+			      uint32_t const* words);
+    
   };
 
 
@@ -0,0 +1,274 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+
+#include "eventmerger.hpp"
+
+
+namespace Dino {
+  
+  
+  using std::bad_alloc;
+  using std::vector;
+  
+  
+  /** A run buffer. The events are stored as headers that point into a 
+      byte array so messages of any size can be merged. */
+  class EventMerger::Run : public EventBuffer {
+  public:
+    
+    struct Item {
+      SongTime time;
+      uint32_t offset;
+      uint32_t size;
+      /** True if the data is a Universal MIDI Packet. */
+      bool packet;
+    };
+    
+    Run(size_t events, size_t bytes) throw(bad_alloc)
+      : items(events),
+	data(bytes),
+	n_items(0),
+	n_bytes(0),
+	next(0) {
+    }
+    
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* d) {
+      if (n_items == items.size() || bytes > data.size() - n_bytes)
+	return false;
+      Item& i = items[n_items++];
+      i.time = st;
+      i.offset = n_bytes;
+      i.size = bytes;
+      i.packet = false;
+      std::memcpy(&data[n_bytes], d, bytes);
+      n_bytes += bytes;
+      return true;
+    }
+    
+    bool write_packet(SongTime const& st, size_t n, uint32_t const* words) {
+      if (!write_event(st, n * sizeof(uint32_t), 
+		       reinterpret_cast<unsigned char const*>(words)))
+	return false;
+      items[n_items - 1].packet = true;
+      return true;
+    }
+    
+    size_t write_events(Event const* events, size_t n) {
+      size_t room = std::min(items.size() - n_items, 
+			     (data.size() - n_bytes) / 3);
+      n = std::min(n, room);
+      for (size_t j = 0; j < n; ++j) {
+	Item& i = items[n_items++];
+	i.time = events[j].time;
+	i.offset = n_bytes;
+	i.size = 3;
+	i.packet = false;
+	std::memcpy(&data[n_bytes], events[j].data, 3);
+	n_bytes += 3;
+      }
+      return n;
+    }
+    
+    /** Write item @c j to @c buf. */
+    bool write_item(size_t j, EventBuffer& buf) const throw() {
+      Item const& item = items[j];
+      if (item.packet) {
+	// the words were copied byte by byte, so they may not be aligned
+	uint32_t words[4];
+	size_t n = std::min(item.size / sizeof(uint32_t), size_t(4));
+	std::memcpy(words, &data[item.offset], n * sizeof(uint32_t));
+	return buf.write_packet(item.time, n, words);
+      }
+      return buf.write_event(item.time, item.size, &data[item.offset]);
+    }
+    
+    /** Remove the items before @c next and move the rest to the start of
+	the buffers. */
+    void compact() throw() {
+      if (next == n_items) {
+	clear();
+	return;
+      }
+      if (next == 0)
+	return;
+      uint32_t base = items[next].offset;
+      std::memmove(&data[0], &data[base], n_bytes - base);
+      for (size_t j = next; j < n_items; ++j) {
+	items[j - next] = items[j];
+	items[j - next].offset -= base;
+      }
+      n_items -= next;
+      n_bytes -= base;
+      next = 0;
+    }
+    
+    void clear() throw() {
+      n_items = 0;
+      n_bytes = 0;
+      next = 0;
+    }
+    
+    vector<Item> items;
+    vector<unsigned char> data;
+    size_t n_items;
+    size_t n_bytes;
+    
+    /** The next item to merge. */
+    size_t next;
+    
+  };
+  
+  
+  /** The comparison for the heap. std::make_heap() and friends put the 
+      largest element first, so this returns true if @c a should come 
+      @b after @c b. */
+  class EventMerger::Later {
+  public:
+    
+    Later(vector<std::unique_ptr<Run> > const& runs) throw()
+      : m_runs(runs) {
+    }
+    
+    bool operator()(size_t a, size_t b) const throw() {
+      SongTime const& ta = m_runs[a]->items[m_runs[a]->next].time;
+      SongTime const& tb = m_runs[b]->items[m_runs[b]->next].time;
+      if (ta != tb)
+	return tb < ta;
+      return b < a;
+    }
+    
+  private:
+    
+    vector<std::unique_ptr<Run> > const& m_runs;
+    
+  };
+  
+  
+  EventMerger::EventMerger(size_t runs, size_t events, size_t bytes) 
+    throw(bad_alloc)
+    : m_batch(events > 256 ? 256 : (events > 0 ? events : 1)),
+      m_batch_size(0),
+      m_batch_runs(m_batch.size()) {
+    m_runs.reserve(runs);
+    for (size_t i = 0; i < runs; ++i)
+      m_runs.push_back(std::unique_ptr<Run>(new Run(events, bytes)));
+    m_heap.reserve(runs);
+  }
+  
+  
+  EventMerger::~EventMerger() {}
+  
+  
+  size_t EventMerger::get_run_count() const throw() {
+    return m_runs.size();
+  }
+  
+  
+  EventBuffer& EventMerger::get_run(size_t i) throw() {
+    return *m_runs[i];
+  }
+  
+  
+  bool EventMerger::merge(EventBuffer& buf) throw() {
+    
+    // start with every run that has something in it
+    m_heap.clear();
+    for (size_t i = 0; i < m_runs.size(); ++i) {
+      if (m_runs[i]->n_items > 0)
+	m_heap.push_back(i);
+    }
+    Later later(m_runs);
+    std::make_heap(m_heap.begin(), m_heap.end(), later);
+    
+    // repeatedly take the earliest event. m_heap has room for all runs, so 
+    // none of this allocates. An event only counts as taken from its run
+    // when it has been written or batched, and flush() puts back the
+    // batched events that didn't fit
+    bool ok = true;
+    m_batch_size = 0;
+    while (!m_heap.empty() && ok) {
+      std::pop_heap(m_heap.begin(), m_heap.end(), later);
+      size_t i = m_heap.back();
+      Run& r = *m_runs[i];
+      Run::Item const& item = r.items[r.next];
+      if (!item.packet && item.size == 3) {
+	EventBuffer::Event& e = m_batch[m_batch_size];
+	e.time = item.time;
+	std::memcpy(e.data, &r.data[item.offset], 3);
+	m_batch_runs[m_batch_size++] = i;
+	++r.next;
+	if (m_batch_size == m_batch.size())
+	  ok = flush(buf);
+      }
+      else {
+	ok = flush(buf) && r.write_item(r.next, buf);
+	if (ok)
+	  ++r.next;
+      }
+      if (r.next < r.n_items)
+	std::push_heap(m_heap.begin(), m_heap.end(), later);
+      else
+	m_heap.pop_back();
+    }
+    if (ok)
+      ok = flush(buf);
+    
+    for (size_t i = 0; i < m_runs.size(); ++i)
+      m_runs[i]->compact();
+    return ok;
+  }
+  
+  
+  bool EventMerger::drain(size_t i, EventBuffer& buf) throw() {
+    Run& r = *m_runs[i];
+    bool ok = true;
+    while (r.next < r.n_items && (ok = r.write_item(r.next, buf)))
+      ++r.next;
+    r.compact();
+    return ok;
+  }
+  
+  
+  void EventMerger::clear() throw() {
+    for (size_t i = 0; i < m_runs.size(); ++i)
+      m_runs[i]->clear();
+    m_batch_size = 0;
+  }
+  
+  
+  bool EventMerger::flush(EventBuffer& buf) throw() {
+    size_t n = m_batch_size;
+    m_batch_size = 0;
+    if (n == 0)
+      return true;
+    size_t written = buf.write_events(&m_batch[0], n);
+    
+    // the events from each run were batched in order and nothing was taken
+    // from that run after them, so stepping back once for every event that
+    // wasn't written puts them back
+    for (size_t j = written; j < n; ++j)
+      --m_runs[m_batch_runs[j]]->next;
+    return written == n;
+  }
+  
+  
+}
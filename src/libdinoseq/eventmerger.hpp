@@ -0,0 +1,118 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef EVENTMERGER_HPP
+#define EVENTMERGER_HPP
+
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <stdint.h>
+
+#include "eventbuffer.hpp"
+#include "songtime.hpp"
+
+
+namespace Dino {
+  
+  
+  /** Merges several time-sorted streams of events into one. Each stream
+      is written to its own run buffer, returned by get_run(), and merge()
+      then writes all the events to an output buffer in time order with a
+      k-way merge. Events with the same time come out in the order of the 
+      runs they were written to. 
+      
+      All the space is allocated when the merger is created, so 
+      get_run(), merge(), drain() and clear() are realtime safe. If a run 
+      fills up its write_event() returns @c false like any other full 
+      buffer.
+      
+      If the output buffer fills up during merge() the events that didn't
+      fit stay in their runs and come out first in the next merge(), since
+      the objects that wrote them have already moved past them. 
+      
+      The events written to each run must be sorted by time, which is what
+      Sequencable::sequence() does. 
+      
+      @ingroup sequencing
+  */
+  class EventMerger {
+  public:
+    
+    /** Create a merger for @c runs streams. Each run has room for 
+	@c events events and @c bytes bytes of event data. */
+    EventMerger(size_t runs, size_t events = 1024, size_t bytes = 4096) 
+      throw(std::bad_alloc);
+    
+    ~EventMerger();
+    
+    /** Return the number of runs. */
+    size_t get_run_count() const throw();
+    
+    /** Return the buffer for run @c i. */
+    EventBuffer& get_run(size_t i) throw();
+    
+    /** Write all events in all runs to @c buf in time order and remove 
+	them from the runs. Returns @c false if @c buf ran out of space, in
+	which case the events that didn't fit are kept in the runs until 
+	the next call. */
+    bool merge(EventBuffer& buf) throw();
+    
+    /** Write the events in run @c i to @c buf without merging them with
+	the other runs, and remove them from the run. Returns @c false if 
+	@c buf ran out of space, in which case the events that didn't fit 
+	are kept. This is used to move the events that are left in a run to
+	another merger. */
+    bool drain(size_t i, EventBuffer& buf) throw();
+    
+    /** Remove all events from all runs. */
+    void clear() throw();
+    
+  private:
+    
+    class Run;
+    class Later;
+    
+    EventMerger(EventMerger const&) = delete;
+    EventMerger& operator=(EventMerger const&) = delete;
+    
+    /** Write the batched events to @c buf. */
+    bool flush(EventBuffer& buf) throw();
+    
+    /** The runs. */
+    std::vector<std::unique_ptr<Run> > m_runs;
+    
+    /** A heap of run numbers, ordered by the time of their next event. */
+    std::vector<size_t> m_heap;
+    
+    /** Three byte events that are waiting to be passed to 
+	EventBuffer::write_events(). */
+    std::vector<EventBuffer::Event> m_batch;
+    size_t m_batch_size;
+    
+    /** The run that each event in m_batch came from. */
+    std::vector<size_t> m_batch_runs;
+    
+  };
+  
+  
+}
+
+
+#endif
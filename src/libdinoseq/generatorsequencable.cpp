@@ -0,0 +1,263 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <time.h>
+
+#include "eventbuffer.hpp"
+#include "generatorsequencable.hpp"
+
+
+namespace Dino {
+  
+  
+  namespace {
+    
+    /** Return the CPU time used by the calling thread, in nanoseconds. */
+    int64_t thread_time() throw() {
+      timespec ts;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+      return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+    
+  }
+  
+  
+  /** A position that also keeps track of the notes that the generator 
+      has turned on and not off, one bit per note and channel. It is only 
+      used by the sequencing thread. */
+  class GeneratorSequencable::GeneratorPosition 
+    : public Sequencable::Position {
+  public:
+    
+    GeneratorPosition(SongTime const& st) throw()
+      : Position(st),
+	midi2_groups(0) {
+      std::memset(notes, 0, sizeof(notes));
+      std::memset(packet_notes, 0, sizeof(packet_notes));
+    }
+    
+    /** The notes that were sent as MIDI 1.0 byte messages. */
+    uint32_t notes[16][4];
+    
+    /** The notes that were sent as Universal MIDI Packets, per group. */
+    uint32_t packet_notes[16][16][4];
+    
+    /** One bit per group that is set if the last note in that group was 
+	a MIDI 2.0 message, so it is turned off with one too. */
+    uint16_t midi2_groups;
+    
+  };
+  
+  
+  /** An EventBuffer that passes the events on to another one and keeps 
+      track of the notes that are turned on and off. */
+  class GeneratorSequencable::NoteTracker : public EventBuffer {
+  public:
+    
+    NoteTracker(EventBuffer& buf, GeneratorPosition& pos) throw()
+      : m_buf(buf), m_pos(pos) {}
+    
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data) {
+      if (!m_buf.write_event(st, bytes, data))
+	return false;
+      if (bytes == 3)
+	track(data);
+      return true;
+    }
+    
+    size_t write_events(Event const* events, size_t n) {
+      size_t written = m_buf.write_events(events, n);
+      for (size_t i = 0; i < written; ++i)
+	track(events[i].data);
+      return written;
+    }
+    
+    bool write_packet(SongTime const& st, size_t n, uint32_t const* words) {
+      if (!m_buf.write_packet(st, n, words))
+	return false;
+      track_packet(n, words);
+      return true;
+    }
+    
+    /** Write note offs for all the notes that are on, in the same form as
+	the note ons. Returns @c false if the buffer was full, the notes 
+	that didn't fit are still on. */
+    bool release(SongTime const& st) throw() {
+      for (unsigned c = 0; c < 16; ++c) {
+	for (unsigned k = 0; k < 128; ++k) {
+	  if (!is_on(m_pos.notes[c], k))
+	    continue;
+	  unsigned char data[] = { (unsigned char)(0x80 | c), 
+				   (unsigned char)k, 64 };
+	  if (!write_event(st, 3, data))
+	    return false;
+	}
+      }
+      for (unsigned g = 0; g < 16; ++g) {
+	bool midi2 = m_pos.midi2_groups & (1 << g);
+	for (unsigned c = 0; c < 16; ++c) {
+	  for (unsigned k = 0; k < 128; ++k) {
+	    if (!is_on(m_pos.packet_notes[g][c], k))
+	      continue;
+	    uint32_t words[2] = { (g << 24) | ((0x80 | c) << 16) | (k << 8), 
+				  0x80000000 };
+	    words[0] |= midi2 ? 0x40000000 : 0x20000040;
+	    if (!write_packet(st, midi2 ? 2 : 1, words))
+	      return false;
+	  }
+	}
+      }
+      return true;
+    }
+    
+  private:
+    
+    static bool is_on(uint32_t const (&notes)[4], unsigned k) throw() {
+      return notes[k / 32] & (uint32_t(1) << (k % 32));
+    }
+    
+    static void set(uint32_t (&notes)[4], unsigned k, bool on) throw() {
+      uint32_t bit = uint32_t(1) << (k % 32);
+      if (on)
+	notes[k / 32] |= bit;
+      else
+	notes[k / 32] &= ~bit;
+    }
+    
+    void track(unsigned char const* data) throw() {
+      unsigned c = data[0] & 0x0F;
+      unsigned k = data[1] & 0x7F;
+      if ((data[0] & 0xF0) == 0x90)
+	set(m_pos.notes[c], k, data[2] > 0);
+      else if ((data[0] & 0xF0) == 0x80)
+	set(m_pos.notes[c], k, false);
+    }
+    
+    void track_packet(size_t n, uint32_t const* words) throw() {
+      if (n < 1)
+	return;
+      uint32_t w = words[0];
+      bool midi2 = (w >> 28) == 0x4;
+      if ((w >> 28) != 0x2 && !(midi2 && n >= 2))
+	return;
+      unsigned status = (w >> 20) & 0x0F;
+      if (status != 0x8 && status != 0x9)
+	return;
+      unsigned g = (w >> 24) & 0x0F;
+      unsigned c = (w >> 16) & 0x0F;
+      unsigned k = (w >> 8) & 0x7F;
+      // a MIDI 1.0 note on with velocity 0 is a note off, a MIDI 2.0 one 
+      // is not
+      set(m_pos.packet_notes[g][c], k, 
+	  status == 0x9 && (midi2 || (w & 0x7F) > 0));
+      if (midi2)
+	m_pos.midi2_groups |= 1 << g;
+      else
+	m_pos.midi2_groups &= ~(1 << g);
+    }
+    
+    EventBuffer& m_buf;
+    GeneratorPosition& m_pos;
+    
+  };
+  
+  
+  GeneratorSequencable::GeneratorSequencable(std::string const& label, 
+					     Generator const& gen,
+					     SongTime const& step, 
+					     int64_t budget)
+    : Sequencable(label, SongTime(-1, 0)),
+      m_generator(gen),
+      m_step(std::max(step.to_ticks(), int64_t(1))),
+      m_budget(0),
+      m_overruns(0) {
+    set_budget(budget);
+  }
+  
+  
+  int64_t GeneratorSequencable::get_budget() const throw() {
+    return m_budget.get();
+  }
+  
+  
+  void GeneratorSequencable::set_budget(int64_t budget) throw() {
+    int64_t max = std::numeric_limits<AtomicInt::Type>::max();
+    m_budget.set(AtomicInt::Type(std::max(std::min(budget, max), 
+					  int64_t(0))));
+  }
+  
+  
+  AtomicInt::Type GeneratorSequencable::get_overruns() const throw() {
+    return m_overruns.get();
+  }
+  
+  
+  std::unique_ptr<Sequencable::Position> 
+  GeneratorSequencable::create_position(SongTime const& st) const {
+    return std::unique_ptr<Position>(new GeneratorPosition(st));
+  }
+  
+  
+  bool GeneratorSequencable::sequence(Position& pos, SongTime const& to,
+				      EventBuffer& buf) const {
+    int64_t deadline = thread_time() + m_budget.get();
+    NoteTracker tracker(buf, static_cast<GeneratorPosition&>(pos));
+    int64_t t = pos.get_time().to_ticks();
+    int64_t end = to.to_ticks();
+    
+    while (t < end) {
+      
+      // out of time, skip the rest but don't leave any notes hanging
+      if (thread_time() >= deadline) {
+	m_overruns.increase();
+	if (!tracker.release(SongTime::from_ticks(t))) {
+	  update_position(pos, SongTime::from_ticks(t));
+	  return false;
+	}
+	break;
+      }
+      
+      // call the generator for the rest of the current step
+      int64_t next = std::min((t / m_step + 1) * m_step, end);
+      bool ok;
+      try {
+	ok = m_generator(SongTime::from_ticks(t), SongTime::from_ticks(next), 
+			 tracker);
+      }
+      catch (...) {
+	deadline = 0;
+	continue;
+      }
+      if (!ok) {
+	update_position(pos, SongTime::from_ticks(t));
+	return false;
+      }
+      t = next;
+    }
+    
+    update_position(pos, to);
+    return true;
+  }
+  
+  
+}
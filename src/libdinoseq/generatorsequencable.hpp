@@ -0,0 +1,122 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef GENERATORSEQUENCABLE_HPP
+#define GENERATORSEQUENCABLE_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <stdint.h>
+
+#include "atomicint.hpp"
+#include "sequencable.hpp"
+#include "songtime.hpp"
+
+
+namespace Dino {
+  
+  
+  /** A Sequencable that generates its events on the fly by calling a 
+      user supplied function, for things like arpeggiators and 
+      algorithmic parts. It has no length.
+      
+      The generator is called once for every step in the sequenced range,
+      and sequence() checks the thread's CPU time between the steps. If 
+      the budget for the call has been used up the rest of the range is
+      skipped: nothing more is sent, so the output stays in the state it 
+      was last left in, except that the notes that the generator has 
+      started are turned off so they don't hang, also when they were sent
+      as Universal MIDI Packets. The notes are tracked separately for 
+      each Position. Every skipped range is counted as an overrun. A step
+      that takes too long can not be interrupted, so the steps should be 
+      short.
+      
+      Exceptions thrown by the generator are caught and treated like an
+      overrun.
+      
+      @ingroup mididata
+  */
+  class GeneratorSequencable : public Sequencable {
+  public:
+    
+    /** The function that generates the events. It should write all events
+	in [@c from, @c to) to the buffer, in time order, and return 
+	@c false if the buffer was full. The ranges are consecutive except
+	after a relocation or an overrun, when @c from is not where the 
+	previous range ended. If it returns @c false the step is generated
+	again in the next call. It is called in the realtime thread, so it 
+	must be realtime safe. */
+    typedef std::function<bool (SongTime const& from, SongTime const& to,
+				EventBuffer& buf)> Generator;
+    
+    /** Create a new generator object. @c step is the length of the steps
+	that the generator is called for, and @c budget is the CPU time 
+	in nanoseconds that one sequence() call may use. */
+    GeneratorSequencable(std::string const& label, Generator const& gen,
+			 SongTime const& step = SongTime(0, 0x400000),
+			 int64_t budget = 200000);
+    
+    /** Return the CPU time budget for each call to sequence(), in 
+	nanoseconds. */
+    int64_t get_budget() const throw();
+    
+    /** Set the CPU time budget. Budgets above about two seconds are 
+	treated as two seconds. This can be called while the object is 
+	played. */
+    void set_budget(int64_t budget) throw();
+    
+    /** Return the number of times sequence() has skipped steps because 
+	the budget was used up or the generator threw an exception. This 
+	can be read in any thread. */
+    AtomicInt::Type get_overruns() const throw();
+    
+    virtual std::unique_ptr<Position> 
+    create_position(SongTime const& st) const;
+    
+    /** Call the generator for each step in [@c pos, @c to) until the 
+	budget is used up. This function is realtime safe if the generator 
+	is. */
+    virtual bool sequence(Position& pos, SongTime const& to, 
+			  EventBuffer& buf) const;
+    
+  private:
+    
+    class GeneratorPosition;
+    class NoteTracker;
+    
+    /** The function that generates the events. */
+    Generator m_generator;
+    
+    /** The length of each step, in ticks. */
+    int64_t m_step;
+    
+    /** The budget in nanoseconds. */
+    AtomicInt m_budget;
+    
+    /** The number of overruns. */
+    mutable AtomicInt m_overruns;
+    
+  };
+  
+  
+}
+
+
+#endif
@@ -0,0 +1,56 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef INSTRUMENT_HPP
+#define INSTRUMENT_HPP
+
+#include <stdint.h>
+
+
+namespace Dino {
+  
+  
+  class InstrumentBuffer;
+  
+  
+  /** An abstract base class for things that turn sequenced events into 
+      sound, such as plugin instances. Instruments are run by an 
+      InstrumentGraph once per period, after the Sequencer has written the
+      events for that period to their InstrumentBuffers. Where the audio 
+      goes is up to the subclass.
+      
+      @ingroup sequencing */
+  class Instrument {
+  public:
+    
+    /** A virtual destructor is needed to delete safely. */
+    virtual ~Instrument();
+    
+    /** Process a period of @c nframes frames, using the events in 
+	@c events. This is called in the thread that runs the graph or in 
+	one of its worker threads, so it must be realtime safe. Instruments
+	that don't depend on each other may be run at the same time. */
+    virtual void run(InstrumentBuffer& events, uint32_t nframes) = 0;
+    
+  };
+  
+  
+}
+
+
+#endif
@@ -0,0 +1,183 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <cstring>
+#include <limits>
+
+#include "instrumentbuffer.hpp"
+
+
+namespace Dino {
+  
+  
+  using std::invalid_argument;
+  using std::numeric_limits;
+  
+  
+  namespace {
+    
+    /** The part of Header::size that isn't events. */
+    uint32_t const body_size = 2 * sizeof(uint32_t);
+    
+    /** Return the number of bytes an event with @c bytes bytes of data 
+	uses. */
+    size_t event_size(size_t bytes) {
+      return sizeof(InstrumentBuffer::EventHeader) + ((bytes + 7) & ~size_t(7));
+    }
+    
+  }
+  
+  
+  InstrumentBuffer::InstrumentBuffer(size_t capacity) 
+    throw(std::bad_alloc, invalid_argument)
+    : m_data(0),
+      m_capacity(capacity & ~size_t(7)),
+      m_count(0),
+      m_last_frame(0),
+      m_event_type(0),
+      m_span(0),
+      m_nframes(0) {
+    if (capacity > numeric_limits<uint32_t>::max() - body_size)
+      throw invalid_argument("Invalid capacity for instrument buffer");
+    // allocate as 64 bit words so the events are aligned
+    uint64_t* mem = new uint64_t[(sizeof(Header) + m_capacity) / 8];
+    m_data = reinterpret_cast<Header*>(mem);
+    m_data->size = body_size;
+    m_data->type = 0;
+    m_data->unit = 0;
+    m_data->pad = 0;
+  }
+  
+  
+  InstrumentBuffer::~InstrumentBuffer() throw() {
+    delete [] reinterpret_cast<uint64_t*>(m_data);
+  }
+  
+  
+  void InstrumentBuffer::set_type_ids(uint32_t sequence_type, 
+				      uint32_t event_type) throw() {
+    m_data->type = sequence_type;
+    m_event_type = event_type;
+    unsigned char* p = reinterpret_cast<unsigned char*>(m_data + 1);
+    unsigned char* e = p + get_size();
+    while (p < e) {
+      EventHeader* h = reinterpret_cast<EventHeader*>(p);
+      h->type = event_type;
+      p += event_size(h->size);
+    }
+  }
+  
+  
+  void InstrumentBuffer::begin_period(SongTime const& from, SongTime const& to,
+				      uint32_t nframes) throw() {
+    m_data->size = body_size;
+    m_count = 0;
+    m_last_frame = 0;
+    m_from = from;
+    m_span = (to - from).to_ticks();
+    m_nframes = nframes;
+  }
+  
+  
+  bool InstrumentBuffer::write_event(SongTime const& st, size_t bytes, 
+				     unsigned char const* data) {
+    if (bytes == 0)
+      return true;
+    size_t used = get_size();
+    size_t esize = event_size(bytes);
+    if (esize > m_capacity - used)
+      return false;
+    
+    int64_t frame = to_frame(st);
+    unsigned char* base = reinterpret_cast<unsigned char*>(m_data + 1);
+    unsigned char* pos = base + used;
+    
+    // events from a single Sequencable arrive in order, so this is only 
+    // needed when several of them share the buffer
+    if (m_count > 0 && frame < m_last_frame) {
+      EventHeader const* e = begin();
+      while (e->frame <= frame)
+	e = e->next();
+      pos = reinterpret_cast<unsigned char*>(const_cast<EventHeader*>(e));
+      std::memmove(pos + esize, pos, base + used - pos);
+    }
+    else
+      m_last_frame = frame;
+    
+    EventHeader* h = reinterpret_cast<EventHeader*>(pos);
+    h->frame = frame;
+    h->size = bytes;
+    h->type = m_event_type;
+    unsigned char* d = reinterpret_cast<unsigned char*>(h + 1);
+    std::memcpy(d, data, bytes);
+    std::memset(d + bytes, 0, esize - sizeof(EventHeader) - bytes);
+    
+    m_data->size += esize;
+    ++m_count;
+    return true;
+  }
+  
+  
+  size_t InstrumentBuffer::get_event_count() const throw() {
+    return m_count;
+  }
+  
+  
+  size_t InstrumentBuffer::get_size() const throw() {
+    return m_data->size - body_size;
+  }
+  
+  
+  size_t InstrumentBuffer::get_capacity() const throw() {
+    return m_capacity;
+  }
+  
+  
+  InstrumentBuffer::Header* InstrumentBuffer::get_data() throw() {
+    return m_data;
+  }
+  
+  
+  InstrumentBuffer::Header const* InstrumentBuffer::get_data() const throw() {
+    return m_data;
+  }
+  
+  
+  InstrumentBuffer::EventHeader const* InstrumentBuffer::begin() const throw() {
+    return reinterpret_cast<EventHeader const*>(m_data + 1);
+  }
+  
+  
+  InstrumentBuffer::EventHeader const* InstrumentBuffer::end() const throw() {
+    return reinterpret_cast<EventHeader const*>
+      (reinterpret_cast<unsigned char const*>(m_data + 1) + get_size());
+  }
+  
+  
+  int64_t InstrumentBuffer::to_frame(SongTime const& st) const throw() {
+    if (m_span <= 0 || m_nframes == 0 || st <= m_from)
+      return 0;
+    int64_t offset = (st - m_from).to_ticks();
+    if (offset >= m_span)
+      return m_nframes - 1;
+    int64_t frame = offset * m_nframes / m_span;
+    return frame < m_nframes ? frame : m_nframes - 1;
+  }
+  
+  
+}
@@ -0,0 +1,175 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef INSTRUMENTBUFFER_HPP
+#define INSTRUMENTBUFFER_HPP
+
+#include <stdexcept>
+
+#include <stdint.h>
+
+#include "eventbuffer.hpp"
+#include "songtime.hpp"
+
+
+namespace Dino {
+  
+  
+  /** An EventBuffer that an Instrument reads its input events from. It
+      is allocated once with a fixed capacity, and stores the events as 
+      frame offsets into the current period in the same memory layout as 
+      an LV2 atom sequence: a Header followed by events that each start with
+      an EventHeader and are padded to a multiple of 8 bytes. A plugin host
+      can therefore connect a plugin's event input port directly to 
+      get_data() without converting or copying anything.
+      
+      The events are kept sorted by frame even if several Sequencables 
+      write to the same buffer. All functions except the constructor are
+      realtime safe.
+      
+      @ingroup sequencing */
+  class InstrumentBuffer : public EventBuffer {
+  public:
+    
+    /** The header of the buffer. This is an LV2_Atom followed by an
+	LV2_Atom_Sequence_Body. */
+    struct Header {
+      
+      /** The number of bytes after @c size and @c type. */
+      uint32_t size;
+      
+      /** The type ID of the sequence, see set_type_ids(). */
+      uint32_t type;
+      
+      /** The time unit. This is always 0, which means frames. */
+      uint32_t unit;
+      
+      /** Unused. */
+      uint32_t pad;
+    };
+    
+    /** The header of a single event. This is an LV2_Atom_Event. The MIDI
+	message follows directly after it. */
+    struct EventHeader {
+      
+      /** The frame offset from the start of the period. */
+      int64_t frame;
+      
+      /** The number of bytes in the MIDI message. */
+      uint32_t size;
+      
+      /** The type ID of the event, see set_type_ids(). */
+      uint32_t type;
+      
+      /** Return a pointer to the MIDI message. */
+      unsigned char const* data() const throw() {
+	return reinterpret_cast<unsigned char const*>(this + 1);
+      }
+      
+      /** Return a pointer to the next event in the buffer. */
+      EventHeader const* next() const throw() {
+	return reinterpret_cast<EventHeader const*>
+	  (data() + ((size + 7) & ~uint32_t(7)));
+      }
+    };
+    
+    /** Create a new buffer with room for @c capacity bytes of events. A 
+	three byte MIDI message uses 24 bytes.
+	
+	@throw std::invalid_argument if @c capacity is too large */
+    InstrumentBuffer(size_t capacity) 
+      throw(std::bad_alloc, std::invalid_argument);
+    
+    ~InstrumentBuffer() throw();
+    
+    /** Copying is not allowed. */
+    InstrumentBuffer(InstrumentBuffer const&) = delete;
+    
+    /** Assignment is not allowed. */
+    InstrumentBuffer& operator=(InstrumentBuffer const&) = delete;
+    
+    /** Set the type IDs that are written to the header and to every event.
+	An LV2 host should set them to the mapped URIDs for atom:Sequence 
+	and midi:MidiEvent. Both are 0 by default. */
+    void set_type_ids(uint32_t sequence_type, uint32_t event_type) throw();
+    
+    /** Remove all events and set the period that incoming event times are
+	mapped to. Events at @c from are written at frame 0 and events at 
+	@c to would be written at frame @c nframes, events outside the 
+	period are clamped to it. */
+    void begin_period(SongTime const& from, SongTime const& to, 
+		      uint32_t nframes) throw();
+    
+    /** Write a single event. Returns @c false if the buffer is full. */
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data);
+    
+    /** Return the number of events in the buffer. */
+    size_t get_event_count() const throw();
+    
+    /** Return the number of bytes that the events use. */
+    size_t get_size() const throw();
+    
+    /** Return the size of the event area. */
+    size_t get_capacity() const throw();
+    
+    /** Return a pointer to the buffer header. */
+    Header* get_data() throw();
+    
+    /** Return a pointer to the buffer header. */
+    Header const* get_data() const throw();
+    
+    /** Return a pointer to the first event. */
+    EventHeader const* begin() const throw();
+    
+    /** Return a pointer to the end of the last event. */
+    EventHeader const* end() const throw();
+    
+  private:
+    
+    /** Return the frame offset for @c st in the current period. */
+    int64_t to_frame(SongTime const& st) const throw();
+    
+    /** The header followed by the event area. */
+    Header* m_data;
+    
+    /** The size of the event area in bytes. */
+    size_t m_capacity;
+    
+    /** The number of events. */
+    size_t m_count;
+    
+    /** The frame of the last event, used to tell whether a new event can
+	simply be appended. */
+    int64_t m_last_frame;
+    
+    /** The event type ID. */
+    uint32_t m_event_type;
+    
+    /** The current period. */
+    SongTime m_from;
+    int64_t m_span;
+    uint32_t m_nframes;
+    
+  };
+  
+  
+}
+
+
+#endif
@@ -0,0 +1,265 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "instrument.hpp"
+#include "instrumentbuffer.hpp"
+#include "instrumentgraph.hpp"
+#include "sequencer.hpp"
+
+
+namespace Dino {
+  
+  
+  using std::invalid_argument;
+  using std::out_of_range;
+  using std::runtime_error;
+  using std::shared_ptr;
+  using std::vector;
+  
+  
+  InstrumentGraph::InstrumentGraph(unsigned threads, size_t buffer_capacity,
+				   int priority)
+    throw(std::bad_alloc, runtime_error)
+    : m_ready_write(0),
+      m_ready_read(0),
+      m_remaining(0),
+      m_nframes(0),
+      m_buffer_capacity(buffer_capacity),
+      m_quit(0) {
+    
+    sem_init(&m_ready_sem, 0, 0);
+    sem_init(&m_done_sem, 0, 0);
+    
+    m_workers.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+      pthread_t thread;
+      int err = EPERM;
+      
+      // try to get a SCHED_FIFO thread first, then fall back to a normal one
+      if (priority > 0) {
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	sched_param param;
+	std::memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	pthread_attr_setschedparam(&attr, &param);
+	err = pthread_create(&thread, &attr, &InstrumentGraph::worker_main,
+			     this);
+	pthread_attr_destroy(&attr);
+      }
+      if (err == EPERM || err == EINVAL)
+	err = pthread_create(&thread, 0, &InstrumentGraph::worker_main, this);
+      
+      if (err != 0) {
+	stop_workers();
+	sem_destroy(&m_ready_sem);
+	sem_destroy(&m_done_sem);
+	throw runtime_error("Could not start the instrument worker threads");
+      }
+      m_workers.push_back(thread);
+    }
+  }
+  
+  
+  InstrumentGraph::~InstrumentGraph() throw() {
+    stop_workers();
+    sem_destroy(&m_ready_sem);
+    sem_destroy(&m_done_sem);
+  }
+  
+  
+  unsigned InstrumentGraph::default_threads() throw() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 1 ? unsigned(cpus - 1) : 0;
+  }
+  
+  
+  unsigned InstrumentGraph::get_threads() const throw() {
+    return m_workers.size();
+  }
+  
+  
+  InstrumentGraph::NodeID 
+  InstrumentGraph::add_instrument(shared_ptr<Instrument> instrument)
+    throw(std::bad_alloc, invalid_argument) {
+    if (!instrument)
+      throw invalid_argument("Can not add a null instrument");
+    shared_ptr<InstrumentBuffer> buffer(new InstrumentBuffer(m_buffer_capacity));
+    m_ready.push_back(AtomicInt(-1));
+    m_nodes.push_back(Node());
+    Node& n = m_nodes.back();
+    n.instrument = instrument;
+    n.buffer = buffer;
+    n.dependencies = 0;
+    return m_nodes.size() - 1;
+  }
+  
+  
+  size_t InstrumentGraph::get_size() const throw() {
+    return m_nodes.size();
+  }
+  
+  
+  void InstrumentGraph::add_dependency(NodeID before, NodeID after)
+    throw(std::bad_alloc, out_of_range, invalid_argument) {
+    if (before >= m_nodes.size() || after >= m_nodes.size())
+      throw out_of_range("Invalid instrument ID");
+    if (before == after || reachable(after, before))
+      throw invalid_argument("The dependency would create a cycle");
+    vector<NodeID>& deps = m_nodes[before].dependents;
+    for (size_t i = 0; i < deps.size(); ++i) {
+      if (deps[i] == after)
+	return;
+    }
+    deps.push_back(after);
+    ++m_nodes[after].dependencies;
+  }
+  
+  
+  shared_ptr<Instrument> InstrumentGraph::get_instrument(NodeID id) const
+    throw(out_of_range) {
+    if (id >= m_nodes.size())
+      throw out_of_range("Invalid instrument ID");
+    return m_nodes[id].instrument;
+  }
+  
+  
+  shared_ptr<InstrumentBuffer> InstrumentGraph::get_event_buffer(NodeID id) 
+    const throw(out_of_range) {
+    if (id >= m_nodes.size())
+      throw out_of_range("Invalid instrument ID");
+    return m_nodes[id].buffer;
+  }
+  
+  
+  void InstrumentGraph::begin_period(SongTime const& from, SongTime const& to,
+				     uint32_t nframes) throw() {
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+      m_nodes[i].buffer->begin_period(from, to, nframes);
+  }
+  
+  
+  void InstrumentGraph::run(uint32_t nframes) throw() {
+    if (m_nodes.empty())
+      return;
+    
+    // reset the scheduling state. No worker touches it between periods.
+    m_nframes = nframes;
+    m_remaining.set(m_nodes.size());
+    m_ready_write.set(0);
+    m_ready_read.set(0);
+    for (size_t i = 0; i < m_nodes.size(); ++i) {
+      m_ready[i].set(-1);
+      m_nodes[i].pending.set(m_nodes[i].dependencies);
+    }
+    for (size_t i = 0; i < m_nodes.size(); ++i) {
+      if (m_nodes[i].dependencies == 0)
+	push_ready(i);
+    }
+    
+    // help the workers until the queue is empty, then wait for the ones
+    // that are still running. Without workers this runs everything.
+    while (m_remaining.get() > 0 && sem_trywait(&m_ready_sem) == 0)
+      execute(pop_ready());
+    while (sem_wait(&m_done_sem) != 0 && errno == EINTR);
+  }
+  
+  
+  void InstrumentGraph::process(Sequencer& seq, SongTime const& from, 
+				SongTime const& to, uint32_t nframes) {
+    begin_period(from, to, nframes);
+    seq.run(from, to);
+    run(nframes);
+  }
+  
+  
+  bool InstrumentGraph::reachable(NodeID from, NodeID to) const {
+    vector<bool> visited(m_nodes.size(), false);
+    vector<NodeID> stack(1, from);
+    while (!stack.empty()) {
+      NodeID id = stack.back();
+      stack.pop_back();
+      if (id == to)
+	return true;
+      if (visited[id])
+	continue;
+      visited[id] = true;
+      vector<NodeID> const& deps = m_nodes[id].dependents;
+      stack.insert(stack.end(), deps.begin(), deps.end());
+    }
+    return false;
+  }
+  
+  
+  void InstrumentGraph::push_ready(NodeID id) throw() {
+    m_ready[m_ready_write.add(1)].set(id);
+    sem_post(&m_ready_sem);
+  }
+  
+  
+  InstrumentGraph::NodeID InstrumentGraph::pop_ready() throw() {
+    // the slot may have been claimed by a thread that hasn't written it yet
+    AtomicInt& slot = m_ready[m_ready_read.add(1)];
+    AtomicInt::Type id;
+    while ((id = slot.get()) < 0);
+    return id;
+  }
+  
+  
+  void InstrumentGraph::execute(NodeID id) throw() {
+    Node& n = m_nodes[id];
+    n.instrument->run(*n.buffer, m_nframes);
+    for (size_t i = 0; i < n.dependents.size(); ++i) {
+      if (m_nodes[n.dependents[i]].pending.decrease_and_test())
+	push_ready(n.dependents[i]);
+    }
+    if (m_remaining.decrease_and_test())
+      sem_post(&m_done_sem);
+  }
+  
+  
+  void InstrumentGraph::stop_workers() throw() {
+    m_quit.set(1);
+    for (size_t i = 0; i < m_workers.size(); ++i)
+      sem_post(&m_ready_sem);
+    for (size_t i = 0; i < m_workers.size(); ++i)
+      pthread_join(m_workers[i], 0);
+    m_workers.clear();
+  }
+  
+  
+  void* InstrumentGraph::worker_main(void* arg) {
+    InstrumentGraph* graph = static_cast<InstrumentGraph*>(arg);
+    while (true) {
+      while (sem_wait(&graph->m_ready_sem) != 0 && errno == EINTR);
+      if (graph->m_quit.get())
+	break;
+      graph->execute(graph->pop_ready());
+    }
+    return 0;
+  }
+  
+  
+}
@@ -0,0 +1,199 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef INSTRUMENTGRAPH_HPP
+#define INSTRUMENTGRAPH_HPP
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+
+#include "atomicint.hpp"
+#include "songtime.hpp"
+
+
+namespace Dino {
+  
+  
+  class Instrument;
+  class InstrumentBuffer;
+  class Sequencer;
+  
+  
+  /** The stage after the Sequencer. It holds a set of Instruments, each 
+      with its own preallocated InstrumentBuffer that the Sequencer writes 
+      to, and runs all of them once per period. 
+      
+      Instruments are independent unless add_dependency() says otherwise,
+      for example when one instrument processes the audio output of 
+      another. Independent instruments are run in parallel by a fixed pool
+      of worker threads that is created by the constructor, together with
+      the thread that calls run(). Scheduling a period doesn't allocate 
+      memory or take any locks, the threads only wait on semaphores, so 
+      run() and process() are realtime safe as long as the instruments are.
+      
+      The graph is edited in the non-realtime thread. Edits must not be 
+      made while run() or process() is executing.
+      
+      @ingroup sequencing */
+  class InstrumentGraph {
+  public:
+    
+    /** The identifier for an instrument in the graph. */
+    typedef size_t NodeID;
+    
+    /** Create a new empty graph with @c threads worker threads and 
+	instrument buffers with @c buffer_capacity bytes each. The workers
+	get SCHED_FIFO with the given priority if @c priority is larger 
+	than 0 and the process is allowed to, otherwise they are normal 
+	threads.
+	
+	@throw std::runtime_error if the worker threads can't be created */
+    InstrumentGraph(unsigned threads = default_threads(), 
+		    size_t buffer_capacity = 16384, int priority = 0)
+      throw(std::bad_alloc, std::runtime_error);
+    
+    /** Stop the worker threads. */
+    ~InstrumentGraph() throw();
+    
+    /** Copying is not allowed. */
+    InstrumentGraph(InstrumentGraph const&) = delete;
+    
+    /** Assignment is not allowed. */
+    InstrumentGraph& operator=(InstrumentGraph const&) = delete;
+    
+    /** Return one less than the number of online CPUs, since the thread 
+	that calls run() does work too. */
+    static unsigned default_threads() throw();
+    
+    /** Return the number of worker threads. */
+    unsigned get_threads() const throw();
+    
+    /** Add an instrument and return its ID. */
+    NodeID add_instrument(std::shared_ptr<Instrument> instrument)
+      throw(std::bad_alloc, std::invalid_argument);
+    
+    /** Return the number of instruments in the graph. */
+    size_t get_size() const throw();
+    
+    /** Make sure that the instrument @c after is not run until @c before
+	has finished.
+	
+	@throw std::out_of_range if any of the IDs is invalid
+	@throw std::invalid_argument if the dependency would create a 
+	                             cycle */
+    void add_dependency(NodeID before, NodeID after)
+      throw(std::bad_alloc, std::out_of_range, std::invalid_argument);
+    
+    /** Return the instrument with the given ID. */
+    std::shared_ptr<Instrument> get_instrument(NodeID id) const
+      throw(std::out_of_range);
+    
+    /** Return the buffer that the instrument with the given ID reads its
+	events from. Pass it to Sequencer::set_event_buffer() to connect 
+	a Sequencable to the instrument. */
+    std::shared_ptr<InstrumentBuffer> get_event_buffer(NodeID id) const
+      throw(std::out_of_range);
+    
+    /** Clear all instrument buffers and map the period from @c from to 
+	@c to onto @c nframes frames. Call this before Sequencer::run(). */
+    void begin_period(SongTime const& from, SongTime const& to,
+		      uint32_t nframes) throw();
+    
+    /** Run all instruments for @c nframes frames and return when they are
+	done. */
+    void run(uint32_t nframes) throw();
+    
+    /** Sequence the period from @c from to @c to with @c seq and run all 
+	instruments for it. This is the same as calling begin_period(),
+	Sequencer::run() and run(). */
+    void process(Sequencer& seq, SongTime const& from, SongTime const& to,
+		 uint32_t nframes);
+    
+  private:
+    
+    /** An instrument and the scheduling state for it. */
+    struct Node {
+      std::shared_ptr<Instrument> instrument;
+      std::shared_ptr<InstrumentBuffer> buffer;
+      /** The nodes that depend on this one. */
+      std::vector<NodeID> dependents;
+      /** The number of nodes that this one depends on. */
+      AtomicInt::Type dependencies;
+      /** The number of dependencies that haven't finished in the current
+	  period. */
+      AtomicInt pending;
+    };
+    
+    /** Return @c true if @c to can be reached from @c from. */
+    bool reachable(NodeID from, NodeID to) const;
+    
+    /** Queue a node that has no unfinished dependencies. */
+    void push_ready(NodeID id) throw();
+    
+    /** Take a node from the queue. The semaphore must have been taken. */
+    NodeID pop_ready() throw();
+    
+    /** Run a node and queue the dependents that it was the last 
+	dependency for. */
+    void execute(NodeID id) throw();
+    
+    /** Tell the worker threads to quit and wait for them. */
+    void stop_workers() throw();
+    
+    static void* worker_main(void* arg);
+    
+    
+    std::vector<Node> m_nodes;
+    
+    /** The queue of nodes that are ready to run in the current period. 
+	Each node is queued exactly once per period, so it never wraps. 
+	Slots are -1 until the node ID has been written. */
+    std::vector<AtomicInt> m_ready;
+    AtomicInt m_ready_write;
+    AtomicInt m_ready_read;
+    
+    /** The number of nodes that haven't finished in the current period. */
+    AtomicInt m_remaining;
+    
+    /** Counts the nodes in the ready queue. */
+    sem_t m_ready_sem;
+    
+    /** Posted by the node that finishes the period. */
+    sem_t m_done_sem;
+    
+    /** The frame count for the current period. */
+    uint32_t m_nframes;
+    
+    size_t m_buffer_capacity;
+    
+    std::vector<pthread_t> m_workers;
+    
+    AtomicInt m_quit;
+    
+  };
+  
+  
+}
+
+
+#endif
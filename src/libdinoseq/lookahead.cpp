@@ -0,0 +1,336 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <cstring>
+
+#include <unistd.h>
+
+#include "eventbuffer.hpp"
+#include "lookahead.hpp"
+
+
+namespace Dino {
+  
+  
+  using std::shared_ptr;
+  using std::unique_ptr;
+  using std::vector;
+  
+  
+  namespace {
+    
+    /** Return @c true if generation @c a is older than @c b, taking 
+	wrapping into account. */
+    bool is_older(AtomicInt::Type a, AtomicInt::Type b) throw() {
+      return int32_t(uint32_t(a) - uint32_t(b)) < 0;
+    }
+    
+  }
+  
+  
+  /** The realtime thread's position. It has its own position in the source
+      for when it has to be sequenced directly. */
+  class Lookahead::LookaheadPosition : public Sequencable::Position {
+  public:
+    
+    LookaheadPosition(SongTime const& st, unique_ptr<Position> d)
+      : Position(st), direct(move(d)), locates(0), fallbacks(0) {}
+    
+    unique_ptr<Position> direct;
+    AtomicInt::Type locates;
+    AtomicInt::Type fallbacks;
+    
+  };
+  
+  
+  /** An EventBuffer that stages the events before they are pushed into
+      the ring. It never runs out of space, so every event that the source
+      writes is pushed exactly once. */
+  class Lookahead::StagingBuffer : public EventBuffer {
+  public:
+    
+    StagingBuffer(vector<Item>& items, AtomicInt::Type generation) throw()
+      : m_items(items), m_generation(generation) {}
+    
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data) {
+      // there is no room for long messages like SysEx, drop them
+      if (bytes > sizeof(Item::data))
+	return true;
+      Item item;
+      item.time = st;
+      item.generation = m_generation;
+      item.size = bytes;
+      item.packet = false;
+      std::memcpy(item.data, data, bytes);
+      m_items.push_back(item);
+      return true;
+    }
+    
+    bool write_packet(SongTime const& st, size_t n, uint32_t const* words) {
+      if (n > 4)
+	return true;
+      Item item;
+      item.time = st;
+      item.generation = m_generation;
+      item.size = n;
+      item.packet = true;
+      std::memcpy(item.data, words, n * sizeof(uint32_t));
+      m_items.push_back(item);
+      return true;
+    }
+    
+  private:
+    
+    vector<Item>& m_items;
+    AtomicInt::Type m_generation;
+    
+  };
+  
+  
+  Lookahead::Lookahead(shared_ptr<Sequencable> source, 
+		       SongTime const& window, size_t capacity) 
+    throw(std::bad_alloc)
+    : Sequencable(source->get_label(), source->get_length()),
+      m_source(source),
+      m_window(window),
+      m_ring(new CommandRing<Item>(capacity)),
+      m_edits(new CommandRing<Range>(64)),
+      m_edits_lost(0),
+      m_render_pos(source->create_position(SongTime(0, 0))),
+      m_generation(0),
+      m_staged_next(0) {
+    // nothing is rendered until the worker has seen a position
+    m_rendered.start = m_rendered.end = SongTime(0, 0);
+    m_rendered.generation = 0;
+    m_rendered.locates = -1;
+    m_progress.write(m_rendered);
+  }
+  
+  
+  Lookahead::~Lookahead() {}
+  
+  
+  shared_ptr<Sequencable> Lookahead::get_source() const throw() {
+    return m_source;
+  }
+  
+  
+  unique_ptr<Sequencable::Position> 
+  Lookahead::create_position(SongTime const& st) const {
+    // this is called from a non-realtime thread, so it must not publish 
+    // the playhead - only the realtime thread writes to that channel. The
+    // worker starts rendering when the first update_position() or 
+    // sequence() call publishes where the new position is
+    return unique_ptr<Position>(new LookaheadPosition(st, m_source->
+						      create_position(st)));
+  }
+  
+  
+  void Lookahead::update_position(Position& pos, SongTime const& st) const {
+    Sequencable::update_position(pos, st);
+    LookaheadPosition& lp = static_cast<LookaheadPosition&>(pos);
+    Playhead ph = { st, ++lp.locates, lp.fallbacks };
+    m_playhead.write(ph);
+  }
+  
+  
+  bool Lookahead::sequence(Position& pos, SongTime const& to, 
+			   EventBuffer& buf) const {
+    LookaheadPosition& lp = static_cast<LookaheadPosition&>(pos);
+    SongTime from = pos.get_time();
+    Progress p;
+    bool known = m_progress.read(p);
+    bool rendered = known && p.locates == lp.locates &&
+      p.start <= from && to <= p.end;
+    
+    // throw away everything from older generations or before the position,
+    // but leave newer generations alone, the worker may have restarted 
+    // after p was read
+    Item const* item;
+    if (known) {
+      while ((item = m_ring->peek()) && 
+	     !is_older(p.generation, item->generation) &&
+	     (item->generation != p.generation || item->time < from))
+	m_ring->drop();
+    }
+    
+    // copy the rendered events
+    bool ok = true;
+    if (rendered) {
+      while ((item = m_ring->peek()) && item->generation == p.generation &&
+	     item->time < to) {
+	if (item->packet)
+	  ok = buf.write_packet(item->time, item->size, item->data);
+	else {
+	  ok = buf.write_event(item->time, item->size, 
+			       reinterpret_cast<unsigned char const*>
+			       (item->data));
+	}
+	if (!ok) {
+	  Sequencable::update_position(pos, item->time);
+	  break;
+	}
+	m_ring->drop();
+      }
+      if (ok)
+	Sequencable::update_position(pos, to);
+    }
+    
+    // or sequence the source directly, the rendered events for this range
+    // are thrown away in the next call
+    else {
+      if (lp.direct->get_time() != from)
+	m_source->update_position(*lp.direct, from);
+      ok = m_source->sequence(*lp.direct, to, buf);
+      Sequencable::update_position(pos, lp.direct->get_time());
+      ++lp.fallbacks;
+    }
+    
+    Playhead ph = { pos.get_time(), lp.locates, lp.fallbacks };
+    m_playhead.write(ph);
+    
+    return ok;
+  }
+  
+  
+  bool Lookahead::chase(Position& pos, EventBuffer& buf) const {
+    LookaheadPosition& lp = static_cast<LookaheadPosition&>(pos);
+    if (lp.direct->get_time() != pos.get_time())
+      m_source->update_position(*lp.direct, pos.get_time());
+    return m_source->chase(*lp.direct, buf);
+  }
+  
+  
+  void Lookahead::invalidate(SongTime const& from, SongTime const& to) 
+    throw() {
+    Range r = { from, to };
+    if (!m_edits->push(r))
+      m_edits_lost.set(1);
+  }
+  
+  
+  bool Lookahead::fill() throw() {
+    try {
+      Playhead ph;
+      if (!m_playhead.read(ph))
+	return false;
+      
+      // start over after a relocation
+      bool again = ph.locates != m_rendered.locates;
+      
+      // or if an edit overlaps what has been rendered but not played yet
+      Range r;
+      while (m_edits->pop(r))
+	again = again || (r.to > ph.time && r.from < m_rendered.end);
+      if (m_edits_lost.get()) {
+	m_edits_lost.set(0);
+	again = true;
+      }
+      
+      if (again)
+	restart(ph.time, ph.locates);
+      
+      // render up to the window, but only when the previous events have 
+      // found room in the ring
+      SongTime target = ph.time + m_window;
+      if (m_staged_next == m_staged.size() && 
+	  m_render_pos->get_time() < target) {
+	m_staged.clear();
+	m_staged_next = 0;
+	StagingBuffer staging(m_staged, m_generation);
+	m_source->sequence(*m_render_pos, target, staging);
+      }
+      while (m_staged_next < m_staged.size() && 
+	     m_ring->push(m_staged[m_staged_next]))
+	++m_staged_next;
+      
+      // everything before the first event that is still staged is in the 
+      // ring now
+      SongTime end = m_staged_next < m_staged.size() ? 
+	m_staged[m_staged_next].time : m_render_pos->get_time();
+      if (end == m_rendered.end)
+	return false;
+      m_rendered.end = end;
+      m_progress.write(m_rendered);
+      return true;
+    }
+    catch (...) {
+      // the source failed to render, so start over at the playhead on the
+      // next call as if the whole range had been edited
+      m_staged.clear();
+      m_staged_next = 0;
+      m_edits_lost.set(1);
+      return false;
+    }
+  }
+  
+  
+  AtomicInt::Type Lookahead::get_fallbacks() const throw() {
+    Playhead ph;
+    m_playhead.read(ph);
+    return ph.fallbacks;
+  }
+  
+  
+  void Lookahead::restart(SongTime const& st, AtomicInt::Type locates) {
+    // publish the new generation before writing any events for it, so the
+    // realtime thread doesn't throw them away as unknown
+    ++m_generation;
+    m_source->update_position(*m_render_pos, st);
+    m_staged.clear();
+    m_staged_next = 0;
+    m_rendered.start = m_rendered.end = st;
+    m_rendered.generation = m_generation;
+    m_rendered.locates = locates;
+    m_progress.write(m_rendered);
+  }
+  
+  
+  LookaheadWorker::LookaheadWorker(vector<shared_ptr<Lookahead>> const& 
+				   objects, unsigned interval) 
+    throw(std::bad_alloc, std::runtime_error)
+    : m_objects(objects),
+      m_interval(interval),
+      m_quit(0) {
+    if (pthread_create(&m_thread, 0, &LookaheadWorker::thread_main, this))
+      throw std::runtime_error("Could not start the lookahead thread");
+  }
+  
+  
+  LookaheadWorker::~LookaheadWorker() throw() {
+    m_quit.set(1);
+    pthread_join(m_thread, 0);
+  }
+  
+  
+  void* LookaheadWorker::thread_main(void* arg) {
+    LookaheadWorker* me = static_cast<LookaheadWorker*>(arg);
+    while (!me->m_quit.get()) {
+      bool busy = false;
+      for (size_t i = 0; i < me->m_objects.size(); ++i)
+	busy = me->m_objects[i]->fill() || busy;
+      // keep going while there's work, but don't spin when there isn't
+      if (!busy)
+	usleep(me->m_interval);
+    }
+    return 0;
+  }
+  
+  
+}
@@ -0,0 +1,250 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LOOKAHEAD_HPP
+#define LOOKAHEAD_HPP
+
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "atomicint.hpp"
+#include "commandring.hpp"
+#include "sequencable.hpp"
+#include "songtime.hpp"
+#include "statuschannel.hpp"
+
+
+namespace Dino {
+  
+  
+  /** A Sequencable that sequences another Sequencable ahead of the 
+      playhead in a non-realtime thread. The events are rendered into a 
+      lock-free ring by fill(), which a LookaheadWorker calls regularly, 
+      and sequence() only copies the events for the requested range out of
+      the ring. This makes the realtime cost of expensive Sequencables, 
+      like generated or scripted ones, small and predictable.
+      
+      When the ring doesn't cover the requested range, for example just 
+      after a relocation or an edit, sequence() calls the source directly
+      instead, so nothing is ever missed. This means the source must 
+      allow two positions to be sequenced from different threads at the 
+      same time, which Curve does.
+      
+      Edits to the source must be followed by a call to invalidate(). If 
+      they overlap the rendered window it is rendered again from the 
+      playhead, otherwise nothing needs to be done.
+      
+      A Lookahead can only be played by one Sequencer at a time.
+      
+      @ingroup sequencing
+  */
+  class Lookahead : public Sequencable {
+  public:
+    
+    /** Create a new Lookahead that renders @c source up to @c window ahead
+	of the playhead, using at most @c capacity events. */
+    Lookahead(std::shared_ptr<Sequencable> source, SongTime const& window,
+	      size_t capacity = 4096) throw(std::bad_alloc);
+    
+    ~Lookahead();
+    
+    /** Return the Sequencable that is rendered. */
+    std::shared_ptr<Sequencable> get_source() const throw();
+    
+    virtual std::unique_ptr<Position> 
+    create_position(SongTime const& st) const;
+    
+    /** Move the position. The worker starts rendering from the new time
+	the next time it runs. */
+    virtual void update_position(Position& pos, SongTime const& st) const;
+    
+    /** Copy the rendered events in [@c pos, @c to) to @c buf, or sequence
+	the source directly if they haven't been rendered. This function is
+	realtime safe if the source's sequence() is. */
+    virtual bool sequence(Position& pos, SongTime const& to, 
+			  EventBuffer& buf) const;
+    
+    /** Chase the source's state. This always calls the source directly. */
+    virtual bool chase(Position& pos, EventBuffer& buf) const;
+    
+    /** Tell the Lookahead that the source has been changed in the range 
+	[@c from, @c to). This may be called by one non-realtime thread. */
+    void invalidate(SongTime const& from, SongTime const& to) throw();
+    
+    /** Render the source up to the window ahead of the playhead, or as far
+	as the ring has space for. Returns @c true if the rendered range 
+	grew. This is called by the worker thread, and must not be called
+	by more than one thread. It is not realtime safe. If the source
+	throws an exception nothing is rendered, and the next call starts 
+	over at the playhead. */
+    bool fill() throw();
+    
+    /** Return the number of times that sequence() had to call the source 
+	directly because the ring didn't cover the range. */
+    AtomicInt::Type get_fallbacks() const throw();
+    
+  private:
+    
+    class LookaheadPosition;
+    class StagingBuffer;
+    
+    /** A rendered event. */
+    struct Item {
+      
+      /** The time of the event. */
+      SongTime time;
+      
+      /** The generation the event was rendered in. */
+      AtomicInt::Type generation;
+      
+      /** The number of bytes in the event, or words in the packet. */
+      uint8_t size;
+      
+      /** Whether this is a UMP packet written with write_packet(). */
+      bool packet;
+      
+      /** The event or packet data. */
+      uint32_t data[4];
+    };
+    
+    /** The state of the realtime thread, published for the worker. */
+    struct Playhead {
+      
+      /** The position of the last sequence() call. */
+      SongTime time;
+      
+      /** The number of relocations. */
+      AtomicInt::Type locates;
+      
+      /** The number of direct calls to the source. */
+      AtomicInt::Type fallbacks;
+    };
+    
+    /** The range that has been rendered, published by the worker. */
+    struct Progress {
+      
+      /** The start of the rendered range. */
+      SongTime start;
+      
+      /** The end of the rendered range. */
+      SongTime end;
+      
+      /** The generation of the events in the range. */
+      AtomicInt::Type generation;
+      
+      /** The relocation that the range was started for. */
+      AtomicInt::Type locates;
+    };
+    
+    /** A range that has been edited. */
+    struct Range {
+      SongTime from;
+      SongTime to;
+    };
+    
+    /** Start a new generation at @c st. This may throw whatever the 
+	source's update_position() throws. */
+    void restart(SongTime const& st, AtomicInt::Type locates);
+    
+    /** The rendered object. */
+    std::shared_ptr<Sequencable> m_source;
+    
+    /** How far ahead of the playhead to render. */
+    SongTime m_window;
+    
+    /** The rendered events, written by the worker and read by the 
+	realtime thread. */
+    std::unique_ptr<CommandRing<Item>> m_ring;
+    
+    /** Edited ranges, written by invalidate() and read by the worker. */
+    std::unique_ptr<CommandRing<Range>> m_edits;
+    
+    /** Set by invalidate() if m_edits was full. */
+    AtomicInt m_edits_lost;
+    
+    /** The realtime thread's state. This is only written by 
+	update_position() and sequence(), since the channel only allows one
+	writer. */
+    mutable StatusChannel<Playhead> m_playhead;
+    
+    /** The worker's state. */
+    StatusChannel<Progress> m_progress;
+    
+    /** The worker's position in the source. */
+    std::unique_ptr<Position> m_render_pos;
+    
+    /** The worker's current generation. */
+    AtomicInt::Type m_generation;
+    
+    /** The worker's current rendered range. */
+    Progress m_rendered;
+    
+    /** Rendered events that haven't been pushed into the ring yet. */
+    std::vector<Item> m_staged;
+    
+    /** The first event in m_staged that hasn't been pushed. */
+    size_t m_staged_next;
+    
+  };
+  
+  
+  /** A thread that calls Lookahead::fill() for a set of Lookahead objects
+      every @c interval microseconds. It runs with normal priority, below 
+      the realtime thread. 
+      
+      @ingroup sequencing
+  */
+  class LookaheadWorker {
+  public:
+    
+    /** Start a worker for @c objects. */
+    LookaheadWorker(std::vector<std::shared_ptr<Lookahead>> const& objects, 
+		    unsigned interval = 2000) 
+      throw(std::bad_alloc, std::runtime_error);
+    
+    /** Stop the thread. */
+    ~LookaheadWorker() throw();
+    
+  private:
+    
+    LookaheadWorker(LookaheadWorker const&) = delete;
+    LookaheadWorker& operator=(LookaheadWorker const&) = delete;
+    
+    /** The thread function. */
+    static void* thread_main(void* arg);
+    
+    std::vector<std::shared_ptr<Lookahead>> m_objects;
+    
+    unsigned m_interval;
+    
+    AtomicInt m_quit;
+    
+    pthread_t m_thread;
+    
+  };
+  
+  
+}
+
+
+#endif
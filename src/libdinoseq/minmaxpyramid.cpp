@@ -0,0 +1,138 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <limits>
+
+#include "minmaxpyramid.hpp"
+
+
+namespace Dino {
+  
+  
+  using std::bad_alloc;
+  using std::numeric_limits;
+  
+  
+  MinMaxPyramid::Range::Range() throw()
+    : min(numeric_limits<Value>::max()),
+      max(numeric_limits<Value>::min()) {
+  }
+  
+  
+  bool MinMaxPyramid::Range::is_empty() const throw() {
+    return min > max;
+  }
+  
+  
+  void MinMaxPyramid::Range::merge(Range const& r) throw() {
+    if (r.min < min)
+      min = r.min;
+    if (r.max > max)
+      max = r.max;
+  }
+  
+  
+  MinMaxPyramid::MinMaxPyramid(size_t buckets) throw(bad_alloc) {
+    if (buckets == 0)
+      buckets = 1;
+    m_levels.push_back(std::vector<Range>(buckets));
+    while (buckets > 1) {
+      buckets = (buckets + 1) / 2;
+      m_levels.push_back(std::vector<Range>(buckets));
+    }
+  }
+  
+  
+  size_t MinMaxPyramid::get_size() const throw() {
+    return m_levels[0].size();
+  }
+  
+  
+  size_t MinMaxPyramid::get_memory_usage() const throw() {
+    size_t bytes = m_levels.capacity() * sizeof(std::vector<Range>);
+    for (size_t l = 0; l < m_levels.size(); ++l)
+      bytes += m_levels[l].capacity() * sizeof(Range);
+    return bytes;
+  }
+  
+  
+  void MinMaxPyramid::add(size_t bucket, Value value) throw() {
+    Range r;
+    r.min = value;
+    r.max = value;
+    for (size_t l = 0; l < m_levels.size(); ++l, bucket /= 2)
+      m_levels[l][bucket].merge(r);
+  }
+  
+  
+  void MinMaxPyramid::set(size_t bucket, Value min, Value max) throw() {
+    m_levels[0][bucket].min = min;
+    m_levels[0][bucket].max = max;
+    update_parents(bucket);
+  }
+  
+  
+  void MinMaxPyramid::clear(size_t bucket) throw() {
+    m_levels[0][bucket] = Range();
+    update_parents(bucket);
+  }
+  
+  
+  void MinMaxPyramid::clear() throw() {
+    for (size_t l = 0; l < m_levels.size(); ++l)
+      m_levels[l].assign(m_levels[l].size(), Range());
+  }
+  
+  
+  bool MinMaxPyramid::get(size_t first, size_t last, 
+			  Value& min, Value& max) const throw() {
+    if (last > get_size())
+      last = get_size();
+    
+    // merge the odd buckets at the edges on every level and move up
+    Range r;
+    for (size_t l = 0; first < last; ++l, first /= 2, last /= 2) {
+      if (first % 2)
+	r.merge(m_levels[l][first++]);
+      if (last % 2)
+	r.merge(m_levels[l][--last]);
+    }
+    
+    if (r.is_empty())
+      return false;
+    if (r.min < min)
+      min = r.min;
+    if (r.max > max)
+      max = r.max;
+    return true;
+  }
+  
+  
+  void MinMaxPyramid::update_parents(size_t bucket) throw() {
+    for (size_t l = 1; l < m_levels.size(); ++l) {
+      size_t child = bucket & ~size_t(1);
+      bucket /= 2;
+      Range r = m_levels[l - 1][child];
+      if (child + 1 < m_levels[l - 1].size())
+	r.merge(m_levels[l - 1][child + 1]);
+      m_levels[l][bucket] = r;
+    }
+  }
+  
+  
+}
@@ -0,0 +1,95 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef MINMAXPYRAMID_HPP
+#define MINMAXPYRAMID_HPP
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "atomicint.hpp"
+
+
+namespace Dino {
+  
+  
+  /** A summary of the smallest and largest values in a sequence of buckets.
+      Level 0 holds one range per bucket, and every level above it holds
+      the union of pairs of ranges from the level below, so the range of
+      any interval of buckets can be found by merging O(log n) ranges. This 
+      is used to draw zoomed out views of large curves without looking at
+      every point. It is @b not thread safe and should only be used in the 
+      non-realtime thread. */
+  class MinMaxPyramid {
+  public:
+    
+    /** The value type. */
+    typedef AtomicInt::Type Value;
+    
+    /** Create a new pyramid with @c buckets empty buckets. */
+    explicit MinMaxPyramid(size_t buckets = 1) throw(std::bad_alloc);
+    
+    /** Return the number of buckets. */
+    size_t get_size() const throw();
+    
+    /** Return the number of bytes allocated for the buckets on all 
+	levels. */
+    size_t get_memory_usage() const throw();
+    
+    /** Extend the range of the bucket @c bucket to include @c value. */
+    void add(size_t bucket, Value value) throw();
+    
+    /** Set the range of @c bucket to [@c min, @c max]. */
+    void set(size_t bucket, Value min, Value max) throw();
+    
+    /** Make @c bucket empty. */
+    void clear(size_t bucket) throw();
+    
+    /** Make all buckets empty. */
+    void clear() throw();
+    
+    /** Extend [@c min, @c max] to include the ranges of the buckets in
+	[@c first, @c last). Returns false and leaves @c min and @c max 
+	alone if all those buckets are empty. */
+    bool get(size_t first, size_t last, Value& min, Value& max) const throw();
+    
+  private:
+    
+    /** A range of values. It is empty if @c min > @c max. */
+    struct Range {
+      Range() throw();
+      bool is_empty() const throw();
+      void merge(Range const& r) throw();
+      Value min;
+      Value max;
+    };
+    
+    /** Recompute the parents of @c bucket on all levels above level 0. */
+    void update_parents(size_t bucket) throw();
+    
+    /** The levels, with the individual buckets at level 0. */
+    std::vector<std::vector<Range>> m_levels;
+    
+  };
+  
+  
+}
+
+
+#endif
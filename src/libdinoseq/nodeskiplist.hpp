@@ -19,9 +19,12 @@
 #ifndef NODESKIPLIST_HPP
 #define NODESKIPLIST_HPP
 
+#include <algorithm>
 #include <cstdlib>
 #include <limits>
 #include <memory>
+#include <new>
+#include <utility>
 
 #include "atomicptr.hpp"
 #include "meta.hpp"
@@ -33,109 +36,203 @@ namespace Dino {
   /** A basic skip list. This is a very basic list, it has no
       iterator interface and the user is responsible for allocating and
       deallocating the Node objects before inserting and after removing
-      them, using @c new and @c delete. The only exception is when the
-      destructor for the list is called, at which point all nodes still
-      in the list will be deallocated using @c delete.
+      them, using Node::create() and Node::destroy(). The only exception 
+      is when the destructor for the list is called, at which point all 
+      nodes still in the list will be deallocated.
       
       This list type is more suited to be used as a building block for more 
       complex data structures than as a stand-alone skip list. All operations
       except construction and destruction are thread-safe and lock-free
       as long as only one thread is calling insert() and remove().
       
+      The nodes are compact since lists with millions of them are common.
+      The links to the next nodes are stored in the same allocation as the
+      node itself, just in front of it, and only the bottom level has a 
+      link to the previous node. On a 64 bit system a node with one level 
+      takes 24 bytes plus the payload.
+      
       @tparam T the payload type of the skiplist
       @tparam K the inverse of the probability that a node should have links
                 at level N, given that it has links at level N-1
-      @tparam M the maximum number of levels
+      @tparam M the maximum number of levels, at most 255
   */
   template <typename T, int K = 2, int M = 20>
   class NodeSkipList {
   public:
     
-    
-    struct NodeBase;
+    static_assert(M > 0 && M < 256, "The number of levels must fit in a byte");
     
     
-    /** The data structure that holds the actual links. Each NodeBase
-	has an array of LinkNode objects that contain links to the previous
-	and next nodes at different levels. Only the @c next element is
-	atomic since that is the only one that may be read by multiple 
-	threads.*/
-    struct LinkNode {
+    /** A base struct for Node. This only has the links and is used for the
+	head and end markers so we don't have to use Node with its
+	potentially expensive data member for that. The links to the next
+	nodes are stored in an array of @c levels AtomicPtr objects that 
+	ends where the NodeBase starts, use next() to access them. Only 
+	the @c next links are atomic since they are the only ones that may 
+	be read by multiple threads. */
+    struct NodeBase {
+      
+      /** Constructs a new NodeBase with the given number of levels. The
+	  links must already be in place. */
+      explicit NodeBase(size_t l) throw() 
+	: prev(0),
+	  levels(l) {}
+      
+      /** Return the link to the next node on level @c l. */
+      AtomicPtr<NodeBase>& next(size_t l) throw() {
+	return reinterpret_cast<AtomicPtr<NodeBase>*>(this)[-1 - long(l)];
+      }
       
-      /** This constructor sets the prev and next pointers to 0. */
-      LinkNode() : prev(0), next(0) {}
+      /** Return the link to the next node on level @c l. */
+      AtomicPtr<NodeBase> const& next(size_t l) const throw() {
+	return reinterpret_cast<AtomicPtr<NodeBase> const*>(this)
+	  [-1 - long(l)];
+      }
       
-      /** A pointer to the previous node in the list at this level. */
+      /** The previous node on the bottom level. This is only used by the
+	  thread that modifies the list. */
       NodeBase* prev;
       
-      /** A pointer to the next node in the list at this level. */
-      AtomicPtr<NodeBase> next;
-    };
-    
-    
-    /** A base struct for Node. This only has the links and is used for the
-	head and end markers so we don't have to use Node with its
-	potentially expensive data member for that. */
-    struct NodeBase {
+      /** The number of levels that this node has links on. */
+      unsigned char levels;
       
-      /** Constructs a new NodeBase. */
-      NodeBase(size_t l) throw() 
-	: levels(l), 
-	  links(l > 0 ? new LinkNode[levels] : 0) {}
+    private:
       
-      /** The number of elements in links. */
-      size_t levels;
+      NodeBase(NodeBase const&) = delete;
+      NodeBase& operator=(NodeBase const&) = delete;
       
-      /** The links to the previous and next nodes on different levels. */
-      std::unique_ptr<LinkNode[]> links;
     };
     
     
     /** The node type of NodeSkipList. It inherits NodeBase and adds the data
-	member. */
+	member. Nodes can only be created on the heap using create(), and 
+	must be deallocated using destroy(). */
     struct Node : NodeBase {
       
-      /** Constructs a new node with the given data. This function will
-	  not throw any exceptions unless the copy constructor for @c T
-	  does. */
-      Node(T const& d, size_t l = 0) 
-	: NodeBase(l), 
-	  data(d) {
-	if (this->levels == 0) {
-	  do {
-	    ++(this->levels);
-	  } while (this->levels <= M && (std::rand() % K == 0));
+      /** A deleter for @c std::unique_ptr and @c std::shared_ptr. */
+      struct Deleter {
+	void operator()(Node* n) const throw() {
+	  destroy(n);
+	}
+      };
+      
+      /** Allocate a new node with the given data and @c levels levels, or
+	  a random number of levels if @c levels is 0. This function will 
+	  not throw any exceptions except @c std::bad_alloc and the ones 
+	  thrown by the copy constructor for @c T. */
+      static Node* create(T const& d, size_t levels = 0) {
+	levels = pick_levels(levels);
+	char* p = allocate(levels);
+	try {
+	  return new (p + link_bytes(levels)) Node(d, levels);
+	}
+	catch (...) {
+	  ::operator delete(p);
+	  throw;
 	}
-	this->links = std::unique_ptr<LinkNode[]>(new LinkNode[this->levels]);
       }
       
-      /** Constructs a new node with the given data, which may be moved.
-	  This function will not throw any exceptions unless the move
-	  constructor for @c T does. */
-      Node(T&& d, size_t levels) : NodeBase(levels), data(std::move(d)) {}
+      /** Allocate a new node with the given data, which may be moved. */
+      static Node* create(T&& d, size_t levels = 0) {
+	levels = pick_levels(levels);
+	char* p = allocate(levels);
+	try {
+	  return new (p + link_bytes(levels)) Node(std::move(d), levels);
+	}
+	catch (...) {
+	  ::operator delete(p);
+	  throw;
+	}
+      }
+      
+      /** Destroy and deallocate a node that was allocated with create(). */
+      static void destroy(Node* n) throw() {
+	if (!n)
+	  return;
+	size_t levels = n->levels;
+	n->~Node();
+	::operator delete(reinterpret_cast<char*>(n) - link_bytes(levels));
+      }
+      
+      /** Return the number of bytes used by a node with @c levels levels,
+	  not counting the overhead of the memory allocator. */
+      static size_t get_size(size_t levels) throw() {
+	return link_bytes(levels) + sizeof(Node);
+      }
       
       /** The data element of this list node. */
       T data;
+      
+    private:
+      
+      Node(T const& d, size_t levels) : NodeBase(levels), data(d) {}
+      
+      Node(T&& d, size_t levels) : NodeBase(levels), data(std::move(d)) {}
+      
+      ~Node() {}
+      
+      /** Return @c levels, or a random number of levels if it is 0. */
+      static size_t pick_levels(size_t levels) throw() {
+	if (levels == 0) {
+	  do {
+	    ++levels;
+	  } while (levels < size_t(M) && (std::rand() % K == 0));
+	}
+	return std::min(levels, size_t(M));
+      }
+      
+      /** The number of bytes in front of the node that hold its links,
+	  rounded up so the node is properly aligned. */
+      static size_t link_bytes(size_t levels) throw() {
+	size_t a = alignof(Node);
+	return (levels * sizeof(AtomicPtr<NodeBase>) + a - 1) / a * a;
+      }
+      
+      /** Allocate the memory for a node and initialise its links. */
+      static char* allocate(size_t levels) {
+	char* p = static_cast<char*>(::operator new(get_size(levels)));
+	AtomicPtr<NodeBase>* links = reinterpret_cast<AtomicPtr<NodeBase>*>
+	  (p + link_bytes(levels)) - levels;
+	for (size_t l = 0; l < levels; ++l)
+	  new (links + l) AtomicPtr<NodeBase>(0);
+	return p;
+      }
+      
+    };
+    
+    
+    /** The memory used by a list, see get_memory_usage(). */
+    struct MemoryUsage {
+      
+      /** The number of nodes in the list. */
+      size_t nodes;
+      
+      /** The total number of links in the nodes. */
+      size_t links;
+      
+      /** The number of bytes used by the nodes, not counting the overhead
+	  of the memory allocator. */
+      size_t bytes;
     };
     
     
     /** Construct an empty list. */
     NodeSkipList() throw() 
-      : m_head(M),
-	m_end(M) {
-      for (int l = 0; l < M; ++l) {
-	m_head.links[l].next.set(&m_end);
-	m_end.links[l].prev = &m_head;
-      }
+      : m_nodes(0),
+	m_links(0),
+	m_bytes(0) {
+      for (int l = 0; l < M; ++l)
+	m_head.node.next(l).set(&m_end.node);
+      m_end.node.prev = &m_head.node;
     }
     
     /** Release all memory used by the list and its nodes. */
     ~NodeSkipList() throw() {
-      NodeBase* nb = m_head.links[0].next.get();
-      while (nb != &m_end) {
+      NodeBase* nb = m_head.node.next(0).get();
+      while (nb != &m_end.node) {
 	Node* n = static_cast<Node*>(nb);
-	nb = nb->links[0].next.get();
-	delete n;
+	nb = nb->next(0).get();
+	Node::destroy(n);
       }
     }
     
@@ -148,7 +245,7 @@ namespace Dino {
 	
 	This function is atomic and a memory barrier. */
     NodeBase* first_node() throw() {
-      return m_head.links[0].next.get();
+      return m_head.node.next(0).get();
     }
     
     /** Returns the first node in the list. You can use it to insert nodes
@@ -160,13 +257,13 @@ namespace Dino {
     
 	This function is atomic and a memory barrier. */
     NodeBase const* first_node() const throw() {
-      return m_head.links[0].next.get();
+      return m_head.node.next(0).get();
     }
     
     /** Returns a pointer to the end marker of the list. You can compare
 	it to the return value of find_less(). */
     NodeBase const* head_marker() const throw() {
-      return &m_head;
+      return &m_head.node;
     }
     
     /** Returns a pointer to the end marker of the list. You can use it
@@ -174,24 +271,21 @@ namespace Dino {
 	list.insert(list.end_marker(), my_node) or compare it to return
 	values of find(). */
     NodeBase* end_marker() throw() {
-      return &m_end;
+      return &m_end.node;
     }
     
     /** Returns a const pointer to the end marker of the list. You can 
 	compare it to return values of find(). */
     NodeBase const* end_marker() const throw() {
-      return &m_end;
+      return &m_end.node;
     }
     
     /** Insert a new node into the list at a given position. The node will
 	be inserted before the NodeBase @c before, which must either be a
 	pointer to a node already in the list, or end_marker(). The list 
 	assumes ownership of the object pointed to by @c node and will 
-	deallocate it in the list destructor using @c delete unless the 
-	node has been removed from the list before that. This means that 
-	the Node object @b must be allocated using @c new unless you are 
-	completely sure that it will be removed before the list destructor 
-	is called.
+	deallocate it in the list destructor unless the node has been 
+	removed from the list before that.
 	
 	If inserting the new Node at the given position would break the order
 	of the list it will not be inserted and the function will return 
@@ -201,79 +295,106 @@ namespace Dino {
       // Check that we can insert the node in this position.
       if ((before != end_marker() &&
 	   static_cast<Node*>(before)->data < node->data) ||
-	  (before->links[0].prev != head_marker() &&
-	   node->data < static_cast<Node*>(before->links[0].prev)->data))
+	  (before->prev != head_marker() &&
+	   node->data < static_cast<Node*>(before->prev)->data))
 	return false;
       
-      // For each level, set the next and prev pointers of the new node.
+      // For each level, set the next pointers of the new node.
       NodeBase* next = before;
-      NodeBase* prev = next->links[0].prev;
-      node->links[0].next.set(next);
-      node->links[0].prev = prev;
+      node->next(0).set(next);
+      node->prev = before->prev;
       for (size_t l = 1; l < node->levels; ++l) {
 	while (next->levels <= l)
-	  next = next->links[l - 1].next.get();
-	node->links[l].next.set(next);
-	prev = next->links[l].prev;
-	node->links[l].prev = prev;
+	  next = next->next(l - 1).get();
+	node->next(l).set(next);
       }
-
-      // Insert the node into the list.
+      
+      // Insert the node into the list. The previous node on each level is
+      // the closest one before it on the bottom level that is high enough.
+      before->prev = node;
+      NodeBase* prev = node->prev;
       for (size_t l = 0; l < node->levels; ++l) {
-	node->links[l].next.get()->links[l].prev = node;
+	while (prev->levels <= l)
+	  prev = prev->prev;
 	// After this line read-only threads can actually see the new node
 	// when traversing the list at level l.
-	node->links[l].prev->links[l].next.set(node);
+	prev->next(l).set(node);
       }
       
+      ++m_nodes;
+      m_links += node->levels;
+      m_bytes += Node::get_size(node->levels);
+      
       return true;
     }
     
     /** Remove the given node from the list. The caller assumes ownership
 	of the node. */
     void remove(Node* node) throw() {
-
-      // Change the links of the previous and next nodes to point past
-      // the node we're removing, effectively removing it from the list,
-      // starting at the top level. Also set the previous links from
-      // this node to 0, but don't touch the next links - a read-only
-      // thread may be holding a pointer to this node.
+      
+      // Find the previous node on each level.
+      NodeBase* prevs[M];
+      NodeBase* prev = node->prev;
+      for (size_t l = 0; l < node->levels; ++l) {
+	while (prev->levels <= l)
+	  prev = prev->prev;
+	prevs[l] = prev;
+      }
+      
+      // Change the links of the previous nodes to point past the node 
+      // we're removing, effectively removing it from the list, starting 
+      // at the top level. Don't touch the next links of this node - a 
+      // read-only thread may be holding a pointer to it.
       for (int l = node->levels - 1; l >= 0; --l) {
-	NodeBase* next = node->links[l].next.get();
 	// After this line the read-only threads can no longer see this
 	// node when traversing the list at level l.
-	node->links[l].prev->links[l].next.set(next);
-	next->links[l].prev = node->links[l].prev;
-	node->links[l].prev = 0;
+	prevs[l]->next(l).set(node->next(l).get());
       }
+      node->next(0).get()->prev = node->prev;
+      node->prev = 0;
+      
+      --m_nodes;
+      m_links -= node->levels;
+      m_bytes -= Node::get_size(node->levels);
+    }
+    
+    /** Return the number of nodes in the list, the number of links in 
+	them and the memory they use. This should only be called by the 
+	thread that modifies the list. */
+    MemoryUsage get_memory_usage() const throw() {
+      MemoryUsage mu;
+      mu.nodes = m_nodes;
+      mu.links = m_links;
+      mu.bytes = m_bytes;
+      return mu;
     }
     
     
     /** Return the first node with a value not less than @c c, or end_marker()
 	if there is no such node. */
     NodeBase* lower_bound(T const& c) {
-      return find_less(c)->links[0].next.get();
+      return find_less(c)->next(0).get();
     }
     
 
     /** Return the first node with a value not less than @c c, or end_marker()
 	if there is no such node. */
     NodeBase const* lower_bound(T const& c) const {
-      return find_less(c)->links[0].next.get();
+      return find_less(c)->next(0).get();
     }
     
 
     /** Return the first node with a value larger than @c c, or end_marker()
 	if there is no such node. */
     NodeBase* upper_bound(T const& c) {
-      return find_less_or_equal(c)->links[0].next.get();
+      return find_less_or_equal(c)->next(0).get();
     }
     
 
     /** Return the first node with a value larger than @c c, or end_marker()
 	if there is no such node. */
     NodeBase const* upper_bound(T const& c) const {
-      return find_less_or_equal(c)->links[0].next.get();
+      return find_less_or_equal(c)->next(0).get();
     }
     
 
@@ -315,10 +436,10 @@ namespace Dino {
       typedef typename copy_const<NSL, NodeBase>::type NB;
       typedef typename copy_const<NSL, Node>::type N;
       
-      NB* i = &me.m_head;
+      NB* i = &me.m_head.node;
       int level = M - 1;
       do {
-	NB* next = i->links[level].next.get();
+	NB* next = i->next(level).get();
 	if (next == me.end_marker() || 
 	    !(static_cast<N*>(next)->data < c))
 	  --level;
@@ -338,10 +459,10 @@ namespace Dino {
       typedef typename copy_const<NSL, NodeBase>::type NB;
       typedef typename copy_const<NSL, Node>::type N;
       
-      NB* i = &me.m_head;
+      NB* i = &me.m_head.node;
       int level = M - 1;
       do {
-	NB* next = i->links[level].next.get();
+	NB* next = i->next(level).get();
 	if (next == me.end_marker() || (c < static_cast<N*>(next)->data))
 	  --level;
 	else
@@ -351,11 +472,28 @@ namespace Dino {
     }
 			     
     
-    /** A pointer to the head of the list. */
-    NodeBase m_head;
+    /** A NodeBase with links on all levels, used for the head and end 
+	markers. */
+    struct Marker {
+      Marker() throw() : node(M) {}
+      AtomicPtr<NodeBase> links[M];
+      NodeBase node;
+    };
+    
+    /** The head of the list. */
+    Marker m_head;
     
     /** The end marker. */
-    NodeBase m_end;
+    Marker m_end;
+    
+    /** The number of nodes in the list. */
+    size_t m_nodes;
+    
+    /** The number of links in the nodes. */
+    size_t m_links;
+    
+    /** The number of bytes used by the nodes. */
+    size_t m_bytes;
     
   };
   
@@ -40,12 +40,39 @@ namespace Dino {
   bool OStreamBuffer::write_event(SongTime const& st, size_t bytes, 
 				  unsigned char const* data) {
     auto f = m_stream.flags();
+    print_event(st, bytes, data);
+    m_stream.flags(f);
+    return true;
+  }
+  
+  
+  size_t OStreamBuffer::write_events(Event const* events, size_t n) {
+    auto f = m_stream.flags();
+    for (size_t i = 0; i < n; ++i)
+      print_event(events[i].time, 3, events[i].data);
+    m_stream.flags(f);
+    return n;
+  }
+  
+  
+  bool OStreamBuffer::write_packet(SongTime const& st, size_t n,
+				   uint32_t const* words) {
+    auto f = m_stream.flags();
+    m_stream<<st<<": UMP"<<hex<<uppercase;
+    for (size_t i = 0; i < n; ++i)
+      m_stream<<' '<<setw(8)<<setfill('0')<<words[i];
+    m_stream<<'\n';
+    m_stream.flags(f);
+    return true;
+  }
+  
+  
+  void OStreamBuffer::print_event(SongTime const& st, size_t bytes, 
+				  unsigned char const* data) {
     m_stream<<st<<':'<<hex<<uppercase;
     for (size_t i = 0; i < bytes; ++i)
       m_stream<<' '<<setw(2)<<setfill('0')<<static_cast<int>(data[i]);
     m_stream<<'\n';
-    m_stream.flags(f);
-    return true;
   }
 
 
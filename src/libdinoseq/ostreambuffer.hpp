@@ -50,8 +50,20 @@ namespace Dino {
     bool write_event(SongTime const& st, size_t bytes, 
 		     unsigned char const* data);
     
+    /** Print a batch of events. The stream flags are only saved and 
+	restored once for the whole batch. */
+    size_t write_events(Event const* events, size_t n);
+    
+    /** Print a Universal MIDI Packet as "UMP" followed by its words in 
+	hexadecimal. */
+    bool write_packet(SongTime const& st, size_t n, uint32_t const* words);
+    
   private:
     
+    /** Print a single event without touching the stream flags. */
+    void print_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data);
+    
     /** The @c ostream that events will be written to. */
     std::ostream& m_stream;
     
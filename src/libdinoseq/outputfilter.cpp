@@ -0,0 +1,196 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <cstring>
+
+#include "outputfilter.hpp"
+
+
+namespace Dino {
+  
+  
+  namespace {
+    
+    /** Return @c true if a controller changes the receiver's state in a way
+	that makes sending it twice different from sending it once. */
+    bool has_side_effects(unsigned char cc) throw() {
+      return cc == 6 || cc == 38 || (cc >= 96 && cc <= 101) || cc >= 120;
+    }
+    
+  }
+  
+  
+  OutputFilter::OutputFilter(std::shared_ptr<EventBuffer> target) throw()
+    : m_target(target),
+      m_dropped(0) {
+    reset();
+  }
+  
+  
+  bool OutputFilter::write_event(SongTime const& st, size_t bytes, 
+				 unsigned char const* data) {
+    if (!filter(data, bytes)) {
+      ++m_dropped;
+      return true;
+    }
+    if (!m_target->write_event(st, bytes, data)) {
+      forget(data);
+      return false;
+    }
+    return true;
+  }
+  
+  
+  size_t OutputFilter::write_events(Event const* events, size_t n) {
+    static size_t const batch = 64;
+    Event out[batch];
+    size_t source[batch];
+    size_t i = 0;
+    while (i < n) {
+      size_t m = 0;
+      size_t first = i;
+      for ( ; i < n && m < batch; ++i) {
+	if (filter(events[i].data, 3)) {
+	  out[m] = events[i];
+	  source[m++] = i;
+	}
+      }
+      size_t written = m > 0 ? m_target->write_events(out, m) : 0;
+      if (written < m) {
+	// the events that didn't fit haven't changed anything yet, and the
+	// ones after them will be filtered again in the next call
+	for (size_t j = written; j < m; ++j)
+	  forget(out[j].data);
+	m_dropped += source[written] - first - written;
+	return source[written];
+      }
+      m_dropped += i - first - m;
+    }
+    return n;
+  }
+  
+  
+  bool OutputFilter::write_packet(SongTime const& st, size_t n, 
+				  uint32_t const* words) {
+    if (n > 0 && ((words[0] >> 28) == 0x2 || (words[0] >> 28) == 0x4)) {
+      unsigned char channel = (words[0] >> 16) & 0x0F;
+      std::memset(m_controllers[channel], -1, sizeof(m_controllers[channel]));
+      m_programs[channel] = -1;
+      m_pressure[channel] = -1;
+      m_pitchbend[channel] = -1;
+    }
+    return m_target->write_packet(st, n, words);
+  }
+  
+  
+  void OutputFilter::reset() throw() {
+    std::memset(m_controllers, -1, sizeof(m_controllers));
+    std::memset(m_programs, -1, sizeof(m_programs));
+    std::memset(m_pressure, -1, sizeof(m_pressure));
+    for (int c = 0; c < 16; ++c)
+      m_pitchbend[c] = -1;
+  }
+  
+  
+  size_t OutputFilter::get_dropped() const throw() {
+    return m_dropped;
+  }
+  
+  
+  bool OutputFilter::filter(unsigned char const* data, size_t bytes) throw() {
+    if (bytes < 2)
+      return true;
+    unsigned char channel = data[0] & 0x0F;
+    switch (data[0] & 0xF0) {
+      
+    case 0xB0: {
+      if (bytes < 3)
+	return true;
+      unsigned char cc = data[1] & 0x7F;
+      int8_t value = data[2] & 0x7F;
+      if (cc >= 98 && cc <= 101) {
+	// a new parameter, the next data entry must go through
+	m_controllers[channel][6] = -1;
+	m_controllers[channel][38] = -1;
+      }
+      else if (cc == 0 || cc == 32)
+	m_programs[channel] = -1;
+      if (has_side_effects(cc))
+	return true;
+      if (m_controllers[channel][cc] == value)
+	return false;
+      m_controllers[channel][cc] = value;
+      // receivers reset the LSB of a 14 bit controller when a new MSB 
+      // arrives, so the next LSB must go through even if it's the same
+      if (cc < 32)
+	m_controllers[channel][cc + 32] = -1;
+      return true;
+    }
+      
+    case 0xC0: {
+      int8_t program = data[1] & 0x7F;
+      if (m_programs[channel] == program)
+	return false;
+      m_programs[channel] = program;
+      return true;
+    }
+      
+    case 0xD0: {
+      int8_t pressure = data[1] & 0x7F;
+      if (m_pressure[channel] == pressure)
+	return false;
+      m_pressure[channel] = pressure;
+      return true;
+    }
+      
+    case 0xE0: {
+      if (bytes < 3)
+	return true;
+      int16_t bend = (data[1] & 0x7F) | ((data[2] & 0x7F) << 7);
+      if (m_pitchbend[channel] == bend)
+	return false;
+      m_pitchbend[channel] = bend;
+      return true;
+    }
+      
+    }
+    
+    return true;
+  }
+  
+  
+  void OutputFilter::forget(unsigned char const* data) throw() {
+    unsigned char channel = data[0] & 0x0F;
+    switch (data[0] & 0xF0) {
+    case 0xB0:
+      m_controllers[channel][data[1] & 0x7F] = -1;
+      break;
+    case 0xC0:
+      m_programs[channel] = -1;
+      break;
+    case 0xD0:
+      m_pressure[channel] = -1;
+      break;
+    case 0xE0:
+      m_pitchbend[channel] = -1;
+      break;
+    }
+  }
+  
+  
+}
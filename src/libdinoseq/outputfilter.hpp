@@ -0,0 +1,111 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef OUTPUTFILTER_HPP
+#define OUTPUTFILTER_HPP
+
+#include <memory>
+
+#include <stdint.h>
+
+#include "eventbuffer.hpp"
+
+
+namespace Dino {
+  
+  
+  /** An EventBuffer that removes redundant messages before passing the 
+      rest on to another EventBuffer. It can be put between the Sequencer 
+      and an output port that has little bandwidth, like a hardware MIDI
+      port, where dense automation would otherwise saturate the link.
+      
+      The filter remembers the last value sent for every controller, 
+      program, channel pressure and pitchbend on every channel and drops
+      messages that would set the same value again. Notes, system messages
+      and controllers that have side effects in the receiver (data 
+      entry, data increment and decrement, the (N)RPN selectors and the 
+      channel mode messages) always pass. Selecting a parameter forgets 
+      the data entry values and bank select forgets the program, so the 
+      messages that follow them are never dropped.
+      
+      The state table is about 2 kB and is allocated with the filter, so
+      writing to it is realtime safe. Call reset() when the receiver may
+      have lost its state, for example after a relocation or when the port
+      is reconnected.
+      
+      @ingroup sequencing
+  */
+  class OutputFilter : public EventBuffer {
+  public:
+    
+    /** Create a filter that writes to @c target. */
+    OutputFilter(std::shared_ptr<EventBuffer> target) throw();
+    
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data);
+    
+    /** Filter a batch of events and write the remaining ones to the target
+	with a single call to EventBuffer::write_events(). */
+    size_t write_events(Event const* events, size_t n);
+    
+    /** Pass a packet on to the target unchanged. The state of the packet's
+	channel is forgotten since the packet may have changed it. */
+    bool write_packet(SongTime const& st, size_t n, uint32_t const* words);
+    
+    /** Forget all the remembered values so the next message for each of 
+	them is passed on. */
+    void reset() throw();
+    
+    /** Return the number of messages that have been dropped. */
+    size_t get_dropped() const throw();
+    
+  private:
+    
+    /** Check if a channel message is redundant and update the state if it
+	isn't. */
+    bool filter(unsigned char const* data, size_t bytes) throw();
+    
+    /** Forget the value that the message @c data set, used when the 
+	target could not take the message after all. */
+    void forget(unsigned char const* data) throw();
+    
+    /** The buffer that the remaining messages are written to. */
+    std::shared_ptr<EventBuffer> m_target;
+    
+    /** The last controller values for each channel, -1 for unknown. */
+    int8_t m_controllers[16][128];
+    
+    /** The last program for each channel, -1 for unknown. */
+    int8_t m_programs[16];
+    
+    /** The last channel pressure for each channel, -1 for unknown. */
+    int8_t m_pressure[16];
+    
+    /** The last pitchbend for each channel, -1 for unknown. */
+    int16_t m_pitchbend[16];
+    
+    /** The number of dropped messages. */
+    size_t m_dropped;
+    
+  };
+  
+  
+}
+
+
+#endif
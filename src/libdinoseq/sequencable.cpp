@@ -57,6 +57,11 @@ namespace Dino {
   }
   
   
+  bool Sequencable::chase(Position&, EventBuffer&) const {
+    return true;
+  }
+  
+  
   string const& Sequencable::get_label() const throw() {
     return m_label;
   }
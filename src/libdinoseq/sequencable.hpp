@@ -97,6 +97,17 @@ namespace Dino {
     virtual bool sequence(Position& pos, SongTime const& to, 
 			  EventBuffer& buf) const = 0;
     
+    /** Write the events that bring a receiver into the state it would be
+	in if the Sequencable had been played from the start up to @c pos,
+	for example the current controller values or the notes that are 
+	held over @c pos. The events are written with the time of @c pos.
+	The Sequencer calls this after a relocation, so it must be 
+	realtime safe and should not need to scan everything before 
+	@c pos - objects with a lot of notes can keep checkpoints of the 
+	active notes at regular intervals. It returns @c false if @c buf was
+	full. The default implementation writes nothing. */
+    virtual bool chase(Position& pos, EventBuffer& buf) const;
+    
     /** Returns the label of this Sequencable. */
     std::string const& get_label() const throw();
     
@@ -108,8 +119,10 @@ namespace Dino {
     /** Set the label for this Sequencable. */
     void set_label(std::string const& label);
     
-    /** Set the length of this Sequencable, if applicable. */
-    void set_length(SongTime const& st);
+    /** Set the length of this Sequencable, if applicable. Subclasses that
+	keep data that depends on the length can override this, but must
+	call this implementation. */
+    virtual void set_length(SongTime const& st);
     
   private:
     
@@ -20,6 +20,8 @@
 #include <stdexcept>
 #include <string>
 
+#include "eventbuffer.hpp"
+#include "eventmerger.hpp"
 #include "sequencer.hpp"
 
 
@@ -30,23 +32,170 @@ namespace Dino {
   using std::move;
   using std::shared_ptr;
   using std::bad_alloc;
-  using std::overflow_error;
+  using std::vector;
+  
+  
+  namespace {
+    
+    /** Return true if serial number @c a is newer than @c b, taking
+	wraparound into account. */
+    bool is_newer(AtomicInt::Type a, AtomicInt::Type b) throw() {
+      return AtomicInt::Type(unsigned(a) - unsigned(b)) > 0;
+    }
+    
+    
+    /** Passes events through to another buffer and counts them for the
+	sequencer status. It lives on the stack in run(), so it costs one
+	extra virtual call per batch and doesn't allocate anything. */
+    class ActivityBuffer : public EventBuffer {
+    public:
+      
+      ActivityBuffer(EventBuffer& buf, uint16_t& events, uint8_t& velocity)
+	throw()
+	: m_buf(buf),
+	  m_events(events),
+	  m_velocity(velocity) {
+      }
+      
+      bool write_event(SongTime const& st, size_t bytes, 
+		       unsigned char const* data) {
+	if (!m_buf.write_event(st, bytes, data))
+	  return false;
+	++m_events;
+	if (bytes == 3)
+	  note_velocity(data);
+	return true;
+      }
+      
+      size_t write_events(Event const* events, size_t n) {
+	size_t written = m_buf.write_events(events, n);
+	m_events += written;
+	for (size_t i = 0; i < written; ++i)
+	  note_velocity(events[i].data);
+	return written;
+      }
+      
+      bool write_packet(SongTime const& st, size_t n, 
+			uint32_t const* words) {
+	if (!m_buf.write_packet(st, n, words))
+	  return false;
+	++m_events;
+	return true;
+      }
+      
+    private:
+      
+      void note_velocity(unsigned char const* data) throw() {
+	if ((data[0] & 0xF0) == 0x90 && data[2] > 0)
+	  m_velocity = data[2];
+      }
+      
+      EventBuffer& m_buf;
+      uint16_t& m_events;
+      uint8_t& m_velocity;
+      
+    };
+    
+  }
+  
+  
+  Sequencer::Transaction::Transaction(vector<Entry> const& entries) 
+    throw(bad_alloc)
+    : m_entries(entries) {
+  }
+  
+  
+  void Sequencer::Transaction::add_sequencable(shared_ptr<Sequencable const> 
+					       sqbl,
+					       shared_ptr<EventBuffer> buf)
+    throw(bad_alloc, invalid_argument) {
+    if (!sqbl)
+      throw invalid_argument("Invalid Sequencable pointer!");
+    Entry e;
+    e.seq = sqbl;
+    e.pos = sqbl->create_position(SongTime());
+    e.state = std::make_shared<EntryState>();
+    e.buf = buf;
+    e.serial = 0;
+    m_entries.push_back(move(e));
+  }
+  
+  
+  bool Sequencer::Transaction::remove_sequencable(shared_ptr<Sequencable const>
+						  sqbl) throw() {
+    auto iter = find(sqbl);
+    if (iter == m_entries.end())
+      return false;
+    m_entries.erase(iter);
+    return true;
+  }
+  
+  
+  bool Sequencer::Transaction::set_event_buffer(shared_ptr<Sequencable const>
+						sqbl,
+						shared_ptr<EventBuffer> buf)
+    throw() {
+    auto iter = find(sqbl);
+    if (iter == m_entries.end())
+      return false;
+    iter->buf = buf;
+    return true;
+  }
+  
+  
+  void Sequencer::Transaction::clear() throw() {
+    m_entries.clear();
+  }
+  
+  
+  vector<Sequencer::Entry>::iterator 
+  Sequencer::Transaction::find(shared_ptr<Sequencable const> const& sqbl) 
+    throw() {
+    for (auto i = m_entries.begin(); i != m_entries.end(); ++i) {
+      if (i->seq == sqbl)
+	return i;
+    }
+    return m_entries.end();
+  }
   
 
-  Sequencer::Sequencer() {
+  Sequencer::Plan::Plan() throw() {}
+  
+  
+  Sequencer::Plan::~Plan() {}
+  
+  
+  Sequencer::Sequencer(size_t merge_capacity) throw(bad_alloc)
+    : m_plan(new Plan),
+      m_retired(0),
+      m_rt_plan(m_plan),
+      m_rt_ack(1),
+      m_rt_serial(1),
+      m_rt_last(m_plan),
+      m_merge_capacity(merge_capacity),
+      m_rt_status(Status()) {
+    m_plan->serial = 1;
+    m_plan->next_retired = 0;
+  }
+  
+  
+  Sequencer::~Sequencer() {
+    while (m_retired) {
+      Plan* plan = m_retired;
+      m_retired = plan->next_retired;
+      delete plan;
+    }
+    delete m_plan;
   }
   
   
   Sequencer::Iterator 
   Sequencer::add_sequencable(shared_ptr<Sequencable const> sqbl) 
-    throw(bad_alloc, overflow_error, invalid_argument) {
-    if (!sqbl)
-      throw invalid_argument("Invalid Sequencable pointer!");
-    SeqData sd;
-    sd.seq = sqbl;
-    sd.pos = sqbl->create_position(SongTime());
-    sd.buf = shared_ptr<EventBuffer>();
-    return Iterator(m_sqbls.insert(m_sqbls.end(), move(sd)));
+    throw(bad_alloc, invalid_argument) {
+    Transaction t = begin_transaction();
+    t.add_sequencable(sqbl);
+    commit(t);
+    return Iterator(m_plan->entries.end() - 1);
   }
   
   
@@ -62,17 +211,17 @@ namespace Dino {
   
   
   Sequencer::Iterator Sequencer::sqbl_begin() throw() {
-    return Iterator(m_sqbls.begin());
+    return Iterator(m_plan->entries.begin());
   }
   
   Sequencer::Iterator Sequencer::sqbl_end() throw() {
-    return Iterator(m_sqbls.end());
+    return Iterator(m_plan->entries.end());
   }
   
   
   Sequencer::Iterator 
   Sequencer::sqbl_find(shared_ptr<Sequencable const> match) throw() {
-    for (auto i = m_sqbls.begin(); i != m_sqbls.end(); ++i) {
+    for (auto i = m_plan->entries.begin(); i != m_plan->entries.end(); ++i) {
       if (i->seq == match)
 	return Iterator(i);
     }
@@ -81,18 +230,18 @@ namespace Dino {
   
   
   Sequencer::ConstIterator Sequencer::sqbl_begin() const throw() {
-    return ConstIterator(m_sqbls.begin());
+    return ConstIterator(m_plan->entries.begin());
   }
   
   
   Sequencer::ConstIterator Sequencer::sqbl_end() const throw() {
-    return ConstIterator(m_sqbls.end());
+    return ConstIterator(m_plan->entries.end());
   }
   
   
   Sequencer::ConstIterator 
   Sequencer::sqbl_find(shared_ptr<Sequencable const> match) const throw() {
-    for (auto i = m_sqbls.begin(); i != m_sqbls.end(); ++i) {
+    for (auto i = m_plan->entries.begin(); i != m_plan->entries.end(); ++i) {
       if (i->seq == match)
 	return ConstIterator(i);
     }
@@ -100,34 +249,197 @@ namespace Dino {
   }
   
   
-  void Sequencer::remove_sequencable(Iterator iter) throw(overflow_error) {
-    m_sqbls.erase(iter.base());
+  void Sequencer::remove_sequencable(Iterator iter) throw(bad_alloc) {
+    Transaction t = begin_transaction();
+    t.m_entries.erase(t.m_entries.begin() + 
+		      (iter.base() - m_plan->entries.begin()));
+    commit(t);
   }
   
   
   void Sequencer::set_event_buffer(Iterator iter, 
-				   shared_ptr<EventBuffer> buf) throw() {
-    iter.base()->buf = buf;
+				   shared_ptr<EventBuffer> buf) 
+    throw(bad_alloc) {
+    Transaction t = begin_transaction();
+    t.m_entries[iter.base() - m_plan->entries.begin()].buf = buf;
+    commit(t);
+  }
+  
+  
+  Sequencer::Transaction Sequencer::begin_transaction() const 
+    throw(bad_alloc) {
+    return Transaction(m_plan->entries);
+  }
+  
+  
+  void Sequencer::commit(Transaction& t) throw(bad_alloc) {
+    delete_retired_plans();
+    Plan* plan = new Plan;
+    plan->entries = move(t.m_entries);
+    plan->serial = m_plan->serial + 1;
+    if (plan->serial == 0)
+      plan->serial = 1;
+    plan->next_retired = 0;
+    for (auto i = plan->entries.begin(); i != plan->entries.end(); ++i) {
+      if (i->serial == 0)
+	i->serial = plan->serial;
+    }
+    
+    // group the entries by buffer and allocate merge space for the groups
+    // that need it, so run() doesn't have to
+    for (size_t i = 0; i < plan->entries.size(); ++i) {
+      if (!plan->entries[i].buf)
+	continue;
+      auto g = plan->groups.begin();
+      while (g != plan->groups.end() && g->buf != plan->entries[i].buf)
+	++g;
+      if (g == plan->groups.end()) {
+	plan->groups.push_back(Group());
+	g = plan->groups.end() - 1;
+	g->buf = plan->entries[i].buf;
+      }
+      g->entries.push_back(i);
+    }
+    for (auto g = plan->groups.begin(); g != plan->groups.end(); ++g) {
+      if (g->entries.size() > 1)
+	g->merger.reset(new EventMerger(g->entries.size(), m_merge_capacity,
+					4 * m_merge_capacity));
+    }
+    
+    // this is the only thing the realtime thread will see
+    m_rt_plan.set(plan);
+    
+    m_plan->next_retired = m_retired;
+    m_retired = m_plan;
+    m_plan = plan;
+    t.m_entries.clear();
+  }
+  
+  
+  void Sequencer::delete_retired_plans() throw() {
+    AtomicInt::Type ack = m_rt_ack.get();
+    Plan** link = &m_retired;
+    while (*link) {
+      Plan* plan = *link;
+      if (is_newer(ack, plan->serial)) {
+	*link = plan->next_retired;
+	delete plan;
+      }
+      else
+	link = &plan->next_retired;
+    }
   }
   
   
   void Sequencer::run(SongTime const& from, SongTime const& to) {
     
-    // let the list deallocate unused nodes we're no longer touching
-    m_sqbls.reader_holds_no_iterator();
+    // pick up the latest plan and tell the writer that older ones are 
+    // unused. The last plan isn't deallocated before that, so the events
+    // that are left in its mergers can still be moved to the new one
+    Plan const* plan = m_rt_plan.get();
+    if (plan != m_rt_last) {
+      move_pending(*m_rt_last, *plan);
+      m_rt_last = plan;
+    }
+    m_rt_ack.set(plan->serial);
     
-    // if the start time isn't the same as last call's end time, update
-    if (m_next_start != from) {
-      for (auto iter = m_sqbls.begin(); iter != m_sqbls.end(); ++iter)
+    // if the start time isn't the same as last call's end time, update all
+    // positions, otherwise only the ones that were added since the last call
+    bool locate = m_next_start != from;
+    for (auto iter = plan->entries.begin(); iter != plan->entries.end(); 
+	 ++iter) {
+      if (locate || is_newer(iter->serial, m_rt_serial))
 	iter->seq->update_position(*iter->pos, from);
     }
+    m_rt_serial = plan->serial;
     
-    // sequence all the objects
-    for (auto iter = m_sqbls.begin(); iter != m_sqbls.end(); ++iter)
-      iter->seq->sequence(*iter->pos, to, *iter->buf);
+    // sequence all the objects, merging the ones that share a buffer
+    for (auto g = plan->groups.begin(); g != plan->groups.end(); ++g) {
+      bool ok = true;
+      if (!g->merger)
+	ok = sequence_entry(*plan, g->entries[0], to, *g->buf, locate);
+      else {
+	// events that didn't fit last period are from before the jump
+	if (locate)
+	  g->merger->clear();
+	for (size_t r = 0; r < g->entries.size(); ++r) {
+	  ok = sequence_entry(*plan, g->entries[r], to, g->merger->get_run(r), 
+			      locate) && ok;
+	}
+	ok = g->merger->merge(*g->buf) && ok;
+      }
+      if (!ok)
+	++m_rt_status.overflows;
+    }
     
     m_next_start = to;
+    
+    // publish the status
+    m_rt_status.position = to;
+    ++m_rt_status.periods;
+    m_status.write(m_rt_status);
+  }
+  
+  
+  bool Sequencer::sequence_entry(Plan const& plan, size_t i, 
+				 SongTime const& to, EventBuffer& buf,
+				 bool chase) {
+    // count events for the objects that are included in the status
+    Entry const& e = plan.entries[i];
+    ActivityBuffer ab(buf, m_rt_status.events[i % max_status_entries], 
+		      m_rt_status.velocity[i % max_status_entries]);
+    EventBuffer& out = i < max_status_entries ? 
+      static_cast<EventBuffer&>(ab) : buf;
+    
+    // if the chased state doesn't fit, try again next period, and don't 
+    // sequence anything before it has been sent
+    if (chase)
+      e.state->chase_pending = true;
+    if (e.state->chase_pending) {
+      if (!e.seq->chase(*e.pos, out))
+	return false;
+      e.state->chase_pending = false;
+    }
+    return e.seq->sequence(*e.pos, to, out);
+  }
+  
+  
+  void Sequencer::move_pending(Plan const& old, Plan const& plan) throw() {
+    for (auto g = old.groups.begin(); g != old.groups.end(); ++g) {
+      if (!g->merger)
+	continue;
+      for (size_t r = 0; r < g->entries.size(); ++r) {
+	
+	// find the entry in the new plan and the buffer it writes to
+	Sequencable::Position const* pos = old.entries[g->entries[r]].pos.get();
+	EventBuffer* target = 0;
+	for (auto h = plan.groups.begin(); h != plan.groups.end() && !target;
+	     ++h) {
+	  for (size_t s = 0; s < h->entries.size(); ++s) {
+	    if (plan.entries[h->entries[s]].pos.get() == pos) {
+	      target = h->merger ? &h->merger->get_run(s) : h->buf.get();
+	      break;
+	    }
+	  }
+	}
+	
+	// if the entry was removed its events go with it
+	if (target)
+	  g->merger->drain(r, *target);
+      }
+    }
+  }
+  
+  
+  bool Sequencer::get_status(Status& status) const throw() {
+    return m_status.read(status);
   }
   
   
+  AtomicInt::Type Sequencer::get_status_count() const throw() {
+    return m_status.get_count();
+  }
+  
+  
+
 }
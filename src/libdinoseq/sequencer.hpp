@@ -22,57 +22,213 @@
 #include <memory>
 #include <stdexcept>
 #include <utility>
+#include <vector>
 
 #include <boost/iterator/transform_iterator.hpp>
 
-#include "linkedlist.hpp"
+#include <stdint.h>
+
+#include "atomicint.hpp"
+#include "atomicptr.hpp"
 #include "sequencable.hpp"
 #include "songtime.hpp"
+#include "statuschannel.hpp"
 
 
 namespace Dino {
   
   
   class EventBuffer;
+  class EventMerger;
   
   
   /** This is the sequencer engine. It holds references to a collection
       of Sequencable objects and EventBuffer objects, and sequences data from
-      the former into the latter. */
+      the former into the latter. 
+      
+      The collection is stored in an immutable plan. Edits are made to a 
+      Transaction that is built in the non-realtime thread, and commit()
+      publishes it to the realtime thread as a new plan with a single 
+      atomic pointer swap. run() picks up the new plan at the next period 
+      boundary, so the realtime thread never sees a half-applied edit. 
+      Replaced plans are kept until run() has acknowledged a newer one,
+      and are deallocated by the next commit() or delete_retired_plans()
+      after that. 
+      
+      The single-operation functions add_sequencable(), 
+      remove_sequencable() and set_event_buffer() are one-operation 
+      transactions. Each one copies the plan, so use a Transaction when 
+      making many changes at once. Any edit invalidates all Iterator and 
+      ConstIterator objects for this Sequencer. 
+      
+      Any number of Sequencables can be routed to the same EventBuffer. 
+      They are then sequenced into separate runs in an EventMerger that 
+      was allocated when the plan was committed, and merged into the 
+      buffer in time order, so the buffer always receives its events 
+      sorted no matter how many objects write to it. If the buffer fills
+      up the events that didn't fit are written first in the next period,
+      also when a new plan is picked up in between. 
+      
+      After every call to run() the realtime thread publishes a Status 
+      with the song position and the event activity of each sequenced 
+      object in a StatusChannel. Other threads poll it with get_status() 
+      at their own rate, so the realtime thread never has to emit signals
+      or wake anyone up. */
   class Sequencer {
     
-    struct SeqData {
-      SeqData() throw() {}
-      SeqData(SeqData&& sd) throw()
-	: seq(sd.seq), pos(std::move(sd.pos)), buf(sd.buf) {}
-      SeqData(SeqData const&) = delete;
+    /** The state that the realtime thread keeps for an entry between
+	periods. */
+    struct EntryState {
+      EntryState() throw() : chase_pending(false) {}
+      /** Set when the entry has to chase its state before it is 
+	  sequenced, cleared when chase() has written everything. */
+      bool chase_pending;
+    };
+    
+    /** One sequenced object in a plan. The Position and the EntryState 
+	are shared between plans that contain the same entry, but they are
+	only ever used by the realtime thread. */
+    struct Entry {
       std::shared_ptr<Sequencable const> seq;
-      std::unique_ptr<Sequencable::Position> pos;
+      std::shared_ptr<Sequencable::Position> pos;
+      std::shared_ptr<EntryState> state;
       std::shared_ptr<EventBuffer> buf;
+      /** The serial number of the plan this entry was added in, or 0 if it
+	  hasn't been committed yet. */
+      AtomicInt::Type serial;
+    };
+    
+    /** The entries that write to the same EventBuffer. */
+    struct Group {
+      std::shared_ptr<EventBuffer> buf;
+      /** Indices in Plan::entries, in order. */
+      std::vector<size_t> entries;
+      /** Scratch space for merging, only used if there is more than one
+	  entry in the group. */
+      std::unique_ptr<EventMerger> merger;
+    };
+    
+    /** An immutable snapshot of everything the realtime thread needs. */
+    struct Plan {
+      Plan() throw();
+      ~Plan();
+      std::vector<Entry> entries;
+      /** The entries grouped by EventBuffer. Entries without a buffer are
+	  not in any group. */
+      std::vector<Group> groups;
+      AtomicInt::Type serial;
+      /** The next plan in the list of retired plans. */
+      Plan* next_retired;
     };
     
     struct GetSqbl {
       std::shared_ptr<Sequencable const> const& 
-      operator()(SeqData const& wrp) const throw() {
-	return wrp.seq;
+      operator()(Entry const& e) const throw() {
+	return e.seq;
       }
     };
     
   public:
     
+    /** The number of sequenced objects that Status reports activity for.
+	Objects after these in the list are sequenced as usual but not 
+	reported. */
+    static size_t const max_status_entries = 16;
+    
+    /** The state of the realtime thread after the last call to run(). */
+    struct Status {
+      
+      /** The end of the range that was sequenced. */
+      SongTime position;
+      
+      /** The number of calls to run(), modulo 2^32. */
+      uint32_t periods;
+      
+      /** The number of times a sequenced object or a merge ran out of 
+	  buffer space, modulo 2^32. The events that didn't fit are written 
+	  in the following periods. */
+      uint32_t overflows;
+      
+      /** The number of events that each sequenced object has written, in
+	  the same order as sqbl_begin() to sqbl_end(), modulo 2^16. An 
+	  activity indicator should compare this to the value it saw last 
+	  time. */
+      uint16_t events[max_status_entries];
+      
+      /** The velocity of the last note on event that each sequenced object
+	  wrote, for meters. It is never reset, so readers should let their
+	  meters decay on their own. */
+      uint8_t velocity[max_status_entries];
+      
+    };
+    
     /** The iterator type for iterating over Sequencables. */
     typedef boost::transform_iterator<GetSqbl,
-				      LinkedList<SeqData>::Iterator,
+				      std::vector<Entry>::iterator,
 				      std::shared_ptr<Sequencable const>const&>
     Iterator;
 
     /** The const iterator type for iterating over Sequencables. */
     typedef boost::transform_iterator<GetSqbl,
-				      LinkedList<SeqData>::ConstIterator, 
+				      std::vector<Entry>::const_iterator, 
 				      std::shared_ptr<Sequencable const> const&>
   ConstIterator;
     
-    Sequencer();
+    
+    /** A set of edits that is applied atomically by commit(). It starts
+	out as a copy of the plan that was current when it was created by
+	begin_transaction(), and should only be used in the non-realtime 
+	thread. */
+    class Transaction {
+    public:
+      
+      /** Add an object to the list of sequenced objects, optionally with
+	  the buffer it should be sequenced to. */
+      void add_sequencable(std::shared_ptr<Sequencable const> sqbl,
+			   std::shared_ptr<EventBuffer> buf = 
+			   std::shared_ptr<EventBuffer>())
+	throw(std::bad_alloc, std::invalid_argument);
+      
+      /** Remove the first occurance of @c sqbl from the list of sequenced
+	  objects. Returns false if it wasn't in the list. */
+      bool remove_sequencable(std::shared_ptr<Sequencable const> sqbl) 
+	throw();
+      
+      /** Set the buffer that the first occurance of @c sqbl will be 
+	  sequenced to. Returns false if it wasn't in the list. */
+      bool set_event_buffer(std::shared_ptr<Sequencable const> sqbl,
+			    std::shared_ptr<EventBuffer> buf) throw();
+      
+      /** Remove all objects from the list of sequenced objects. */
+      void clear() throw();
+      
+    private:
+      
+      friend class Sequencer;
+      
+      Transaction(std::vector<Entry> const& entries) throw(std::bad_alloc);
+      
+      std::vector<Entry>::iterator find(std::shared_ptr<Sequencable const> 
+					const& sqbl) throw();
+      
+      std::vector<Entry> m_entries;
+      
+    };
+    
+    
+    /** Create a new sequencer. When several Sequencables write to the 
+	same EventBuffer each of them can write up to @c merge_capacity 
+	events per call to run(), if one writes more it continues in the 
+	next call. */
+    explicit Sequencer(size_t merge_capacity = 1024) throw(std::bad_alloc);
+    
+    ~Sequencer();
+    
+    /** Copying is not allowed. */
+    Sequencer(Sequencer const&) = delete;
+    
+    /** Assignment is not allowed. */
+    Sequencer& operator=(Sequencer const&) = delete;
 
     /** Return the event buffer that the Sequencable that @c iter refers to 
 	will be sequenced to. */
@@ -112,29 +268,96 @@ namespace Dino {
     
     /** Add an object to the list of sequenced objects. */
     Iterator add_sequencable(std::shared_ptr<Sequencable const> sqbl) 
-      throw(std::bad_alloc, std::overflow_error, std::invalid_argument);
+      throw(std::bad_alloc, std::invalid_argument);
     
     /** Remove the reference to the Sequencable that @c iter refers to from
 	the list, which means that it will not be sequenced any more. */
-    void remove_sequencable(Iterator iter) throw(std::overflow_error);
+    void remove_sequencable(Iterator iter) throw(std::bad_alloc);
     
     /** Set the buffer that the Sequencable that @c iter refers to will be
 	sequenced to. */
     void set_event_buffer(Iterator iter, std::shared_ptr<EventBuffer> instr)
-      throw();
+      throw(std::bad_alloc);
+    
+    /** Return a new Transaction that starts out with the current list of
+	sequenced objects. */
+    Transaction begin_transaction() const throw(std::bad_alloc);
+    
+    /** Publish the edits in @c t to the realtime thread. If several 
+	transactions are created from the same plan, the last one committed
+	replaces the others. */
+    void commit(Transaction& t) throw(std::bad_alloc);
     
-    /** This is the function that does the actual sequencing. */
+    /** Deallocate all replaced plans that the realtime thread has 
+	acknowledged that it's no longer using. This is called automatically
+	by commit(), so you should normally not have to call it directly. */
+    void delete_retired_plans() throw();
+    
+    /** This is the function that does the actual sequencing. Sequencables
+	without an EventBuffer are skipped. If @c from is not where the 
+	last call ended, the transport has jumped and all Sequencables are 
+	asked to chase their state at @c from before sequencing. This is the
+	only function that should be called in the realtime thread. */
     void run(SongTime const& from, SongTime const& to);
     
+    /** Copy the status published by the last call to run() to @c status.
+	Returns @c false if run() kept interrupting the read, which only 
+	happens if the caller is preempted for several periods. This can be
+	called by any number of threads and never blocks the realtime 
+	thread. */
+    bool get_status(Status& status) const throw();
+    
+    /** Return the number of times the status has been published, modulo 
+	2^31, so pollers can skip reading it if nothing has happened. */
+    AtomicInt::Type get_status_count() const throw();
+    
   private:
     
-    LinkedList<SeqData> m_sqbls;
+    /** Sequence entry number @c i in @c plan up to @c to into @c buf, 
+	chasing its state first if @c chase is set or an earlier chase 
+	didn't fit. Returns @c false if @c buf ran out of space. */
+    bool sequence_entry(Plan const& plan, size_t i, SongTime const& to,
+			EventBuffer& buf, bool chase);
+    
+    /** Move the events that the mergers in @c old couldn't write to the 
+	entries with the same Positions in @c plan. */
+    void move_pending(Plan const& old, Plan const& plan) throw();
+    
+    /** The current plan, as seen by the non-realtime thread. */
+    Plan* m_plan;
+    
+    /** Plans that have been replaced, linked through @c next_retired. */
+    Plan* m_retired;
+    
+    /** The current plan, as seen by the realtime thread. */
+    AtomicPtr<Plan> m_rt_plan;
+    
+    /** The serial number of the last plan that run() has picked up. Plans
+	with lower serial numbers can be deallocated. */
+    AtomicInt m_rt_ack;
+    
+    /** The serial number of the plan used in the last call to run(). This
+	is only touched by the realtime thread. */
+    AtomicInt::Type m_rt_serial;
+    
+    /** The plan used in the last call to run(). This is only touched by
+	the realtime thread. */
+    Plan const* m_rt_last;
     
     SongTime m_next_start;
     
+    /** The number of events per entry in the EventMergers. */
+    size_t m_merge_capacity;
+    
+    /** The status that is being built by run(). This is only touched by
+	the realtime thread. */
+    Status m_rt_status;
+    
+    /** The published status. */
+    StatusChannel<Status> m_status;
+    
   };
 
-
 }
 
 
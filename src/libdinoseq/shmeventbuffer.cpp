@@ -0,0 +1,201 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shmeventbuffer.hpp"
+
+
+namespace Dino {
+  
+  
+  using std::invalid_argument;
+  using std::runtime_error;
+  using std::string;
+  
+  
+  ShmEventBuffer::ShmEventBuffer(string const& name, size_t capacity)
+    throw(runtime_error, invalid_argument)
+    : m_name(name),
+      m_ring(0),
+      m_size(0),
+      m_write(0) {
+    
+    // round up to a power of 2, and add the slot that is always empty
+    if (capacity == 0 || capacity >= (size_t(1) << 30))
+      throw invalid_argument("Invalid capacity for shared memory ring");
+    uint32_t slots = 2;
+    while (slots < capacity + 1)
+      slots *= 2;
+    m_size = ShmEventRing::segment_size(slots);
+    
+    int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1)
+      throw runtime_error("Could not create shared memory segment " + m_name);
+    if (ftruncate(fd, m_size) == -1) {
+      close(fd);
+      shm_unlink(m_name.c_str());
+      throw runtime_error("Could not resize shared memory segment " + m_name);
+    }
+    void* mem = mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+      shm_unlink(m_name.c_str());
+      throw runtime_error("Could not map shared memory segment " + m_name);
+    }
+    
+    // initialise the header, the magic number goes last (after the memory
+    // barrier in AtomicInt::set()) so readers never see a half initialised
+    // ring
+    m_ring = new (mem) ShmEventRing;
+    m_ring->version = ShmEventRing::version_value;
+    m_ring->capacity = slots;
+    m_ring->write_index.set(0);
+    m_ring->read_index.set(0);
+    m_ring->magic = ShmEventRing::magic_value;
+  }
+  
+  
+  ShmEventBuffer::~ShmEventBuffer() throw() {
+    munmap(m_ring, m_size);
+    shm_unlink(m_name.c_str());
+  }
+  
+  
+  string const& ShmEventBuffer::get_name() const throw() {
+    return m_name;
+  }
+  
+  
+  bool ShmEventBuffer::write_event(SongTime const& st, size_t bytes, 
+				   unsigned char const* data) {
+    if (bytes > max_event_size)
+      return true;
+    if (free_slots() == 0)
+      return false;
+    ShmEventRing::Slot& slot = m_ring->slots()[m_write];
+    slot.time = st.to_ticks();
+    slot.size = bytes;
+    std::memcpy(slot.data, data, bytes);
+    m_write = (m_write + 1) & (m_ring->capacity - 1);
+    m_ring->write_index.set(m_write);
+    return true;
+  }
+  
+  
+  size_t ShmEventBuffer::write_events(Event const* events, size_t n) {
+    uint32_t mask = m_ring->capacity - 1;
+    uint32_t free = free_slots();
+    if (n > free)
+      n = free;
+    ShmEventRing::Slot* slots = m_ring->slots();
+    for (size_t i = 0; i < n; ++i) {
+      ShmEventRing::Slot& slot = slots[(m_write + i) & mask];
+      slot.time = events[i].time.to_ticks();
+      slot.size = sizeof(events[i].data);
+      std::memcpy(slot.data, events[i].data, sizeof(events[i].data));
+    }
+    m_write = (m_write + n) & mask;
+    m_ring->write_index.set(m_write);
+    return n;
+  }
+  
+  
+  uint32_t ShmEventBuffer::free_slots() const throw() {
+    uint32_t read = m_ring->read_index.get();
+    return (read - m_write - 1) & (m_ring->capacity - 1);
+  }
+  
+  
+  ShmEventReader::ShmEventReader(string const& name) throw(runtime_error)
+    : m_ring(0),
+      m_size(0),
+      m_mask(0),
+      m_read(0) {
+    
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1)
+      throw runtime_error("Could not open shared memory segment " + name);
+    struct stat st;
+    if (fstat(fd, &st) == -1 || 
+	size_t(st.st_size) < ShmEventRing::segment_size(0)) {
+      close(fd);
+      throw runtime_error("Invalid shared memory segment " + name);
+    }
+    m_size = st.st_size;
+    void* mem = mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+      throw runtime_error("Could not map shared memory segment " + name);
+    
+    // the header was written by another process, so check everything 
+    // that is used to index the slots and keep our own copies of it
+    m_ring = static_cast<ShmEventRing*>(mem);
+    uint32_t capacity = m_ring->capacity;
+    m_read = m_ring->read_index.get();
+    if (m_ring->magic != ShmEventRing::magic_value ||
+	m_ring->version != ShmEventRing::version_value ||
+	capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+	ShmEventRing::segment_size(capacity) > m_size ||
+	m_read >= capacity) {
+      munmap(mem, m_size);
+      throw runtime_error("Invalid shared memory segment " + name);
+    }
+    m_mask = capacity - 1;
+  }
+  
+  
+  ShmEventReader::~ShmEventReader() throw() {
+    munmap(m_ring, m_size);
+  }
+  
+  
+  size_t ShmEventReader::get_available() const throw() {
+    uint32_t write = m_ring->write_index.get();
+    return (write - m_read) & m_mask;
+  }
+  
+  
+  bool ShmEventReader::peek(SongTime& time, size_t& bytes, 
+			    unsigned char const*& data) const throw() {
+    if (uint32_t(m_ring->write_index.get()) == m_read)
+      return false;
+    ShmEventRing::Slot const& slot = m_ring->slots()[m_read];
+    time = SongTime::from_ticks(slot.time);
+    bytes = std::min(size_t(slot.size), sizeof(slot.data));
+    data = slot.data;
+    return true;
+  }
+  
+  
+  void ShmEventReader::pop() throw() {
+    if (uint32_t(m_ring->write_index.get()) == m_read)
+      return;
+    m_read = (m_read + 1) & m_mask;
+    m_ring->read_index.set(m_read);
+  }
+  
+  
+}
@@ -0,0 +1,237 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef SHMEVENTBUFFER_HPP
+#define SHMEVENTBUFFER_HPP
+
+#include <stdexcept>
+#include <string>
+
+#include <stdint.h>
+
+#include "atomicint.hpp"
+#include "eventbuffer.hpp"
+#include "songtime.hpp"
+
+
+namespace Dino {
+  
+  
+  /** The layout of the shared memory segment used by ShmEventBuffer and
+      ShmEventReader. It is a single-producer single-consumer ring buffer
+      of fixed size slots, followed directly by the slot array. One slot is
+      always left empty so a full ring can be told apart from an empty one.
+      
+      @ingroup sequencing */
+  struct ShmEventRing {
+    
+    /** A single event in the ring. */
+    struct Slot {
+      
+      /** The time of the event, as returned by SongTime::to_ticks(). */
+      int64_t time;
+      
+      /** The number of bytes in the MIDI message. */
+      uint8_t size;
+      
+      /** The MIDI message. */
+      unsigned char data[7];
+    };
+    
+    /** The value of @c magic in a valid segment. */
+    static uint32_t const magic_value = 0x44534552; // "DSER"
+    
+    /** The current layout version. */
+    static uint32_t const version_value = 1;
+    
+    /** This is set to magic_value once the segment has been initialised. */
+    uint32_t magic;
+    
+    /** The layout version. */
+    uint32_t version;
+    
+    /** The number of slots in the ring. It is always a power of 2. */
+    uint32_t capacity;
+    
+    /** The index of the next slot that the producer will write. */
+    AtomicInt write_index;
+    
+    /** Padding to keep the indices in different cache lines. */
+    char padding[64];
+    
+    /** The index of the next slot that the consumer will read. */
+    AtomicInt read_index;
+    
+    /** Return a pointer to the first slot. */
+    Slot* slots() throw() {
+      return reinterpret_cast<Slot*>(this + 1);
+    }
+    
+    /** Return a pointer to the first slot. */
+    Slot const* slots() const throw() {
+      return reinterpret_cast<Slot const*>(this + 1);
+    }
+    
+    /** Return the number of bytes needed for a ring with @c capacity 
+	slots. */
+    static size_t segment_size(uint32_t capacity) throw() {
+      return sizeof(ShmEventRing) + capacity * sizeof(Slot);
+    }
+  };
+  
+  
+  /** An EventBuffer that writes events to a lock-free ring buffer in a 
+      POSIX shared memory segment. A synth host running in a separate 
+      process can open the same segment using ShmEventReader and read the
+      sequenced events directly from the shared memory, without going
+      through JACK or any other copying transport. 
+      
+      write_event() and write_events() are realtime safe. Events longer
+      than ShmEventBuffer::max_event_size bytes can not be stored in a slot
+      and are dropped.
+      
+      @ingroup sequencing */
+  class ShmEventBuffer : public EventBuffer {
+  public:
+    
+    /** The largest MIDI message that fits in a slot. */
+    static size_t const max_event_size = sizeof(ShmEventRing::Slot::data);
+    
+    /** Create a new shared memory segment with the given name (which should
+	start with a '/', see @c shm_open(3)) and room for at least 
+	@c capacity events. The segment is removed again when this object is
+	destroyed.
+	
+	@throw std::runtime_error if the segment can't be created
+	@throw std::invalid_argument if @c capacity is 0 or too large */
+    ShmEventBuffer(std::string const& name, size_t capacity)
+      throw(std::runtime_error, std::invalid_argument);
+    
+    /** Unmap and unlink the shared memory segment. */
+    ~ShmEventBuffer() throw();
+    
+    /** Copying is not allowed. */
+    ShmEventBuffer(ShmEventBuffer const&) = delete;
+    
+    /** Assignment is not allowed. */
+    ShmEventBuffer& operator=(ShmEventBuffer const&) = delete;
+    
+    /** Return the name of the shared memory segment. */
+    std::string const& get_name() const throw();
+    
+    /** Write a single event to the ring. Returns @c false if the ring is
+	full. */
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data);
+    
+    /** Write a batch of events to the ring. The free space is only checked
+	once and the write index is only published once for the whole 
+	batch. */
+    size_t write_events(Event const* events, size_t n);
+    
+  private:
+    
+    /** Return the number of free slots. */
+    uint32_t free_slots() const throw();
+    
+    /** The name of the segment. */
+    std::string m_name;
+    
+    /** The mapped segment. */
+    ShmEventRing* m_ring;
+    
+    /** The size of the mapped segment in bytes. */
+    size_t m_size;
+    
+    /** The producer's copy of the write index. Only this object writes it,
+	so there's no need to read it back from the shared memory. */
+    uint32_t m_write;
+    
+  };
+  
+  
+  /** The consumer side of a ShmEventBuffer. It maps an existing shared 
+      memory segment and lets one thread, typically in another process, read
+      the events in place. All functions except the constructor and 
+      destructor are realtime safe. 
+      
+      A typical consumer loop looks like this:
+      @code
+      SongTime time;
+      size_t bytes;
+      unsigned char const* data;
+      while (reader.peek(time, bytes, data)) {
+        play_event(time, bytes, data);
+	reader.pop();
+      }
+      @endcode
+      
+      @ingroup sequencing */
+  class ShmEventReader {
+  public:
+    
+    /** Map the shared memory segment with the given name. 
+	
+	@throw std::runtime_error if the segment can't be opened or does not
+	                          contain a valid ring buffer */
+    ShmEventReader(std::string const& name) throw(std::runtime_error);
+    
+    /** Unmap the shared memory segment. */
+    ~ShmEventReader() throw();
+    
+    /** Copying is not allowed. */
+    ShmEventReader(ShmEventReader const&) = delete;
+    
+    /** Assignment is not allowed. */
+    ShmEventReader& operator=(ShmEventReader const&) = delete;
+    
+    /** Return the number of events that are ready to be read. */
+    size_t get_available() const throw();
+    
+    /** Get the next event without removing it from the ring. @c data will
+	point directly into the shared memory and is valid until pop() is 
+	called. @c bytes is never larger than the slot, even if the 
+	producer wrote a bad size. Returns @c false if the ring is empty. */
+    bool peek(SongTime& time, size_t& bytes, 
+	      unsigned char const*& data) const throw();
+    
+    /** Remove the event returned by the last peek() from the ring. */
+    void pop() throw();
+    
+  private:
+    
+    /** The mapped segment. */
+    ShmEventRing* m_ring;
+    
+    /** The size of the mapped segment in bytes. */
+    size_t m_size;
+    
+    /** The capacity minus 1, checked and copied when the segment is 
+	mapped. */
+    uint32_t m_mask;
+    
+    /** The consumer's copy of the read index. */
+    uint32_t m_read;
+    
+  };
+  
+  
+}
+
+
+#endif
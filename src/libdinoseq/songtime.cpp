@@ -24,93 +24,6 @@
 namespace Dino {
   
   
-  SongTime::SongTime() throw()
-    : m_data(0) {
-  }
-  
-  
-  SongTime::SongTime(Beat beat, Tick tick) throw()
-    : m_data((static_cast<int64_t>(beat) * (1 << 24)) | (tick & 0xFFFFFF)) {
-  }
-  
-  
-  bool SongTime::operator==(SongTime const& st) const throw() {
-    return m_data == st.m_data;
-  }
-  
-  
-  bool SongTime::operator!=(SongTime const& st) const throw() {
-    return !operator==(st);
-  }
-    
-  
-  bool SongTime::operator<(SongTime const& st) const throw() {
-    return m_data < st.m_data;
-  }
-  
-  
-  bool SongTime::operator>(SongTime const& st) const throw() {
-    return m_data > st.m_data;
-  }
-  
-  
-  bool SongTime::operator<=(SongTime const& st) const throw() {
-    return !operator>(st);
-  }
-  
-  
-  bool SongTime::operator>=(SongTime const& st) const throw() {
-    return !operator<(st);
-  }
-  
-
-  SongTime SongTime::operator+(SongTime const& st) const throw() {
-    return SongTime(m_data + st.m_data);
-  }
-
-  
-  SongTime SongTime::operator-(SongTime const& st) const throw() {
-    return SongTime(m_data - st.m_data);
-  }
-  
-  
-  SongTime& SongTime::operator+=(SongTime const& st) throw() {
-    m_data += st.m_data;
-    return *this;
-  }
-  
-  
-  SongTime& SongTime::operator-=(SongTime const& st) throw() {
-    m_data -= st.m_data;
-    return *this;
-  }
-  
-  
-  SongTime::Beat SongTime::get_beat() const throw() {
-    return m_data / (1 << 24);
-  }
-  
-  
-  SongTime::Tick SongTime::get_tick() const throw() {
-    return m_data & 0xFFFFFF;
-  }
-
-
-  void SongTime::set_beat(Beat b) throw() {
-    m_data = (static_cast<int64_t>(b) * (1 << 24)) | get_tick();
-  }
-
-  
-  void SongTime::set_tick(Tick t) throw() {
-    m_data = (get_beat() * (1 << 24)) | (t & 0xFFFFFF);
-  }
-
-
-  SongTime::SongTime(int64_t data) throw()
-    : m_data(data) {
-  }
-
-
   std::ostream& operator<<(std::ostream& os, SongTime const& st) {
     auto f = os.flags();
     os<<std::hex<<std::uppercase<<st.get_beat()<<':'
@@ -120,18 +33,4 @@ namespace Dino {
   }
 
 
-  SongTime::Tick SongTime::ticks_per_beat() throw() {
-    return (1 << 24) - 1;
-  }
-
-
-  unsigned SongTime::overhead_bits() throw() {
-    return 16;
-  }
-
-
-  SongTime SongTime::max_valid() throw() {
-    return SongTime(int64_t(1) << 47);
-  }
-
 }
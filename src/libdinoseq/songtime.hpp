@@ -27,7 +27,20 @@
 namespace Dino {
   
   
-  /** A type that represents time in a Sequencable or a Song. */
+  /** A type that represents time in a Sequencable or a Song. 
+      
+      A SongTime is a signed 64 bit fixed-point number of beats with 24
+      fractional bits. The lower 24 bits hold the tick and the upper 40 bits
+      hold the beat in two's complement, so the beat and the tick can be
+      extracted with a shift and a mask and the comparison and arithmetic
+      operators work directly on the underlying integer. Since a valid
+      beat never uses more than 24 of those 40 bits (see max_valid()) there
+      are 16 bits of overhead, which means that sums and differences of 
+      valid times can never overflow.
+      
+      Everything is inline and most functions are @c constexpr, so 
+      comparisons in tight loops such as skip list searches compile down to
+      single integer instructions. */
   class SongTime {
   public:
     
@@ -39,67 +52,134 @@ namespace Dino {
     typedef uint32_t Tick;
     
     /** Create a SongTime at beat 0 and tick 0. */
-    SongTime() throw();
+    constexpr SongTime() throw() 
+      : m_data(0) {}
     
     /** Create a SongTime with the given beat and tick. */
-    SongTime(Beat beat, Tick tick) throw();
+    constexpr SongTime(Beat beat, Tick tick) throw()
+      : m_data(int64_t(beat) * (int64_t(1) << tick_bits) | (tick & tick_mask)) {}
+    
+    /** Create a SongTime from an absolute number of ticks, i.e. the raw
+	fixed-point representation. */
+    static constexpr SongTime from_ticks(int64_t ticks) throw() {
+      return SongTime(ticks);
+    }
+    
+    /** Return the absolute number of ticks, i.e. the raw fixed-point 
+	representation. */
+    constexpr int64_t to_ticks() const throw() {
+      return m_data;
+    }
     
     /** Compare for equality. */
-    bool operator==(SongTime const& st) const throw();
+    constexpr bool operator==(SongTime const& st) const throw() {
+      return m_data == st.m_data;
+    }
 
     /** Compare for inequality. */
-    bool operator!=(SongTime const& st) const throw();
+    constexpr bool operator!=(SongTime const& st) const throw() {
+      return m_data != st.m_data;
+    }
     
     /** Return true if this SongTime is earlier than another. */
-    bool operator<(SongTime const& st) const throw();
+    constexpr bool operator<(SongTime const& st) const throw() {
+      return m_data < st.m_data;
+    }
 
     /** Return true if this SongTime is later than another. */
-    bool operator>(SongTime const& st) const throw();
+    constexpr bool operator>(SongTime const& st) const throw() {
+      return m_data > st.m_data;
+    }
 
     /** Return true if this SongTime is not later than another. */
-    bool operator<=(SongTime const& st) const throw();
+    constexpr bool operator<=(SongTime const& st) const throw() {
+      return m_data <= st.m_data;
+    }
 
     /** Return true if this SongTime is not earlier than another. */
-    bool operator>=(SongTime const& st) const throw();
+    constexpr bool operator>=(SongTime const& st) const throw() {
+      return m_data >= st.m_data;
+    }
     
     /** Add one SongTime to another, return the result by value. */
-    SongTime operator+(SongTime const& st) const throw();
+    constexpr SongTime operator+(SongTime const& st) const throw() {
+      return SongTime(m_data + st.m_data);
+    }
     
     /** Subtract one SongTime from another, return the result by value. */
-    SongTime operator-(SongTime const& st) const throw();
+    constexpr SongTime operator-(SongTime const& st) const throw() {
+      return SongTime(m_data - st.m_data);
+    }
     
     /** Add SongTime objects in place. */
-    SongTime& operator+=(SongTime const& st) throw();
+    SongTime& operator+=(SongTime const& st) throw() {
+      m_data += st.m_data;
+      return *this;
+    }
 
     /** Subtract SongTime objects in place. */
-    SongTime& operator-=(SongTime const& st) throw();
+    SongTime& operator-=(SongTime const& st) throw() {
+      m_data -= st.m_data;
+      return *this;
+    }
+    
+    /** Return this SongTime multiplied by the ratio @c num / @c den,
+	rounded towards zero. This can be used to scale times by tempo 
+	ratios. The result is exact as long as the product of @c num and 
+	@c den fits in 63 bits and the result is a valid time, there is
+	no intermediate overflow even for times close to max_valid(). 
+	@c den must not be 0. */
+    constexpr SongTime scale(int64_t num, int64_t den) const throw() {
+      return SongTime(m_data / den * num + m_data % den * num / den);
+    }
     
     /** Get the beat. */
-    Beat get_beat() const throw();
+    constexpr Beat get_beat() const throw() {
+      return Beat(m_data >> tick_bits);
+    }
     
     /** Get the tick. */
-    Tick get_tick() const throw();
+    constexpr Tick get_tick() const throw() {
+      return Tick(m_data & tick_mask);
+    }
     
     /** Set the beat. */
-    void set_beat(Beat b) throw();
+    void set_beat(Beat b) throw() {
+      m_data = int64_t(b) * (int64_t(1) << tick_bits) | get_tick();
+    }
     
     /** Set the tick. */
-    void set_tick(Tick t) throw();
+    void set_tick(Tick t) throw() {
+      m_data = (m_data & ~int64_t(tick_mask)) | (t & tick_mask);
+    }
     
     /** Return the number of ticks per beat. */
-    static Tick ticks_per_beat() throw();
+    static constexpr Tick ticks_per_beat() throw() {
+      return tick_mask;
+    }
 
     /** Return the number of bits of overhead that is available. */
-    static unsigned overhead_bits() throw();
+    static constexpr unsigned overhead_bits() throw() {
+      return 16;
+    }
 
     /** Return the maximal length of a song. Because of the overhead this is
 	not the maximal value representable by a SongTime. */
-    static SongTime max_valid() throw();
+    static constexpr SongTime max_valid() throw() {
+      return SongTime(int64_t(1) << (63 - overhead_bits()));
+    }
 
   private:
     
+    /** The number of fractional bits, i.e. bits used for the tick. */
+    static constexpr int tick_bits = 24;
+    
+    /** The mask for the tick bits. */
+    static constexpr Tick tick_mask = (Tick(1) << tick_bits) - 1;
+    
     /** Initialise a SongTime object from a single 64 bit integer. */
-    SongTime(int64_t data) throw();
+    constexpr explicit SongTime(int64_t data) throw() 
+      : m_data(data) {}
     
     /** The actual data. */
     int64_t m_data;
@@ -0,0 +1,121 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef STATUSCHANNEL_HPP
+#define STATUSCHANNEL_HPP
+
+#include <cstring>
+
+#include "atomicint.hpp"
+
+
+namespace Dino {
+
+  
+  /** A lock-free channel that publishes the latest value of a small struct
+      from one writer to any number of readers, protected by a sequence 
+      lock. The writer never waits and never allocates, so it can be used 
+      to report state like the song position from a realtime thread. 
+      Readers poll at whatever rate they like and only ever see complete 
+      values. A reader that is interrupted by a write just tries again, 
+      and gives up after a few attempts instead of spinning.
+      
+      The value is stored as an array of AtomicInt words, so @c T must be
+      trivially copyable. Readers only see the latest value, not every 
+      value that was written - anything that must not be missed, like 
+      events, should be a counter in @c T rather than a flag.
+  */
+  template <typename T>
+  class StatusChannel {
+  public:
+    
+    /** Create a new channel with the value @c initial. */
+    explicit StatusChannel(T const& initial = T()) throw()
+      : m_sequence(0) {
+      store(initial);
+    }
+    
+    /** Publish a new value. This may only be called by the writer. */
+    void write(T const& value) throw() {
+      // an odd sequence number tells readers that a write is in progress
+      m_sequence.increase();
+      store(value);
+      m_sequence.increase();
+    }
+    
+    /** Copy the latest value to @c value. Returns @c false, leaving 
+	@c value unchanged, if the writer kept interrupting the read. This 
+	can be called by any number of threads at once. */
+    bool read(T& value) const throw() {
+      for (int attempt = 0; attempt < max_attempts; ++attempt) {
+	AtomicInt::Type before = m_sequence.get();
+	if (before & 1)
+	  continue;
+	AtomicInt::Type words[n_words];
+	for (size_t i = 0; i < n_words; ++i)
+	  words[i] = m_words[i].get();
+	if (m_sequence.get() == before) {
+	  std::memcpy(&value, words, sizeof(T));
+	  return true;
+	}
+      }
+      return false;
+    }
+    
+    /** Return the number of values that have been written, modulo 2^31.
+	Readers can compare this to the number they got last time to see if
+	anything has changed without copying the value. */
+    AtomicInt::Type get_count() const throw() {
+      return AtomicInt::Type(unsigned(m_sequence.get()) >> 1);
+    }
+    
+  private:
+    
+    StatusChannel(StatusChannel const&) = delete;
+    StatusChannel& operator=(StatusChannel const&) = delete;
+    
+    /** Copy @c value into the words. */
+    void store(T const& value) throw() {
+      AtomicInt::Type words[n_words];
+      words[n_words - 1] = 0;
+      std::memcpy(words, &value, sizeof(T));
+      for (size_t i = 0; i < n_words; ++i)
+	m_words[i].set(words[i]);
+    }
+    
+    /** The number of words needed to hold a @c T. */
+    static size_t const n_words = 
+      (sizeof(T) + sizeof(AtomicInt::Type) - 1) / sizeof(AtomicInt::Type);
+    
+    /** How many times read() tries before giving up. */
+    static int const max_attempts = 16;
+    
+    /** Twice the number of completed writes, plus one while a write is in
+	progress. */
+    AtomicInt m_sequence;
+    
+    /** The value. */
+    AtomicInt m_words[n_words];
+    
+  };
+  
+  
+}
+
+
+#endif
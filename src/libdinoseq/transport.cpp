@@ -0,0 +1,119 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "sequencer.hpp"
+#include "transport.hpp"
+
+
+namespace Dino {
+  
+  
+  Transport::Transport(uint32_t rate, double bpm, size_t capacity) 
+    throw(std::bad_alloc)
+    : m_commands(capacity),
+      m_tempo_num(int64_t(bpm * 1000 + 0.5)),
+      m_tempo_den(int64_t(60000) * rate),
+      m_anchor_frame(0),
+      m_anchor_time(0, 0),
+      m_playing(false),
+      m_playing_flag(0) {
+
+  }
+  
+  
+  bool Transport::post_play(uint64_t frame) throw() {
+    Command c = { Command::Play, frame, SongTime() };
+    return m_commands.push(c);
+  }
+  
+  
+  bool Transport::post_stop(uint64_t frame) throw() {
+    Command c = { Command::Stop, frame, SongTime() };
+    return m_commands.push(c);
+  }
+  
+  
+  bool Transport::post_locate(SongTime const& time, uint64_t frame) throw() {
+    Command c = { Command::Locate, frame, time };
+    return m_commands.push(c);
+  }
+  
+  
+  void Transport::process(Sequencer& seq, uint64_t frame, uint32_t nframes) {
+    uint64_t end = frame + nframes;
+    
+    // run up to each command that is due in this period, then apply it
+    Command const* c;
+    while ((c = m_commands.peek()) && c->frame < end) {
+      uint64_t at = c->frame > frame ? c->frame : frame;
+      if (m_playing && at > frame)
+	seq.run(get_position(frame), get_position(at));
+      apply(*c, at);
+      m_commands.drop();
+      frame = at;
+    }
+    
+    if (m_playing && end > frame)
+      seq.run(get_position(frame), get_position(end));
+    
+    m_playing_flag.set(m_playing ? 1 : 0);
+  }
+  
+  
+  bool Transport::is_playing() const throw() {
+    return m_playing_flag.get() != 0;
+  }
+  
+  
+  SongTime Transport::get_position(uint64_t frame) const throw() {
+    if (!m_playing || frame <= m_anchor_frame)
+      return m_anchor_time;
+    return m_anchor_time + frames_to_time(frame - m_anchor_frame);
+  }
+  
+  
+  void Transport::apply(Command const& c, uint64_t frame) throw() {
+    switch (c.type) {
+    case Command::Play:
+      if (!m_playing) {
+	m_anchor_frame = frame;
+	m_playing = true;
+      }
+      break;
+    case Command::Stop:
+      if (m_playing) {
+	m_anchor_time = get_position(frame);
+	m_anchor_frame = frame;
+	m_playing = false;
+      }
+      break;
+    case Command::Locate:
+      m_anchor_time = c.time;
+      m_anchor_frame = frame;
+      break;
+    }
+  }
+  
+  
+  SongTime Transport::frames_to_time(uint64_t frames) const throw() {
+    return SongTime::from_ticks(int64_t(frames) << 24).scale(m_tempo_num,
+							     m_tempo_den);
+  }
+  
+  
+}
@@ -0,0 +1,144 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <stdexcept>
+
+#include <stdint.h>
+
+#include "atomicint.hpp"
+#include "commandring.hpp"
+#include "songtime.hpp"
+
+
+namespace Dino {
+  
+  
+  class Sequencer;
+  
+  
+  /** The transport state (playing or stopped, and the song position) for a
+      Sequencer that is driven by a frame clock. Other threads, for example
+      an OSC server or a MIDI sync input, change the state by posting 
+      commands to a CommandRing. The clock thread applies them in process(),
+      which splits the period at the frames the commands are scheduled for,
+      so a locate or a stop takes effect on the exact frame instead of 
+      whenever some other thread gets around to it.
+      
+      Only one thread at a time may post commands. Commands take effect in
+      the order they were posted, so a command scheduled for a later frame
+      delays the ones that were posted after it.
+      
+      @ingroup sequencing
+  */
+  class Transport {
+  public:
+    
+    /** A transport command. */
+    struct Command {
+      
+      /** The command types. */
+      enum Type {
+	Play,
+	Stop,
+	Locate
+      };
+      
+      /** What to do. */
+      Type type;
+      
+      /** The frame that the command should take effect on. Commands for 
+	  frames that have already passed take effect at the start of the 
+	  next period. */
+      uint64_t frame;
+      
+      /** The new song position for Locate commands. */
+      SongTime time;
+    };
+    
+    /** Create a new stopped transport at position 0 for a clock with 
+	@c rate frames per second and a tempo of @c bpm beats per minute.
+	@c capacity is the number of commands that can be waiting. */
+    Transport(uint32_t rate, double bpm, size_t capacity = 256) 
+      throw(std::bad_alloc);
+    
+    /** Start playing at @c frame. Returns @c false if the command ring is
+	full. */
+    bool post_play(uint64_t frame = 0) throw();
+    
+    /** Stop playing at @c frame. Returns @c false if the command ring is
+	full. */
+    bool post_stop(uint64_t frame = 0) throw();
+    
+    /** Move the song position to @c time at @c frame. Returns @c false if
+	the command ring is full. */
+    bool post_locate(SongTime const& time, uint64_t frame = 0) throw();
+    
+    /** Apply the commands that are due in the period of @c nframes frames
+	starting at @c frame, and run @c seq for the parts of the period
+	where the transport is playing. This should be called once per period
+	in the clock thread, and is realtime safe. */
+    void process(Sequencer& seq, uint64_t frame, uint32_t nframes);
+    
+    /** Return @c true if the transport was playing at the end of the last
+	period. This can be called in any thread. */
+    bool is_playing() const throw();
+    
+    /** Return the song position at @c frame, assuming that no commands 
+	take effect before it. This may only be called in the clock 
+	thread. */
+    SongTime get_position(uint64_t frame) const throw();
+    
+  private:
+    
+    /** Apply a single command at @c frame. */
+    void apply(Command const& c, uint64_t frame) throw();
+    
+    /** Convert a number of frames to a SongTime offset. */
+    SongTime frames_to_time(uint64_t frames) const throw();
+    
+    
+    /** The posted commands that haven't been applied yet. */
+    CommandRing<Command> m_commands;
+    
+    /** The tempo as a ratio, beats per frame scaled by 2^24 / ticks per 
+	beat. */
+    int64_t m_tempo_num;
+    int64_t m_tempo_den;
+    
+    /** The position is m_anchor_time at m_anchor_frame, and moves forward
+	from there while playing. Both only change when a command is 
+	applied, so positions don't drift with the period size. */
+    uint64_t m_anchor_frame;
+    SongTime m_anchor_time;
+    
+    /** Whether the transport is playing, as seen by the clock thread. */
+    bool m_playing;
+    
+    /** A copy of m_playing for other threads. */
+    AtomicInt m_playing_flag;
+    
+  };
+  
+  
+}
+
+
+#endif
@@ -19,21 +19,33 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <sstream>
 #include <stdexcept>
+#include <vector>
 
+#include <cxxabi.h>
 #include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "dtest.hpp"
 
 
+using std::cerr;
 using std::cout;
 using std::endl;
+using std::pair;
 using std::runtime_error;
 using std::string;
 using std::unique_ptr;
+using std::vector;
 
 
 namespace DTest {
@@ -48,11 +60,30 @@ namespace {
   /** The shell command used to generate the symbol list. It is a bit hacky to
       do it this way, but it lets us build the test as a single binary without
       wrapping scripts which is very convenient. The %s should be replaced by
-      argv[0]. */
-  char const* symbol_cmd = 
-    "nm %s | grep ' T ' | awk '{print $3}' | "
-    "xargs -I'{}' sh -c \"echo -n '{} '; c++filt {}\" \\; | "
-    "grep -E '[a-zA-Z0-9_:]+::dtest_' | sed 's/(.*//'";
+      the file name. The symbols are demangled in main(), spawning c++filt
+      once per symbol made the discovery slower than most of the tests. */
+  char const* symbol_cmd = "nm %s";
+  
+  
+  /** The suffix for the file that the symbol list is cached in. */
+  char const* cache_suffix = ".dtest-symbols";
+  
+  
+  /** The command line options. */
+  struct Options {
+    
+    /** The number of top level suites that may run at the same time, each
+	in its own process. */
+    unsigned jobs;
+    
+    /** Tests that take longer than this many milliseconds fail. 0 means
+	no limit. */
+    double max_time;
+    
+    /** Whether the symbol list should be cached. */
+    bool cache;
+    
+  } options = { 1, 0, true };
   
   
   /** This is not in the standard library for some reason. */
@@ -60,6 +91,14 @@ namespace {
   unique_ptr<T, D> make_unique(T* ptr, D&& deleter) {
     return unique_ptr<T, D>(ptr, deleter);
   }
+  
+  
+  /** Return the value of a monotonic clock in milliseconds. */
+  double now_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+  }
 
   
   /** A test suite is a set of tests and/or other suits. */
@@ -79,8 +118,11 @@ namespace {
       }
     }
     
-    /** Run all tests and suites and print some info. */
-    bool run(size_t indent = 0) {
+    /** Run all tests and suites and print some info. If @c jobs is larger
+	than 1 the direct subsuites are run in that many child processes 
+	at a time, and their output is printed in order when they are 
+	done. */
+    bool run(size_t indent = 0, unsigned jobs = 1) {
       bool passed = true;
       string indent_str(indent, ' ');
       int good = 0, bad = 0;
@@ -90,6 +132,7 @@ namespace {
 	  DTest::state.indent = indent;
 	  DTest::state.good = DTest::state.bad = 0;
 	  cout<<indent_str<<"* "<<ti->first<<": "<<endl;
+	  double start = now_ms();
 	  try {
 	    ti->second();
 	  }
@@ -101,6 +144,13 @@ namespace {
 	    DTEST_MSG("  Unexpected exception of unknown type "
 		      "thrown outside test code");
 	  }
+	  double time = now_ms() - start;
+	  cout<<indent_str<<"  Time: "<<time<<" ms"<<endl;
+	  if (options.max_time > 0 && time > options.max_time) {
+	    cout<<indent_str<<"  Too slow, the limit is "<<options.max_time
+		<<" ms... failed"<<endl;
+	    ++DTest::state.bad;
+	  }
 	  if (DTest::state.bad)
 	    ++bad;
 	  else
@@ -113,12 +163,16 @@ namespace {
 
       if (!m_suites.empty()) {
 	good = 0; bad = 0;
-	for (auto si = m_suites.begin(); si != m_suites.end(); ++si) {
-	  cout<<indent_str<<"* Suite: "<<si->first<<endl;
-	  if (si->second.run(indent + 2))
-	    ++good;
-	  else
-	    ++bad;
+	if (jobs > 1)
+	  run_forked(indent, jobs, good, bad);
+	else {
+	  for (auto si = m_suites.begin(); si != m_suites.end(); ++si) {
+	    cout<<indent_str<<"* Suite: "<<si->first<<endl;
+	    if (si->second.run(indent + 2))
+	      ++good;
+	    else
+	      ++bad;
+	  }
 	}
 	cout<<indent_str<<"Summary (suites): "<<good<<"/"<<(good + bad)<<endl;
 	if (bad)
@@ -130,6 +184,94 @@ namespace {
     
   private:
     
+    /** A subsuite running in a child process. */
+    struct Child {
+      TestSuite* suite;
+      string name;
+      pid_t pid;
+      FILE* output;
+      string text;
+      bool passed;
+    };
+    
+    /** Run the subsuites in child processes, at most @c jobs at a time. A
+	suite that crashes only fails itself. */
+    void run_forked(size_t indent, unsigned jobs, int& good, int& bad) {
+      string indent_str(indent, ' ');
+      vector<Child> children;
+      for (auto si = m_suites.begin(); si != m_suites.end(); ++si) {
+	Child c = { &si->second, si->first, -1, 0, "", false };
+	children.push_back(c);
+      }
+      
+      size_t next = 0;
+      unsigned running = 0;
+      while (next < children.size() || running > 0) {
+	
+	while (running < jobs && next < children.size()) {
+	  Child& c = children[next++];
+	  c.output = std::tmpfile();
+	  cout.flush();
+	  c.pid = c.output ? fork() : -1;
+	  if (c.pid == 0) {
+	    dup2(fileno(c.output), STDOUT_FILENO);
+	    bool ok = c.suite->run(indent + 2);
+	    cout.flush();
+	    _exit(ok ? 0 : 1);
+	  }
+	  else if (c.pid > 0)
+	    ++running;
+	  
+	  // if we can't fork, run the suite here instead
+	  else {
+	    std::ostringstream oss;
+	    std::streambuf* old = cout.rdbuf(oss.rdbuf());
+	    c.passed = c.suite->run(indent + 2);
+	    cout.rdbuf(old);
+	    c.text = oss.str();
+	  }
+	}
+	
+	if (running > 0) {
+	  int status;
+	  pid_t pid = wait(&status);
+	  if (pid == -1)
+	    break;
+	  for (size_t i = 0; i < children.size(); ++i) {
+	    Child& c = children[i];
+	    if (c.pid != pid)
+	      continue;
+	    --running;
+	    c.passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	    if (WIFSIGNALED(status)) {
+	      std::ostringstream oss;
+	      oss<<indent_str<<"  Crashed with signal "<<WTERMSIG(status)
+		 <<"... failed"<<endl;
+	      c.text = oss.str();
+	    }
+	  }
+	}
+      }
+      
+      for (size_t i = 0; i < children.size(); ++i) {
+	Child& c = children[i];
+	cout<<indent_str<<"* Suite: "<<c.name<<endl;
+	if (c.output) {
+	  std::rewind(c.output);
+	  char buffer[4096];
+	  size_t n;
+	  while ((n = std::fread(buffer, 1, sizeof(buffer), c.output)) > 0)
+	    cout.write(buffer, n);
+	  std::fclose(c.output);
+	}
+	cout<<c.text;
+	if (c.passed)
+	  ++good;
+	else
+	  ++bad;
+      }
+    }
+    
     std::map<string, TestSuite> m_suites;
     std::map<string, Test> m_tests;
   };
@@ -148,45 +290,130 @@ namespace {
   }
   
   
+  /** Return the mangled and the qualified names of all test functions in
+      @c lib. The list is cached in a file next to @c lib and only 
+      regenerated when the inode, the modification time (with nanoseconds)
+      or the size of @c lib changes. */
+  vector<pair<string, string> > find_tests(char const* lib) {
+    vector<pair<string, string> > tests;
+    
+    struct stat st;
+    if (stat(lib, &st) != 0)
+      throw runtime_error(string("Could not stat ") + lib);
+    std::ostringstream key;
+    key<<st.st_ino<<' '<<st.st_mtim.tv_sec<<'.'<<st.st_mtim.tv_nsec<<' '
+       <<st.st_size;
+    string cache_file = string(lib) + cache_suffix;
+    
+    // try the cache first
+    if (options.cache) {
+      std::ifstream ifs(cache_file.c_str());
+      string line;
+      if (std::getline(ifs, line) && line == key.str()) {
+	string mangled, name;
+	while (ifs>>mangled>>name)
+	  tests.push_back(make_pair(mangled, name));
+	return tests;
+      }
+    }
+    
+    // then read the symbols and demangle them
+    unique_ptr<char[]> real_symbol_cmd(new char[std::strlen(symbol_cmd) - 2 +
+						std::strlen(lib) + 1]);
+    std::sprintf(real_symbol_cmd.get(), symbol_cmd, lib);
+    auto cmd_pipe = make_unique(popen(real_symbol_cmd.get(), "r"), &pclose);
+    if (!cmd_pipe)
+      throw runtime_error(string("Could not run ") + real_symbol_cmd.get());
+    char line[1024];
+    while (std::fgets(line, sizeof(line), cmd_pipe.get())) {
+      char address[256], type[8], symbol[1024];
+      if (std::sscanf(line, "%255s %7s %1023s", address, type, symbol) != 3 ||
+	  string(type) != "T")
+	continue;
+      int status;
+      auto demangled = make_unique(abi::__cxa_demangle(symbol, 0, 0, &status),
+				   &std::free);
+      if (status != 0 || !demangled)
+	continue;
+      string name = demangled.get();
+      name = name.substr(0, name.find('('));
+      size_t dtest = name.rfind("::dtest_");
+      if (dtest == string::npos || name.find(' ') != string::npos)
+	continue;
+      tests.push_back(make_pair(string(symbol), name));
+    }
+    
+    if (options.cache) {
+      std::ofstream ofs(cache_file.c_str());
+      if (ofs) {
+	ofs<<key.str()<<endl;
+	for (size_t i = 0; i < tests.size(); ++i)
+	  ofs<<tests[i].first<<' '<<tests[i].second<<endl;
+      }
+    }
+    
+    return tests;
+  }
+  
+  
+  void print_usage(char const* argv0) {
+    cerr<<"usage: "<<argv0<<" [OPTIONS] [LIBRARY]"<<endl
+	<<"Run all tests in LIBRARY, or in this program if no library is "
+	<<"given."<<endl<<endl
+	<<"  -j JOBS   run up to JOBS top level suites in parallel (default "
+	<<"the number"<<endl
+	<<"            of online CPUs)"<<endl
+	<<"  -t MS     fail tests that take longer than MS milliseconds"<<endl
+	<<"  -n        don't cache the symbol list"<<endl
+	<<"  -h        show this message"<<endl;
+  }
+  
+  
 }
 
   
 int main(int argc, char** argv) {
   
-  /* If there's an argument, load that. Otherwise, load ourself. */
-  char const* lib = (argc > 1 ? argv[1] : argv[0]);
-  
-  /* First, get the list of functions that we should run. */
-  unique_ptr<char[]> real_symbol_cmd(new char[std::strlen(symbol_cmd) - 2 +
-					      std::strlen(lib) + 1]);
-  std::sprintf(real_symbol_cmd.get(), symbol_cmd, lib);
-  auto cmd_pipe = make_unique(popen(real_symbol_cmd.get(), "r"), &pclose);
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  options.jobs = cpus > 1 ? cpus : 1;
+  int c;
+  while ((c = getopt(argc, argv, "j:t:nh")) != -1) {
+    switch (c) {
+    case 'j': options.jobs = std::atoi(optarg); break;
+    case 't': options.max_time = std::atof(optarg); break;
+    case 'n': options.cache = false; break;
+    case 'h': print_usage(argv[0]); return 0;
+    default: print_usage(argv[0]); return 1;
+    }
+  }
+  if (argc - optind > 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
   
-  /* Then, build the test suites. */
-  char line[256];
-  TestSuite root;
-  auto self = make_unique(dlopen(lib, RTLD_LAZY | RTLD_GLOBAL), &dlclose);
+  /* If there's an argument, load that. Otherwise, load ourself. A PIE
+     executable can't be dlopen()ed by name, so we use the handle for the
+     main program in that case. */
+  char const* lib = (optind < argc ? argv[optind] : argv[0]);
+  auto self = make_unique(dlopen(optind < argc ? lib : 0, 
+				 RTLD_LAZY | RTLD_GLOBAL), &dlclose);
   if (!self)
     throw runtime_error(string("Could not dlopen() ") + lib);
   auto state_ptr = static_cast<DTest::State**>(dlsym(self.get(), "_dtest"));
   if (state_ptr)
     *state_ptr = &DTest::state;
   _dtest = &DTest::state;
-  while (std::fgets(line, 255, cmd_pipe.get())) {
-    char* space;
-    for (space = line; *space != 0 && *space != ' '; ++space);
-    if (space == 0)
-      throw runtime_error(string("Invalid line: ") + line);
-    *space = 0;
-    char* i;
-    for (i = space + 1; *i != 0 && *i != '\n'; ++i);
-    *i = 0;
-    root.add_test(space + 1, dltestsym(self.get(), line));
-  }
   
-  /* And run the test suites. */
+  /* Build the test suites. */
+  TestSuite root;
+  vector<pair<string, string> > tests = find_tests(lib);
+  for (size_t i = 0; i < tests.size(); ++i)
+    root.add_test(tests[i].second, dltestsym(self.get(), tests[i].first));
+  
+  /* And run them. */
   cout<<"Running tests..."<<endl;
-  if (root.run())
-    return 0;
-  return 1;
+  double start = now_ms();
+  bool passed = root.run(0, options.jobs);
+  cout<<"Total time: "<<(now_ms() - start)<<" ms"<<endl;
+  return passed ? 0 : 1;
 }
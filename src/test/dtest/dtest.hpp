@@ -62,7 +62,14 @@
     @endcode
     
     Test suites and tests are run in alphabetical order, and nested suites are
-    run as a part of their parent suites.
+    run as a part of their parent suites. The top level suites are run in 
+    separate processes, as many at a time as there are CPUs, and their output
+    is printed in order when they are done. Use the @c -j option to change 
+    the number of parallel suites, @c -j1 runs everything in one process.
+    
+    The wall time for every test is printed after its results. If the @c -t
+    option is given, tests that take longer than that many milliseconds 
+    fail, so the test suite can catch performance regressions too.
     
     You can test the truth value of a code snippet (using DTEST_TRUE()), 
     that it doesn't throw an exception (DTEST_NOTHROW()), that it <em>does</em>
@@ -77,9 +84,11 @@
     compiled with @c -fPIC and linked with @c -shared @c -fPIC as per usual.
     
     The test program must not be stripped. Also, your default shell (the one
-    used by @c popen()) must have the programs @c awk, @c c++filt,
-    @c grep, @c nm, @c sed, @c sh and @c xargs available, and your dynamic
-    linker must support backlinking.
+    used by @c popen()) must have the program @c nm available, and your 
+    dynamic linker must support backlinking. The list of test functions is
+    cached in a file called @c PROGRAM.dtest-symbols next to the test 
+    program or library, and is only regenerated when it changes. Use the
+    @c -n option to disable the cache.
 */
 
 
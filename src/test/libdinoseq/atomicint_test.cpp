@@ -57,4 +57,21 @@ namespace AtomicIntTest {
   }
 
 
+  void dtest_add() {
+    AtomicInt ai = 42;
+    DTEST_TRUE(ai.add(5) == 42);
+    DTEST_TRUE(ai.get() == 47);
+    DTEST_TRUE(ai.add(-7) == 47);
+    DTEST_TRUE(ai.get() == 40);
+  }
+
+
+  void dtest_decrease_and_test() {
+    AtomicInt ai = 2;
+    DTEST_TRUE(!ai.decrease_and_test());
+    DTEST_TRUE(ai.decrease_and_test());
+    DTEST_TRUE(ai.get() == 0);
+  }
+
+
 }
@@ -0,0 +1,64 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "commandring.hpp"
+#include "dtest.hpp"
+
+
+using namespace Dino;
+
+
+namespace CommandRingTest {
+  
+  
+  void dtest_capacity() {
+    CommandRing<int> r1(1);
+    DTEST_TRUE(r1.get_capacity() == 1);
+    CommandRing<int> r2(100);
+    DTEST_TRUE(r2.get_capacity() == 128);
+  }
+  
+  
+  void dtest_push_pop() {
+    CommandRing<int> r(4);
+    int i;
+    DTEST_TRUE(r.peek() == 0);
+    DTEST_TRUE(!r.pop(i));
+    
+    DTEST_TRUE(r.push(1));
+    DTEST_TRUE(r.push(2));
+    DTEST_TRUE(r.push(3));
+    DTEST_TRUE(r.push(4));
+    DTEST_TRUE(!r.push(5));
+    
+    DTEST_TRUE(r.peek() && *r.peek() == 1);
+    r.drop();
+    DTEST_TRUE(r.pop(i) && i == 2);
+    
+    // wrap around the end of the slots a few times
+    for (int j = 5; j < 20; ++j) {
+      DTEST_TRUE(r.push(j));
+      DTEST_TRUE(r.pop(i) && i == j - 2);
+    }
+    DTEST_TRUE(r.pop(i) && i == 18);
+    DTEST_TRUE(r.pop(i) && i == 19);
+    DTEST_TRUE(!r.pop(i));
+  }
+  
+  
+}
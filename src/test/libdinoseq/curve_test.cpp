@@ -18,10 +18,13 @@
 
 #include <algorithm>
 #include <iterator>
+#include <limits>
 #include <vector>
 
 #include "dtest.hpp"
 #include "curve.hpp"
+#include "eventbuffer.hpp"
+#include "vectorbuffer.hpp"
 
 
 using namespace Dino;
@@ -95,6 +98,20 @@ namespace CurveTest {
 }
 
 
+  void dtest_move_point_earlier() {
+    Curve c("Test curve", SongTime(4, 0), 1);
+    c.add_point(SongTime(0, 0), 1);
+    c.add_point(SongTime(1, 0), 2);
+    Curve::Iterator iter = c.add_point(SongTime(3, 0), 3);
+    iter = c.move_point(iter, SongTime(2, 0), 4);
+    DTEST_TRUE(iter != c.end());
+    DTEST_TRUE(c.count_points() == 3);
+    DTEST_TRUE(iter->m_time == SongTime(2, 0));
+    DTEST_TRUE(iter->m_value.get() == 4);
+    DTEST_TRUE(--iter == ++c.begin());
+  }
+
+
   void dtest_begin_end() {
   Curve c("Test curve", SongTime(4, 0), 1);
   
@@ -284,6 +301,481 @@ namespace CurveTest {
     
     DTEST_NOTHROW(c_iter = iter);
   }
+  
+  
+  /** Find the value range in [from, to] by looking at every point. */
+  void brute_force_range(Curve const& c, SongTime const& from, 
+			 SongTime const& to, 
+			 AtomicInt::Type& min, AtomicInt::Type& max) {
+    min = std::min(c.get_value(from), c.get_value(to));
+    max = std::max(c.get_value(from), c.get_value(to));
+    for (auto i = c.begin(); i != c.end(); ++i) {
+      if (i->m_time >= from && i->m_time <= to) {
+	min = std::min(min, i->m_value.get());
+	max = std::max(max, i->m_value.get());
+      }
+    }
+  }
+  
+  
+  void dtest_get_value() {
+    Curve c("Test curve", SongTime(4, 0), 1);
+    c.add_point(SongTime(1, 0), 100);
+    c.add_point(SongTime(3, 0), 300);
+    
+    DTEST_TRUE(c.get_value(SongTime(0, 0)) == 100);
+    DTEST_TRUE(c.get_value(SongTime(1, 0)) == 100);
+    DTEST_TRUE(c.get_value(SongTime(2, 0)) == 200);
+    DTEST_TRUE(c.get_value(SongTime(3, 0)) == 300);
+    DTEST_TRUE(c.get_value(SongTime(4, 0)) == 300);
+  }
+  
+  
+  void dtest_get_range() {
+    Curve c("Test curve", SongTime(64, 0), 1);
+    AtomicInt::Type min, max;
+    DTEST_TRUE(!c.get_range(SongTime(0, 0), SongTime(64, 0), min, max));
+    
+    // a sawtooth with a couple of spikes in the middle
+    std::vector<Curve::Iterator> spikes;
+    for (int b = 0; b < 64; ++b) {
+      for (int q = 0; q < 8; ++q)
+	c.add_point(SongTime(b, q * (SongTime::ticks_per_beat() / 8)), 
+		    1000 + q * 10);
+    }
+    spikes.push_back(c.add_point(SongTime(20, 1234), 5));
+    spikes.push_back(c.add_point(SongTime(40, 4321), 99999));
+    
+    SongTime ranges[][2] = {
+      { SongTime(0, 0), SongTime(64, 0) },
+      { SongTime(0, 100), SongTime(0, 200) },
+      { SongTime(19, 0), SongTime(21, 0) },
+      { SongTime(20, 1235), SongTime(40, 4320) },
+      { SongTime(39, 5), SongTime(63, 17) },
+      { SongTime(40, 4321), SongTime(40, 4321) }
+    };
+    for (unsigned i = 0; i < sizeof(ranges) / sizeof(ranges[0]); ++i) {
+      AtomicInt::Type bmin, bmax;
+      brute_force_range(c, ranges[i][0], ranges[i][1], bmin, bmax);
+      DTEST_TRUE(c.get_range(ranges[i][0], ranges[i][1], min, max));
+      DTEST_TRUE(min == bmin);
+      DTEST_TRUE(max == bmax);
+    }
+    DTEST_TRUE(c.get_range(SongTime(0, 0), SongTime(64, 0), min, max));
+    DTEST_TRUE(min == 5 && max == 99999);
+    
+    // the summary must follow moved and removed points
+    spikes[1] = c.move_point(spikes[1], SongTime(40, 4321), 2000);
+    DTEST_TRUE(c.get_range(SongTime(0, 0), SongTime(64, 0), min, max));
+    DTEST_TRUE(min == 5 && max == 2000);
+    spikes[1] = c.move_point(spikes[1], SongTime(40, 4322), 50000);
+    DTEST_TRUE(c.get_range(SongTime(30, 0), SongTime(50, 0), min, max));
+    DTEST_TRUE(min == 1000 && max == 50000);
+    c.remove_point(spikes[1]);
+    c.remove_point(spikes[0]);
+    DTEST_TRUE(c.get_range(SongTime(0, 0), SongTime(64, 0), min, max));
+    DTEST_TRUE(min == 1000 && max == 1070);
+  }
+
+
+  void dtest_add_copy_points() {
+    Curve c("Test curve", SongTime(8, 0), 1);
+    c.add_point(SongTime(1, 0), 10);
+    c.add_point(SongTime(3, 0), 30);
+    
+    SongTime times[] = { SongTime(0, 0), SongTime(1, 0), SongTime(2, 0),
+			 SongTime(5, 0), SongTime(8, 0) };
+    AtomicInt::Type values[] = { 0, 11, 20, 50, 80 };
+    
+    // nothing is added if any of the points is bad
+    SongTime bad_times[] = { SongTime(0, 0), SongTime(9, 0) };
+    DTEST_THROW_TYPE(c.add_points(bad_times, values, 2), std::out_of_range);
+    SongTime unsorted[] = { SongTime(2, 0), SongTime(1, 0) };
+    DTEST_THROW_TYPE(c.add_points(unsorted, values, 2), 
+		     std::invalid_argument);
+    DTEST_TRUE(c.count_points() == 2);
+    
+    DTEST_NOTHROW(c.add_points(times, values, 5));
+    DTEST_TRUE(c.count_points() == 7);
+    
+    // the points are merged in order, new ones after old ones at the same
+    // time
+    SongTime t[8];
+    AtomicInt::Type v[8];
+    DTEST_TRUE(c.copy_points(c.begin(), t, v, 8) == 7);
+    SongTime et[] = { SongTime(0, 0), SongTime(1, 0), SongTime(1, 0),
+		      SongTime(2, 0), SongTime(3, 0), SongTime(5, 0), 
+		      SongTime(8, 0) };
+    AtomicInt::Type ev[] = { 0, 10, 11, 20, 30, 50, 80 };
+    for (int i = 0; i < 7; ++i) {
+      DTEST_TRUE(t[i] == et[i]);
+      DTEST_TRUE(v[i] == ev[i]);
+    }
+    DTEST_TRUE(c.copy_points(c.lower_bound(SongTime(3, 0)), t, v, 2) == 2);
+    DTEST_TRUE(t[0] == SongTime(3, 0) && t[1] == SongTime(5, 0));
+    
+    // the summary knows about the new points
+    AtomicInt::Type min, max;
+    DTEST_TRUE(c.get_range(SongTime(4, 0), SongTime(8, 0), min, max));
+    DTEST_TRUE(min == 40 && max == 80);
+  }
+  
+  
+  void dtest_set_length() {
+    Curve c("Test curve", SongTime(4, 0), 1);
+    c.add_point(SongTime(1, 0), 100);
+    c.add_point(SongTime(3, 0), 300);
+    
+    // the summary grows with the curve and keeps the old points
+    c.set_length(SongTime(8192, 0));
+    DTEST_TRUE(c.get_length() == SongTime(8192, 0));
+    Curve::Iterator low = c.add_point(SongTime(5000, 0), 50);
+    c.add_point(SongTime(8000, 0), 800);
+    AtomicInt::Type min, max;
+    DTEST_TRUE(c.get_range(SongTime(0, 0), SongTime(2, 0), min, max));
+    DTEST_TRUE(min == 100 && max == 200);
+    DTEST_TRUE(c.get_range(SongTime(0, 0), SongTime(8192, 0), min, max));
+    DTEST_TRUE(min == 50 && max == 800);
+    
+    // the buckets far after the old end must follow moved points
+    low = c.move_point(low, SongTime(6000, 0), 5);
+    DTEST_TRUE(c.get_range(SongTime(5000, 0), SongTime(7000, 0), min, max));
+    DTEST_TRUE(min == 5 && max == c.get_value(SongTime(7000, 0)));
+    DTEST_TRUE(c.get_range(SongTime(0, 0), SongTime(8192, 0), min, max));
+    DTEST_TRUE(min == 5 && max == 800);
+    
+    // and shrinks again
+    c.remove_point(low);
+    c.set_length(SongTime(4, 0));
+    DTEST_TRUE(c.get_range(SongTime(0, 0), SongTime(4, 0), min, max));
+    DTEST_TRUE(min == 100 && max == 300);
+  }
+  
+  
+  void dtest_sequence() {
+    Curve c("Test curve", SongTime(4, 0), 7);
+    c.add_point(SongTime(0, 0), 0);
+    c.add_point(SongTime(1, 0), std::numeric_limits<AtomicInt::Type>::max());
+    c.add_point(SongTime(3, 0), std::numeric_limits<AtomicInt::Type>::max());
+    
+    VectorBuffer buf;
+    auto pos = c.create_position(SongTime(0, 0));
+    
+    DTEST_TRUE(c.sequence(*pos, SongTime(4, 0), buf));
+    
+    DTEST_TRUE(buf.events.size() == 129);
+    
+    DTEST_TRUE(buf.events.front().time == SongTime(0, 0));
+
+    DTEST_TRUE(buf.events.front().data[0] == 0xB0);
+    
+    DTEST_TRUE(buf.events.front().data[1] == 7);
+    
+    DTEST_TRUE(buf.events.front().data[2] == 0);
+    
+    DTEST_TRUE(buf.events[127].time == SongTime(1, 0));
+    
+    DTEST_TRUE(buf.events[127].data[2] == 127);
+
+    DTEST_TRUE(buf.events[128].time == SongTime(3, 0));
+    
+    bool ordered = true;
+    for (size_t i = 1; i < 128; ++i) {
+      ordered = ordered && buf.events[i - 1].time < buf.events[i].time &&
+	buf.events[i].data[2] == i;
+    }
+    
+    DTEST_TRUE(ordered);
+  }
+  
+  
+  void dtest_sequence_split() {
+    Curve c("Test curve", SongTime(4, 0), 7);
+    c.add_point(SongTime(0, 0), 0);
+    c.add_point(SongTime(1, 0), std::numeric_limits<AtomicInt::Type>::max());
+    
+    VectorBuffer buf1;
+    auto pos1 = c.create_position(SongTime(0, 0));
+    c.sequence(*pos1, SongTime(2, 0), buf1);
+    
+    VectorBuffer buf2;
+    auto pos2 = c.create_position(SongTime(0, 0));
+    c.sequence(*pos2, SongTime(0, 0x3A3A3A), buf2);
+    c.sequence(*pos2, SongTime(0, 0x800000), buf2);
+    c.sequence(*pos2, SongTime(1, 0), buf2);
+    c.sequence(*pos2, SongTime(2, 0), buf2);
+    
+    DTEST_TRUE(buf1.events.size() == buf2.events.size());
+    
+    bool same = buf1.events.size() == buf2.events.size();
+    for (size_t i = 0; same && i < buf1.events.size(); ++i) {
+      same = buf1.events[i].time == buf2.events[i].time && 
+	buf1.events[i].data[2] == buf2.events[i].data[2];
+    }
+    
+    DTEST_TRUE(same);
+  }
+  
+  
+  void dtest_sequence_full_buffer() {
+    Curve c("Test curve", SongTime(4, 0), 7);
+    c.add_point(SongTime(0, 0), 0);
+    c.add_point(SongTime(1, 0), std::numeric_limits<AtomicInt::Type>::max());
+    
+    VectorBuffer buf(50);
+    auto pos = c.create_position(SongTime(0, 0));
+    
+    DTEST_TRUE(!c.sequence(*pos, SongTime(2, 0), buf));
+    
+    DTEST_TRUE(buf.events.size() == 50);
+    
+    DTEST_TRUE(pos->get_time() > buf.events.back().time);
+    
+    buf.room = 50;
+    c.sequence(*pos, SongTime(2, 0), buf);
+    buf.room = 50;
+    c.sequence(*pos, SongTime(2, 0), buf);
+    
+    DTEST_TRUE(buf.events.size() == 128);
+    
+    DTEST_TRUE(buf.events.back().data[2] == 127);
+  }
+
+  
+  
+  void dtest_get_set_output_mode() {
+    Curve c("Test curve", SongTime(4, 0), 1);
+    
+    DTEST_TRUE(c.get_output_mode() == Curve::Controller7);
+    
+    c.set_output_mode(Curve::NRPN);
+    
+    DTEST_TRUE(c.get_output_mode() == Curve::NRPN);
+  }
+  
+  
+  void dtest_sequence_controller14() {
+    Curve c("Test curve", SongTime(4, 0), 7);
+    c.set_output_mode(Curve::Controller14);
+    c.add_point(SongTime(0, 0), 0);
+    c.add_point(SongTime(1, 0), std::numeric_limits<AtomicInt::Type>::max());
+    
+    VectorBuffer buf;
+    auto pos = c.create_position(SongTime(0, 0));
+    
+    DTEST_TRUE(c.sequence(*pos, SongTime(2, 0), buf));
+    
+    // the MSB must only be sent when it changes, and always before the LSB
+    size_t msbs = 0;
+    size_t lsbs = 0;
+    bool ordered = true;
+    int msb = -1;
+    for (size_t i = 0; i < buf.events.size(); ++i) {
+      if (buf.events[i].data[1] == 7) {
+	ordered = ordered && buf.events[i].data[2] != msb;
+	msb = buf.events[i].data[2];
+	++msbs;
+      }
+      else if (buf.events[i].data[1] == 39)
+	++lsbs;
+      else
+	ordered = false;
+      if (i > 0)
+	ordered = ordered && buf.events[i - 1].time <= buf.events[i].time;
+    }
+    
+    DTEST_TRUE(ordered);
+    
+    DTEST_TRUE(msbs == 128);
+    
+    // at most 128 interpolated values per beat plus the points
+    DTEST_TRUE(lsbs <= 130);
+    
+    DTEST_TRUE(lsbs > 100);
+    
+    DTEST_TRUE(buf.events.back().time == SongTime(1, 0));
+    
+    DTEST_TRUE(buf.events.back().data[1] == 39);
+    
+    DTEST_TRUE(buf.events.back().data[2] == 127);
+    
+    DTEST_TRUE(msb == 127);
+  }
+  
+  
+  void dtest_sequence_nrpn() {
+    Curve c("Test curve", SongTime(4, 0), (3 << 7) | 5);
+    c.set_output_mode(Curve::NRPN);
+    c.add_point(SongTime(0, 0), 0);
+    c.add_point(SongTime(1, 0), 0x100000);
+    
+    VectorBuffer buf;
+    auto pos = c.create_position(SongTime(0, 0));
+    
+    DTEST_TRUE(c.sequence(*pos, SongTime(2, 0), buf));
+    
+    // the parameter is selected once, then the MSB is sent once since it
+    // never changes, and then the LSBs follow
+    DTEST_TRUE(buf.events.size() > 4);
+    
+    DTEST_TRUE(buf.events[0].data[1] == 99 && buf.events[0].data[2] == 3);
+    
+    DTEST_TRUE(buf.events[1].data[1] == 98 && buf.events[1].data[2] == 5);
+    
+    DTEST_TRUE(buf.events[2].data[1] == 6 && buf.events[2].data[2] == 0);
+    
+    bool lsb_only = true;
+    for (size_t i = 3; i < buf.events.size(); ++i)
+      lsb_only = lsb_only && buf.events[i].data[1] == 38;
+    
+    DTEST_TRUE(lsb_only);
+    
+    // a relocation selects the parameter again
+    buf.events.clear();
+    c.update_position(*pos, SongTime(0, 0));
+    c.sequence(*pos, SongTime(0, 1), buf);
+    
+    DTEST_TRUE(buf.events.size() == 4);
+    
+    DTEST_TRUE(buf.events[0].data[1] == 99);
+  }
+  
+  
+  /** An EventBuffer that stores the UMP packets written to it. */
+  class PacketBuffer : public EventBuffer {
+  public:
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data) {
+      return false;
+    }
+    bool write_packet(SongTime const& st, size_t n, uint32_t const* words) {
+      if (n != 2)
+	return false;
+      times.push_back(st);
+      words0.push_back(words[0]);
+      words1.push_back(words[1]);
+      return true;
+    }
+    std::vector<SongTime> times;
+    std::vector<uint32_t> words0;
+    std::vector<uint32_t> words1;
+  };
+  
+  
+  void dtest_sequence_ump() {
+    Curve c("Test curve", SongTime(4, 0), (2 << 7) | 9);
+    c.set_output_mode(Curve::UMPRegistered);
+    c.add_point(SongTime(0, 0), 0);
+    c.add_point(SongTime(1, 0), std::numeric_limits<AtomicInt::Type>::max());
+    
+    PacketBuffer buf;
+    auto pos = c.create_position(SongTime(0, 0));
+    
+    DTEST_TRUE(c.sequence(*pos, SongTime(2, 0), buf));
+    
+    DTEST_TRUE(buf.words0.size() > 100 && buf.words0.size() <= 130);
+    
+    DTEST_TRUE(buf.words0.front() == 0x40200209);
+    
+    DTEST_TRUE(buf.words1.front() == 0);
+    
+    DTEST_TRUE(buf.words1.back() == 0xFFFFFFFF);
+    
+    bool ordered = true;
+    for (size_t i = 1; i < buf.words1.size(); ++i) {
+      ordered = ordered && buf.times[i - 1] < buf.times[i] &&
+	buf.words1[i - 1] < buf.words1[i];
+    }
+    
+    DTEST_TRUE(ordered);
+  }
+  
+  
+  void dtest_sequence_ump_translated() {
+    Curve c("Test curve", SongTime(4, 0), 7);
+    c.set_output_mode(Curve::UMPController);
+    c.add_point(SongTime(0, 0), 0);
+    c.add_point(SongTime(1, 0), std::numeric_limits<AtomicInt::Type>::max());
+    
+    // a buffer that doesn't handle packets gets 7 bit controllers
+    VectorBuffer buf;
+    auto pos = c.create_position(SongTime(0, 0));
+    
+    DTEST_TRUE(c.sequence(*pos, SongTime(2, 0), buf));
+    
+    DTEST_TRUE(buf.events.front().data[0] == 0xB0);
+    
+    DTEST_TRUE(buf.events.front().data[1] == 7);
+    
+    DTEST_TRUE(buf.events.back().data[2] == 127);
+  }
 
+  
+  
+  void dtest_chase() {
+    Curve c("Test curve", SongTime(4, 0), 7);
+    VectorBuffer buf;
+    auto pos = c.create_position(SongTime(0, 0x800000));
+    
+    // nothing to chase in an empty curve
+    DTEST_TRUE(c.chase(*pos, buf));
+    DTEST_TRUE(buf.events.empty());
+    
+    c.add_point(SongTime(0, 0), 0);
+    c.add_point(SongTime(1, 0), std::numeric_limits<AtomicInt::Type>::max());
+    
+    DTEST_TRUE(c.chase(*pos, buf));
+    
+    DTEST_TRUE(buf.events.size() == 1);
+    
+    DTEST_TRUE(buf.events[0].time == SongTime(0, 0x800000));
+    
+    DTEST_TRUE(buf.events[0].data[1] == 7 && buf.events[0].data[2] == 64);
+    
+    // the (N)RPN modes select the parameter again
+    buf.events.clear();
+    c.set_output_mode(Curve::RPN);
+    c.update_position(*pos, SongTime(2, 0));
+    
+    DTEST_TRUE(c.chase(*pos, buf));
+    
+    DTEST_TRUE(buf.events.size() == 4);
+    
+    DTEST_TRUE(buf.events[0].data[1] == 101 && buf.events[2].data[1] == 6 &&
+	       buf.events[2].data[2] == 127);
+    
+    // and the values after it don't repeat the selection or the MSB
+    buf.events.clear();
+    c.add_point(SongTime(3, 0), std::numeric_limits<AtomicInt::Type>::max());
+    c.sequence(*pos, SongTime(4, 0), buf);
+    
+    DTEST_TRUE(buf.events.size() == 1);
+    
+    DTEST_TRUE(buf.events[0].data[1] == 38);
+  }
+  
+  
+  void dtest_memory_usage() {
+    Curve c("Test curve", SongTime(4, 0), 1);
+    Curve::MemoryUsage mu = c.get_memory_usage();
+    
+    DTEST_TRUE(mu.points == 0 && mu.links == 0 && mu.point_bytes == 0);
+    
+    DTEST_TRUE(mu.summary_bytes > 0);
+    
+    for (int i = 0; i < 100; ++i)
+      c.add_point(SongTime(0, i * 0x10000), i);
+    mu = c.get_memory_usage();
+    
+    DTEST_TRUE(mu.points == 100);
+    
+    DTEST_TRUE(mu.links >= 100);
+    
+    DTEST_TRUE(mu.point_bytes > 100 * sizeof(Curve::Point));
+    
+    c.remove_point(c.begin());
+    
+    DTEST_TRUE(c.get_memory_usage().points == 99);
+  }
 
 }
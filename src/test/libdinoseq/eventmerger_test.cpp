@@ -0,0 +1,190 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <sstream>
+
+#include "dtest.hpp"
+#include "eventmerger.hpp"
+#include "ostreambuffer.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+namespace EventMergerTest {
+  
+  
+  /** Write a three byte event with the given data byte at @c time. */
+  void write(EventBuffer& buf, SongTime const& time, unsigned char b) {
+    unsigned char data[] = { 0x90, b, 0x40 };
+    buf.write_event(time, 3, data);
+  }
+  
+  
+  /** An OStreamBuffer that only has room for @c room more events. */
+  class SmallBuffer : public OStreamBuffer {
+  public:
+    
+    SmallBuffer(ostream& os) : OStreamBuffer(os), room(0) {}
+    
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data) {
+      if (room == 0)
+	return false;
+      --room;
+      return OStreamBuffer::write_event(st, bytes, data);
+    }
+    
+    size_t write_events(Event const* events, size_t n) {
+      return EventBuffer::write_events(events, n);
+    }
+    
+    bool write_packet(SongTime const& st, size_t n, uint32_t const* words) {
+      if (room == 0)
+	return false;
+      --room;
+      return OStreamBuffer::write_packet(st, n, words);
+    }
+    
+    size_t room;
+    
+  };
+  
+  
+  void dtest_merge() {
+    EventMerger em(3);
+    DTEST_TRUE(em.get_run_count() == 3);
+    
+    write(em.get_run(0), SongTime(0, 0), 1);
+    write(em.get_run(0), SongTime(2, 0), 4);
+    write(em.get_run(1), SongTime(1, 0), 3);
+    write(em.get_run(1), SongTime(3, 0), 6);
+    // same time as the first event in run 0, should come after it
+    write(em.get_run(2), SongTime(0, 0), 2);
+    unsigned char clock = 0xF8;
+    em.get_run(2).write_event(SongTime(2, 0), 1, &clock);
+    unsigned char sysex[] = { 0xF0, 0x7D, 0xF7 };
+    em.get_run(2).write_event(SongTime(2, 1), 3, sysex);
+    
+    ostringstream os;
+    OStreamBuffer osb(os);
+    DTEST_TRUE(em.merge(osb));
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "0:000000: 90 01 40\n"
+	       "0:000000: 90 02 40\n"
+	       "1:000000: 90 03 40\n"
+	       "2:000000: 90 04 40\n"
+	       "2:000000: F8\n"
+	       "2:000001: F0 7D F7\n"
+	       "3:000000: 90 06 40\n");
+    
+    // merging clears the runs
+    ostringstream os2;
+    OStreamBuffer osb2(os2);
+    DTEST_TRUE(em.merge(osb2));
+    os2<<flush;
+    DTEST_TRUE(os2.str() == "");
+  }
+  
+  
+  void dtest_capacity() {
+    EventMerger em(2, 2, 1000);
+    unsigned char data[] = { 0x90, 1, 2 };
+    EventBuffer& r = em.get_run(0);
+    DTEST_TRUE(r.write_event(SongTime(0, 0), 3, data));
+    DTEST_TRUE(r.write_event(SongTime(1, 0), 3, data));
+    DTEST_TRUE(!r.write_event(SongTime(2, 0), 3, data));
+    
+    EventBuffer::Event events[3];
+    for (int i = 0; i < 3; ++i) {
+      events[i].time = SongTime(i, 0);
+      events[i].data[0] = 0x80;
+      events[i].data[1] = i;
+      events[i].data[2] = 0;
+    }
+    DTEST_TRUE(em.get_run(1).write_events(events, 3) == 2);
+    
+    em.clear();
+    DTEST_TRUE(r.write_event(SongTime(2, 0), 3, data));
+  }
+  
+  
+  void dtest_full_output() {
+    EventMerger em(2);
+    write(em.get_run(0), SongTime(0, 0), 1);
+    write(em.get_run(1), SongTime(0, 1), 2);
+    unsigned char sysex[] = { 0xF0, 0x7D, 0xF7 };
+    em.get_run(0).write_event(SongTime(0, 2), 3, sysex);
+    unsigned char clock = 0xF8;
+    em.get_run(1).write_event(SongTime(0, 3), 1, &clock);
+    uint32_t note = 0x20903C40;
+    em.get_run(0).write_packet(SongTime(0, 4), 1, &note);
+    write(em.get_run(1), SongTime(0, 5), 3);
+    
+    ostringstream os;
+    SmallBuffer sb(os);
+    
+    // nothing fits, so everything is kept
+    DTEST_TRUE(!em.merge(sb));
+    
+    // the events that didn't fit come out first in the next period, 
+    // before the ones that are written after the first merge
+    sb.room = 2;
+    DTEST_TRUE(!em.merge(sb));
+    write(em.get_run(0), SongTime(1, 0), 4);
+    sb.room = 3;
+    DTEST_TRUE(!em.merge(sb));
+    write(em.get_run(1), SongTime(2, 0), 5);
+    sb.room = 3;
+    DTEST_TRUE(em.merge(sb));
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "0:000000: 90 01 40\n"
+	       "0:000001: 90 02 40\n"
+	       "0:000002: F0 7D F7\n"
+	       "0:000003: F8\n"
+	       "0:000004: UMP 20903C40\n"
+	       "0:000005: 90 03 40\n"
+	       "1:000000: 90 04 40\n"
+	       "2:000000: 90 05 40\n");
+  }
+  
+  
+  void dtest_drain() {
+    EventMerger em(2);
+    write(em.get_run(1), SongTime(0, 0), 1);
+    write(em.get_run(1), SongTime(1, 0), 2);
+    
+    ostringstream os;
+    SmallBuffer sb(os);
+    sb.room = 1;
+    DTEST_TRUE(!em.drain(1, sb));
+    sb.room = 1;
+    DTEST_TRUE(em.drain(1, sb));
+    sb.room = 1;
+    DTEST_TRUE(em.merge(sb));
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "0:000000: 90 01 40\n"
+	       "1:000000: 90 02 40\n");
+  }
+  
+  
+}
@@ -0,0 +1,210 @@
+/*****************************************************************************
+    libdinoseq_test - unit test module for libdinoseq
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "dtest.hpp"
+#include "eventbuffer.hpp"
+#include "generatorsequencable.hpp"
+#include "vectorbuffer.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+namespace GeneratorSequencableTest {
+  
+  
+  void dtest_constructor() {
+    GeneratorSequencable g("gen", 
+			   [](SongTime const&, SongTime const&, EventBuffer&) {
+			     return true;
+			   });
+    
+    DTEST_TRUE(g.get_length() == SongTime(-1, 0));
+    
+    DTEST_TRUE(g.get_overruns() == 0);
+    
+    g.set_budget(1000);
+    
+    DTEST_TRUE(g.get_budget() == 1000);
+  }
+  
+  
+  void dtest_steps() {
+    vector<pair<SongTime, SongTime>> calls;
+    GeneratorSequencable g("gen", 
+			   [&](SongTime const& from, SongTime const& to, 
+			       EventBuffer&) {
+			     calls.push_back(make_pair(from, to));
+			     return true;
+			   }, SongTime(1, 0), 1000000000);
+    VectorBuffer buf;
+    auto pos = g.create_position(SongTime(0, 0x800000));
+    
+    DTEST_TRUE(g.sequence(*pos, SongTime(2, 0x100000), buf));
+    
+    DTEST_TRUE(calls.size() == 3);
+    
+    DTEST_TRUE(calls[0].first == SongTime(0, 0x800000) && 
+	       calls[0].second == SongTime(1, 0));
+    
+    DTEST_TRUE(calls[1].first == SongTime(1, 0) && 
+	       calls[1].second == SongTime(2, 0));
+    
+    DTEST_TRUE(calls[2].first == SongTime(2, 0) && 
+	       calls[2].second == SongTime(2, 0x100000));
+    
+    DTEST_TRUE(pos->get_time() == SongTime(2, 0x100000));
+  }
+  
+  
+  /** Writes a note on at the start of every beat, and never turns it 
+      off. */
+  bool hold_notes(SongTime const& from, SongTime const& to, 
+		  EventBuffer& buf) {
+    if (from.get_tick() != 0)
+      return true;
+    unsigned char data[] = { 0x91, (unsigned char)(60 + from.get_beat()), 
+			     100 };
+    return buf.write_event(from, 3, data);
+  }
+  
+  
+  void dtest_overrun() {
+    GeneratorSequencable g("gen", &hold_notes, SongTime(1, 0), 1000000000);
+    VectorBuffer buf;
+    auto pos = g.create_position(SongTime(0, 0));
+    
+    g.sequence(*pos, SongTime(2, 0), buf);
+    
+    DTEST_TRUE(buf.events.size() == 2);
+    
+    // without any budget nothing is generated, and the held notes are 
+    // turned off
+    g.set_budget(0);
+    buf.events.clear();
+    
+    DTEST_TRUE(g.sequence(*pos, SongTime(4, 0), buf));
+    
+    DTEST_TRUE(g.get_overruns() == 1);
+    
+    DTEST_TRUE(buf.events.size() == 2);
+    
+    DTEST_TRUE(buf.events[0].time == SongTime(2, 0) &&
+	       buf.events[0].data[0] == 0x81 && buf.events[0].data[1] == 60);
+    
+    DTEST_TRUE(buf.events[1].data[0] == 0x81 && buf.events[1].data[1] == 61);
+    
+    DTEST_TRUE(pos->get_time() == SongTime(4, 0));
+    
+    // the next overrun has nothing left to turn off
+    buf.events.clear();
+    g.sequence(*pos, SongTime(5, 0), buf);
+    
+    DTEST_TRUE(g.get_overruns() == 2);
+    
+    DTEST_TRUE(buf.events.empty());
+  }
+  
+  
+  void dtest_positions() {
+    GeneratorSequencable g("gen", &hold_notes, SongTime(1, 0), 1000000000);
+    VectorBuffer buf1;
+    VectorBuffer buf2;
+    auto pos1 = g.create_position(SongTime(0, 0));
+    auto pos2 = g.create_position(SongTime(3, 0));
+    
+    g.sequence(*pos1, SongTime(1, 0), buf1);
+    g.sequence(*pos2, SongTime(4, 0), buf2);
+    
+    // each position only turns off its own notes
+    g.set_budget(0);
+    buf1.events.clear();
+    buf2.events.clear();
+    g.sequence(*pos1, SongTime(2, 0), buf1);
+    g.sequence(*pos2, SongTime(5, 0), buf2);
+    
+    DTEST_TRUE(buf1.events.size() == 1 && buf1.events[0].data[1] == 60);
+    
+    DTEST_TRUE(buf2.events.size() == 1 && buf2.events[0].data[1] == 63);
+  }
+  
+  
+  /** Writes a MIDI 1.0 note on in group 2 and a MIDI 2.0 note on in group
+      3 as packets at the start of every beat. */
+  bool hold_packets(SongTime const& from, SongTime const& to, 
+		    EventBuffer& buf) {
+    if (from.get_tick() != 0)
+      return true;
+    uint32_t midi1 = 0x22916440 | (from.get_beat() << 8);
+    uint32_t midi2[] = { uint32_t(0x43920000 | 
+				  ((60 + from.get_beat()) << 8)), 0 };
+    return buf.write_packet(from, 1, &midi1) && 
+      buf.write_packet(from, 2, midi2);
+  }
+  
+  
+  void dtest_packets() {
+    GeneratorSequencable g("gen", &hold_packets, SongTime(1, 0), 1000000000);
+    VectorBuffer buf;
+    buf.translate = false;
+    auto pos = g.create_position(SongTime(0, 0));
+    
+    g.sequence(*pos, SongTime(1, 0), buf);
+    
+    DTEST_TRUE(buf.packets.size() == 2);
+    
+    // the notes are turned off with the same kind of packet, even the 
+    // MIDI 2.0 one with velocity 0
+    g.set_budget(0);
+    buf.packets.clear();
+    g.sequence(*pos, SongTime(2, 0), buf);
+    
+    DTEST_TRUE(buf.packets.size() == 2);
+    
+    DTEST_TRUE(buf.packets[0].size == 1 && 
+	       buf.packets[0].words[0] == 0x22816440);
+    
+    DTEST_TRUE(buf.packets[1].size == 2 && 
+	       buf.packets[1].words[0] == 0x43823C00 &&
+	       buf.packets[1].words[1] == 0x80000000);
+  }
+  
+  
+  void dtest_exception() {
+    GeneratorSequencable g("gen", 
+			   [](SongTime const&, SongTime const&, 
+			      EventBuffer&) -> bool {
+			     throw runtime_error("Broken generator");
+			   });
+    VectorBuffer buf;
+    auto pos = g.create_position(SongTime(0, 0));
+    
+    DTEST_TRUE(g.sequence(*pos, SongTime(1, 0), buf));
+    
+    DTEST_TRUE(g.get_overruns() == 1);
+    
+    DTEST_TRUE(pos->get_time() == SongTime(1, 0));
+  }
+  
+  
+}
@@ -0,0 +1,242 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <memory>
+#include <vector>
+
+#include "atomicint.hpp"
+#include "dtest.hpp"
+#include "instrument.hpp"
+#include "instrumentbuffer.hpp"
+#include "instrumentgraph.hpp"
+#include "sequencable.hpp"
+#include "sequencer.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+namespace InstrumentGraphTest {
+  
+  
+  /** Writes a note on at every half beat. */
+  class Ticker : public Sequencable {
+  public:
+    Ticker() : Sequencable("Ticker") {}
+    bool sequence(Position& pos, SongTime const& to, EventBuffer& buf) const {
+      SongTime half = SongTime::from_ticks(SongTime(1, 0).to_ticks() / 2);
+      SongTime t = SongTime::from_ticks((pos.get_time().to_ticks() + 
+					 half.to_ticks() - 1) / 
+					half.to_ticks() * half.to_ticks());
+      unsigned char data[] = { 0x90, 60, 100 };
+      for ( ; t < to; t += half)
+	buf.write_event(t, 3, data);
+      update_position(pos, to);
+      return true;
+    }
+  };
+  
+  
+  /** Records the order it was run in and the events it got. */
+  class Recorder : public Instrument {
+  public:
+    Recorder(AtomicInt& counter) : m_counter(counter), order(-1) {}
+    void run(InstrumentBuffer& events, uint32_t nframes) {
+      order = m_counter.add(1);
+      frames.clear();
+      for (InstrumentBuffer::EventHeader const* e = events.begin();
+	   e != events.end(); e = e->next())
+	frames.push_back(e->frame);
+    }
+    AtomicInt& m_counter;
+    AtomicInt::Type order;
+    vector<int64_t> frames;
+  };
+  
+  
+  SongTime beats(int64_t num, int64_t den) {
+    return SongTime::from_ticks(SongTime(1, 0).to_ticks() * num / den);
+  }
+  
+  
+  void dtest_buffer_layout() {
+    InstrumentBuffer buf(256);
+    buf.set_type_ids(7, 9);
+    buf.begin_period(SongTime(0, 0), SongTime(1, 0), 100);
+    unsigned char data[] = { 0x90, 60, 100 };
+    DTEST_TRUE(buf.write_event(beats(1, 2), 3, data));
+    DTEST_TRUE(buf.get_event_count() == 1);
+    DTEST_TRUE(buf.get_size() == 24);
+    DTEST_TRUE(buf.get_data()->size == 32);
+    DTEST_TRUE(buf.get_data()->type == 7);
+    DTEST_TRUE(buf.get_data()->unit == 0);
+    InstrumentBuffer::EventHeader const* e = buf.begin();
+    DTEST_TRUE(e->frame == 50);
+    DTEST_TRUE(e->size == 3);
+    DTEST_TRUE(e->type == 9);
+    DTEST_TRUE(e->data()[0] == 0x90 && e->data()[2] == 100);
+    DTEST_TRUE(e->next() == buf.end());
+    
+    // longer messages are padded to 8 bytes
+    unsigned char sysex[] = { 0xF0, 1, 2, 3, 4, 5, 6, 7, 8, 0xF7 };
+    DTEST_TRUE(buf.write_event(beats(3, 4), 10, sysex));
+    DTEST_TRUE(buf.get_size() == 24 + 32);
+    
+    // times outside the period are clamped
+    DTEST_TRUE(buf.write_event(SongTime(2, 0), 3, data));
+    DTEST_TRUE(buf.begin()->next()->next()->frame == 99);
+    
+    buf.begin_period(SongTime(1, 0), SongTime(2, 0), 100);
+    DTEST_TRUE(buf.get_event_count() == 0);
+    DTEST_TRUE(buf.begin() == buf.end());
+  }
+  
+  
+  void dtest_buffer_sorting() {
+    InstrumentBuffer buf(256);
+    buf.begin_period(SongTime(0, 0), SongTime(1, 0), 100);
+    unsigned char data[] = { 0x90, 60, 100 };
+    unsigned char sysex[] = { 0xF0, 1, 2, 3, 4, 5, 6, 7, 8, 0xF7 };
+    DTEST_TRUE(buf.write_event(beats(1, 2), 3, data));
+    DTEST_TRUE(buf.write_event(beats(1, 8), 10, sysex));
+    DTEST_TRUE(buf.write_event(beats(1, 4), 3, data));
+    DTEST_TRUE(buf.write_event(beats(1, 4), 3, data));
+    vector<int64_t> frames;
+    for (InstrumentBuffer::EventHeader const* e = buf.begin(); 
+	 e != buf.end(); e = e->next())
+      frames.push_back(e->frame);
+    DTEST_TRUE(frames.size() == 4);
+    DTEST_TRUE(frames[0] == 12 && frames[1] == 25 && 
+	       frames[2] == 25 && frames[3] == 50);
+    DTEST_TRUE(buf.begin()->size == 10);
+  }
+  
+  
+  void dtest_buffer_full() {
+    InstrumentBuffer buf(48);
+    buf.begin_period(SongTime(0, 0), SongTime(1, 0), 100);
+    EventBuffer::Event events[3];
+    for (int i = 0; i < 3; ++i) {
+      events[i].time = beats(i, 4);
+      events[i].data[0] = 0x90;
+      events[i].data[1] = 60 + i;
+      events[i].data[2] = 100;
+    }
+    DTEST_TRUE(buf.write_events(events, 3) == 2);
+    DTEST_TRUE(buf.get_event_count() == 2);
+    DTEST_TRUE(buf.get_size() == buf.get_capacity());
+  }
+  
+  
+  void dtest_graph_add() {
+    InstrumentGraph g(0);
+    DTEST_TRUE(g.get_threads() == 0);
+    DTEST_THROW_TYPE(g.add_instrument(shared_ptr<Instrument>()), 
+		     invalid_argument);
+    AtomicInt counter;
+    auto r = make_shared<Recorder>(counter);
+    InstrumentGraph::NodeID id = g.add_instrument(r);
+    DTEST_TRUE(g.get_size() == 1);
+    DTEST_TRUE(g.get_instrument(id) == r);
+    DTEST_TRUE(g.get_event_buffer(id));
+    DTEST_THROW_TYPE(g.get_event_buffer(id + 1), out_of_range);
+    DTEST_THROW_TYPE(g.add_dependency(id, id + 1), out_of_range);
+  }
+  
+  
+  void dtest_graph_cycles() {
+    InstrumentGraph g(0);
+    AtomicInt counter;
+    InstrumentGraph::NodeID a = g.add_instrument(make_shared<Recorder>(counter));
+    InstrumentGraph::NodeID b = g.add_instrument(make_shared<Recorder>(counter));
+    InstrumentGraph::NodeID c = g.add_instrument(make_shared<Recorder>(counter));
+    DTEST_THROW_TYPE(g.add_dependency(a, a), invalid_argument);
+    DTEST_NOTHROW(g.add_dependency(a, b));
+    DTEST_NOTHROW(g.add_dependency(b, c));
+    DTEST_NOTHROW(g.add_dependency(a, b));
+    DTEST_THROW_TYPE(g.add_dependency(c, a), invalid_argument);
+  }
+  
+  
+  /** Run a graph with 64 instruments, where every fourth one depends on 
+      the three before it, and check the order. */
+  void check_order(unsigned threads) {
+    InstrumentGraph g(threads);
+    AtomicInt counter;
+    vector<shared_ptr<Recorder> > rs;
+    for (int i = 0; i < 64; ++i) {
+      rs.push_back(make_shared<Recorder>(counter));
+      g.add_instrument(rs.back());
+      if (i % 4 == 3) {
+	for (int j = i - 3; j < i; ++j)
+	  g.add_dependency(j, i);
+      }
+    }
+    for (int period = 0; period < 100; ++period) {
+      counter.set(0);
+      g.run(64);
+      DTEST_TRUE(counter.get() == 64);
+      for (int i = 3; i < 64; i += 4) {
+	for (int j = i - 3; j < i; ++j)
+	  DTEST_TRUE(rs[j]->order < rs[i]->order);
+      }
+    }
+  }
+  
+  
+  void dtest_graph_order_single_thread() {
+    check_order(0);
+  }
+  
+  
+  void dtest_graph_order_workers() {
+    check_order(3);
+  }
+  
+  
+  void dtest_graph_process() {
+    Sequencer seq;
+    InstrumentGraph g(2);
+    AtomicInt counter;
+    auto r1 = make_shared<Recorder>(counter);
+    auto r2 = make_shared<Recorder>(counter);
+    InstrumentGraph::NodeID id1 = g.add_instrument(r1);
+    InstrumentGraph::NodeID id2 = g.add_instrument(r2);
+    
+    // two Sequencables share the first buffer, the second gets none
+    auto tick = make_shared<Ticker>();
+    auto tick2 = make_shared<Ticker>();
+    seq.set_event_buffer(seq.add_sequencable(tick), g.get_event_buffer(id1));
+    seq.set_event_buffer(seq.add_sequencable(tick2), g.get_event_buffer(id1));
+    
+    g.process(seq, SongTime(0, 0), SongTime(1, 0), 1000);
+    DTEST_TRUE(r1->frames.size() == 4);
+    DTEST_TRUE(r1->frames[0] == 0 && r1->frames[1] == 0 &&
+	       r1->frames[2] == 500 && r1->frames[3] == 500);
+    DTEST_TRUE(r2->frames.empty());
+    
+    // the buffers are cleared for every period
+    g.process(seq, SongTime(1, 0), beats(3, 2), 500);
+    DTEST_TRUE(r1->frames.size() == 2);
+    DTEST_TRUE(r1->frames[0] == 0 && r1->frames[1] == 0);
+    DTEST_TRUE(g.get_event_buffer(id2)->get_event_count() == 0);
+  }
+  
+  
+}
@@ -0,0 +1,280 @@
+/*****************************************************************************
+    libdinoseq_test - unit test module for libdinoseq
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+#include "atomicint.hpp"
+#include "dtest.hpp"
+#include "eventbuffer.hpp"
+#include "lookahead.hpp"
+#include "vectorbuffer.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+namespace LookaheadTest {
+  
+  
+  /** Writes a note on at every 1/4 beat, with the velocity given by the 
+      beat number plus an offset that the tests can change. */
+  class QuarterSequence : public Sequencable {
+  public:
+    
+    QuarterSequence() : Sequencable("quarters"), offset(0) { }
+    
+    bool sequence(Sequencable::Position& pos, 
+		  SongTime const& to, EventBuffer& buf) const {
+      int64_t q = SongTime(0, 0x400000).to_ticks();
+      int64_t t = (pos.get_time().to_ticks() + q - 1) / q * q;
+      for ( ; t < to.to_ticks(); t += q) {
+	SongTime st = SongTime::from_ticks(t);
+	unsigned char data[] = { 0x90, 60, 
+				 (unsigned char)(st.get_beat() + 
+						 offset.get()) };
+	if (!buf.write_event(st, 3, data)) {
+	  update_position(pos, st);
+	  return false;
+	}
+      }
+      update_position(pos, to);
+      return true;
+    }
+    
+    AtomicInt offset;
+    
+  };
+  
+  
+  /** A QuarterSequence that throws from sequence() while @c fail is 
+      set. */
+  class FailingSequence : public QuarterSequence {
+  public:
+    
+    FailingSequence() : fail(false) { }
+    
+    bool sequence(Sequencable::Position& pos, 
+		  SongTime const& to, EventBuffer& buf) const {
+      if (fail)
+	throw std::runtime_error("Could not render");
+      return QuarterSequence::sequence(pos, to, buf);
+    }
+    
+    bool fail;
+    
+  };
+  
+  
+  /** Check that @c buf has a note every 1/4 beat in [from, to), with the
+      velocity beat + offset. */
+  bool check_quarters(VectorBuffer const& buf, SongTime::Beat from, 
+		      SongTime::Beat to, int offset) {
+    if (buf.events.size() != size_t(to - from) * 4)
+      return false;
+    for (size_t i = 0; i < buf.events.size(); ++i) {
+      SongTime st(from + i / 4, (i % 4) * 0x400000);
+      if (buf.events[i].time != st || 
+	  buf.events[i].data[2] != st.get_beat() + offset)
+	return false;
+    }
+    return true;
+  }
+  
+  
+  void dtest_direct() {
+    auto source = make_shared<QuarterSequence>();
+    Lookahead la(source, SongTime(4, 0));
+    auto pos = la.create_position(SongTime(0, 0));
+    VectorBuffer buf;
+    
+    // nothing has been rendered yet, so the source is called directly
+    DTEST_TRUE(la.sequence(*pos, SongTime(2, 0), buf));
+    
+    DTEST_TRUE(check_quarters(buf, 0, 2, 0));
+    
+    DTEST_TRUE(la.get_fallbacks() == 1);
+  }
+  
+  
+  void dtest_rendered() {
+    auto source = make_shared<QuarterSequence>();
+    Lookahead la(source, SongTime(4, 0));
+    auto pos = la.create_position(SongTime(0, 0));
+    VectorBuffer buf;
+    
+    DTEST_TRUE(la.fill());
+    
+    // the window is rendered, it doesn't need to be rendered again
+    DTEST_TRUE(!la.fill());
+    
+    la.sequence(*pos, SongTime(1, 0), buf);
+    la.sequence(*pos, SongTime(3, 0), buf);
+    
+    DTEST_TRUE(check_quarters(buf, 0, 3, 0));
+    
+    DTEST_TRUE(la.get_fallbacks() == 0);
+    
+    // beyond the window it has to call the source again
+    la.sequence(*pos, SongTime(5, 0), buf);
+    
+    DTEST_TRUE(check_quarters(buf, 0, 5, 0));
+    
+    DTEST_TRUE(la.get_fallbacks() == 1);
+  }
+  
+  
+  void dtest_create_position() {
+    auto source = make_shared<QuarterSequence>();
+    Lookahead la(source, SongTime(4, 0));
+    auto pos = la.create_position(SongTime(0, 0));
+    
+    DTEST_TRUE(la.fill());
+    
+    // creating a position in another thread doesn't move the playhead, 
+    // only the realtime thread publishes that
+    auto pos2 = la.create_position(SongTime(8, 0));
+    
+    DTEST_TRUE(!la.fill());
+    
+    la.update_position(*pos2, SongTime(8, 0));
+    
+    DTEST_TRUE(la.fill());
+  }
+  
+  
+  void dtest_fill_exception() {
+    auto source = make_shared<FailingSequence>();
+    Lookahead la(source, SongTime(4, 0));
+    auto pos = la.create_position(SongTime(0, 0));
+    VectorBuffer buf;
+    
+    // the exception doesn't leave fill(), nothing is rendered
+    source->fail = true;
+    
+    DTEST_TRUE(!la.fill());
+    
+    // and the next call starts over
+    source->fail = false;
+    
+    DTEST_TRUE(la.fill());
+    
+    la.sequence(*pos, SongTime(3, 0), buf);
+    
+    DTEST_TRUE(check_quarters(buf, 0, 3, 0));
+    
+    DTEST_TRUE(la.get_fallbacks() == 0);
+  }
+  
+  
+  void dtest_relocate() {
+    auto source = make_shared<QuarterSequence>();
+    Lookahead la(source, SongTime(4, 0));
+    auto pos = la.create_position(SongTime(0, 0));
+    VectorBuffer buf;
+    
+    la.fill();
+    la.update_position(*pos, SongTime(10, 0));
+    
+    // the rendered events are for the wrong place now
+    la.sequence(*pos, SongTime(11, 0), buf);
+    
+    DTEST_TRUE(check_quarters(buf, 10, 11, 0));
+    
+    DTEST_TRUE(la.get_fallbacks() == 1);
+    
+    // until the worker has caught up
+    la.fill();
+    la.sequence(*pos, SongTime(13, 0), buf);
+    
+    DTEST_TRUE(check_quarters(buf, 10, 13, 0));
+    
+    DTEST_TRUE(la.get_fallbacks() == 1);
+  }
+  
+  
+  void dtest_invalidate() {
+    auto source = make_shared<QuarterSequence>();
+    Lookahead la(source, SongTime(4, 0));
+    auto pos = la.create_position(SongTime(0, 0));
+    VectorBuffer buf;
+    
+    la.fill();
+    la.sequence(*pos, SongTime(1, 0), buf);
+    
+    // an edit after the window doesn't throw anything away
+    source->offset.set(10);
+    la.invalidate(SongTime(8, 0), SongTime(9, 0));
+    la.fill();
+    la.sequence(*pos, SongTime(2, 0), buf);
+    
+    DTEST_TRUE(check_quarters(buf, 0, 2, 0));
+    
+    // one inside it does
+    la.invalidate(SongTime(3, 0), SongTime(4, 0));
+    la.fill();
+    buf.events.clear();
+    la.sequence(*pos, SongTime(3, 0), buf);
+    
+    DTEST_TRUE(check_quarters(buf, 2, 3, 10));
+    
+    DTEST_TRUE(la.get_fallbacks() == 0);
+  }
+  
+  
+  void dtest_small_ring() {
+    auto source = make_shared<QuarterSequence>();
+    Lookahead la(source, SongTime(8, 0), 8);
+    auto pos = la.create_position(SongTime(0, 0));
+    VectorBuffer buf;
+    
+    // the ring only has room for two beats at a time, but every event 
+    // must come out once
+    for (SongTime::Beat b = 1; b <= 16; ++b) {
+      la.fill();
+      la.sequence(*pos, SongTime(b, 0), buf);
+    }
+    
+    DTEST_TRUE(check_quarters(buf, 0, 16, 0));
+  }
+  
+  
+  void dtest_worker() {
+    auto source = make_shared<QuarterSequence>();
+    auto la = make_shared<Lookahead>(source, SongTime(4, 0));
+    auto pos = la->create_position(SongTime(0, 0));
+    VectorBuffer buf;
+    
+    {
+      vector<shared_ptr<Lookahead>> objects(1, la);
+      LookaheadWorker worker(objects, 100);
+      for (SongTime::Beat b = 1; b <= 32; ++b) {
+	usleep(500);
+	la->sequence(*pos, SongTime(b, 0), buf);
+      }
+    }
+    
+    DTEST_TRUE(check_quarters(buf, 0, 32, 0));
+  }
+  
+  
+}
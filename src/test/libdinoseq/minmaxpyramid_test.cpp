@@ -0,0 +1,114 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "dtest.hpp"
+#include "minmaxpyramid.hpp"
+
+
+using namespace Dino;
+
+
+namespace MinMaxPyramidTest {
+  
+  
+  void dtest_constructor() {
+    DTEST_NOTHROW(MinMaxPyramid p(0));
+    DTEST_NOTHROW(MinMaxPyramid p(1000));
+    MinMaxPyramid p(13);
+    DTEST_TRUE(p.get_size() == 13);
+    DTEST_TRUE(p.get_memory_usage() >= 
+	       (13 + 7 + 4 + 2 + 1) * 2 * sizeof(MinMaxPyramid::Value));
+  }
+  
+  
+  void dtest_add_get() {
+    MinMaxPyramid p(13);
+    MinMaxPyramid::Value min = 100, max = 0;
+    DTEST_TRUE(!p.get(0, 13, min, max));
+    DTEST_TRUE(min == 100 && max == 0);
+    
+    p.add(3, 10);
+    p.add(3, 20);
+    p.add(12, -5);
+    p.add(7, 50);
+    
+    min = 15;
+    max = 15;
+    DTEST_TRUE(p.get(3, 4, min, max));
+    DTEST_TRUE(min == 10 && max == 20);
+    
+    min = max = 15;
+    DTEST_TRUE(p.get(0, 13, min, max));
+    DTEST_TRUE(min == -5 && max == 50);
+    
+    min = max = 15;
+    DTEST_TRUE(p.get(4, 12, min, max));
+    DTEST_TRUE(min == 15 && max == 50);
+    
+    min = max = 15;
+    DTEST_TRUE(!p.get(8, 12, min, max));
+    DTEST_TRUE(!p.get(4, 4, min, max));
+  }
+  
+  
+  void dtest_set_clear() {
+    MinMaxPyramid p(5);
+    MinMaxPyramid::Value min, max;
+    
+    p.add(0, 1);
+    p.add(4, 9);
+    p.set(4, 3, 4);
+    min = max = 2;
+    DTEST_TRUE(p.get(0, 5, min, max));
+    DTEST_TRUE(min == 1 && max == 4);
+    
+    p.clear(0);
+    min = max = 3;
+    DTEST_TRUE(p.get(0, 5, min, max));
+    DTEST_TRUE(min == 3 && max == 4);
+    
+    p.clear();
+    DTEST_TRUE(!p.get(0, 5, min, max));
+  }
+  
+  
+  void dtest_all_intervals() {
+    const int n = 37;
+    MinMaxPyramid p(n);
+    MinMaxPyramid::Value values[n];
+    for (int i = 0; i < n; ++i) {
+      values[i] = (i * 7919) % 101;
+      p.add(i, values[i]);
+    }
+    bool ok = true;
+    for (int a = 0; a < n; ++a) {
+      for (int b = a + 1; b <= n; ++b) {
+	MinMaxPyramid::Value min = values[a], max = values[a];
+	for (int i = a; i < b; ++i) {
+	  min = values[i] < min ? values[i] : min;
+	  max = values[i] > max ? values[i] : max;
+	}
+	MinMaxPyramid::Value pmin = values[a], pmax = values[a];
+	ok = ok && p.get(a, b, pmin, pmax) && pmin == min && pmax == max;
+      }
+    }
+    DTEST_TRUE(ok);
+  }
+  
+  
+}
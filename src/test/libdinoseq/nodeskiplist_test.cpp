@@ -17,7 +17,9 @@
 *****************************************************************************/
 
 #include <algorithm>
+#include <cstdlib>
 #include <iterator>
+#include <vector>
 
 #include "dtest.hpp"
 #include "nodeskiplist.hpp"
@@ -46,9 +48,120 @@ namespace NodeSkipListTest {
 
     DTEST_TRUE(nsl.head_marker() != nsl.end_marker());
   
-    DTEST_TRUE(nsl.head_marker()->links[0].next.get() == nsl.first_node());
+    DTEST_TRUE(nsl.head_marker()->next(0).get() == nsl.first_node());
 
-    DTEST_TRUE(nsl.head_marker()->links[0].next.get() == nsl.end_marker());
+    DTEST_TRUE(nsl.head_marker()->next(0).get() == nsl.end_marker());
+  }
+
+
+  void dtest_node_levels() {
+    // with K = 2 and M = 2 about every fourth node would get too many levels
+    // if the limit was off by one
+    typedef NodeSkipList<int, 2, 2>::Node Node;
+    bool ok = true;
+    for (int i = 0; i < 1000; ++i) {
+      Node* n = Node::create(i);
+      ok = ok && n->levels >= 1 && n->levels <= 2;
+      Node::destroy(n);
+    }
+    DTEST_TRUE(ok);
+  }
+
+
+  void dtest_node_links() {
+    typedef NodeSkipList<int>::Node Node;
+    
+    // the links are stored in front of the node, make sure they don't 
+    // overlap with it or with each other
+    Node* n = Node::create(42, 5);
+    DTEST_TRUE(n->levels == 5);
+    for (size_t l = 0; l < 5; ++l)
+      n->next(l).set(n);
+    DTEST_TRUE(n->data == 42);
+    DTEST_TRUE(n->prev == 0);
+    bool ok = true;
+    for (size_t l = 0; l < 5; ++l)
+      ok = ok && n->next(l).get() == n;
+    DTEST_TRUE(ok);
+    Node::destroy(n);
+    
+    DTEST_TRUE(Node::get_size(1) < Node::get_size(2));
+    DTEST_TRUE(Node::get_size(1) <= sizeof(Node) + sizeof(void*) + 
+	       alignof(Node));
+  }
+
+
+  void dtest_memory_usage() {
+    typedef NodeSkipList<int>::Node Node;
+    
+    NodeSkipList<int> nsl;
+    NodeSkipList<int>::MemoryUsage mu = nsl.get_memory_usage();
+    DTEST_TRUE(mu.nodes == 0 && mu.links == 0 && mu.bytes == 0);
+    
+    Node* n1 = Node::create(1, 1);
+    Node* n2 = Node::create(2, 3);
+    nsl.insert(nsl.end_marker(), n1);
+    nsl.insert(nsl.end_marker(), n2);
+    mu = nsl.get_memory_usage();
+    DTEST_TRUE(mu.nodes == 2);
+    DTEST_TRUE(mu.links == 4);
+    DTEST_TRUE(mu.bytes == Node::get_size(1) + Node::get_size(3));
+    
+    nsl.remove(n2);
+    Node::destroy(n2);
+    mu = nsl.get_memory_usage();
+    DTEST_TRUE(mu.nodes == 1);
+    DTEST_TRUE(mu.links == 1);
+    DTEST_TRUE(mu.bytes == Node::get_size(1));
+  }
+
+
+  void dtest_random_insert_remove() {
+    typedef NodeSkipList<int>::NodeBase NodeBase;
+    typedef NodeSkipList<int>::Node Node;
+    
+    // insert and remove nodes in random places and check that every level
+    // is still sorted and that the bottom level has consistent back links
+    NodeSkipList<int> nsl;
+    std::vector<Node*> nodes;
+    for (int i = 0; i < 2000; ++i) {
+      if (nodes.empty() || std::rand() % 3 != 0) {
+	int v = std::rand() % 500;
+	Node* n = Node::create(v);
+	DTEST_TRUE(nsl.insert(nsl.upper_bound(v), n));
+	nodes.push_back(n);
+      }
+      else {
+	size_t j = std::rand() % nodes.size();
+	nsl.remove(nodes[j]);
+	Node::destroy(nodes[j]);
+	nodes[j] = nodes.back();
+	nodes.pop_back();
+      }
+    }
+    
+    bool ok = true;
+    for (size_t l = 0; l < 20; ++l) {
+      NodeBase const* prev = nsl.head_marker();
+      NodeBase const* nb = prev->next(l).get();
+      size_t count = 0;
+      while (nb != nsl.end_marker()) {
+	ok = ok && nb->levels > l;
+	if (prev != nsl.head_marker())
+	  ok = ok && !(static_cast<Node const*>(nb)->data < 
+		       static_cast<Node const*>(prev)->data);
+	if (l == 0)
+	  ok = ok && nb->prev == prev;
+	prev = nb;
+	nb = nb->next(l).get();
+	++count;
+      }
+      if (l == 0)
+	ok = ok && count == nodes.size() && 
+	  static_cast<NodeBase const*>(nsl.end_marker())->prev == prev;
+    }
+    DTEST_TRUE(ok);
+    DTEST_TRUE(nsl.get_memory_usage().nodes == nodes.size());
   }
 
 
@@ -61,42 +174,42 @@ namespace NodeSkipListTest {
   
     DTEST_TRUE(nl.first_node() == nl.end_marker());
   
-    DTEST_TRUE(nl.insert(end, new Node(1)));
+    DTEST_TRUE(nl.insert(end, Node::create(1)));
 
     DTEST_TRUE(nl.first_node() != nl.end_marker());
   
-    DTEST_TRUE(nl.insert(end, new Node(2)));
+    DTEST_TRUE(nl.insert(end, Node::create(2)));
   
-    DTEST_TRUE(nl.insert(nl.first_node(), new Node(0)));
+    DTEST_TRUE(nl.insert(nl.first_node(), Node::create(0)));
   
     NodeBase* nb = nl.first_node();
   
     DTEST_TRUE(static_cast<Node*>(nb)->data == 0);
 
-    nb = static_cast<Node*>(nb)->links[0].next.get();
+    nb = static_cast<Node*>(nb)->next(0).get();
   
     DTEST_TRUE(static_cast<Node*>(nb)->data == 1);
   
-    nb = static_cast<Node*>(nb)->links[0].next.get();
+    nb = static_cast<Node*>(nb)->next(0).get();
   
     DTEST_TRUE(static_cast<Node*>(nb)->data == 2);
   
     Node* n = static_cast<Node*>(nl.first_node());
     nl.remove(n);
-    delete n;
+    Node::destroy(n);
   
     n = static_cast<Node*>(nl.first_node());
   
     DTEST_TRUE(n->data == 1);
   
     nl.remove(n);
-    delete n;
+    Node::destroy(n);
     n = static_cast<Node*>(nl.first_node());
 
     DTEST_TRUE(n->data == 2);
   
     nl.remove(n);
-    delete n;
+    Node::destroy(n);
   
     DTEST_TRUE(nl.first_node() == nl.end_marker());
   }
@@ -108,16 +221,16 @@ namespace NodeSkipListTest {
 
     NodeSkipList<int> nsl;
   
-    Node* n1 = new Node(1);
+    Node* n1 = Node::create(1);
     nsl.insert(nsl.end_marker(), n1);
-    Node* n2 = new Node(2);
+    Node* n2 = Node::create(2);
     nsl.insert(nsl.end_marker(), n2);
-    nsl.insert(nsl.end_marker(), new Node(2));
-    Node* n3 = new Node(3);
+    nsl.insert(nsl.end_marker(), Node::create(2));
+    Node* n3 = Node::create(3);
     nsl.insert(nsl.end_marker(), n3);
-    nsl.insert(nsl.end_marker(), new Node(3));
-    nsl.insert(nsl.end_marker(), new Node(3));
-    Node* n4 = new Node(4);
+    nsl.insert(nsl.end_marker(), Node::create(3));
+    nsl.insert(nsl.end_marker(), Node::create(3));
+    Node* n4 = Node::create(4);
     nsl.insert(nsl.end_marker(), n4);
   
     DTEST_TRUE(nsl.lower_bound(0) == n1);
@@ -154,16 +267,16 @@ namespace NodeSkipListTest {
 
     NodeSkipList<int> nsl;
   
-    Node* n1 = new Node(1);
+    Node* n1 = Node::create(1);
     nsl.insert(nsl.end_marker(), n1);
-    Node* n2 = new Node(2);
+    Node* n2 = Node::create(2);
     nsl.insert(nsl.end_marker(), n2);
-    nsl.insert(nsl.end_marker(), new Node(2));
-    Node* n3 = new Node(3);
+    nsl.insert(nsl.end_marker(), Node::create(2));
+    Node* n3 = Node::create(3);
     nsl.insert(nsl.end_marker(), n3);
-    nsl.insert(nsl.end_marker(), new Node(3));
-    nsl.insert(nsl.end_marker(), new Node(3));
-    Node* n4 = new Node(4);
+    nsl.insert(nsl.end_marker(), Node::create(3));
+    nsl.insert(nsl.end_marker(), Node::create(3));
+    Node* n4 = Node::create(4);
     nsl.insert(nsl.end_marker(), n4);
   
     DTEST_TRUE(nsl.upper_bound(0) == n1);
@@ -196,16 +309,16 @@ namespace NodeSkipListTest {
 
     NodeSkipList<int> nsl;
   
-    Node* n1 = new Node(1);
+    Node* n1 = Node::create(1);
     nsl.insert(nsl.end_marker(), n1);
-    nsl.insert(nsl.end_marker(), new Node(2));
-    Node* n2 = new Node(2);
+    nsl.insert(nsl.end_marker(), Node::create(2));
+    Node* n2 = Node::create(2);
     nsl.insert(nsl.end_marker(), n2);
-    nsl.insert(nsl.end_marker(), new Node(3));
-    nsl.insert(nsl.end_marker(), new Node(3));
-    Node* n3 = new Node(3);
+    nsl.insert(nsl.end_marker(), Node::create(3));
+    nsl.insert(nsl.end_marker(), Node::create(3));
+    Node* n3 = Node::create(3);
     nsl.insert(nsl.end_marker(), n3);
-    Node* n4 = new Node(4);
+    Node* n4 = Node::create(4);
     nsl.insert(nsl.end_marker(), n4);
   
     DTEST_TRUE(nsl.find_less(0) == nsl.head_marker());
@@ -242,16 +355,16 @@ namespace NodeSkipListTest {
 
     NodeSkipList<int> nsl;
   
-    Node* n1 = new Node(1);
+    Node* n1 = Node::create(1);
     nsl.insert(nsl.end_marker(), n1);
-    nsl.insert(nsl.end_marker(), new Node(2));
-    Node* n2 = new Node(2);
+    nsl.insert(nsl.end_marker(), Node::create(2));
+    Node* n2 = Node::create(2);
     nsl.insert(nsl.end_marker(), n2);
-    nsl.insert(nsl.end_marker(), new Node(3));
-    nsl.insert(nsl.end_marker(), new Node(3));
-    Node* n3 = new Node(3);
+    nsl.insert(nsl.end_marker(), Node::create(3));
+    nsl.insert(nsl.end_marker(), Node::create(3));
+    Node* n3 = Node::create(3);
     nsl.insert(nsl.end_marker(), n3);
-    Node* n4 = new Node(4);
+    Node* n4 = Node::create(4);
     nsl.insert(nsl.end_marker(), n4);
   
     DTEST_TRUE(nsl.find_less_or_equal(0) == nsl.head_marker());
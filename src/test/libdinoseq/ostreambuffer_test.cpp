@@ -55,4 +55,75 @@ namespace OStreamBufferTest {
   }
 
 
+  void dtest_write_events() {
+    ostringstream os;
+    OStreamBuffer osb(os);
+    
+    EventBuffer::Event events[] = { 
+      { SongTime(0, 0x238388), { 0x80, 0x34, 0x00 } },
+      { SongTime(5, 0xFFAD03), { 0x90, 0x34, 0x42 } } 
+    };
+    
+    DTEST_TRUE(osb.write_events(events, 2) == 2);
+    
+    os<<flush;
+    
+    DTEST_TRUE(os.str() == "0:238388: 80 34 00\n5:FFAD03: 90 34 42\n");
+  }
+
+
+
+  void dtest_write_packet() {
+    ostringstream os;
+    OStreamBuffer osb(os);
+    
+    uint32_t packet[] = { 0x40B40700, 0x80000000 };
+    
+    DTEST_TRUE(osb.write_packet(SongTime(1, 0x10), 2, packet));
+    
+    os<<flush;
+    
+    DTEST_TRUE(os.str() == "1:000010: UMP 40B40700 80000000\n");
+  }
+
+
+  /** An EventBuffer that prints the events that the default write_packet()
+      translates packets to. */
+  class TranslatingBuffer : public EventBuffer {
+  public:
+    TranslatingBuffer(ostream& os) : m_osb(os) {}
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data) {
+      return m_osb.write_event(st, bytes, data);
+    }
+  private:
+    OStreamBuffer m_osb;
+  };
+
+
+  void dtest_write_packet_translated() {
+    ostringstream os;
+    TranslatingBuffer buf(os);
+    
+    uint32_t cc[] = { 0x40B40700, 0x80000000 };
+    uint32_t rpn[] = { 0x40200102, 0x12345678 };
+    uint32_t midi1[] = { 0x20C30500 };
+    uint32_t sysex[] = { 0x30010000, 0 };
+    
+    DTEST_TRUE(buf.write_packet(SongTime(0, 0), 2, cc));
+    DTEST_TRUE(buf.write_packet(SongTime(0, 0), 2, rpn));
+    DTEST_TRUE(buf.write_packet(SongTime(0, 0), 1, midi1));
+    DTEST_TRUE(buf.write_packet(SongTime(0, 0), 2, sysex));
+    
+    os<<flush;
+    
+    DTEST_TRUE(os.str() == 
+	       "0:000000: B4 07 40\n"
+	       "0:000000: B0 65 01\n"
+	       "0:000000: B0 64 02\n"
+	       "0:000000: B0 06 09\n"
+	       "0:000000: B0 26 0D\n"
+	       "0:000000: C3 05\n");
+  }
+
 }
@@ -0,0 +1,150 @@
+/*****************************************************************************
+    libdinoseq_test - unit test module for libdinoseq
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <memory>
+#include <vector>
+
+#include "dtest.hpp"
+#include "outputfilter.hpp"
+#include "songtime.hpp"
+#include "vectorbuffer.hpp"
+
+
+using namespace Dino;
+
+
+namespace OutputFilterTest {
+  
+  
+  bool write(EventBuffer& buf, unsigned char s, unsigned char d1, 
+	     unsigned char d2 = 0) {
+    unsigned char data[] = { s, d1, d2 };
+    return buf.write_event(SongTime(0, 0), (s & 0xE0) == 0xC0 ? 2 : 3, data);
+  }
+  
+  
+  void dtest_controllers() {
+    std::shared_ptr<VectorBuffer> target(new VectorBuffer);
+    OutputFilter f(target);
+    
+    write(f, 0xB0, 7, 100);
+    write(f, 0xB0, 7, 100);
+    write(f, 0xB1, 7, 100);
+    write(f, 0xB0, 7, 101);
+    write(f, 0xB0, 7, 101);
+    
+    DTEST_TRUE(target->events.size() == 3);
+    
+    DTEST_TRUE(f.get_dropped() == 2);
+    
+    f.reset();
+    write(f, 0xB0, 7, 101);
+    
+    DTEST_TRUE(target->events.size() == 4);
+  }
+  
+  
+  void dtest_controller14() {
+    std::shared_ptr<VectorBuffer> target(new VectorBuffer);
+    OutputFilter f(target);
+    
+    write(f, 0xB0, 1, 10);
+    write(f, 0xB0, 33, 5);
+    
+    // a repeated MSB doesn't reset the LSB in the receiver
+    write(f, 0xB0, 1, 10);
+    write(f, 0xB0, 33, 5);
+    
+    DTEST_TRUE(target->events.size() == 2);
+    
+    // a new one does, so the same LSB must be sent again
+    write(f, 0xB0, 1, 11);
+    write(f, 0xB0, 33, 5);
+    
+    DTEST_TRUE(target->events.size() == 4);
+    
+    DTEST_TRUE(target->events[3].data[1] == 33 && 
+	       target->events[3].data[2] == 5);
+  }
+  
+  
+  void dtest_side_effects() {
+    std::shared_ptr<VectorBuffer> target(new VectorBuffer);
+    OutputFilter f(target);
+    
+    // notes, data entry and channel mode messages are never dropped
+    write(f, 0x90, 60, 100);
+    write(f, 0x90, 60, 100);
+    write(f, 0xB0, 6, 1);
+    write(f, 0xB0, 6, 1);
+    write(f, 0xB0, 123, 0);
+    write(f, 0xB0, 123, 0);
+    
+    DTEST_TRUE(target->events.size() == 6);
+    
+    // bank select makes the next program change go through
+    write(f, 0xC0, 5);
+    write(f, 0xC0, 5);
+    write(f, 0xB0, 0, 1);
+    write(f, 0xC0, 5);
+    
+    DTEST_TRUE(target->events.size() == 9);
+    
+    write(f, 0xE0, 0, 64);
+    write(f, 0xE0, 0, 64);
+    write(f, 0xE0, 1, 64);
+    
+    DTEST_TRUE(target->events.size() == 11);
+  }
+  
+  
+  void dtest_write_events() {
+    std::shared_ptr<VectorBuffer> target(new VectorBuffer(3));
+    OutputFilter f(target);
+    
+    EventBuffer::Event events[] = {
+      { SongTime(0, 0), { 0xB0, 7, 1 } },
+      { SongTime(0, 1), { 0xB0, 7, 1 } },
+      { SongTime(0, 2), { 0xB0, 7, 2 } },
+      { SongTime(0, 3), { 0xB0, 7, 2 } },
+      { SongTime(0, 4), { 0xB0, 8, 2 } },
+      { SongTime(0, 5), { 0xB0, 9, 2 } },
+      { SongTime(0, 6), { 0xB0, 9, 2 } }
+    };
+    
+    // the target is full after the third event that passes, the 
+    // remaining ones must be written again later
+    DTEST_TRUE(f.write_events(events, 7) == 5);
+    
+    DTEST_TRUE(target->events.size() == 3);
+    
+    DTEST_TRUE(target->events[2].data[1] == 8);
+    
+    target->room = 1000;
+    
+    DTEST_TRUE(f.write_events(events + 5, 2) == 2);
+    
+    DTEST_TRUE(target->events.size() == 4);
+    
+    DTEST_TRUE(target->events[3].data[1] == 9);
+    
+    DTEST_TRUE(f.get_dropped() == 3);
+  }
+  
+  
+}
@@ -103,6 +103,61 @@ namespace SequencerTest {
 	       shared_ptr<EventBuffer>());
   }
 
+  
+  
+  void dtest_transaction() {
+    auto sqbl1 = make_shared<PhonySequencable>();
+    auto sqbl2 = make_shared<PhonySequencable>();
+    auto buf = make_shared<PhonyEventBuffer>();
+    Sequencer seq;
+    
+    Sequencer::Transaction t = seq.begin_transaction();
+    t.add_sequencable(sqbl1);
+    t.add_sequencable(sqbl2, buf);
+    DTEST_THROW_TYPE(t.add_sequencable(shared_ptr<PhonySequencable>()), 
+		     std::invalid_argument);
+    
+    // nothing is visible until the transaction is committed
+    DTEST_TRUE(seq.sqbl_begin() == seq.sqbl_end());
+    seq.commit(t);
+    DTEST_TRUE(distance(seq.sqbl_begin(), seq.sqbl_end()) == 2);
+    DTEST_TRUE(seq.get_event_buffer(seq.sqbl_find(sqbl2)) == buf);
+    
+    t = seq.begin_transaction();
+    DTEST_TRUE(t.remove_sequencable(sqbl1));
+    DTEST_TRUE(!t.remove_sequencable(sqbl1));
+    DTEST_TRUE(t.set_event_buffer(sqbl2, shared_ptr<EventBuffer>()));
+    DTEST_TRUE(!t.set_event_buffer(sqbl1, buf));
+    seq.commit(t);
+    DTEST_TRUE(distance(seq.sqbl_begin(), seq.sqbl_end()) == 1);
+    DTEST_TRUE(seq.sqbl_find(sqbl1) == seq.sqbl_end());
+    DTEST_TRUE(seq.get_event_buffer(seq.sqbl_find(sqbl2)) ==
+	       shared_ptr<EventBuffer>());
+    
+    t = seq.begin_transaction();
+    t.clear();
+    seq.commit(t);
+    DTEST_TRUE(seq.sqbl_begin() == seq.sqbl_end());
+  }
+  
+  
+  void dtest_retired_plans() {
+    auto sqbl = make_shared<PhonySequencable>();
+    weak_ptr<PhonySequencable> weak = sqbl;
+    Sequencer seq;
+    
+    seq.add_sequencable(sqbl);
+    seq.remove_sequencable(seq.sqbl_find(sqbl));
+    sqbl.reset();
+    
+    // the old plans can't be deleted until run() has seen a newer one
+    seq.delete_retired_plans();
+    DTEST_TRUE(!weak.expired());
+    seq.run(SongTime(0, 0), SongTime(1, 0));
+    seq.delete_retired_plans();
+    DTEST_TRUE(weak.expired());
+  }
+
 
   class BeatSequence : public Sequencable {
   public:
@@ -170,5 +225,293 @@ namespace SequencerTest {
     DTEST_TRUE(os2.str() == expected_result);
   }
 
+  
+  
+  void dtest_run_added_during_playback() {
+    ostringstream os;
+    auto sqbl = make_shared<BeatSequence>();
+    auto buf = make_shared<OStreamBuffer>(os);
+    Sequencer seq;
+    
+    seq.run(SongTime(0, 0), SongTime(2, 1));
+    seq.set_event_buffer(seq.add_sequencable(sqbl), buf);
+    seq.run(SongTime(2, 1), SongTime(4, 1));
+    
+    os<<flush;
+    DTEST_TRUE(os.str() == "3:000000: 03\n4:000000: 04\n");
+  }
+  
+  
+  /** Writes a note on with velocity b + 10 at every beat b. */
+  class NoteSequence : public Sequencable {
+  public:
+    
+    NoteSequence() : Sequencable("notes") { }
+    
+    bool sequence(Sequencable::Position& pos, 
+		  SongTime const& to, EventBuffer& buf) const {
+      for (SongTime::Beat b = pos.get_time().get_beat() + 
+	     (pos.get_time().get_tick() > 0 ? 1 : 0); 
+	   SongTime(b, 0) < to; ++b) {
+	EventBuffer::Event e;
+	e.time = SongTime(b, 0);
+	e.data[0] = 0x90;
+	e.data[1] = 60;
+	e.data[2] = b + 10;
+	buf.write_events(&e, 1);
+      }
+      update_position(pos, to);
+      return true;
+    }
+    
+  };
+  
+  
+  void dtest_status() {
+    ostringstream os;
+    auto buf = make_shared<OStreamBuffer>(os);
+    Sequencer seq;
+    Sequencer::Status st;
+    
+    DTEST_TRUE(seq.get_status_count() == 0);
+    DTEST_TRUE(seq.get_status(st));
+    DTEST_TRUE(st.periods == 0 && st.events[0] == 0 && st.velocity[0] == 0);
+    
+    seq.set_event_buffer(seq.add_sequencable(make_shared<BeatSequence>()), 
+			 buf);
+    seq.set_event_buffer(seq.add_sequencable(make_shared<NoteSequence>()), 
+			 buf);
+    seq.add_sequencable(make_shared<NoteSequence>());
+    
+    seq.run(SongTime(0, 0), SongTime(2, 1));
+    DTEST_TRUE(seq.get_status_count() == 1);
+    DTEST_TRUE(seq.get_status(st));
+    DTEST_TRUE(st.position == SongTime(2, 1));
+    DTEST_TRUE(st.periods == 1);
+    DTEST_TRUE(st.events[0] == 3);
+    DTEST_TRUE(st.velocity[0] == 0);
+    DTEST_TRUE(st.events[1] == 3);
+    DTEST_TRUE(st.velocity[1] == 12);
+    // no buffer, so nothing was sequenced
+    DTEST_TRUE(st.events[2] == 0);
+    
+    // the counters keep going
+    seq.run(SongTime(2, 1), SongTime(4, 1));
+    DTEST_TRUE(seq.get_status(st));
+    DTEST_TRUE(st.position == SongTime(4, 1));
+    DTEST_TRUE(st.periods == 2);
+    DTEST_TRUE(st.events[0] == 5);
+    DTEST_TRUE(st.events[1] == 5);
+    DTEST_TRUE(st.velocity[1] == 14);
+  }
+  
+  
+  /** Writes a note on at every beat b with b % 2 == parity. */
+  class ParitySequence : public Sequencable {
+  public:
+    
+    ParitySequence(int parity) : Sequencable("parity"), m_parity(parity) { }
+    
+    bool sequence(Sequencable::Position& pos, 
+		  SongTime const& to, EventBuffer& buf) const {
+      for (SongTime::Beat b = pos.get_time().get_beat() + 
+	     (pos.get_time().get_tick() > 0 ? 1 : 0); 
+	   SongTime(b, 0) < to; ++b) {
+	if (b % 2 != m_parity)
+	  continue;
+	unsigned char data[] = { 0x90, (unsigned char)b, 0x40 };
+	if (!buf.write_event(SongTime(b, 0), 3, data)) {
+	  update_position(pos, SongTime(b, 0));
+	  return false;
+	}
+      }
+      update_position(pos, to);
+      return true;
+    }
+    
+  private:
+    
+    int m_parity;
+    
+  };
+  
+  
+  void dtest_merge_shared_buffer() {
+    ostringstream os;
+    auto buf = make_shared<OStreamBuffer>(os);
+    Sequencer seq;
+    
+    // two objects that interleave in time, writing to the same buffer
+    seq.set_event_buffer(seq.add_sequencable(make_shared<ParitySequence>(1)),
+			 buf);
+    seq.set_event_buffer(seq.add_sequencable(make_shared<ParitySequence>(0)),
+			 buf);
+    seq.run(SongTime(0, 0), SongTime(4, 0));
+    
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "0:000000: 90 00 40\n"
+	       "1:000000: 90 01 40\n"
+	       "2:000000: 90 02 40\n"
+	       "3:000000: 90 03 40\n");
+  }
+  
+  
+  void dtest_merge_capacity() {
+    ostringstream os;
+    auto buf = make_shared<OStreamBuffer>(os);
+    Sequencer seq(1);
+    
+    // with room for one event per object and period the rest is delayed to
+    // the next period, but the order is kept
+    seq.set_event_buffer(seq.add_sequencable(make_shared<ParitySequence>(1)),
+			 buf);
+    seq.set_event_buffer(seq.add_sequencable(make_shared<ParitySequence>(0)),
+			 buf);
+    seq.run(SongTime(0, 0), SongTime(4, 0));
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "0:000000: 90 00 40\n"
+	       "1:000000: 90 01 40\n");
+    
+    seq.run(SongTime(4, 0), SongTime(4, 0));
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "0:000000: 90 00 40\n"
+	       "1:000000: 90 01 40\n"
+	       "2:000000: 90 02 40\n"
+	       "3:000000: 90 03 40\n");
+  }
+
+  
+  
+  /** An OStreamBuffer that only has room for @c room more events. */
+  class SmallBuffer : public OStreamBuffer {
+  public:
+    
+    SmallBuffer(ostream& os) : OStreamBuffer(os), room(0) {}
+    
+    bool write_event(SongTime const& st, size_t bytes, 
+		     unsigned char const* data) {
+      if (room == 0)
+	return false;
+      --room;
+      return OStreamBuffer::write_event(st, bytes, data);
+    }
+    
+    size_t write_events(Event const* events, size_t n) {
+      return EventBuffer::write_events(events, n);
+    }
+    
+    size_t room;
+    
+  };
+  
+  
+  void dtest_merge_full_buffer() {
+    ostringstream os;
+    auto buf = make_shared<SmallBuffer>(os);
+    Sequencer seq;
+    Sequencer::Status st;
+    
+    seq.set_event_buffer(seq.add_sequencable(make_shared<ParitySequence>(1)),
+			 buf);
+    seq.set_event_buffer(seq.add_sequencable(make_shared<ParitySequence>(0)),
+			 buf);
+    
+    // the objects have moved past the events that didn't fit, so they are
+    // written first in the next period
+    buf->room = 1;
+    seq.run(SongTime(0, 0), SongTime(4, 0));
+    DTEST_TRUE(seq.get_status(st));
+    DTEST_TRUE(st.overflows == 1);
+    
+    // also if the plan is replaced in between
+    seq.add_sequencable(make_shared<PhonySequencable>());
+    buf->room = 2;
+    seq.run(SongTime(4, 0), SongTime(4, 0));
+    buf->room = 10;
+    seq.run(SongTime(4, 0), SongTime(6, 0));
+    DTEST_TRUE(seq.get_status(st));
+    DTEST_TRUE(st.overflows == 2);
+    
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "0:000000: 90 00 40\n"
+	       "1:000000: 90 01 40\n"
+	       "2:000000: 90 02 40\n"
+	       "3:000000: 90 03 40\n"
+	       "4:000000: 90 04 40\n"
+	       "5:000000: 90 05 40\n");
+  }
+
+  
+  
+  /** Writes a note on at every beat and chases the note on of the beat 
+      that the position is in. */
+  class ChasingSequence : public NoteSequence {
+  public:
+    
+    bool chase(Sequencable::Position& pos, EventBuffer& buf) const {
+      unsigned char data[] = { 0x90, 60, 
+			       (unsigned char)(pos.get_time().get_beat() + 10) };
+      return buf.write_event(pos.get_time(), 3, data);
+    }
+    
+  };
+  
+  
+  void dtest_chase_on_locate() {
+    ostringstream os;
+    auto buf = make_shared<OStreamBuffer>(os);
+    Sequencer seq;
+    seq.set_event_buffer(seq.add_sequencable(make_shared<ChasingSequence>()),
+			 buf);
+    
+    // continuous playback doesn't chase
+    seq.run(SongTime(0, 0), SongTime(0, 10));
+    seq.run(SongTime(0, 10), SongTime(0, 20));
+    os<<flush;
+    DTEST_TRUE(os.str() == "0:000000: 90 3C 0A\n");
+    
+    // a jump does, before the events that follow it
+    seq.run(SongTime(2, 5), SongTime(3, 1));
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "0:000000: 90 3C 0A\n"
+	       "2:000005: 90 3C 0C\n"
+	       "3:000000: 90 3C 0D\n");
+  }
+  
+  
+  void dtest_chase_full_buffer() {
+    ostringstream os;
+    auto buf = make_shared<SmallBuffer>(os);
+    Sequencer seq;
+    Sequencer::Status st;
+    seq.set_event_buffer(seq.add_sequencable(make_shared<ChasingSequence>()),
+			 buf);
+    
+    // the chased state doesn't fit after the jump, so it is sent in the
+    // next period before anything else
+    seq.run(SongTime(2, 5), SongTime(2, 10));
+    DTEST_TRUE(seq.get_status(st));
+    DTEST_TRUE(st.overflows == 1);
+    
+    buf->room = 10;
+    seq.run(SongTime(2, 10), SongTime(3, 1));
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "2:000005: 90 3C 0C\n"
+	       "3:000000: 90 3C 0D\n");
+    
+    // and only once
+    seq.run(SongTime(3, 1), SongTime(4, 1));
+    os<<flush;
+    DTEST_TRUE(os.str() == 
+	       "2:000005: 90 3C 0C\n"
+	       "3:000000: 90 3C 0D\n"
+	       "4:000000: 90 3C 0E\n");
+  }
 
 }
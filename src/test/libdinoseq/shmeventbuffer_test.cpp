@@ -0,0 +1,192 @@
+/*****************************************************************************
+    libdinoseq_test - unit test module for libdinoseq
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <sstream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "dtest.hpp"
+#include "shmeventbuffer.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+namespace ShmEventBufferTest {
+  
+  
+  /** Return a segment name that no other test run will use. */
+  string segment_name(char const* test) {
+    ostringstream os;
+    os<<"/dino-test-"<<getpid()<<'-'<<test;
+    return os.str();
+  }
+  
+  
+  /** Map the ring in the segment @c name, the way another process would
+      see it. */
+  ShmEventRing* map_ring(string const& name, size_t size) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    void* mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return static_cast<ShmEventRing*>(mem);
+  }
+
+
+  void dtest_constructor() {
+    string name = segment_name("constructor");
+    DTEST_NOTHROW(ShmEventBuffer buf(name, 16));
+    DTEST_THROW_TYPE(ShmEventBuffer buf(name, 0), std::invalid_argument);
+    DTEST_THROW_TYPE(ShmEventReader reader(name), std::runtime_error);
+  }
+  
+  
+  void dtest_write_read() {
+    string name = segment_name("write_read");
+    ShmEventBuffer buf(name, 4);
+    ShmEventReader reader(name);
+    
+    SongTime time;
+    size_t bytes;
+    unsigned char const* data;
+    
+    DTEST_TRUE(!reader.peek(time, bytes, data));
+    
+    unsigned char event1[] = { 0x90, 0x40, 0x7F };
+    unsigned char event2[] = { 0xC0, 0x05 };
+    buf.write_event(SongTime(1, 2), 3, event1);
+    buf.write_event(SongTime(3, 4), 2, event2);
+    
+    DTEST_TRUE(reader.get_available() == 2);
+    
+    DTEST_TRUE(reader.peek(time, bytes, data) && time == SongTime(1, 2) &&
+	       bytes == 3 && data[0] == 0x90 && data[2] == 0x7F);
+    
+    reader.pop();
+    
+    DTEST_TRUE(reader.peek(time, bytes, data) && time == SongTime(3, 4) &&
+	       bytes == 2 && data[0] == 0xC0 && data[1] == 0x05);
+    
+    reader.pop();
+    
+    DTEST_TRUE(reader.get_available() == 0);
+  }
+  
+  
+  void dtest_full() {
+    string name = segment_name("full");
+    ShmEventBuffer buf(name, 3);
+    ShmEventReader reader(name);
+    
+    unsigned char event[] = { 0xB0, 0x07, 0x00 };
+    size_t written = 0;
+    while (written < 100 && buf.write_event(SongTime(0, written), 3, event))
+      ++written;
+    
+    DTEST_TRUE(written == 3);
+    
+    reader.pop();
+    
+    DTEST_TRUE(buf.write_event(SongTime(1, 0), 3, event));
+    
+    DTEST_TRUE(!buf.write_event(SongTime(1, 0), 3, event));
+  }
+  
+  
+  void dtest_write_events() {
+    string name = segment_name("write_events");
+    ShmEventBuffer buf(name, 7);
+    ShmEventReader reader(name);
+    
+    EventBuffer::Event events[10];
+    for (int i = 0; i < 10; ++i) {
+      events[i].time = SongTime(i, 0);
+      events[i].data[0] = 0xB0;
+      events[i].data[1] = 0x01;
+      events[i].data[2] = i;
+    }
+    
+    DTEST_TRUE(buf.write_events(events, 5) == 5);
+    
+    DTEST_TRUE(buf.write_events(events + 5, 5) == 2);
+    
+    SongTime time;
+    size_t bytes;
+    unsigned char const* data;
+    bool ok = true;
+    for (int i = 0; i < 7; ++i) {
+      ok = ok && reader.peek(time, bytes, data) && time == SongTime(i, 0) &&
+	bytes == 3 && data[2] == i;
+      reader.pop();
+    }
+    
+    DTEST_TRUE(ok);
+    
+    DTEST_TRUE(!reader.peek(time, bytes, data));
+  }
+  
+  
+  void dtest_bad_header() {
+    string name = segment_name("bad_header");
+    ShmEventBuffer buf(name, 3);
+    size_t size = ShmEventRing::segment_size(4);
+    ShmEventRing* ring = map_ring(name, size);
+    
+    ring->capacity = 0;
+    DTEST_THROW_TYPE(ShmEventReader reader(name), std::runtime_error);
+    
+    ring->capacity = 3;
+    DTEST_THROW_TYPE(ShmEventReader reader(name), std::runtime_error);
+    
+    ring->capacity = 4;
+    ring->read_index.set(4);
+    DTEST_THROW_TYPE(ShmEventReader reader(name), std::runtime_error);
+    
+    ring->read_index.set(0);
+    DTEST_NOTHROW(ShmEventReader reader(name));
+    
+    munmap(ring, size);
+  }
+  
+  
+  void dtest_bad_size() {
+    string name = segment_name("bad_size");
+    ShmEventBuffer buf(name, 3);
+    ShmEventReader reader(name);
+    size_t size = ShmEventRing::segment_size(4);
+    ShmEventRing* ring = map_ring(name, size);
+    
+    unsigned char event[] = { 0x90, 0x40, 0x7F };
+    buf.write_event(SongTime(0, 0), 3, event);
+    ring->slots()[0].size = 200;
+    
+    SongTime time;
+    size_t bytes;
+    unsigned char const* data;
+    DTEST_TRUE(reader.peek(time, bytes, data) && 
+	       bytes == sizeof(ring->slots()[0].data));
+    
+    munmap(ring, size);
+  }
+  
+  
+}
@@ -61,6 +61,44 @@ namespace SongTimeTest {
   }
 
 
+  void dtest_negative_beat() {
+    SongTime st(-35, 0xFFFFFE);
+    
+    DTEST_TRUE(st.get_beat() == -35);
+    
+    DTEST_TRUE(st.get_tick() == 0xFFFFFE);
+    
+    DTEST_TRUE(SongTime(0, 0) - SongTime(0, 1) == SongTime(-1, 0xFFFFFF));
+
+    DTEST_TRUE((SongTime(0, 0) - SongTime(0, 1)).get_beat() == -1);
+  }
+
+
+  void dtest_ticks() {
+    DTEST_TRUE(SongTime(3, 5).to_ticks() == 3 * (int64_t(1) << 24) + 5);
+    
+    DTEST_TRUE(SongTime::from_ticks(SongTime(-7, 42).to_ticks()) == 
+	       SongTime(-7, 42));
+    
+    static_assert(SongTime(1, 0) < SongTime(1, 1), 
+		  "SongTime comparisons should be constant expressions");
+  }
+
+
+  void dtest_scale() {
+    DTEST_TRUE(SongTime(4, 0).scale(3, 2) == SongTime(6, 0));
+    
+    DTEST_TRUE(SongTime(1, 0).scale(1, 3) == 
+	       SongTime::from_ticks((int64_t(1) << 24) / 3));
+    
+    // floor(2^47 * 120 / 121) beats and ticks
+    DTEST_TRUE(SongTime::max_valid().scale(120, 121) == 
+	       SongTime(8319280, 11092374));
+    
+    DTEST_TRUE(SongTime(-4, 0).scale(1, 2) == SongTime(-2, 0));
+  }
+
+
   void dtest_equality_inequality() {
     SongTime st1(0, 4);
     SongTime st2(0, 4);
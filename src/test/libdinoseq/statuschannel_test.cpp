@@ -0,0 +1,114 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <pthread.h>
+
+#include "dtest.hpp"
+#include "statuschannel.hpp"
+
+
+using namespace Dino;
+
+
+namespace StatusChannelTest {
+  
+  
+  /** A status with fields that have to be consistent with each other, and
+      a size that isn't a multiple of the word size. */
+  struct Status {
+    int a;
+    int b;
+    long long c;
+    char d;
+  };
+  
+  
+  Status make_status(int n) {
+    Status s;
+    s.a = n;
+    s.b = ~n;
+    s.c = 3LL * n;
+    s.d = char(n);
+    return s;
+  }
+  
+  
+  bool is_consistent(Status const& s) {
+    return s.b == ~s.a && s.c == 3LL * s.a && s.d == char(s.a);
+  }
+  
+  
+  void dtest_read_write() {
+    StatusChannel<Status> sc(make_status(7));
+    Status s;
+    DTEST_TRUE(sc.read(s) && s.a == 7 && is_consistent(s));
+    DTEST_TRUE(sc.get_count() == 0);
+    
+    sc.write(make_status(42));
+    DTEST_TRUE(sc.get_count() == 1);
+    DTEST_TRUE(sc.read(s) && s.a == 42 && is_consistent(s));
+    
+    // reading doesn't consume anything
+    DTEST_TRUE(sc.read(s) && s.a == 42);
+    DTEST_TRUE(sc.get_count() == 1);
+  }
+  
+  
+  struct Writer {
+    StatusChannel<Status>* sc;
+    AtomicInt done;
+  };
+  
+  
+  void* write_thread(void* arg) {
+    Writer* w = static_cast<Writer*>(arg);
+    for (int i = 1; !w->done.get(); ++i)
+      w->sc->write(make_status(i));
+    return 0;
+  }
+  
+  
+  void dtest_concurrent_read() {
+    StatusChannel<Status> sc(make_status(0));
+    Writer w;
+    w.sc = &sc;
+    pthread_t thread;
+    DTEST_TRUE(pthread_create(&thread, 0, &write_thread, &w) == 0);
+    
+    // every successful read must give a complete value, and values must
+    // never go backwards
+    int last = 0;
+    int reads = 0;
+    bool ok = true;
+    for (int i = 0; i < 100000 && ok; ++i) {
+      Status s;
+      if (sc.read(s)) {
+	ok = is_consistent(s) && s.a >= last;
+	last = s.a;
+	++reads;
+      }
+    }
+    w.done.set(1);
+    pthread_join(thread, 0);
+    
+    DTEST_TRUE(ok);
+    DTEST_TRUE(reads > 0);
+  }
+  
+  
+}
@@ -0,0 +1,149 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "dtest.hpp"
+#include "eventbuffer.hpp"
+#include "sequencable.hpp"
+#include "sequencer.hpp"
+#include "transport.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+namespace TransportTest {
+  
+  
+  /** Records the ranges that the sequencer asks for. */
+  class RangeRecorder : public Sequencable {
+  public:
+    RangeRecorder() : Sequencable("Recorder") {}
+    bool sequence(Position& pos, SongTime const& to, EventBuffer&) const {
+      ranges.push_back(make_pair(pos.get_time(), to));
+      update_position(pos, to);
+      return true;
+    }
+    mutable vector<pair<SongTime, SongTime> > ranges;
+  };
+  
+  
+  class NullBuffer : public EventBuffer {
+  public:
+    bool write_event(SongTime const&, size_t, unsigned char const*) {
+      return true;
+    }
+  };
+  
+  
+  /** Return the time of @c frames frames at 60 BPM and 1000 frames per 
+      second. */
+  SongTime ms(int64_t frames) {
+    return SongTime::from_ticks(frames * SongTime(1, 0).to_ticks() / 1000);
+  }
+  
+  
+  void dtest_constructor() {
+    DTEST_NOTHROW(Transport t(48000, 120));
+    Transport t(48000, 120);
+    DTEST_TRUE(!t.is_playing());
+    DTEST_TRUE(t.get_position(1000) == SongTime(0, 0));
+  }
+  
+  
+  void dtest_play_stop() {
+    auto rec = make_shared<RangeRecorder>();
+    Sequencer seq;
+    seq.set_event_buffer(seq.add_sequencable(rec), make_shared<NullBuffer>());
+    Transport t(1000, 60);
+    
+    // nothing runs while stopped
+    t.process(seq, 0, 100);
+    DTEST_TRUE(rec->ranges.empty());
+    
+    // a command for a frame that has passed takes effect at the start of 
+    // the next period
+    DTEST_TRUE(t.post_play(50));
+    t.process(seq, 100, 100);
+    DTEST_TRUE(t.is_playing());
+    DTEST_TRUE(rec->ranges.size() == 1);
+    DTEST_TRUE(rec->ranges[0].first == ms(0));
+    DTEST_TRUE(rec->ranges[0].second == ms(100));
+    
+    // a stop in the middle of a period splits it
+    DTEST_TRUE(t.post_stop(250));
+    t.process(seq, 200, 100);
+    DTEST_TRUE(!t.is_playing());
+    DTEST_TRUE(rec->ranges.size() == 2);
+    DTEST_TRUE(rec->ranges[1].first == ms(100));
+    DTEST_TRUE(rec->ranges[1].second == ms(150));
+    
+    // playing again continues from where it stopped
+    DTEST_TRUE(t.post_play(320));
+    t.process(seq, 300, 100);
+    DTEST_TRUE(rec->ranges.size() == 3);
+    DTEST_TRUE(rec->ranges[2].first == ms(150));
+    DTEST_TRUE(rec->ranges[2].second == ms(230));
+  }
+  
+  
+  void dtest_locate() {
+    auto rec = make_shared<RangeRecorder>();
+    Sequencer seq;
+    seq.set_event_buffer(seq.add_sequencable(rec), make_shared<NullBuffer>());
+    Transport t(1000, 60);
+    
+    DTEST_TRUE(t.post_play());
+    DTEST_TRUE(t.post_locate(SongTime(8, 0), 40));
+    t.process(seq, 0, 100);
+    DTEST_TRUE(rec->ranges.size() == 2);
+    DTEST_TRUE(rec->ranges[0].first == ms(0));
+    DTEST_TRUE(rec->ranges[0].second == ms(40));
+    DTEST_TRUE(rec->ranges[1].first == SongTime(8, 0));
+    DTEST_TRUE(rec->ranges[1].second == SongTime(8, 0) + ms(60));
+    
+    // commands for later periods wait
+    DTEST_TRUE(t.post_locate(SongTime(2, 0), 1000));
+    t.process(seq, 100, 100);
+    DTEST_TRUE(rec->ranges.size() == 3);
+    DTEST_TRUE(rec->ranges[2].first == SongTime(8, 0) + ms(60));
+    DTEST_TRUE(t.get_position(1000) == SongTime(8, 0) + ms(960));
+    
+    // the position doesn't drift with the period size
+    for (uint64_t f = 200; f < 1000; f += 7)
+      t.process(seq, f, f + 7 > 1000 ? 1000 - f : 7);
+    DTEST_TRUE(rec->ranges.back().second == SongTime(8, 0) + ms(960));
+    t.process(seq, 1000, 100);
+    DTEST_TRUE(rec->ranges.back().first == SongTime(2, 0));
+    DTEST_TRUE(rec->ranges.back().second == SongTime(2, 0) + ms(100));
+  }
+  
+  
+  void dtest_full_ring() {
+    Transport t(1000, 60, 2);
+    DTEST_TRUE(t.post_play());
+    DTEST_TRUE(t.post_stop());
+    DTEST_TRUE(!t.post_play());
+  }
+  
+  
+}
@@ -0,0 +1,94 @@
+/*****************************************************************************
+    libdinoseq_test - unit test module for libdinoseq
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef VECTORBUFFER_HPP
+#define VECTORBUFFER_HPP
+
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <stdint.h>
+
+#include "eventbuffer.hpp"
+#include "songtime.hpp"
+
+
+/** An EventBuffer for the tests that stores what is written to it. 
+    Messages of up to three bytes are stored in @c events, with the bytes
+    that weren't written set to 0, and longer ones are dropped. Packets 
+    are translated to MIDI 1.0 messages by EventBuffer::write_packet() 
+    unless @c translate is @c false, in which case they are stored in
+    @c packets. The buffer is full when @c room messages and packets have
+    been written, and @c room can be changed at any time. */
+class VectorBuffer : public Dino::EventBuffer {
+public:
+  
+  /** A stored packet. */
+  struct Packet {
+    Dino::SongTime time;
+    size_t size;
+    uint32_t words[4];
+  };
+  
+  explicit VectorBuffer(size_t r = std::numeric_limits<size_t>::max()) 
+    : room(r), 
+      translate(true) {}
+  
+  bool write_event(Dino::SongTime const& st, size_t bytes, 
+		   unsigned char const* data) {
+    if (room == 0)
+      return false;
+    if (bytes == 0 || bytes > 3)
+      return true;
+    Event e;
+    e.time = st;
+    std::memset(e.data, 0, sizeof(e.data));
+    std::memcpy(e.data, data, bytes);
+    events.push_back(e);
+    --room;
+    return true;
+  }
+  
+  bool write_packet(Dino::SongTime const& st, size_t n, 
+		    uint32_t const* words) {
+    if (translate)
+      return EventBuffer::write_packet(st, n, words);
+    if (room == 0)
+      return false;
+    if (n == 0 || n > 4)
+      return true;
+    Packet p;
+    p.time = st;
+    p.size = n;
+    std::memset(p.words, 0, sizeof(p.words));
+    std::memcpy(p.words, words, n * sizeof(uint32_t));
+    packets.push_back(p);
+    --room;
+    return true;
+  }
+  
+  std::vector<Event> events;
+  std::vector<Packet> packets;
+  size_t room;
+  bool translate;
+  
+};
+
+
+#endif
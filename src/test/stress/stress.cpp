@@ -0,0 +1,426 @@
+/*****************************************************************************
+    libdinoseq - a library for MIDI sequencing
+    Copyright (C) 2009  Lars Luthman <mail@larsluthman.net>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+/* A soak test for the lock-free one-writer/one-reader containers. Each test
+   runs a writer thread that makes random edits and a reader thread that
+   iterates over the container as fast as it can and checks invariants that
+   must hold for every snapshot the reader can see. The unit tests only use
+   the containers from a single thread, so this is the only place where the
+   memory ordering and the deferred deallocation actually get exercised.
+   
+   Build the stress-tsan target to run this under ThreadSanitizer. */
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include "atomicint.hpp"
+#include "curve.hpp"
+#include "eventbuffer.hpp"
+#include "linkedlist.hpp"
+#include "nodequeue.hpp"
+#include "songtime.hpp"
+
+
+using namespace Dino;
+using namespace std;
+
+
+namespace {
+  
+  
+  /** Set when the writer is done. */
+  AtomicInt quit(0);
+  
+  
+  /** Return the value of a monotonic clock in seconds. */
+  double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+  
+  
+  /** A small xorshift generator, so the threads don't share the state of
+      rand(). */
+  class Random {
+  public:
+    Random(uint64_t seed) : m_state(seed ? seed : 1) {}
+    uint32_t operator()(uint32_t n) {
+      m_state ^= m_state << 13;
+      m_state ^= m_state >> 7;
+      m_state ^= m_state << 17;
+      return m_state % n;
+    }
+  private:
+    uint64_t m_state;
+  };
+  
+  
+  /** What the reader thread counts. */
+  struct ReaderStats {
+    uint64_t passes;
+    uint64_t items;
+    uint64_t errors;
+  };
+  
+  
+  /** The common part of every test. It runs @c reader in a new thread and
+      @c writer in this one for @c seconds seconds, and prints the
+      throughput. */
+  template <typename Writer, typename Reader>
+  bool run_test(char const* name, double seconds, Writer& writer, 
+		Reader& reader) {
+    ReaderStats stats = { 0, 0, 0 };
+    struct Arg {
+      Reader* reader;
+      ReaderStats* stats;
+      static void* main(void* p) {
+	Arg* a = static_cast<Arg*>(p);
+	while (!quit.get())
+	  (*a->reader)(*a->stats);
+	// one last pass to see the final state
+	(*a->reader)(*a->stats);
+	return 0;
+      }
+    } arg = { &reader, &stats };
+    
+    quit.set(0);
+    pthread_t thread;
+    if (pthread_create(&thread, 0, &Arg::main, &arg) != 0) {
+      cerr<<name<<": could not start the reader thread"<<endl;
+      return false;
+    }
+    double start = now();
+    double end = start + seconds;
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    while (now() < end) {
+      for (int i = 0; i < 1000; ++i)
+	errors += writer(ops);
+    }
+    quit.set(1);
+    pthread_join(thread, 0);
+    double elapsed = now() - start;
+    
+    errors += stats.errors;
+    cout<<name<<": "<<uint64_t(ops / elapsed)<<" writes/s, "
+	<<uint64_t(stats.passes / elapsed)<<" reader passes/s, "
+	<<uint64_t(stats.items / elapsed)<<" items read/s, "
+	<<errors<<" errors"<<endl;
+    return errors == 0;
+  }
+  
+  
+  /** LinkedList: the writer keeps the list sorted by inserting at the right
+      position and erasing random elements, the reader checks that every 
+      element is intact and that every pass is sorted. */
+  namespace LinkedListStress {
+    
+    struct Item {
+      Item(uint32_t v) : value(v), check(~v) {}
+      uint32_t value;
+      uint32_t check;
+    };
+    
+    size_t const max_size = 1000;
+    
+    struct Writer {
+      Writer() : rng(1) {}
+      uint64_t operator()(uint64_t& ops) {
+	size_t size = list.get_size();
+	if (size < 10 || (size < max_size && rng(2))) {
+	  uint32_t v = rng(1000000);
+	  auto iter = list.begin();
+	  while (iter != list.end() && iter->value < v)
+	    ++iter;
+	  list.insert(iter, Item(v));
+	}
+	else {
+	  auto iter = list.begin();
+	  for (uint32_t i = rng(size); i > 0; --i)
+	    ++iter;
+	  list.erase(iter);
+	}
+	++ops;
+	return 0;
+      }
+      LinkedList<Item> list;
+      Random rng;
+    };
+    
+    struct Reader {
+      Reader(LinkedList<Item>& l) : list(l) {}
+      void operator()(ReaderStats& stats) {
+	uint32_t last = 0;
+	size_t n = 0;
+	for (auto iter = list.reader_begin(); iter != list.reader_end(); 
+	     ++iter) {
+	  if (iter->check != ~iter->value || iter->value < last || 
+	      ++n > 2 * max_size) {
+	    ++stats.errors;
+	    break;
+	  }
+	  last = iter->value;
+	}
+	list.reader_holds_no_iterator();
+	stats.items += n;
+	++stats.passes;
+      }
+      LinkedList<Item>& list;
+    };
+    
+    bool run(double seconds) {
+      Writer w;
+      Reader r(w.list);
+      return run_test("LinkedList", seconds, w, r);
+    }
+    
+  }
+  
+  
+  /** NodeQueue: the writer pushes consecutive numbers, the reader checks 
+      that it pops them in order. */
+  namespace NodeQueueStress {
+    
+    typedef NodeQueue<uint64_t> Queue;
+    
+    struct Writer {
+      Writer() : next(0), popped(0) {}
+      uint64_t operator()(uint64_t& ops) {
+	// don't let the queue grow without bounds if the reader is slow
+	if (next - uint64_t(popped.get()) > 10000) {
+	  sched_yield();
+	  return 0;
+	}
+	queue.push_node(new Queue::Node(next++));
+	++ops;
+	return 0;
+      }
+      Queue queue;
+      uint64_t next;
+      AtomicInt popped;
+    };
+    
+    struct Reader {
+      Reader(Writer& w) : writer(w), expected(0) {}
+      void operator()(ReaderStats& stats) {
+	Queue::Node* n;
+	while ((n = writer.queue.pop_node())) {
+	  if (n->data != expected)
+	    ++stats.errors;
+	  expected = n->data + 1;
+	  delete n;
+	  ++stats.items;
+	  writer.popped.increase();
+	}
+	++stats.passes;
+      }
+      Writer& writer;
+      uint64_t expected;
+    };
+    
+    bool run(double seconds) {
+      Writer w;
+      Reader r(w);
+      return run_test("NodeQueue", seconds, w, r);
+    }
+    
+  }
+  
+  
+  /** Curve (and through it NodeSkipList): the writer adds, moves and 
+      removes random points, the reader sequences the curve over and over
+      and checks that the events are controller events with valid values 
+      in increasing order inside the requested range. */
+  namespace CurveStress {
+    
+    int const beats = 16;
+    size_t const max_points = 500;
+    
+    class CheckBuffer : public EventBuffer {
+    public:
+      CheckBuffer() : errors(0), events(0) {}
+      
+      void begin(SongTime const& f, SongTime const& t) {
+	from = f;
+	to = t;
+	last = f;
+      }
+      
+      bool write_event(SongTime const& st, size_t bytes, 
+		       unsigned char const* data) {
+	++events;
+	if (st < last || st >= to || bytes != 3 || 
+	    (data[0] & 0xF0) != 0xB0 || data[1] > 127 || data[2] > 127)
+	  ++errors;
+	last = st;
+	return true;
+      }
+      
+      SongTime from;
+      SongTime to;
+      SongTime last;
+      uint64_t errors;
+      uint64_t events;
+    };
+    
+    SongTime random_time(Random& rng) {
+      return SongTime::from_ticks(int64_t(rng(beats * 1024)) * 
+				  SongTime(1, 0).to_ticks() / 1024);
+    }
+    
+    struct Writer {
+      Writer() : curve("Stress", SongTime(beats, 0), 1), rng(2), points(0) {}
+      uint64_t operator()(uint64_t& ops) {
+	uint32_t op = rng(3);
+	try {
+	  if (points < 10 || (points < max_points && op == 0)) {
+	    curve.add_point(random_time(rng), rng(128));
+	    ++points;
+	  }
+	  else {
+	    auto iter = curve.begin();
+	    for (uint32_t i = rng(points); i > 0; --i)
+	      ++iter;
+	    if (op == 1) {
+	      curve.remove_point(iter);
+	      --points;
+	    }
+	    else {
+	      // move it somewhere between its neighbours
+	      auto prev = iter;
+	      auto next = iter;
+	      ++next;
+	      SongTime lo = iter == curve.begin() ? SongTime(0, 0) : 
+		(--prev)->m_time;
+	      SongTime hi = next == curve.end() ? SongTime(beats, 0) :
+		next->m_time;
+	      SongTime t = SongTime::from_ticks
+		(lo.to_ticks() + rng(1024) * (hi - lo).to_ticks() / 1024);
+	      curve.move_point(iter, t, rng(128));
+	    }
+	  }
+	}
+	catch (std::exception& e) {
+	  cerr<<"Curve writer: "<<e.what()<<endl;
+	  return 1;
+	}
+	++ops;
+	return 0;
+      }
+      Curve curve;
+      Random rng;
+      size_t points;
+    };
+    
+    struct Reader {
+      Reader(Curve const& c) 
+	: curve(c), pos(c.create_position(SongTime(0, 0))) {}
+      void operator()(ReaderStats& stats) {
+	// sequence the whole curve in periods of an eighth note, then start
+	// over from the beginning
+	SongTime step = SongTime::from_ticks(SongTime(1, 0).to_ticks() / 8);
+	curve.update_position(*pos, SongTime(0, 0));
+	for (SongTime t = SongTime(0, 0); t < SongTime(beats, 0); t += step) {
+	  buf.begin(t, t + step);
+	  curve.sequence(*pos, t + step, buf);
+	}
+	stats.errors = buf.errors;
+	stats.items = buf.events;
+	++stats.passes;
+      }
+      Curve const& curve;
+      unique_ptr<Sequencable::Position> pos;
+      CheckBuffer buf;
+    };
+    
+    bool run(double seconds) {
+      Writer w;
+      for (size_t i = 0; i < 100; ++i) {
+	uint64_t ops;
+	w(ops);
+      }
+      Reader r(w.curve);
+      return run_test("Curve", seconds, w, r);
+    }
+    
+  }
+  
+  
+  void print_usage(char const* argv0) {
+    cerr<<"usage: "<<argv0<<" [OPTIONS] [TEST...]"<<endl
+	<<"Run soak tests for the lock-free containers. The tests are "
+	<<"LinkedList,"<<endl
+	<<"NodeQueue and Curve, all of them are run if none are given."<<endl
+	<<endl
+	<<"  -d, --duration=SECONDS   how long to run each test (default 60)"
+	<<endl
+	<<"  -h, --help               show this message"<<endl;
+  }
+  
+  
+}
+
+
+int main(int argc, char** argv) {
+  
+  double seconds = 60;
+  
+  option long_options[] = {
+    { "duration", required_argument, 0, 'd' },
+    { "help", no_argument, 0, 'h' },
+    { 0, 0, 0, 0 }
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "d:h", long_options, 0)) != -1) {
+    switch (c) {
+    case 'd': seconds = atof(optarg); break;
+    case 'h': print_usage(argv[0]); return 0;
+    default: print_usage(argv[0]); return 1;
+    }
+  }
+  
+  struct {
+    char const* name;
+    bool (*run)(double);
+  } tests[] = {
+    { "LinkedList", &LinkedListStress::run },
+    { "NodeQueue", &NodeQueueStress::run },
+    { "Curve", &CurveStress::run }
+  };
+  
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    bool selected = optind == argc;
+    for (int j = optind; j < argc; ++j)
+      selected = selected || string(argv[j]) == tests[i].name;
+    if (selected)
+      ok = tests[i].run(seconds) && ok;
+  }
+  
+  return ok ? 0 : 1;
+}